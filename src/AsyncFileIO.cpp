@@ -0,0 +1,418 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "AsyncFileIO.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define RSA_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+const int AsyncFileIO::DEFAULT_DEPTH;
+
+// The bytes of a single read or write call, the rest of a larger file takes more calls
+const static size_t MAX_CALL_BYTES = 1 << 30;
+
+/** Open a file to read, @return False if it can't be opened, otherwise its size is stored in size */
+static bool openForRead(const std::string &path, int &fd, size_t &size) {
+    fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) < 0 || !S_ISREG(status.st_mode)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        fd = -1;
+        return false;
+    }
+    size = (size_t) status.st_size;
+    return true;
+}
+
+/** Open a file to write, created or truncated as std::ofstream does, @return -1 if it can't be opened */
+static int openForWrite(const std::string &path) {
+    return open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+}
+
+/**
+ * The portable backend, a thread per operation in flight over the blocking calls.
+ */
+class ThreadFileIO : public AsyncFileIO {
+
+private:
+
+    struct Operation {
+        Kind kind;
+        long long tag;
+        std::string path;
+        std::string data;
+    };
+
+    std::vector<std::thread> workers;
+    // Guards everything below
+    std::mutex lock;
+    std::condition_variable queued;
+    std::condition_variable completed;
+    std::deque<Operation> operations;
+    std::deque<Completion> completions;
+    bool stopping;
+
+    /** @return Whether the whole file is read into data */
+    static bool readFile(const std::string &path, std::string &data) {
+        int fd;
+        size_t size;
+        if (!openForRead(path, fd, size)) {
+            return false;
+        }
+        data.resize(size);
+        size_t done = 0;
+        while (done < size) {
+            ssize_t count = ::read(fd, &data[done], std::min(size - done, MAX_CALL_BYTES));
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                // A file cut short while it is read ends where it was cut
+                data.resize(done);
+                break;
+            }
+            done += (size_t) count;
+        }
+        close(fd);
+        return done == data.size();
+    }
+
+    /** @return Whether the whole data is written */
+    static bool writeFile(const std::string &path, const std::string &data) {
+        int fd = openForWrite(path);
+        if (fd < 0) {
+            return false;
+        }
+        size_t done = 0;
+        while (done < data.length()) {
+            ssize_t count = ::write(fd, data.data() + done, std::min(data.length() - done, MAX_CALL_BYTES));
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                break;
+            }
+            done += (size_t) count;
+        }
+        return close(fd) == 0 && done == data.length();
+    }
+
+    void push(Completion completion) {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->completions.push_back(std::move(completion));
+        }
+        this->completed.notify_one();
+    }
+
+public:
+
+    explicit ThreadFileIO(const int depth) : stopping(false) {
+        for (int i = 0; i < std::max(depth, 1); i++) {
+            this->workers.emplace_back([this]() {
+                std::unique_lock<std::mutex> guard(this->lock);
+                while (true) {
+                    this->queued.wait(guard, [this]() { return this->stopping || !this->operations.empty(); });
+                    if (this->operations.empty()) {
+                        return;
+                    }
+                    Operation operation = std::move(this->operations.front());
+                    this->operations.pop_front();
+                    guard.unlock();
+
+                    Completion completion{operation.kind, operation.tag, false, std::string()};
+                    completion.ok = operation.kind == READ ?
+                                    readFile(operation.path, completion.data) :
+                                    writeFile(operation.path, operation.data);
+                    this->push(std::move(completion));
+                    guard.lock();
+                }
+            });
+        }
+    }
+
+    ~ThreadFileIO() override {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->stopping = true;
+        }
+        this->queued.notify_all();
+        for (std::thread &worker : this->workers) {
+            worker.join();
+        }
+    }
+
+    const char *name() const override {
+        return "threads";
+    }
+
+    void read(const long long tag, const std::string &path) override {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->operations.push_back(Operation{READ, tag, path, std::string()});
+        }
+        this->queued.notify_one();
+    }
+
+    void write(const long long tag, const std::string &path, std::string data) override {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->operations.push_back(Operation{WRITE, tag, path, std::move(data)});
+        }
+        this->queued.notify_one();
+    }
+
+    void post(const long long tag, const bool ok) override {
+        this->push(Completion{POSTED, tag, ok, std::string()});
+    }
+
+    Completion wait() override {
+        std::unique_lock<std::mutex> guard(this->lock);
+        this->completed.wait(guard, [this]() { return !this->completions.empty(); });
+        Completion completion = std::move(this->completions.front());
+        this->completions.pop_front();
+        return completion;
+    }
+};
+
+#ifdef RSA_IO_URING
+
+/**
+ * The io_uring backend over the raw system calls, a submission per read or write call and a completion
+ * per call reaped in wait(), where a short read or write is resubmitted for the rest.
+ */
+class UringFileIO : public AsyncFileIO {
+
+private:
+
+    struct Operation {
+        Kind kind;
+        long long tag;
+        // -1 for the operations completed by a no-op, with ok as their result
+        int fd;
+        bool ok;
+        std::string data;
+        size_t done;
+    };
+
+    int ring;
+
+    // The rings shared with the kernel, mapped once
+    void *sqMap;
+    size_t sqMapSize;
+    void *cqMap;
+    size_t cqMapSize;
+    io_uring_sqe *sqes;
+    size_t sqesSize;
+
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    io_uring_cqe *cqes;
+
+    // Guards the submission ring, the completion ring is only read by wait()
+    std::mutex submitLock;
+
+    static int enter(int ring, unsigned submit, unsigned minComplete, unsigned flags) {
+        return (int) syscall(__NR_io_uring_enter, ring, submit, minComplete, flags, nullptr, 0);
+    }
+
+    /** Submit the next call of operation, a no-op if it has no file */
+    void submit(Operation *operation) {
+        std::lock_guard<std::mutex> guard(this->submitLock);
+        const unsigned tail = *this->sqTail;
+        const unsigned index = tail & *this->sqMask;
+        io_uring_sqe *sqe = &this->sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        if (operation->fd < 0) {
+            sqe->opcode = IORING_OP_NOP;
+        } else {
+            sqe->opcode = operation->kind == READ ? IORING_OP_READ : IORING_OP_WRITE;
+            sqe->fd = operation->fd;
+            sqe->addr = (unsigned long long) (operation->data.data() + operation->done);
+            sqe->len = (unsigned) std::min(operation->data.length() - operation->done, MAX_CALL_BYTES);
+            sqe->off = operation->done;
+        }
+        sqe->user_data = (unsigned long long) operation;
+        this->sqArray[index] = index;
+        __atomic_store_n(this->sqTail, tail + 1, __ATOMIC_RELEASE);
+
+        // Retry while the kernel is short of completion entries, which wait() frees
+        while (enter(this->ring, 1, 0, 0) < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY)) {
+            std::this_thread::yield();
+        }
+    }
+
+    UringFileIO() : ring(-1), sqMap(MAP_FAILED), sqMapSize(0), cqMap(MAP_FAILED), cqMapSize(0),
+                    sqes((io_uring_sqe *) MAP_FAILED), sqesSize(0) {
+    }
+
+public:
+
+    /** @return The backend, or nullptr if the kernel does not take io_uring or its reads and writes */
+    static std::unique_ptr<AsyncFileIO> setup(const int depth) {
+        std::unique_ptr<UringFileIO> io(new UringFileIO());
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        // The completions stay within twice the submissions, which is also what the kernel gives by default
+        io->ring = (int) syscall(__NR_io_uring_setup, (unsigned) std::max(2 * depth, 8), &params);
+        // IORING_OP_READ and IORING_OP_WRITE came in Linux 5.6, just before the fast poll feature
+        if (io->ring < 0 || !(params.features & IORING_FEAT_FAST_POLL)) {
+            return nullptr;
+        }
+
+        io->sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        io->cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMap) {
+            io->sqMapSize = io->cqMapSize = std::max(io->sqMapSize, io->cqMapSize);
+        }
+        io->sqMap = mmap(nullptr, io->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         io->ring, IORING_OFF_SQ_RING);
+        if (io->sqMap == MAP_FAILED) {
+            return nullptr;
+        }
+        io->cqMap = singleMap ? io->sqMap : mmap(nullptr, io->cqMapSize, PROT_READ | PROT_WRITE,
+                                                 MAP_SHARED | MAP_POPULATE, io->ring, IORING_OFF_CQ_RING);
+        io->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        io->sqes = (io_uring_sqe *) mmap(nullptr, io->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                         io->ring, IORING_OFF_SQES);
+        if (io->cqMap == MAP_FAILED || io->sqes == MAP_FAILED) {
+            return nullptr;
+        }
+
+        char *sq = (char *) io->sqMap, *cq = (char *) io->cqMap;
+        io->sqTail = (unsigned *) (sq + params.sq_off.tail);
+        io->sqMask = (unsigned *) (sq + params.sq_off.ring_mask);
+        io->sqArray = (unsigned *) (sq + params.sq_off.array);
+        io->cqHead = (unsigned *) (cq + params.cq_off.head);
+        io->cqTail = (unsigned *) (cq + params.cq_off.tail);
+        io->cqMask = (unsigned *) (cq + params.cq_off.ring_mask);
+        io->cqes = (io_uring_cqe *) (cq + params.cq_off.cqes);
+        return std::unique_ptr<AsyncFileIO>(io.release());
+    }
+
+    ~UringFileIO() override {
+        if (this->sqes != MAP_FAILED) {
+            munmap(this->sqes, this->sqesSize);
+        }
+        if (this->cqMap != MAP_FAILED && this->cqMap != this->sqMap) {
+            munmap(this->cqMap, this->cqMapSize);
+        }
+        if (this->sqMap != MAP_FAILED) {
+            munmap(this->sqMap, this->sqMapSize);
+        }
+        if (this->ring >= 0) {
+            close(this->ring);
+        }
+    }
+
+    const char *name() const override {
+        return "io_uring";
+    }
+
+    void read(const long long tag, const std::string &path) override {
+        Operation *operation = new Operation{READ, tag, -1, false, std::string(), 0};
+        size_t size;
+        if (openForRead(path, operation->fd, size)) {
+            operation->ok = true;
+            operation->data.resize(size);
+            // The empty file has nothing to read
+            if (size == 0) {
+                close(operation->fd);
+                operation->fd = -1;
+            }
+        }
+        this->submit(operation);
+    }
+
+    void write(const long long tag, const std::string &path, std::string data) override {
+        Operation *operation = new Operation{WRITE, tag, openForWrite(path), false, std::move(data), 0};
+        operation->ok = operation->fd >= 0;
+        if (operation->fd >= 0 && operation->data.empty()) {
+            operation->ok = close(operation->fd) == 0;
+            operation->fd = -1;
+        }
+        this->submit(operation);
+    }
+
+    void post(const long long tag, const bool ok) override {
+        this->submit(new Operation{POSTED, tag, -1, ok, std::string(), 0});
+    }
+
+    Completion wait() override {
+        while (true) {
+            const unsigned head = *this->cqHead;
+            if (head == __atomic_load_n(this->cqTail, __ATOMIC_ACQUIRE)) {
+                enter(this->ring, 0, 1, IORING_ENTER_GETEVENTS);
+                continue;
+            }
+            const io_uring_cqe &cqe = this->cqes[head & *this->cqMask];
+            Operation *operation = (Operation *) cqe.user_data;
+            const int result = cqe.res;
+            __atomic_store_n(this->cqHead, head + 1, __ATOMIC_RELEASE);
+
+            if (operation->fd >= 0) {
+                if (result > 0) {
+                    operation->done += (size_t) result;
+                    if (operation->done < operation->data.length()) {
+                        this->submit(operation);
+                        continue;
+                    }
+                } else if (result == 0 && operation->kind == READ) {
+                    // A file cut short while it is read ends where it was cut
+                    operation->data.resize(operation->done);
+                } else {
+                    operation->ok = false;
+                }
+                operation->ok &= close(operation->fd) == 0;
+            }
+
+            Completion completion{operation->kind, operation->tag, operation->ok, std::string()};
+            if (operation->kind == READ) {
+                completion.data = std::move(operation->data);
+            }
+            delete operation;
+            return completion;
+        }
+    }
+};
+
+#endif
+
+std::unique_ptr<AsyncFileIO> AsyncFileIO::create(const int depth, const Backend backend) {
+#ifdef RSA_IO_URING
+    if (backend != THREADS) {
+        std::unique_ptr<AsyncFileIO> io = UringFileIO::setup(depth);
+        if (io) {
+            return io;
+        }
+    }
+#endif
+    return std::unique_ptr<AsyncFileIO>(new ThreadFileIO(depth));
+}
@@ -0,0 +1,73 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#ifndef RSA_ASYNCFILEIO_H
+#define RSA_ASYNCFILEIO_H
+
+#include <memory>
+#include <string>
+
+/**
+ * Whole-file reads and writes kept in flight while the caller does something else, for the bulk
+ * commands over many files.
+ *
+ * The operations may be queued from any thread, and their completions are taken by one thread in wait(),
+ * in the order they complete. The io_uring backend submits the reads and writes to the kernel and reaps
+ * them from its completion ring, where a file is opened and closed on the calling threads; the portable
+ * backend runs the blocking calls on its own threads.
+ */
+class AsyncFileIO {
+
+public:
+
+    enum Backend {
+        // io_uring if the kernel takes it, the threads otherwise
+        AUTO,
+        IO_URING,
+        THREADS
+    };
+
+    enum Kind {
+        READ,
+        WRITE,
+        POSTED
+    };
+
+    struct Completion {
+        Kind kind;
+        long long tag;
+        bool ok;
+        // The content of a read
+        std::string data;
+    };
+
+    // The operations in flight of the bulk commands
+    const static int DEFAULT_DEPTH = 8;
+
+    virtual ~AsyncFileIO() = default;
+
+    /** @return The name of the backend */
+    virtual const char *name() const = 0;
+
+    /** Queue the read of the whole regular file, the completion holds its content and fails for anything else */
+    virtual void read(long long tag, const std::string &path) = 0;
+
+    /** Queue the write of data to the file, which is created or truncated */
+    virtual void write(long long tag, const std::string &path, std::string data) = 0;
+
+    /** Queue a completion without any I/O, to wake up wait() for work done elsewhere */
+    virtual void post(long long tag, bool ok) = 0;
+
+    /** Block until the next completion of the queued operations, there must be one */
+    virtual Completion wait() = 0;
+
+    /**
+     * @param depth The operations expected in flight at once
+     * @return The backend, or the threads if IO_URING is asked but unavailable
+     */
+    static std::unique_ptr<AsyncFileIO> create(int depth, Backend backend = AUTO);
+};
+
+
+#endif //RSA_ASYNCFILEIO_H
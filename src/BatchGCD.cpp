@@ -0,0 +1,72 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "BatchGCD.h"
+
+void BatchGCD::parallelFor(const int count, int threads, const std::function<void(int)> &f) {
+    threads = std::min(threads, count);
+    if (threads <= 1) {
+        for (int i = 0; i < count; i++) {
+            f(i);
+        }
+        return;
+    }
+
+    // The nodes of a level differ in size at the odd ends, so the threads take them one at a time
+    std::atomic<int> next(0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&]() {
+            for (int i = next++; i < count; i = next++) {
+                f(i);
+            }
+        });
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+std::vector<BigInteger> BatchGCD::gcds(const std::vector<BigInteger> &moduli, int threads) {
+    if (threads <= 0) {
+        threads = (int) std::max(1u, std::thread::hardware_concurrency());
+    }
+    const int count = (int) moduli.size();
+    if (count < 2) {
+        return std::vector<BigInteger>(count, BigInteger(1));
+    }
+
+    // The product tree, tree[0] holds the moduli and the last level holds P, an odd node is carried up as it is
+    std::vector<std::vector<BigInteger>> tree{moduli};
+    while (tree.back().size() > 1) {
+        const std::vector<BigInteger> &level = tree.back();
+        std::vector<BigInteger> parents((level.size() + 1) / 2);
+        parallelFor((int) parents.size(), threads, [&](int i) {
+            parents[i] = 2 * i + 1 < (int) level.size() ? level[2 * i] * level[2 * i + 1] : level[2 * i];
+        });
+        tree.push_back(std::move(parents));
+    }
+
+    // The remainder tree, where each node reduces the remainder of its parent by its own square
+    std::vector<BigInteger> remainders = tree.back();
+    for (int depth = (int) tree.size() - 2; depth >= 0; depth--) {
+        const std::vector<BigInteger> &level = tree[depth];
+        std::vector<BigInteger> children(level.size());
+        parallelFor((int) level.size(), threads, [&](int i) {
+            children[i] = remainders[i / 2] % (level[i] * level[i]);
+        });
+        remainders = std::move(children);
+    }
+
+    // gcd((P % n_i^2) / n_i, n_i), where P / n_i % n_i == (P % n_i^2) / n_i
+    std::vector<BigInteger> result(count);
+    parallelFor(count, threads, [&](int i) {
+        result[i] = (remainders[i] / moduli[i]).gcd(moduli[i]);
+    });
+    return result;
+}
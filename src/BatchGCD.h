@@ -0,0 +1,40 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#ifndef RSA_BATCHGCD_H
+#define RSA_BATCHGCD_H
+
+#include <functional>
+#include <vector>
+
+#include "BigInteger.h"
+
+/**
+ * Bernstein's batch GCD: gcd(n_i, prod(n_j) / n_i) of every modulus in a set, in quasi-linear multiplications
+ * instead of the quadratic pairwise GCDs.
+ *
+ * The product tree multiplies the moduli pairwise up to P = prod(n_i), the remainder tree reduces P down to
+ * P % n_i^2 at the leaves, and then gcd((P % n_i^2) / n_i, n_i) is the part of n_i shared with the others.
+ * The nodes of each level of both trees are independent, and they are spread over the threads.
+ */
+class BatchGCD {
+
+private:
+
+    /** Run f(0), ..., f(count - 1) over the threads, where the calls are independent */
+    static void parallelFor(int count, int threads, const std::function<void(int)> &f);
+
+public:
+
+    /**
+     * @param moduli Positive numbers
+     * @param threads The threads for the tree levels, all the cores by default
+     * @return gcd(n_i, prod(n_j) / n_i) for each n_i, 1 for the moduli sharing no factor with the others,
+     *         n_i for a duplicated modulus or one whose every factor is shared
+     */
+    static std::vector<BigInteger> gcds(const std::vector<BigInteger> &moduli, int threads = 0);
+};
+
+
+#endif //RSA_BATCHGCD_H
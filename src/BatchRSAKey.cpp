@@ -0,0 +1,117 @@
+//
+// Created by Yongzao Dan on 2022/11/14.
+//
+
+#include "BatchRSAKey.h"
+
+BatchRSAKey::BatchRSAKey(const RSAPrivateKey &key, int batchSize) : key(key) {
+    const std::vector<BigInteger> &primes = key.getPrimes();
+    BigInteger phiN = BigInteger(1);
+    for (const BigInteger &prime : primes) {
+        phiN = phiN * (prime - 1);
+    }
+
+    BigInteger product = BigInteger(1);
+    for (unsigned int e = 3; (int) this->exponents.size() < batchSize; e += 2) {
+        // Distinct primes are pairwise coprime, and e must be coprime to every r_i - 1
+        bool valid = BigInteger(e).isPrime();
+        for (int i = 0; i < (int) primes.size() && valid; i++) {
+            valid = (primes[i] - 1) % e != 0;
+        }
+        if (!valid) {
+            continue;
+        }
+
+        this->exponents.emplace_back(e);
+        product = product * BigInteger(e);
+        this->rootKeys.emplace_back(product, product.multiplicativeInverse(phiN), primes);
+    }
+}
+
+int BatchRSAKey::getBatchSize() const {
+    return (int) this->exponents.size();
+}
+
+const BigInteger &BatchRSAKey::getN() const {
+    return this->key.getN();
+}
+
+const BigInteger &BatchRSAKey::getExponent(int i) const {
+    return this->exponents[i];
+}
+
+BigInteger BatchRSAKey::encrypt(const BigInteger &x, int i) const {
+    return x.bigPowMod(this->exponents[i], this->key.getN());
+}
+
+int BatchRSAKey::buildTree(const BigInteger *ciphertext, int lo, int hi, std::vector<BatchNode> &nodes) const {
+    BatchNode node;
+    node.lo = lo;
+    node.hi = hi;
+    if (hi - lo == 1) {
+        node.exponent = this->exponents[lo];
+        node.value = ciphertext[lo];
+        node.left = node.right = -1;
+    } else {
+        int mid = (lo + hi) >> 1;
+        node.left = buildTree(ciphertext, lo, mid, nodes);
+        node.right = buildTree(ciphertext, mid, hi, nodes);
+
+        // value = left^E_R * right^E_L, so that value^(1 / (E_L * E_R)) = left^(1 / E_L) * right^(1 / E_R)
+        const BatchNode &left = nodes[node.left];
+        const BatchNode &right = nodes[node.right];
+        const BigInteger &n = this->key.getN();
+        node.exponent = left.exponent * right.exponent;
+        node.value = left.value.bigPowMod(right.exponent, n) * right.value.bigPowMod(left.exponent, n) % n;
+    }
+
+    nodes.push_back(node);
+    return (int) nodes.size() - 1;
+}
+
+void BatchRSAKey::splitTree(
+        const std::vector<BatchNode> &nodes,
+        const int index,
+        const BigInteger &root,
+        BigInteger *plaintext) const {
+
+    const BatchNode &node = nodes[index];
+    if (node.left < 0) {
+        plaintext[node.lo] = root;
+        return;
+    }
+
+    // Split root = M_L * M_R with X == 0 (mod E_L) and X == 1 (mod E_R):
+    //      root^X = left^(X / E_L) * right^((X - 1) / E_R) * M_R,
+    // both quotients are exact, so M_R = root^X / P and M_L = root / M_R = root * P / root^X.
+    const BatchNode &left = nodes[node.left];
+    const BatchNode &right = nodes[node.right];
+    const BigInteger &n = this->key.getN();
+    BigInteger x = left.exponent * left.exponent.multiplicativeInverse(right.exponent);
+    BigInteger rootX = root.bigPowMod(x, n);
+    BigInteger p = left.value.bigPowMod(x / left.exponent, n) *
+                   right.value.bigPowMod((x - 1) / right.exponent, n) % n;
+
+    // Montgomery's trick, invert P * root^X once instead of P and root^X separately
+    BigInteger inverse = (p * rootX % n).multiplicativeInverse(n);
+    BigInteger rightRoot = rootX * rootX % n * inverse % n;
+    BigInteger leftRoot = root * p % n * p % n * inverse % n;
+
+    splitTree(nodes, node.left, leftRoot, plaintext);
+    splitTree(nodes, node.right, rightRoot, plaintext);
+}
+
+bool BatchRSAKey::decrypt(const BigInteger *ciphertext, int count, BigInteger *plaintext) const {
+    if (count <= 0 || count > this->getBatchSize()) {
+        return false;
+    }
+
+    std::vector<BatchNode> nodes;
+    nodes.reserve(2 * count - 1);
+    int root = buildTree(ciphertext, 0, count, nodes);
+
+    // The only full-size exponentiation, root^(1 / (e_1 * ... * e_count))
+    BigInteger m = this->rootKeys[count - 1].privatePowMod(nodes[root].value);
+    splitTree(nodes, root, m, plaintext);
+    return true;
+}
@@ -0,0 +1,74 @@
+//
+// Created by Yongzao Dan on 2022/11/14.
+//
+
+#ifndef RSA_BATCHRSAKEY_H
+#define RSA_BATCHRSAKEY_H
+
+#include <vector>
+
+#include "BigInteger.h"
+#include "RSAPrivateKey.h"
+
+/**
+ * Fiat's batch RSA: one modulus n with several small, pairwise coprime public exponents e_1, ..., e_b.
+ *
+ * A batch of ciphertexts where the i-th one is encrypted with e_i is decrypted with
+ * a single full-size exponentiation and a binary tree of small exponentiations.
+ */
+class BatchRSAKey {
+
+private:
+
+    /** A node of the batch tree, which covers the ciphertexts in [lo, hi) */
+    struct BatchNode {
+        // The product of the exponents in [lo, hi)
+        BigInteger exponent;
+        // prod(c_i^(exponent / e_i)) % n for i in [lo, hi)
+        BigInteger value;
+        int lo, hi;
+        // The indexes of children, -1 for leaves
+        int left, right;
+    };
+
+    RSAPrivateKey key;
+    // The small prime exponents e_1, ..., e_b
+    std::vector<BigInteger> exponents;
+    // rootKeys[i] decrypts the root of a batch with i + 1 ciphertexts, where d = (e_1 * ... * e_(i+1))^-1
+    std::vector<RSAPrivateKey> rootKeys;
+
+    /** Percolate up, @return The index of the node for the ciphertexts in [lo, hi) */
+    int buildTree(const BigInteger *ciphertext, int lo, int hi, std::vector<BatchNode> &nodes) const;
+
+    /** Percolate down, where root = prod(m_i) % n for the plaintexts m_i covered by the node */
+    void splitTree(const std::vector<BatchNode> &nodes, int index, const BigInteger &root, BigInteger *plaintext) const;
+
+public:
+
+    /**
+     * Choose the first batchSize odd primes e such that gcd(e, r_i - 1) == 1 for all primes r_i of key.
+     *
+     * @param key A private key with CRT parameters
+     */
+    BatchRSAKey(const RSAPrivateKey &key, int batchSize);
+
+    int getBatchSize() const;
+
+    const BigInteger &getN() const;
+
+    /** @return The public exponent for the i-th ciphertext in a batch */
+    const BigInteger &getExponent(int i) const;
+
+    /** @return x^e_i % n */
+    BigInteger encrypt(const BigInteger &x, int i) const;
+
+    /**
+     * Let plaintext[i] = ciphertext[i]^(1 / e_i) % n for i in [0, count), where count <= getBatchSize().
+     *
+     * @return False, with plaintext untouched, if count is not in [1, getBatchSize()]
+     */
+    bool decrypt(const BigInteger *ciphertext, int count, BigInteger *plaintext) const;
+};
+
+
+#endif //RSA_BATCHRSAKEY_H
@@ -2,44 +2,25 @@
 // Created by Yongzao Dan on 2022/11/7.
 //
 
+#include <algorithm>
+#include <atomic>
+
 #include "BigInteger.h"
+#include "MontgomeryContext.h"
+#include "RSAPrivateKey.h"
 #include "SmallPrimeSieve.h"
+#include "WordKernels.h"
+#include "WorkerPool.h"
+#include "Tuning.h"
 
 const BigInteger BigInteger::ZERO = BigInteger(0);
 const BigInteger BigInteger::ONE = BigInteger(1);
 const BigInteger BigInteger::E_DEFAULT = BigInteger(65537);
 
-const std::map<unsigned int, char> BigInteger::HEXADECIMAL_MAP = generateHexadecimalMap();
-const std::map<char, unsigned int> BigInteger::HEXADECIMAL_REFLECT = generateHexadecimalReflect();
-
-std::map<unsigned int, char> BigInteger::generateHexadecimalMap() {
-    std::map<unsigned int, char> result;
-    result.clear();
-
-    for (int i = 0; i < 10; i++) {
-        result.insert(std::pair<unsigned int, char>(i, '0' + i));
-    }
-
-    for (int i = 10; i < 16; i++) {
-        result.insert(std::pair<unsigned int, char>(i, 'a' - 10 + i));
-    }
-
-    return result;
-}
-
-std::map<char, unsigned int> BigInteger::generateHexadecimalReflect() {
-    std::map<char, unsigned int> result;
-    result.clear();
-
-    for (int i = 0; i < 10; i++) {
-        result.insert(std::pair<char, unsigned int>('0' + i, i));
-    }
-
-    for (int i = 10; i < 16; i++) {
-        result.insert(std::pair<char, unsigned int>('a' - 10 + i, i));
-    }
+const char BigInteger::HEXADECIMAL_DIGITS[] = "0123456789abcdef";
 
-    return result;
+unsigned int BigInteger::hexadecimalReflect(const char digit) {
+    return digit <= '9' ? digit - '0' : digit - 'a' + 10;
 }
 
 // ========================================
@@ -53,7 +34,9 @@ BigInteger::BigInteger() {
     this->number = new unsigned int[0];
 }
 
-BigInteger::~BigInteger() = default;
+BigInteger::~BigInteger() {
+    delete[] this->number;
+}
 
 BigInteger::BigInteger(const BigInteger &other) {
     this->sign = other.sign;
@@ -64,6 +47,52 @@ BigInteger::BigInteger(const BigInteger &other) {
     std::memcpy(this->number, other.number, this->length * UNSIGNED_INTEGER_BYTES);
 }
 
+BigInteger::BigInteger(BigInteger &&other) noexcept {
+    this->sign = other.sign;
+    this->length = other.length;
+    this->bitLength = other.bitLength;
+    this->number = other.number;
+
+    other.sign = 0;
+    other.length = 0;
+    other.bitLength = 0;
+    other.number = nullptr;
+}
+
+BigInteger &BigInteger::operator=(const BigInteger &other) {
+    if (this == &other) {
+        return *this;
+    }
+
+    auto *z = new unsigned int[other.length];
+    std::memcpy(z, other.number, other.length * UNSIGNED_INTEGER_BYTES);
+    delete[] this->number;
+
+    this->sign = other.sign;
+    this->length = other.length;
+    this->bitLength = other.bitLength;
+    this->number = z;
+    return *this;
+}
+
+BigInteger &BigInteger::operator=(BigInteger &&other) noexcept {
+    if (this == &other) {
+        return *this;
+    }
+
+    delete[] this->number;
+    this->sign = other.sign;
+    this->length = other.length;
+    this->bitLength = other.bitLength;
+    this->number = other.number;
+
+    other.sign = 0;
+    other.length = 0;
+    other.bitLength = 0;
+    other.number = nullptr;
+    return *this;
+}
+
 BigInteger::BigInteger(int value) {
     if (value > 0) {
         this->sign = 1;
@@ -101,7 +130,7 @@ BigInteger::BigInteger(unsigned int value) {
 }
 
 BigInteger::BigInteger(int radix, std::string value) {
-    if (value.length() == 1 && value[0] == '0') {
+    if (value.empty() || (value.length() == 1 && value[0] == '0')) {
         this->sign = 0;
         this->length = 0;
         this->bitLength = 0;
@@ -136,7 +165,7 @@ BigInteger::BigInteger(int radix, std::string value) {
 
         switch (radix) {
             case HEXADECIMAL_RADIX:
-                curNum |= (HEXADECIMAL_REFLECT.find(value[i])->second << j);
+                curNum |= (hexadecimalReflect(value[i]) << j);
                 j += HEXADECIMAL_BITS;
                 break;
             case ASCII_RADIX:
@@ -151,14 +180,33 @@ BigInteger::BigInteger(int radix, std::string value) {
         this->number[index++] = curNum;
     }
 
-    this->bitLength = calcBitLength(this->number, this->length);
+    // Leading zero digits, as in "00", leave zero words on top
+    this->length = trimLeadingZeros(this->number, this->length);
+    this->bitLength = this->length ? calcBitLength(this->number, this->length) : 0;
+    if (this->length == 0) {
+        this->sign = 0;
+    }
+}
+
+BigInteger BigInteger::fromBytes(const char *bytes, const size_t length) {
+    const size_t bytesPerWord = UNSIGNED_INTEGER_BITS / ASCII_BITS;
+    const int words = (int) ((length + bytesPerWord - 1) / bytesPerWord);
+    auto *number = new unsigned int[words]();
+
+    // The last byte is the least significant one of the first word
+    for (size_t i = 0; i < length; i++) {
+        const auto byte = (unsigned int) (unsigned char) bytes[length - 1 - i];
+        number[i / bytesPerWord] |= byte << (i % bytesPerWord * ASCII_BITS);
+    }
+    // Leading zero bytes, as in a binary plaintext, may leave zero words on top
+    return BigInteger(1, number, trimLeadingZeros(number, words));
 }
 
 BigInteger::BigInteger(int sign, unsigned int *number, int length) {
     this->sign = sign;
     this->number = number;
     this->length = length;
-    this->bitLength = calcBitLength(number, length);
+    this->bitLength = length ? calcBitLength(number, length) : 0;
 
     if (this->length == 0 || this->bitLength == 0) {
         this->sign = 0;
@@ -172,6 +220,7 @@ BigInteger BigInteger::randomBigInteger(int bitLength) {
     result.bitLength = bitLength;
 
     result.length = ((bitLength - 1) >> 5) + 1;
+    delete[] result.number;
     result.number = new unsigned int[result.length];
     for (int i = 0; i < result.length; i++) {
         result.number[i] = rd();
@@ -193,6 +242,9 @@ int BigInteger::compareAbsolute(unsigned int x) const {
     if (this->length > 1) {
         return 1;
     }
+    if (this->length == 0) {
+        return x ? -1 : 0;
+    }
     if (this->number[0] == x) {
         return 0;
     } else if (this->number[0] > x) {
@@ -250,40 +302,27 @@ int BigInteger::add(
         bLength = yLength;
     }
 
-    auto *result = new unsigned int[aLength];
+    // Reserve the overflow word in advance
+    auto *result = new unsigned int[aLength + 1];
 
-    // Do addition and reserve the overflow value
-    unsigned long long sum = 0;
-    for (int i = 0; i < bLength; i++) {
-        sum = (a[i] & UNSIGNED_LONG_LONG_MASK) +
-              (b[i] & UNSIGNED_LONG_LONG_MASK) +
-              (sum >> UNSIGNED_INTEGER_BITS);
+    // Add the common limbs by the kernel, then carry through the remained words
+    int limbs = bLength >> 1;
+    unsigned long long sum = WordKernels::active().add(result, a, b, limbs);
+    int i = limbs << 1;
+    for (; i < bLength; i++) {
+        sum = (a[i] & UNSIGNED_LONG_LONG_MASK) + b[i] + sum;
         result[i] = sum & UNSIGNED_INTEGER_MASK;
+        sum >>= UNSIGNED_INTEGER_BITS;
     }
-
-    // Check and carry the overflow value
-    int i = bLength;
-    for (; sum > UNSIGNED_INTEGER_MASK && i < aLength; i++) {
-        sum = (a[i] & UNSIGNED_LONG_LONG_MASK) + 1;
-        result[i] = sum & UNSIGNED_INTEGER_MASK;
-    }
-
-    // Copy the remained value
     for (; i < aLength; i++) {
-        result[i] = a[i];
-    }
-
-    // Extend result if necessary
-    if (sum > UNSIGNED_INTEGER_MASK) {
-        z = new unsigned int[aLength + 1];
-        std::memcpy(z, result, aLength * UNSIGNED_INTEGER_BYTES);
-        (z)[aLength] = 1;
-        return aLength + 1;
+        sum = (a[i] & UNSIGNED_LONG_LONG_MASK) + sum;
+        result[i] = sum & UNSIGNED_INTEGER_MASK;
+        sum >>= UNSIGNED_INTEGER_BITS;
     }
+    result[aLength] = sum;
 
-    z = new unsigned int[aLength];
-    std::memcpy(z, result, aLength * UNSIGNED_INTEGER_BYTES);
-    return aLength;
+    z = result;
+    return aLength + (int) sum;
 }
 
 BigInteger BigInteger::operator+(const BigInteger &other) const {
@@ -322,7 +361,7 @@ void BigInteger::selfAddByTwo() {
     unsigned long long sum = (this->number[0] & UNSIGNED_LONG_LONG_MASK) + x;
     this->number[0] = sum & UNSIGNED_INTEGER_MASK;
     for (int i = 1; i < length; i++) {
-        if (sum <= UNSIGNED_INTEGER_BITS) {
+        if (sum <= UNSIGNED_INTEGER_MASK) {
             break;
         }
         sum = (sum >> UNSIGNED_INTEGER_BITS) + this->number[i];
@@ -334,8 +373,11 @@ void BigInteger::selfAddByTwo() {
         auto *z = new unsigned int[length + 1];
         std::memcpy(z, this->number, length * UNSIGNED_INTEGER_BYTES);
         z[length] = 1;
+        delete[] this->number;
         this->number = z;
+        ++this->length;
     }
+    this->bitLength = calcBitLength(this->number, this->length);
 }
 
 // ========================================
@@ -356,29 +398,25 @@ int BigInteger::subtract(
 
     auto *result = new unsigned int[xLength];
 
-    // Do subtraction and reserve the insufficient value
-    long long difference = 0;
-    for (int i = 0; i < yLength; i++) {
-        difference = (x[i] & LONG_LONG_MASK) -
-                     (y[i] & LONG_LONG_MASK) +
-                     // Add -1's complement if there exists borrow before
-                     (difference >> UNSIGNED_INTEGER_BITS);
-        result[i] = difference & UNSIGNED_INTEGER_MASK;
-    }
-
-    // Check and borrow the insufficient value
-    int i = yLength;
-    for (; difference < 0 && i < xLength; i++) {
-        difference = (x[i] & LONG_LONG_MASK) + (difference >> UNSIGNED_INTEGER_BITS);
+    // Subtract the common limbs by the kernel, then borrow through the remained words
+    int limbs = yLength >> 1;
+    long long difference = -(long long) WordKernels::active().subtract(result, x, y, limbs);
+    int i = limbs << 1;
+    for (; i < yLength; i++) {
+        difference = (x[i] & LONG_LONG_MASK) - y[i] + difference;
         result[i] = difference & UNSIGNED_INTEGER_MASK;
+        // Keep -1 if there is a borrow
+        difference >>= UNSIGNED_INTEGER_BITS;
     }
-
-    // Copy the remained value
     for (; i < xLength; i++) {
-        result[i] = x[i];
+        difference = (x[i] & LONG_LONG_MASK) + difference;
+        result[i] = difference & UNSIGNED_INTEGER_MASK;
+        difference >>= UNSIGNED_INTEGER_BITS;
     }
 
-    return stripLeadingZeros(result, z, xLength);
+    // The leading zeros are kept in the array but excluded from the length
+    z = result;
+    return trimLeadingZeros(result, xLength);
 }
 
 BigInteger BigInteger::operator-(const BigInteger &other) const {
@@ -419,14 +457,17 @@ BigInteger BigInteger::operator-(int x) const {
     BigInteger result = BigInteger{*this};
 
     int index = 1;
-    bool borrow = result.number[0] == 0;
+    bool borrow = result.number[0] < (unsigned int) x;
     result.number[0] -= x;
     while (borrow) {
         borrow = result.number[index] == 0;
-        --result.number[index];
+        --result.number[index++];
     }
 
-    result.length = stripLeadingZeros(result.number, result.number, result.length);
+    unsigned int *z = nullptr;
+    result.length = stripLeadingZeros(result.number, z, result.length);
+    delete[] result.number;
+    result.number = z;
     result.bitLength = calcBitLength(result.number, result.length);
     return result;
 }
@@ -440,6 +481,120 @@ BigInteger BigInteger::operator-(int x) const {
 // Begin of BigInteger multiplication
 // ========================================
 
+int BigInteger::schoolbookLength(const int xLength, const int yLength) {
+    // x is padded with a zero word to whole limbs, and the last row writes a whole carry limb
+    return xLength + (xLength & 1) + yLength + 1;
+}
+
+void BigInteger::schoolbookMultiply(
+        const unsigned int *x,
+        int xLength,
+        const unsigned int *y,
+        int yLength,
+        unsigned int *result) {
+
+    // Multiply by 64-bit limbs, x is padded with a zero word to whole limbs
+    int xLimbs = (xLength + 1) >> 1;
+    const unsigned int *xPadded = x;
+    unsigned int *xCopy = nullptr;
+    if (xLength & 1) {
+        xCopy = new unsigned int[xLength + 1];
+        std::memcpy(xCopy, x, xLength * UNSIGNED_INTEGER_BYTES);
+        xCopy[xLength] = 0;
+        xPadded = xCopy;
+    }
+
+    std::memset(result, 0, schoolbookLength(xLength, yLength) * UNSIGNED_INTEGER_BYTES);
+
+    WordKernels::MultiplyAddKernel multiplyAdd = WordKernels::active().multiplyAdd;
+    for (int i = 0; i < yLength; i += 2) {
+        unsigned long long multiplier = y[i];
+        if (i + 1 < yLength) {
+            multiplier |= (y[i + 1] & UNSIGNED_LONG_LONG_MASK) << UNSIGNED_INTEGER_BITS;
+        }
+
+        // The rows before have never touched the carry limb
+        unsigned long long carry = multiplyAdd(result + i, xPadded, xLimbs, multiplier);
+        result[i + 2 * xLimbs] = carry & UNSIGNED_INTEGER_MASK;
+        result[i + 2 * xLimbs + 1] = carry >> UNSIGNED_INTEGER_BITS;
+    }
+    delete[] xCopy;
+}
+
+/** Let z[0, xLength) = x + y, where xLength >= yLength, @return The carry */
+static unsigned int addWords(unsigned int *z, const unsigned int *x, int xLength, const unsigned int *y, int yLength) {
+    unsigned long long sum = 0;
+    for (int i = 0; i < xLength; i++) {
+        sum = (sum >> UNSIGNED_INTEGER_BITS) + x[i] + (i < yLength ? y[i] : 0);
+        z[i] = sum & UNSIGNED_INTEGER_MASK;
+    }
+    return (unsigned int) (sum >> UNSIGNED_INTEGER_BITS);
+}
+
+/** Let z[0, zLength) += y[0, yLength), where zLength >= yLength and the sum fits in z */
+static void addWordsInPlace(unsigned int *z, int zLength, const unsigned int *y, int yLength) {
+    unsigned long long sum = 0;
+    for (int i = 0; i < zLength && (i < yLength || sum > UNSIGNED_INTEGER_MASK); i++) {
+        sum = (sum >> UNSIGNED_INTEGER_BITS) + z[i] + (i < yLength ? y[i] : 0);
+        z[i] = sum & UNSIGNED_INTEGER_MASK;
+    }
+}
+
+/** Let z[0, zLength) -= y[0, yLength), where zLength >= yLength and z >= y */
+static void subtractWordsInPlace(unsigned int *z, int zLength, const unsigned int *y, int yLength) {
+    long long difference = 0;
+    for (int i = 0; i < zLength && (i < yLength || difference < 0); i++) {
+        difference = (z[i] & LONG_LONG_MASK) - (i < yLength ? y[i] : 0) + difference;
+        z[i] = difference & UNSIGNED_INTEGER_MASK;
+        // Keep -1 if there is a borrow
+        difference >>= UNSIGNED_INTEGER_BITS;
+    }
+}
+
+void BigInteger::karatsubaMultiply(
+        const unsigned int *x,
+        const unsigned int *y,
+        const int n,
+        unsigned int *z,
+        const int threshold,
+        const int parallelWords) {
+
+    if (n < threshold) {
+        std::vector<unsigned int> result(schoolbookLength(n, n));
+        schoolbookMultiply(x, n, y, n, result.data());
+        std::memcpy(z, result.data(), 2 * n * UNSIGNED_INTEGER_BYTES);
+        return;
+    }
+
+    // x = xHigh * B^h + xLow, then x * y = z2 * B^2h + (z1 - z2 - z0) * B^h + z0,
+    // where z0 = xLow * yLow, z2 = xHigh * yHigh and z1 = (xLow + xHigh) * (yLow + yHigh)
+    const int h = n / 2, high = n - h, m = high + 1;
+    std::vector<unsigned int> xSum(m), ySum(m), z1(2 * m);
+    xSum[high] = addWords(xSum.data(), x + h, high, x, h);
+    ySum[high] = addWords(ySum.data(), y + h, high, y, h);
+
+    // z0 and z2 fill the disjoint halves of z
+    auto lowProduct = [=]() { karatsubaMultiply(x, y, h, z, threshold, parallelWords); };
+    auto highProduct = [=]() { karatsubaMultiply(x + h, y + h, high, z + 2 * h, threshold, parallelWords); };
+    if (n >= parallelWords) {
+        WorkerPool &pool = WorkerPool::shared();
+        std::shared_ptr<WorkerPool::Task> low = pool.submit(lowProduct);
+        std::shared_ptr<WorkerPool::Task> highTask = pool.submit(highProduct);
+        karatsubaMultiply(xSum.data(), ySum.data(), m, z1.data(), threshold, parallelWords);
+        pool.wait(highTask);
+        pool.wait(low);
+    } else {
+        lowProduct();
+        highProduct();
+        karatsubaMultiply(xSum.data(), ySum.data(), m, z1.data(), threshold, parallelWords);
+    }
+
+    // z1 - z2 - z0 = xLow * yHigh + xHigh * yLow, which fits in the n + high words of z from h
+    subtractWordsInPlace(z1.data(), 2 * m, z, 2 * h);
+    subtractWordsInPlace(z1.data(), 2 * m, z + 2 * h, 2 * high);
+    addWordsInPlace(z + h, n + high, z1.data(), std::min(2 * m, n + high));
+}
+
 int BigInteger::multiply(
         const unsigned int *x,
         int xLength,
@@ -447,24 +602,40 @@ int BigInteger::multiply(
         int yLength,
         unsigned int *&z) {
 
-    auto *result = new unsigned int[xLength + yLength];
-    std::memset(result, 0, (xLength + yLength) * UNSIGNED_INTEGER_BYTES);
+    // Ensure x is the longer one, it is the inner loop
+    if (xLength < yLength) {
+        std::swap(x, y);
+        std::swap(xLength, yLength);
+    }
 
-    for (int i = 0; i < xLength; i++) {
-        unsigned long long prod = 0;
-        for (int j = 0; j < yLength; j++) {
-            prod = (x[i] & UNSIGNED_LONG_LONG_MASK) *
-                   y[j] +
-                   result[i + j] +
-                   (prod >> UNSIGNED_INTEGER_BITS);
-            result[i + j] = prod & UNSIGNED_INTEGER_MASK;
-        }
-        if (prod > UNSIGNED_INTEGER_MASK) {
-            result[i + yLength] += (prod >> UNSIGNED_INTEGER_BITS);
-        }
+    const Tuning::Profile &profile = Tuning::profile();
+    // Each level of Karatsuba takes at least 4 words to shrink its operands
+    const int threshold = std::max(profile.karatsubaThresholdWords, 4);
+    if (yLength < threshold) {
+        auto *result = new unsigned int[schoolbookLength(xLength, yLength)];
+        schoolbookMultiply(x, xLength, y, yLength, result);
+
+        // The product never exceeds xLength + yLength words
+        z = result;
+        return trimLeadingZeros(result, xLength + yLength);
     }
 
-    return stripLeadingZeros(result, z, xLength + yLength);
+    // Cut x into the blocks of yLength words, the last one is padded with zeros
+    const int resultLength = xLength + yLength;
+    auto *result = new unsigned int[resultLength];
+    std::memset(result, 0, resultLength * UNSIGNED_INTEGER_BYTES);
+    std::vector<unsigned int> block(yLength), product(2 * yLength);
+    for (int offset = 0; offset < xLength; offset += yLength) {
+        const int blockLength = std::min(yLength, xLength - offset);
+        std::memcpy(block.data(), x + offset, blockLength * UNSIGNED_INTEGER_BYTES);
+        std::memset(block.data() + blockLength, 0, (yLength - blockLength) * UNSIGNED_INTEGER_BYTES);
+        karatsubaMultiply(block.data(), y, yLength, product.data(), threshold, profile.parallelMultiplyWords);
+        addWordsInPlace(result + offset, resultLength - offset, product.data(),
+                        std::min(2 * yLength, resultLength - offset));
+    }
+
+    z = result;
+    return trimLeadingZeros(result, resultLength);
 }
 
 BigInteger BigInteger::operator*(const BigInteger &other) const {
@@ -505,13 +676,21 @@ unsigned int BigInteger::modOneWord(
     }
 
     qLength = stripLeadingZeros(quotient, q, xLength);
+    delete[] quotient;
+    return remainder;
+}
+
+unsigned int BigInteger::remainderOneWord(const unsigned int *x, int xLength, unsigned int y) {
+    // The same as modOneWord, but skip materializing the quotient
+    unsigned long long remainder = 0;
+    for (int i = xLength - 1; i >= 0; i--) {
+        remainder = ((remainder << UNSIGNED_INTEGER_BITS) | x[i]) % y;
+    }
     return remainder;
 }
 
 unsigned int BigInteger::operator%(const unsigned int divisor) const {
-    int qLength;
-    unsigned int *quotient = nullptr;
-    return modOneWord(this->number, this->length, divisor, quotient, qLength);
+    return remainderOneWord(this->number, this->length, divisor);
 }
 
 int BigInteger::mod(
@@ -525,14 +704,23 @@ int BigInteger::mod(
     // Implementation of long division algorithm in Knuth's
     // 'The Art of Computer Programming', Vol 2. section 4.3.1
 
-    /* D1. Normalize, ensure that y[0] is not less than 2^31 */
+    /*
+     * D1. Normalize, ensure that y[0] is not less than 2^31.
+     * A zero word is prepended to both when y has an odd length, so that the divisor has whole 64-bit limbs.
+     */
     int shift = countLeadingZeros(y, yLength);
-    unsigned int *remainder = nullptr;
-    int nAddM = leftShiftAndAddLeadingZero(x, remainder, xLength, shift);
-    unsigned int *divisor = nullptr;
-    int n = leftShiftAndAddLeadingZero(y, divisor, yLength, shift);
+    int pad = yLength & 1;
+    auto *remainder = new unsigned int[xLength + pad + 2];
+    shiftLeftWords(x, remainder, xLength, pad, shift);
+    remainder[xLength + pad + 1] = 0;
+    int nAddM = xLength + pad + (shift <= countLeadingZeros(x, xLength) ? 0 : 1);
+    auto *divisor = new unsigned int[yLength + pad + 1];
+    shiftLeftWords(y, divisor, yLength, pad, shift);
+    int n = yLength + pad;
+    int limbs = n >> 1;
 
     /* D2. Initialize iterator j and quotient array */
+    const WordKernels::Kernels &kernels = WordKernels::active();
     int m = nAddM - n;
     auto *quotient = new unsigned int[m + 1];
     unsigned int vFirst = divisor[n - 1];
@@ -560,47 +748,31 @@ int BigInteger::mod(
             }
         }
 
-        /* D4. Multiplication and subtraction */
-        auto *vHat = new unsigned int[n + 1];
-        unsigned long long sum = 0;
-        for (int i = 0; i < n; i++) {
-            sum = qHat * divisor[i] + (sum >> UNSIGNED_INTEGER_BITS);
-            vHat[i] = sum & UNSIGNED_INTEGER_MASK;
-        }
-        vHat[n] = sum >> UNSIGNED_INTEGER_BITS;
-
-        long long difference = 0;
-        for (int i = 0; i <= n; i++) {
-            difference = (remainder[j + i] & LONG_LONG_MASK) -
-                         vHat[i] +
-                         (difference >> UNSIGNED_INTEGER_BITS);
-            remainder[j + i] = difference & UNSIGNED_INTEGER_MASK;
-        }
+        /* D4. Multiplication and subtraction, fused in the kernel */
+        unsigned long long borrow = kernels.multiplySubtract(remainder + j, divisor, limbs, qHat);
+        long long difference = (remainder[j + n] & LONG_LONG_MASK) - (long long) borrow;
+        remainder[j + n] = difference & UNSIGNED_INTEGER_MASK;
 
         /* D5. Test remainder */
         if (difference < 0) {
-            /* D6. Add back */
+            /* D6. Add back, the carry cancels the borrow of the highest word */
             --qHat;
-            sum = 0;
-            for (int i = 0; i <= n; i++) {
-                sum = (remainder[j + i] & LONG_LONG_MASK) +
-                      divisor[i] +
-                      (sum >> UNSIGNED_INTEGER_BITS);
-                remainder[j + i] = sum & UNSIGNED_INTEGER_MASK;
-            }
+            remainder[j + n] += kernels.add(remainder + j, remainder + j, divisor, limbs);
         }
 
         quotient[j] = qHat;
     } /* D7. Loop on j */
 
     /* D8. Denormalize */
-    if (mark == 1) {
-        // Return remainder
-        return rightShift(remainder, z, nAddM, shift);
-    } else {
-        // Return quotient
-        return stripLeadingZeros(quotient, z, m + 1);
-    }
+    int zLength = mark == 1 ?
+                  // Return remainder
+                  rightShift(remainder, z, nAddM, pad * (int) UNSIGNED_INTEGER_BITS + shift) :
+                  // Return quotient
+                  stripLeadingZeros(quotient, z, m + 1);
+    delete[] remainder;
+    delete[] divisor;
+    delete[] quotient;
+    return zLength;
 }
 
 BigInteger BigInteger::operator%(const BigInteger &other) const {
@@ -613,14 +785,7 @@ BigInteger BigInteger::operator%(const BigInteger &other) const {
     }
 
     if (other.length == 1) {
-        int qLength;
-        unsigned int *quotient = nullptr;
-        return BigInteger{modOneWord(
-                this->number,
-                this->length,
-                other.number[0],
-                quotient,
-                qLength)};
+        return BigInteger{remainderOneWord(this->number, this->length, other.number[0])};
     }
 
     unsigned int *z = nullptr;
@@ -678,21 +843,195 @@ BigInteger BigInteger::multiplicativeInverse(const BigInteger &mod) const {
     return result;
 }
 
+BigInteger BigInteger::gcd(const BigInteger &other) const {
+    BigInteger a = *this, b = other;
+    while (!b.isZero()) {
+        BigInteger remainder = a % b;
+        a = std::move(b);
+        b = std::move(remainder);
+    }
+    return a;
+}
+
 // ========================================
 // End of BigInteger inverse
 // ========================================
 
 
+// ========================================
+// Begin of BigInteger bitwise operations
+// ========================================
+
+void BigInteger::trimTo(const int newLength) {
+    this->length = trimLeadingZeros(this->number, newLength);
+    if (this->length == 0) {
+        this->sign = 0;
+        this->bitLength = 0;
+    } else {
+        this->sign = this->sign ? this->sign : 1;
+        this->bitLength = calcBitLength(this->number, this->length);
+    }
+}
+
+BigInteger BigInteger::operator<<(const int n) const {
+    if (n < 0) {
+        return *this >> -n;
+    }
+    if (this->sign == 0) {
+        return BigInteger{};
+    }
+
+    int block = n >> 5;
+    auto *z = new unsigned int[this->length + block + 1];
+    shiftLeftWords(this->number, z, this->length, block, n & (UNSIGNED_INTEGER_BITS - 1));
+
+    BigInteger result;
+    delete[] result.number;
+    result.number = z;
+    result.sign = this->sign;
+    result.trimTo(this->length + block + 1);
+    return result;
+}
+
+BigInteger BigInteger::operator>>(const int n) const {
+    if (n < 0) {
+        return *this << -n;
+    }
+
+    BigInteger result;
+    delete[] result.number;
+    result.length = rightShift(this->number, result.number, this->length, n);
+    result.sign = this->sign;
+    result.trimTo(result.length);
+    return result;
+}
+
+BigInteger &BigInteger::operator<<=(const int n) {
+    if (n < 0) {
+        return *this >>= -n;
+    }
+    if (this->sign == 0) {
+        return *this;
+    }
+
+    int block = n >> 5;
+    int shift = n & (UNSIGNED_INTEGER_BITS - 1);
+    if (block == 0 && shift <= countLeadingZeros(this->number, this->length)) {
+        // The highest word absorbs the shifted bits, shift the words in place
+        if (shift) {
+            for (int i = this->length - 1; i > 0; i--) {
+                this->number[i] = (this->number[i] << shift) |
+                                  (this->number[i - 1] >> (UNSIGNED_INTEGER_BITS - shift));
+            }
+            this->number[0] <<= shift;
+            this->bitLength += shift;
+        }
+        return *this;
+    }
+
+    auto *z = new unsigned int[this->length + block + 1];
+    shiftLeftWords(this->number, z, this->length, block, shift);
+    delete[] this->number;
+    this->number = z;
+    this->trimTo(this->length + block + 1);
+    return *this;
+}
+
+BigInteger &BigInteger::operator>>=(const int n) {
+    if (n < 0) {
+        return *this <<= -n;
+    }
+
+    int block = n >> 5;
+    if (block >= this->length) {
+        this->trimTo(0);
+        return *this;
+    }
+    shiftRightWords(this->number, this->number, this->length, block, n & (UNSIGNED_INTEGER_BITS - 1));
+    this->trimTo(this->length - block);
+    return *this;
+}
+
+BigInteger BigInteger::operator&(const BigInteger &other) const {
+    BigInteger result{*this};
+    result &= other;
+    return result;
+}
+
+BigInteger BigInteger::operator|(const BigInteger &other) const {
+    BigInteger result{this->length >= other.length ? *this : other};
+    result |= this->length >= other.length ? other : *this;
+    return result;
+}
+
+BigInteger &BigInteger::operator&=(const BigInteger &other) {
+    int zLength = std::min(this->length, other.length);
+    for (int i = 0; i < zLength; i++) {
+        this->number[i] &= other.number[i];
+    }
+    this->sign = 1;
+    this->trimTo(zLength);
+    return *this;
+}
+
+BigInteger &BigInteger::operator|=(const BigInteger &other) {
+    if (other.length > this->length) {
+        auto *z = new unsigned int[other.length];
+        std::memcpy(z, this->number, this->length * UNSIGNED_INTEGER_BYTES);
+        std::memset(z + this->length, 0, (other.length - this->length) * UNSIGNED_INTEGER_BYTES);
+        delete[] this->number;
+        this->number = z;
+        this->length = other.length;
+    }
+    for (int i = 0; i < other.length; i++) {
+        this->number[i] |= other.number[i];
+    }
+    this->sign = 1;
+    this->trimTo(this->length);
+    return *this;
+}
+
+bool BigInteger::testBit(const int n) const {
+    int block = n >> 5;
+    return block < this->length && ((this->number[block] >> (n & (UNSIGNED_INTEGER_BITS - 1))) & 1);
+}
+
+int BigInteger::bitCount() const {
+    int result = 0;
+    for (int i = 0; i < this->length; i++) {
+        result += __builtin_popcount(this->number[i]);
+    }
+    return result;
+}
+
+int BigInteger::getLowestSetBit() const {
+    return this->sign == 0 ? -1 : countTailingZeros(this->number, this->length);
+}
+
+// ========================================
+// End of BigInteger bitwise operations
+// ========================================
+
+
 // ========================================
 // Begin of BigInteger prime sieve
 // ========================================
 
-BigInteger BigInteger::generateBigPrime(int bitLength) {
+// Rejection counters of each stage in the primality pipeline
+static std::atomic<unsigned long long> trialDivisionRejected(0);
+static std::atomic<unsigned long long> baseTwoRejected(0);
+static std::atomic<unsigned long long> millerRabinRejected(0);
+static std::atomic<unsigned long long> lucasRejected(0);
+static std::atomic<unsigned long long> primalityAccepted(0);
+
+BigInteger BigInteger::generateBigPrime(int bitLength, PrimalityTest test) {
     BigInteger p = randomBigInteger(bitLength);
     p.number[0] |= 1;
-    SmallPrimeSieve sieve = SmallPrimeSieve{p};
+    SmallPrimeSieve sieve{p};
     while (true) {
-        if (sieve.isCandidate() && p.isPrime()) {
+        if (!sieve.isCandidate()) {
+            ++trialDivisionRejected;
+        } else if (p.isProbablePrimeWithoutSmallFactors(test)) {
             return p;
         }
 
@@ -700,53 +1039,404 @@ BigInteger BigInteger::generateBigPrime(int bitLength) {
         if (p.bitLength > bitLength) {
             p = randomBigInteger(bitLength);
             p.number[0] |= 1;
+            sieve.reset(p);
+            continue;
         }
         sieve.selfAddByTwo();
     }
 }
 
-bool BigInteger::isPrime() const {
-    // Implementation of Miller-Rabin algorithm in Wikipedia
-    // https://en.wikipedia.org/wiki/Miller%E2%80%93Rabin_primality_test
+BigInteger BigInteger::generateSafePrime(int bitLength) {
+    // Search q of bitLength - 1 bits such that q and p = 2q + 1 are both primes,
+    // the sieve rejects the candidates where either q or 2q + 1 has a small prime factor
+    const int qLength = bitLength - 1;
+    BigInteger q = randomBigInteger(qLength);
+    q.number[0] |= 1;
+    SmallPrimeSieve sieve{q, true};
+    while (true) {
+        if (!sieve.isCandidate()) {
+            ++trialDivisionRejected;
+        } else {
+            // Run the cheap base-2 tests on both before the Miller-Rabin rounds on q.
+            // Once q is a prime, 2^(p - 1) == 1 (mod p) proves that p is a prime by Pocklington's criterion.
+            BigInteger p = (q << 1) + ONE;
+            if (q.passesBaseTwoStage() && p.passesBaseTwoStage() && q.passesFinalStage(MILLER_RABIN)) {
+                return p;
+            }
+        }
 
-    // Find s > 0 and d odd > 0 such that this - 1 = 2^s * d
-    const BigInteger thisMinusOne = *this - 1;
-    BigInteger d = BigInteger{thisMinusOne};
-    int s = countTailingZeros(d.number, d.length);
-    d.length = rightShift(d.number, d.number, d.length, s);
-    d.bitLength = calcBitLength(d.number, d.length);
-
-    const static int iteration = 10;
-    for (int i = 0; i < iteration; i++) {
-        // Generate a in range [2, n - 1)
-        BigInteger a = randomBigInteger(this->bitLength);
-        while (a.compareAbsolute(thisMinusOne) >= 0 || a.compareAbsolute(2) < 0) {
-            a = randomBigInteger(this->bitLength);
-        }
-
-        BigInteger y;
-        BigInteger x = a.bigPowMod(d, *this);
-        for (int j = 0; j < s; j++) {
-            y = x * x % *this;
-            // this is composite if y == 1 and x != 1 and x != n - 1
-            if (y.compareAbsolute(1) == 0 &&
-                x.compareAbsolute(1) != 0 &&
-                x.compareAbsolute(thisMinusOne) != 0) {
-                return false;
+        q.selfAddByTwo();
+        if (q.bitLength > qLength) {
+            q = randomBigInteger(qLength);
+            q.number[0] |= 1;
+            sieve.reset(q);
+            continue;
+        }
+        sieve.selfAddByTwo();
+    }
+}
+
+BigInteger BigInteger::generateStrongPrime(int bitLength) {
+    // Implementation of Gordon's algorithm in 'Handbook of Applied Cryptography' 4.53,
+    // p - 1 has the large prime factor r, p + 1 has s, and r - 1 has t
+    const int sLength = bitLength / 2 - 8;
+    const int tLength = bitLength / 2 - 16;
+
+    // The lower bound of p, which is 2^(bitLength - 1)
+    const BigInteger lower = ONE << (bitLength - 1);
+
+    while (true) {
+        BigInteger s = generateBigPrime(sLength);
+        BigInteger t = generateBigPrime(tLength);
+
+        // r = 2it + 1 for the first prime r
+        BigInteger twoT = t << 1;
+        BigInteger r = twoT + ONE;
+        while (!r.isPrime()) {
+            r = r + twoT;
+        }
+
+        // p0 = 2 * (s^(r - 2) % r) * s - 1, so p0 == 1 (mod r) and p0 == -1 (mod s)
+        BigInteger sInverse = s.bigPowMod(r - BigInteger(2), r);
+        BigInteger p0 = (sInverse * s << 1) - 1;
+
+        // p = p0 + 2jrs for the first prime p, starting from a random j with the expected bit length
+        BigInteger twoRS = r * s << 1;
+        BigInteger j = (lower - p0) / twoRS + BigInteger(1 + (rd() & ASCII_MASK));
+        BigInteger p = p0 + j * twoRS;
+        while (p.bitLength == bitLength) {
+            if (p.isPrime()) {
+                return p;
             }
-            x = y;
+            p = p + twoRS;
         }
+    }
+}
 
-        // this is composite if y != 1
-        if (y.compareAbsolute(1) != 0) {
+int BigInteger::millerRabinRounds(int bitLength) {
+    // Minimum rounds from FIPS 186-4 Table C.3 for the prime sizes of 1024, 2048 and 3072-bit moduli,
+    // and 3 rounds from 3747 bits as in OpenSSL for the primes of 8192-bit moduli, where the random
+    // candidates that pass a round are even rarer. Sizes below 512 bits keep the previous fixed 10 rounds.
+    if (bitLength >= 3747) {
+        return 3;
+    }
+    if (bitLength >= 1536) {
+        return 4;
+    }
+    if (bitLength >= 1024) {
+        return 5;
+    }
+    if (bitLength >= 512) {
+        return 7;
+    }
+    return 10;
+}
+
+BigInteger::PrimalityStats BigInteger::getPrimalityStats() {
+    PrimalityStats stats{};
+    stats.trialDivisionRejected = trialDivisionRejected.load();
+    stats.baseTwoRejected = baseTwoRejected.load();
+    stats.millerRabinRejected = millerRabinRejected.load();
+    stats.lucasRejected = lucasRejected.load();
+    stats.accepted = primalityAccepted.load();
+    return stats;
+}
+
+void BigInteger::resetPrimalityStats() {
+    trialDivisionRejected = 0;
+    baseTwoRejected = 0;
+    millerRabinRejected = 0;
+    lucasRejected = 0;
+    primalityAccepted = 0;
+}
+
+bool BigInteger::isPrime(PrimalityTest test) const {
+    // Stage 1. Trial division by the small primes in SmallPrimeSieve
+    int trial = SmallPrimeSieve::trialDivision(*this);
+    if (trial < 0) {
+        ++trialDivisionRejected;
+        return false;
+    }
+    if (trial > 0) {
+        ++primalityAccepted;
+        return true;
+    }
+
+    return isProbablePrimeWithoutSmallFactors(test);
+}
+
+bool BigInteger::isProbablePrimeWithoutSmallFactors(PrimalityTest test) const {
+    return passesBaseTwoStage() && passesFinalStage(test);
+}
+
+int BigInteger::splitThisMinusOne(BigInteger &d) const {
+    // Find s > 0 and d odd > 0 such that this - 1 = 2^s * d
+    d = *this - 1;
+    int s = d.getLowestSetBit();
+    d >>= s;
+    return s;
+}
+
+bool BigInteger::passesBaseTwoStage() const {
+    // Stage 2. Strong probable prime test to base 2, which rejects almost all composites
+    BigInteger d;
+    int s = splitThisMinusOne(d);
+    MontgomeryContext context = MontgomeryContext(*this);
+    MontgomeryContext::Residue x;
+    powerOfTwoMod(context, d, x);
+    if (!isStrongProbablePrime(context, x, s)) {
+        ++baseTwoRejected;
+        return false;
+    }
+    return true;
+}
+
+bool BigInteger::passesFinalStage(PrimalityTest test) const {
+    // Stage 3 of Baillie-PSW. Strong Lucas probable prime test
+    if (test == BAILLIE_PSW) {
+        if (!isStrongLucasProbablePrime()) {
+            ++lucasRejected;
             return false;
         }
+        ++primalityAccepted;
+        return true;
     }
 
+    // Stage 3. Miller-Rabin with random bases, the round count is scaled by the bit length
+    // https://en.wikipedia.org/wiki/Miller%E2%80%93Rabin_primality_test
+    BigInteger d;
+    int s = splitThisMinusOne(d);
+    const BigInteger range = *this - BigInteger(3);
+    const int rounds = millerRabinRounds(this->bitLength);
+    MontgomeryContext context = MontgomeryContext(*this);
+    for (int i = 0; i < rounds; i++) {
+        // Generate a in range [2, n - 2], the extra 64 random bits make the bias negligible
+        BigInteger a = randomBigInteger(this->bitLength + 64) % range + BigInteger(2);
+        MontgomeryContext::Residue x = context.toResidue(a);
+        context.powMod(x, d, x);
+        if (!isStrongProbablePrime(context, x, s)) {
+            ++millerRabinRejected;
+            return false;
+        }
+    }
+
+    ++primalityAccepted;
     return true;
 }
 
+bool BigInteger::isStrongProbablePrime(const MontgomeryContext &context, MontgomeryContext::Residue &x, int s) {
+    // n is probably a prime if x == 1, or x^(2^j) == n - 1 for some j in [0, s)
+    const MontgomeryContext::Residue &one = context.one();
+    MontgomeryContext::Residue minusOne;
+    context.subMod(MontgomeryContext::Residue(one.size()), one, minusOne);
+    if (x == one || x == minusOne) {
+        return true;
+    }
+    for (int j = 1; j < s; j++) {
+        context.sqrMod(x, x);
+        if (x == minusOne) {
+            return true;
+        }
+        // n is composite if x == 1 without passing through n - 1
+        if (x == one) {
+            return false;
+        }
+    }
+    return false;
+}
+
+int BigInteger::jacobiSymbol(int a) const {
+    // Implementation of the binary Jacobi symbol algorithm in Cohen's
+    // 'A Course in Computational Algebraic Number Theory', algorithm 1.4.10
+
+    int result = 1;
+    unsigned int nMod8 = this->number[0] & 7;
+
+    // (-1/n) == -1 iff n == 3 (mod 4)
+    if (a < 0) {
+        a = -a;
+        if ((nMod8 & 3) == 3) {
+            result = -result;
+        }
+    }
+    if (a == 0) {
+        return this->compareAbsolute(1) == 0 ? 1 : 0;
+    }
+
+    // (2/n) == -1 iff n == 3, 5 (mod 8)
+    auto x = (unsigned int) a;
+    while (!(x & 1)) {
+        x >>= 1;
+        if (nMod8 == 3 || nMod8 == 5) {
+            result = -result;
+        }
+    }
+
+    // Quadratic reciprocity, then continue with single words
+    unsigned int y = x;
+    if ((y & 3) == 3 && (nMod8 & 3) == 3) {
+        result = -result;
+    }
+    x = *this % y;
+    while (x) {
+        while (!(x & 1)) {
+            x >>= 1;
+            if ((y & 7) == 3 || (y & 7) == 5) {
+                result = -result;
+            }
+        }
+        std::swap(x, y);
+        if ((x & 3) == 3 && (y & 3) == 3) {
+            result = -result;
+        }
+        x %= y;
+    }
+
+    return y == 1 ? result : 0;
+}
+
+void BigInteger::lucasSequence(
+        const MontgomeryContext &context,
+        const BigInteger &k,
+        const MontgomeryContext::Residue &D,
+        const MontgomeryContext::Residue &Q,
+        MontgomeryContext::Residue &U,
+        MontgomeryContext::Residue &V,
+        MontgomeryContext::Residue &Qk) {
+
+    // Binary method over the bits of k with P = 1:
+    //      U(2k) = U(k) * V(k),            V(2k) = V(k)^2 - 2Q^k,
+    //      U(2k + 1) = (U(2k) + V(2k)) / 2, V(2k + 1) = (D * U(2k) + V(2k)) / 2.
+    U = context.one();
+    V = context.one();
+    Qk = Q;
+
+    MontgomeryContext::Residue U2k, doubleQk;
+    for (int i = k.bitLength - 2; i >= 0; i--) {
+        context.mulMod(U, V, U);
+        context.addMod(Qk, Qk, doubleQk);
+        context.sqrMod(V, V);
+        context.subMod(V, doubleQk, V);
+        context.sqrMod(Qk, Qk);
+
+        if (k.testBit(i)) {
+            context.mulMod(D, U, U2k);
+            context.addMod(U, V, U);
+            context.halveMod(U, U);
+            context.addMod(U2k, V, V);
+            context.halveMod(V, V);
+            context.mulMod(Qk, Q, Qk);
+        }
+    }
+}
+
+bool BigInteger::isStrongLucasProbablePrime() const {
+    // Implementation of the strong Lucas probable prime test in FIPS 186-4 Appendix C.3.3,
+    // with the parameters chosen by Selfridge's method A
+    const BigInteger &n = *this;
+
+    // Find the first D in 5, -7, 9, -11, ... such that (D/n) == -1, and a perfect square n never has one
+    const static int perfectSquareCheck = 10;
+    int D = 5;
+    for (int i = 0;; i++) {
+        int jacobi = this->jacobiSymbol(D);
+        if (jacobi == -1) {
+            break;
+        }
+        if (jacobi == 0 && this->compareAbsolute((unsigned int) std::abs(D)) != 0) {
+            return false;
+        }
+        if (i == perfectSquareCheck && this->isPerfectSquare()) {
+            return false;
+        }
+        D = D > 0 ? -(D + 2) : -(D - 2);
+    }
+    int Q = (1 - D) / 4;
+    MontgomeryContext context = MontgomeryContext(n);
+    MontgomeryContext::Residue modD = context.toResidue(BigInteger(std::abs(D)));
+    MontgomeryContext::Residue modQ = context.toResidue(BigInteger(std::abs(Q)));
+    MontgomeryContext::Residue zero = MontgomeryContext::Residue(modD.size());
+    if (D < 0) {
+        context.subMod(zero, modD, modD);
+    }
+    if (Q < 0) {
+        context.subMod(zero, modQ, modQ);
+    }
+
+    // Find s > 0 and d odd > 0 such that this + 1 = 2^s * d
+    BigInteger d = n + ONE;
+    int s = d.getLowestSetBit();
+    d >>= s;
+
+    MontgomeryContext::Residue U, V, Qk, doubleQk;
+    lucasSequence(context, d, modD, modQ, U, V, Qk);
+
+    // this is a strong Lucas probable prime if U(d) == 0, or V(d * 2^r) == 0 for some r in [0, s)
+    if (U == zero || V == zero) {
+        return true;
+    }
+    for (int r = 1; r < s; r++) {
+        context.addMod(Qk, Qk, doubleQk);
+        context.sqrMod(V, V);
+        context.subMod(V, doubleQk, V);
+        if (V == zero) {
+            return true;
+        }
+        context.sqrMod(Qk, Qk);
+    }
+    return false;
+}
+
+bool BigInteger::isPerfectSquare() const {
+    // Newton's iteration for floor(sqrt(this)), starting from 2^ceil(bitLength / 2) >= sqrt(this)
+    BigInteger x = ONE << ((this->bitLength + 1) / 2);
+    while (true) {
+        BigInteger y = (x + *this / x) >> 1;
+        if (y.compareAbsolute(x) >= 0) {
+            break;
+        }
+        x = y;
+    }
+    return (x * x).compareAbsolute(*this) == 0;
+}
+
+void BigInteger::powerOfTwoMod(
+        const MontgomeryContext &context,
+        const BigInteger &pow,
+        MontgomeryContext::Residue &result) {
+
+    // Left-to-right exponentiation over windows of the exponent,
+    // where multiplying by 2^digit is a chain of doublings instead of a multiplication
+    const static int window = 5;
+
+    result = context.one();
+    int i = pow.bitLength;
+    while (i > 0) {
+        int width = std::min(window, i);
+        i -= width;
+
+        int block = i >> 5;
+        int offset = i & (UNSIGNED_INTEGER_BITS - 1);
+        unsigned int digit = pow.number[block] >> offset;
+        if (offset + width > (int) UNSIGNED_INTEGER_BITS) {
+            digit |= pow.number[block + 1] << (UNSIGNED_INTEGER_BITS - offset);
+        }
+        digit &= (1u << width) - 1;
+
+        for (int j = 0; j < width; j++) {
+            context.sqrMod(result, result);
+        }
+        for (unsigned int j = 0; j < digit; j++) {
+            context.addMod(result, result, result);
+        }
+    }
+}
+
 BigInteger BigInteger::bigPowMod(const BigInteger &pow, const BigInteger &mod) const {
+    if (this->sign >= 0 && mod.sign > 0 && (mod.number[0] & 1) && mod.compareAbsolute(1) > 0) {
+        return MontgomeryContext(mod).powMod(*this, pow);
+    }
+
     BigInteger base = BigInteger{*this};
     BigInteger result = BigInteger{1};
 
@@ -775,6 +1465,9 @@ BigInteger BigInteger::bigPowMod(const BigInteger &pow, const BigInteger &mod) c
 
 std::string BigInteger::toString(const int radix) const {
     std::string result;
+    if (this->length == 0 && radix == HEXADECIMAL_RADIX) {
+        return "0";
+    }
 
     int charPerBlock;
     switch (radix) {
@@ -793,7 +1486,7 @@ std::string BigInteger::toString(const int radix) const {
             char tailChar;
             switch (radix) {
                 case HEXADECIMAL_RADIX:
-                    tailChar = HEXADECIMAL_MAP.find(tail & HEXADECIMAL_MASK)->second;
+                    tailChar = HEXADECIMAL_DIGITS[tail & HEXADECIMAL_MASK];
                     tail >>= HEXADECIMAL_BITS;
                     break;
                 case ASCII_RADIX:
@@ -811,7 +1504,7 @@ std::string BigInteger::toString(const int radix) const {
     return result;
 }
 
-void BigInteger::write(std::ofstream &out) const {
+void BigInteger::write(std::ostream &out) const {
     out << this->toString(HEXADECIMAL_RADIX) << std::endl;
 }
 
@@ -830,16 +1523,34 @@ int BigInteger::encryptPlaintext(
         const BigInteger &e,
         const BigInteger &n) {
 
-    int charPerBigInteger = (int) ((n.bitLength - 1) / ASCII_BITS);
-    int ciphertextLength = (int) ((plaintext.length() - 1) / charPerBigInteger + 1);
+    return encryptPlaintext(plaintext, ciphertext, e, MontgomeryContext(n));
+}
+
+int BigInteger::encryptPlaintext(
+        const std::string &plaintext,
+        BigInteger *&ciphertext,
+        const BigInteger &e,
+        const MontgomeryContext &context) {
+
+    return encryptPlaintext(plaintext.data(), plaintext.length(), ciphertext, e, context);
+}
+
+int BigInteger::encryptPlaintext(
+        const char *plaintext,
+        const size_t length,
+        BigInteger *&ciphertext,
+        const BigInteger &e,
+        const MontgomeryContext &context) {
+
+    size_t charPerBigInteger = (size_t) ((context.getModulus().bitLength - 1) / ASCII_BITS);
+    int ciphertextLength = (int) ((length - 1) / charPerBigInteger + 1);
     ciphertext = new BigInteger[ciphertextLength];
 
-    // Split and encrypt
+    // Split and encrypt, each block packed straight from the plaintext
     for (int i = 0; i < ciphertextLength; i++) {
-        int plainHead = i * charPerBigInteger;
-        int plainLength = std::min(charPerBigInteger, (int) (plaintext.length() - plainHead));
-        BigInteger plain = BigInteger(ASCII_RADIX, plaintext.substr(plainHead, plainLength));
-        ciphertext[i] = plain.bigPowMod(e, n);
+        size_t plainHead = (size_t) i * charPerBigInteger;
+        BigInteger plain = fromBytes(plaintext + plainHead, std::min(charPerBigInteger, length - plainHead));
+        ciphertext[i] = context.powMod(plain, e);
     }
 
     return ciphertextLength;
@@ -852,32 +1563,73 @@ std::string BigInteger::decryptCiphertext(
         const BigInteger &d,
         const BigInteger &n) {
 
+    return decryptCiphertext(plaintextLength, ciphertext, ciphertextLength, RSAPrivateKey{n, d});
+}
+
+std::string BigInteger::decryptCiphertext(
+        const int plaintextLength,
+        const BigInteger *ciphertext,
+        const int ciphertextLength,
+        const RSAPrivateKey &key) {
+
+    std::vector<BigInteger> plain(ciphertextLength);
+    for (int i = 0; i < ciphertextLength; i++) {
+        plain[i] = key.blindedPowMod(ciphertext[i]);
+    }
+    return joinPlaintext(plaintextLength, plain.data(), ciphertextLength, key.getN());
+}
+
+std::string BigInteger::joinPlaintext(
+        const int plaintextLength,
+        const BigInteger *plain,
+        const int plainLength,
+        const BigInteger &n) {
+
     std::string plaintext;
 
-    // Decrypt and join
+    // Join the blocks, each one holds charPerBigInteger chars but the last
     int remainChar = plaintextLength;
     int charPerBigInteger = (int) ((n.bitLength - 1) / ASCII_BITS);
-    for (int i = 0; i < ciphertextLength; i++) {
-        std::string plain = ciphertext[i].bigPowMod(d, n).toString(ASCII_RADIX);
+    for (int i = 0; i < plainLength; i++) {
+        std::string block = plain[i].toString(ASCII_RADIX);
+        // A block of leading zero bytes, or of nothing but them, has fewer chars than it holds
+        if ((int) block.length() < charPerBigInteger) {
+            block.insert(0, charPerBigInteger - block.length(), '\0');
+        }
         if (remainChar >= charPerBigInteger) {
-            plain = plain.substr(plain.length() - charPerBigInteger, charPerBigInteger);
+            block = block.substr(block.length() - charPerBigInteger, charPerBigInteger);
             remainChar -= charPerBigInteger;
         } else {
-            plain = plain.substr(plain.length() - remainChar, remainChar);
+            block = block.substr(block.length() - remainChar, remainChar);
             remainChar = 0;
         }
-        plaintext += plain;
+        plaintext += block;
     }
 
     return plaintext;
 }
 
 BigInteger BigInteger::signSignature(const unsigned int hashcode, const BigInteger &d, const BigInteger &n) {
-    return BigInteger(hashcode).bigPowMod(d, n);
+    return signSignature(hashcode, RSAPrivateKey{n, d});
+}
+
+BigInteger BigInteger::signSignature(const unsigned int hashcode, const RSAPrivateKey &key) {
+    return key.blindedPowMod(BigInteger(hashcode));
 }
 
 unsigned int BigInteger::decryptSignature(const BigInteger &signature, const BigInteger &e, const BigInteger &n) {
-    return signature.bigPowMod(e, n).number[0];
+    BigInteger hashcode = signature.bigPowMod(e, n);
+    return hashcode.length == 0 ? 0 : hashcode.number[0];
+}
+
+unsigned int BigInteger::decryptSignature(
+        const BigInteger &signature,
+        const BigInteger &e,
+        const MontgomeryContext &context) {
+
+    // 0 for a signature of 0 or a multiple of n, which has no words
+    BigInteger hashcode = context.powMod(signature, e);
+    return hashcode.length == 0 ? 0 : hashcode.number[0];
 }
 
 // ========================================
@@ -5,22 +5,57 @@
 #ifndef RSA_BIGINTEGER_H
 #define RSA_BIGINTEGER_H
 
-#include <map>
+#include <string>
+#include <vector>
 
 #include "utils.h"
 
+class RSAPrivateKey;
+class MontgomeryContext;
+
 class BigInteger {
 
+    // Works on the words of BigInteger directly
+    friend class MontgomeryContext;
+    friend class MultiBufferPowMod;
+
+    template<int Bits>
+    friend class FixedBigInteger;
+
+public:
+
+    /** The probable prime test used by isPrime() and generateBigPrime() */
+    enum PrimalityTest {
+        // Strong base-2 test, then millerRabinRounds(bitLength) rounds with random bases
+        MILLER_RABIN,
+        // Strong base-2 test, then a strong Lucas probable prime test (Baillie-PSW)
+        BAILLIE_PSW
+    };
+
+    /** Rejection counters of each stage in the primality pipeline, see isPrime() */
+    struct PrimalityStats {
+        // Rejected by trial division or the residues of SmallPrimeSieve
+        unsigned long long trialDivisionRejected;
+        // Rejected by the strong probable prime test to base 2
+        unsigned long long baseTwoRejected;
+        // Rejected by the Miller-Rabin rounds with random bases
+        unsigned long long millerRabinRejected;
+        // Rejected by the strong Lucas test of Baillie-PSW
+        unsigned long long lucasRejected;
+        // Passed all the stages
+        unsigned long long accepted;
+    };
+
 private:
 
     static const BigInteger ZERO;
     static const BigInteger ONE;
 
-    static const std::map<unsigned int, char> HEXADECIMAL_MAP;
-    static const std::map<char, unsigned int> HEXADECIMAL_REFLECT;
+    // The lowercase hexadecimal digits, indexed by value
+    static const char HEXADECIMAL_DIGITS[];
 
-    static std::map<unsigned int, char> generateHexadecimalMap();
-    static std::map<char, unsigned int> generateHexadecimalReflect();
+    /** @return The value of a lowercase hexadecimal digit */
+    static unsigned int hexadecimalReflect(char digit);
 
     // The sign of this
     // this is positive if sign == 1,
@@ -63,7 +98,8 @@ private:
             unsigned int *&z);
 
     /**
-     * The inner multiplication implementation of BigInteger.
+     * The inner multiplication implementation of BigInteger, over Karatsuba when the shorter operand
+     * has at least Tuning::Profile::karatsubaThresholdWords words.
      *
      * @return The length of z, z = x * y
      */
@@ -74,6 +110,33 @@ private:
             int yLength,
             unsigned int *&z);
 
+    /** @return The words of the result of schoolbookMultiply() */
+    static int schoolbookLength(int xLength, int yLength);
+
+    /**
+     * Let result[0, schoolbookLength(xLength, yLength)) = x * y by the rows of the word kernels.
+     *
+     * Notice: Always ensure that xLength >= yLength.
+     */
+    static void schoolbookMultiply(
+            const unsigned int *x,
+            int xLength,
+            const unsigned int *y,
+            int yLength,
+            unsigned int *result);
+
+    /**
+     * Let z[0, 2n) = x[0, n) * y[0, n) by Karatsuba, down to schoolbookMultiply() below threshold words.
+     * The levels of at least parallelWords words run their three sub-products on WorkerPool::shared().
+     */
+    static void karatsubaMultiply(
+            const unsigned int *x,
+            const unsigned int *y,
+            int n,
+            unsigned int *z,
+            int threshold,
+            int parallelWords);
+
     /**
      * The inner mod implementation of BigInteger.
      *
@@ -101,12 +164,74 @@ private:
             int mark,
             unsigned int *&z);
 
+    /** @return x % y, without materializing the quotient */
+    static unsigned int remainderOneWord(const unsigned int *x, int xLength, unsigned int y);
+
     static void extendGCD(const BigInteger &a, const BigInteger &b, BigInteger &x, BigInteger &y);
 
+    /** result = the residue of 2^pow, the multiplications by the base are replaced by doublings */
+    static void powerOfTwoMod(const MontgomeryContext &context, const BigInteger &pow, std::vector<unsigned int> &result);
+
+    /**
+     * The strong probable prime test on the modulus n of context, where n - 1 = 2^s * d, d is odd.
+     *
+     * @param x The residue of a^d % n for some base a, squared in place
+     * @return True iff n is a strong probable prime to the base a
+     */
+    static bool isStrongProbablePrime(const MontgomeryContext &context, std::vector<unsigned int> &x, int s);
+
+    /** Stage 2 and 3 of isPrime(), this must be odd and have no small prime factors. */
+    bool isProbablePrimeWithoutSmallFactors(PrimalityTest test) const;
+
+    /** @return s such that this - 1 = 2^s * d, where d is odd */
+    int splitThisMinusOne(BigInteger &d) const;
+
+    /** @return True iff this passes stage 2 of isPrime(), the strong test to base 2 */
+    bool passesBaseTwoStage() const;
+
+    /** @return True iff this passes stage 3 of isPrime() with the given test */
+    bool passesFinalStage(PrimalityTest test) const;
+
+    /**
+     * Compute the Lucas sequences with P = 1 modulo the modulus of context, all in residues.
+     *
+     * @param D P^2 - 4Q
+     * @return U = U(k), V = V(k) and Qk = Q^k
+     */
+    static void lucasSequence(
+            const MontgomeryContext &context,
+            const BigInteger &k,
+            const std::vector<unsigned int> &D,
+            const std::vector<unsigned int> &Q,
+            std::vector<unsigned int> &U,
+            std::vector<unsigned int> &V,
+            std::vector<unsigned int> &Qk);
+
+    /** @return True iff this is a strong Lucas probable prime with Selfridge's parameters */
+    bool isStrongLucasProbablePrime() const;
+
+    /** @return True iff this == x * x for some integer x */
+    bool isPerfectSquare() const;
+
+    /** Let length be the given length without leading zero words, and update bitLength and sign */
+    void trimTo(int newLength);
+
 public:
 
     static const BigInteger E_DEFAULT;
 
+    /**
+     * The default least words of the shorter operand to multiply by Karatsuba instead of the schoolbook rows,
+     * Tuning::Profile::karatsubaThresholdWords takes the tuned one.
+     */
+    const static int KARATSUBA_THRESHOLD_WORDS = 192;
+
+    /**
+     * The default least words of a Karatsuba level to fork its sub-products onto the worker threads,
+     * where the product of a half is some milliseconds. Tuning::Profile::parallelMultiplyWords takes another one.
+     */
+    const static int PARALLEL_MULTIPLY_WORDS = 2048;
+
     /** Default constructor, default is 0 */
     BigInteger();
 
@@ -115,6 +240,13 @@ public:
     /** Copy constructor */
     BigInteger(const BigInteger &other);
 
+    /** Move constructor */
+    BigInteger(BigInteger &&other) noexcept;
+
+    BigInteger &operator=(const BigInteger &other);
+
+    BigInteger &operator=(BigInteger &&other) noexcept;
+
     /** Constructor for custom BigInteger */
     BigInteger(int sign, unsigned int* number, int length);
 
@@ -127,6 +259,12 @@ public:
     /** Construct this from the given string */
     explicit BigInteger(int radix, std::string value);
 
+    /**
+     * The value of length bytes in ASCII_RADIX, the first one the most significant, read in place rather
+     * than from a string. Each byte counts as unsigned.
+     */
+    static BigInteger fromBytes(const char *bytes, size_t length);
+
     /**
      * Constructor for generating a random BigInteger.
      *
@@ -203,16 +341,88 @@ public:
      */
     BigInteger operator/(const BigInteger &other) const;
 
+    /**
+     * Shift the absolute value by whole words and the remaining bits, the sign is kept.
+     *
+     * @return BigInteger(this * 2^n), or this >> -n when n < 0
+     */
+    BigInteger operator<<(int n) const;
+
+    /**
+     * Shift the absolute value by whole words and the remaining bits, the sign is kept.
+     *
+     * @return BigInteger(|this| / 2^n) with the sign of this, or this << -n when n < 0
+     */
+    BigInteger operator>>(int n) const;
+
+    /** In-place this << n, the words are reused unless this grows by a word */
+    BigInteger &operator<<=(int n);
+
+    /** In-place this >> n, the words are always reused */
+    BigInteger &operator>>=(int n);
+
+    /** @return BigInteger(|this| & |other|) which is always non-negative */
+    BigInteger operator&(const BigInteger &other) const;
+
+    /** @return BigInteger(|this| | |other|) which is always non-negative */
+    BigInteger operator|(const BigInteger &other) const;
+
+    /** In-place |this| & |other|, the words are always reused */
+    BigInteger &operator&=(const BigInteger &other);
+
+    /** In-place |this| | |other|, the words are reused unless other is longer */
+    BigInteger &operator|=(const BigInteger &other);
+
+    /** @return True iff the n-th bit of |this| is set */
+    bool testBit(int n) const;
+
+    /** @return The number of set bits in |this| */
+    int bitCount() const;
+
+    /** @return The index of the lowest set bit in |this|, or -1 if this is zero */
+    int getLowestSetBit() const;
+
     /** @return this^-1 such that this * this^-1 == 1 (mod mod) */
     BigInteger multiplicativeInverse(const BigInteger &mod) const;
 
-    /** @return z = this^pow % mod */
+    /** @return The greatest common divisor of this and other, both non-negative */
+    BigInteger gcd(const BigInteger &other) const;
+
+    /** @return z = this^pow % mod, in MontgomeryContext::powMod() when mod is odd */
     BigInteger bigPowMod(const BigInteger &pow, const BigInteger &mod) const;
 
-    static BigInteger generateBigPrime(int bitLength);
+    static BigInteger generateBigPrime(int bitLength, PrimalityTest test = MILLER_RABIN);
+
+    /** @return A safe prime p = 2q + 1 of bitLength bits, where q is also a prime */
+    static BigInteger generateSafePrime(int bitLength);
+
+    /**
+     * @return A strong prime p of bitLength bits by Gordon's algorithm, where p - 1 and p + 1
+     *         have large prime factors r and s, and r - 1 has a large prime factor t.
+     */
+    static BigInteger generateStrongPrime(int bitLength);
+
+    /**
+     * The primality pipeline:
+     *      1. trial division by the small primes,
+     *      2. a strong probable prime test to base 2,
+     *      3. millerRabinRounds(bitLength) rounds of Miller-Rabin with random bases for MILLER_RABIN,
+     *         or a strong Lucas probable prime test for BAILLIE_PSW.
+     *
+     * @return Ture iff this is probably a prime.
+     */
+    bool isPrime(PrimalityTest test = MILLER_RABIN) const;
+
+    /** @return The Jacobi symbol (a/this), where this is odd and positive */
+    int jacobiSymbol(int a) const;
+
+    /** @return The number of Miller-Rabin rounds for a prime candidate of bitLength bits */
+    static int millerRabinRounds(int bitLength);
+
+    /** @return A snapshot of the rejection counters of each stage, shared by all threads */
+    static PrimalityStats getPrimalityStats();
 
-    /** @return Ture iff this is probably a prime. */
-    bool isPrime() const;
+    static void resetPrimalityStats();
 
     /** @return The length of ciphertext and ciphertext(plaintext^e (mod n)) */
     static int encryptPlaintext(
@@ -221,6 +431,21 @@ public:
             const BigInteger &e,
             const BigInteger &n);
 
+    /** The same as above over the context of n, which is built once for many plaintexts */
+    static int encryptPlaintext(
+            const std::string &plaintext,
+            BigInteger *&ciphertext,
+            const BigInteger &e,
+            const MontgomeryContext &context);
+
+    /** The same as above over the plaintext of length bytes in place, such as a MappedFile */
+    static int encryptPlaintext(
+            const char *plaintext,
+            size_t length,
+            BigInteger *&ciphertext,
+            const BigInteger &e,
+            const MontgomeryContext &context);
+
     /** @return Plaintext(ciphertext^d (mod n)) */
     static std::string decryptCiphertext(
             int plaintextLength,
@@ -229,16 +454,35 @@ public:
             const BigInteger &d,
             const BigInteger &n);
 
+    /** @return Plaintext(ciphertext^d (mod n)), with the CRT parameters and base blinding of key if present */
+    static std::string decryptCiphertext(
+            int plaintextLength,
+            const BigInteger *ciphertext,
+            int ciphertextLength,
+            const RSAPrivateKey &key);
+
+    /** @return The plaintext of the blocks ciphertext^d (mod n) already decrypted, for the batched decryptions */
+    static std::string joinPlaintext(int plaintextLength, const BigInteger *plain, int plainLength, const BigInteger &n);
+
     /** @return hashcode^d (mod n) */
     static BigInteger signSignature(unsigned int hashcode, const BigInteger &d, const BigInteger &n);
 
+    /** @return hashcode^d (mod n), with the CRT parameters and base blinding of key if present */
+    static BigInteger signSignature(unsigned int hashcode, const RSAPrivateKey &key);
+
     /** @return signature^e (mod n) */
     static unsigned int decryptSignature(const BigInteger &signature, const BigInteger &e, const BigInteger &n);
 
+    /** The same as above over the context of n, which is built once for many signatures */
+    static unsigned int decryptSignature(
+            const BigInteger &signature,
+            const BigInteger &e,
+            const MontgomeryContext &context);
+
     /** @param radix: Only 16(hexadecimal) or 256(ascii) is supported. */
     std::string toString(int radix) const;
 
-    void write(std::ofstream &out) const;
+    void write(std::ostream &out) const;
 
     /** @return Ture iff this is zero. */
     bool isZero() const;
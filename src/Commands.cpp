@@ -0,0 +1,737 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Commands.h"
+#include "AsyncFileIO.h"
+#include "MontgomeryContext.h"
+#include "RequestStream.h"
+#include "SigningClient.h"
+#include "SigningDaemon.h"
+#include "StreamCipher.h"
+#include "WorkerPool.h"
+#include "rsa.h"
+
+const int Commands::SUCCESS;
+const int Commands::FAILURE;
+const int Commands::USAGE;
+
+const static char *const STDIO_PATH = "-";
+
+/** The bytes of an input as the buffer of an istream, parsed without a copy */
+class SpanBuffer : public std::streambuf {
+
+public:
+
+    SpanBuffer(const char *data, size_t size) {
+        // Only read, the const is cast away for the get area
+        char *begin = const_cast<char *>(data);
+        this->setg(begin, begin, begin + size);
+    }
+};
+
+/**
+ * The output of an input to stdout until the outputs before it are written: held in memory up to
+ * MAX_HELD_BYTES and in an unnamed temporary file past it. Once released, what is held goes to stdout and
+ * whatever is written afterwards goes straight there.
+ */
+class TurnBuffer : public std::streambuf {
+
+private:
+
+    // Above it, the output is spilled so that the inputs in flight never hold their whole outputs
+    const static size_t MAX_HELD_BYTES = 1 << 20;
+
+    // Guards everything below, the worker writes while the main thread releases
+    std::mutex lock;
+    std::string held;
+    FILE *spill;
+    bool released;
+    bool failed;
+
+    /** Write to stdout, or hold the bytes until the release, @return False if they are lost */
+    bool put(const char *bytes, const size_t length) {
+        if (this->failed) {
+            return false;
+        }
+        if (this->released) {
+            this->failed = !std::cout.write(bytes, (std::streamsize) length);
+        } else if (!this->spill && this->held.size() + length <= MAX_HELD_BYTES) {
+            this->held.append(bytes, length);
+        } else {
+            this->spill = this->spill ? this->spill : std::tmpfile();
+            this->failed = !this->spill || std::fwrite(bytes, 1, length, this->spill) != length;
+        }
+        return !this->failed;
+    }
+
+protected:
+
+    std::streamsize xsputn(const char *bytes, const std::streamsize count) override {
+        std::lock_guard<std::mutex> guard(this->lock);
+        return this->put(bytes, (size_t) count) ? count : 0;
+    }
+
+    int_type overflow(const int_type c) override {
+        if (traits_type::eq_int_type(c, traits_type::eof())) {
+            return traits_type::not_eof(c);
+        }
+        const char byte = traits_type::to_char_type(c);
+        std::lock_guard<std::mutex> guard(this->lock);
+        return this->put(&byte, 1) ? c : traits_type::eof();
+    }
+
+    int sync() override {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->failed = this->failed || (this->released && !std::cout.flush());
+        return this->failed ? -1 : 0;
+    }
+
+public:
+
+    TurnBuffer() : spill(nullptr), released(false), failed(false) {
+    }
+
+    ~TurnBuffer() override {
+        if (this->spill) {
+            std::fclose(this->spill);
+        }
+    }
+
+    /** Write what is held to stdout and pass the rest through, @return False if any output is lost */
+    bool release() {
+        std::lock_guard<std::mutex> guard(this->lock);
+        if (!this->released) {
+            this->released = true;
+            this->failed = this->failed || !std::cout.write(this->held.data(), (std::streamsize) this->held.size());
+            this->held = std::string();
+        }
+        if (this->spill) {
+            char buffer[1 << 16];
+            std::rewind(this->spill);
+            size_t count;
+            while (!this->failed && (count = std::fread(buffer, 1, sizeof(buffer), this->spill)) > 0) {
+                this->failed = !std::cout.write(buffer, (std::streamsize) count);
+            }
+            this->failed = this->failed || std::ferror(this->spill);
+            std::fclose(this->spill);
+            this->spill = nullptr;
+        }
+        return !this->failed;
+    }
+};
+
+const size_t TurnBuffer::MAX_HELD_BYTES;
+
+bool Commands::parse(const int argc, char *argv[], Arguments &arguments) {
+    arguments.bits = RSA2048;
+    arguments.primes = 2;
+    arguments.randomExponent = false;
+    arguments.threads = 0;
+    arguments.lengthPrefixed = false;
+    arguments.windowMicros = SigningDaemon::DEFAULT_WINDOW_MICROS;
+    for (int i = 2; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument == "-r") {
+            arguments.randomExponent = true;
+        } else if (argument == "-l") {
+            arguments.lengthPrefixed = true;
+        } else if (argument == "-b" || argument == "-p" || argument == "-s" || argument == "-t" ||
+                   argument == "-w") {
+            if (i + 1 == argc) {
+                return false;
+            }
+            std::string value = argv[++i];
+            if (argument == "-s") {
+                arguments.suffix = value;
+            } else if (argument == "-t") {
+                arguments.threads = std::atoi(value.c_str());
+            } else if (argument == "-w") {
+                arguments.windowMicros = std::atoi(value.c_str());
+            } else {
+                (argument == "-b" ? arguments.bits : arguments.primes) = std::atoi(value.c_str());
+            }
+        } else if (argument.length() > 1 && argument[0] == '-') {
+            return false;
+        } else {
+            arguments.operands.push_back(argument);
+        }
+    }
+    return true;
+}
+
+bool Commands::readInput(const std::string &path, std::string &content) {
+    std::ostringstream tmp;
+    if (path == STDIO_PATH) {
+        tmp << std::cin.rdbuf();
+    } else {
+        std::ifstream in(path, std::ios::in | std::ios::binary);
+        if (!in) {
+            std::cerr << "Can't open the input " << path << std::endl;
+            return false;
+        }
+        tmp << in.rdbuf();
+    }
+    content = tmp.str();
+    return true;
+}
+
+std::ostream *Commands::openOutput(const std::string &input, const std::string &suffix, std::ofstream &file) {
+    if (suffix.empty() || input == STDIO_PATH) {
+        return &std::cout;
+    }
+    file.open(input + suffix, std::ios::out | std::ios::binary);
+    if (!file) {
+        std::cerr << "Can't open the output " << input + suffix << std::endl;
+        return nullptr;
+    }
+    return &file;
+}
+
+bool Commands::readPublicKey(const std::string &path, BigInteger &n, BigInteger &e) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Can't open the public key " << path << std::endl;
+        return false;
+    }
+    n = BigInteger(HEXADECIMAL_RADIX, readString(in));
+    e = BigInteger(HEXADECIMAL_RADIX, readString(in));
+    // An RSA modulus is odd and the contexts need it so
+    if (!in || n.compareAbsolute(1) <= 0 || !n.testBit(0)) {
+        std::cerr << "Malformed public key " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Commands::readPrivateKey(const std::string &path, RSAPrivateKey &key) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Can't open the private key " << path << std::endl;
+        return false;
+    }
+    key = RSAPrivateKey::read(in);
+    if (!in || key.getN().compareAbsolute(1) <= 0 || !key.getN().testBit(0)) {
+        std::cerr << "Malformed private key " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::vector<std::string> Commands::inputsOf(const Arguments &arguments, const int skipped) {
+    if ((int) arguments.operands.size() == skipped) {
+        return {STDIO_PATH};
+    }
+
+    std::vector<std::string> inputs;
+    for (auto operand = arguments.operands.begin() + skipped; operand != arguments.operands.end(); operand++) {
+        struct stat status;
+        DIR *directory = stat(operand->c_str(), &status) == 0 && S_ISDIR(status.st_mode) ?
+                         opendir(operand->c_str()) : nullptr;
+        if (!directory) {
+            inputs.push_back(*operand);
+            continue;
+        }
+
+        // The files of a directory in the order of their names, but the outputs of an earlier call
+        std::vector<std::string> files;
+        const std::string separator = operand->back() == '/' ? "" : "/";
+        while (dirent *entry = readdir(directory)) {
+            const std::string name = entry->d_name, path = *operand + separator + name;
+            const bool output = !arguments.suffix.empty() && name.length() > arguments.suffix.length() &&
+                                name.compare(name.length() - arguments.suffix.length(), std::string::npos,
+                                             arguments.suffix) == 0;
+            if (!output && stat(path.c_str(), &status) == 0 && S_ISREG(status.st_mode)) {
+                files.push_back(path);
+            }
+        }
+        closedir(directory);
+        std::sort(files.begin(), files.end());
+        inputs.insert(inputs.end(), files.begin(), files.end());
+    }
+    return inputs;
+}
+
+int Commands::keygen(const Arguments &arguments) {
+    if (arguments.operands.size() > 2 || arguments.bits < 64 ||
+        arguments.primes < 2 || arguments.primes > maxPrimeCount(arguments.bits)) {
+        return USAGE;
+    }
+    const std::string publicKeyFile = arguments.operands.size() > 0 ? arguments.operands[0] : "./public_key.txt";
+    const std::string privateKeyFile = arguments.operands.size() > 1 ? arguments.operands[1] : "./private_key.txt";
+
+    RSAPrivateKey key = generateMultiPrimeRSAKey(arguments.bits, arguments.primes, !arguments.randomExponent);
+
+    // "-" writes the key to stdout, the public one first
+    auto open = [](const std::string &path, std::ofstream &file) -> std::ostream * {
+        if (path == STDIO_PATH) {
+            return &std::cout;
+        }
+        file.open(path);
+        return file ? &file : nullptr;
+    };
+    std::ofstream publicKeyStream, privateKeyStream;
+    std::ostream *publicKey = open(publicKeyFile, publicKeyStream);
+    std::ostream *privateKey = open(privateKeyFile, privateKeyStream);
+    if (!publicKey || !privateKey) {
+        std::cerr << "Can't open the key files " << publicKeyFile << " and " << privateKeyFile << std::endl;
+        return FAILURE;
+    }
+
+    key.getN().write(*publicKey);
+    key.getE().write(*publicKey);
+    key.write(*privateKey);
+    return SUCCESS;
+}
+
+int Commands::process(const std::vector<std::string> &inputs, const std::string &suffix, const Transform &transform) {
+    struct Slot {
+        std::shared_ptr<WorkerPool::Task> task;
+        bool ok;
+        // Ready for its turn on stdout
+        bool ready;
+        std::string output;
+        std::string error;
+        // The output to stdout
+        std::unique_ptr<TurnBuffer> turn;
+    };
+
+    std::unique_ptr<AsyncFileIO> io = AsyncFileIO::create(AsyncFileIO::DEFAULT_DEPTH);
+    // This thread mostly waits for the I/O, so the transforms have a worker per core
+    WorkerPool pool((int) std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<Slot> slots(inputs.size());
+    size_t next = 0, nextOutput = 0, finished = 0;
+    int inFlight = 0, status = SUCCESS;
+
+    auto toStdout = [&](const size_t i) {
+        return suffix.empty() || inputs[i] == STDIO_PATH;
+    };
+    for (size_t i = 0; i < inputs.size(); i++) {
+        slots[i].turn.reset(toStdout(i) ? new TurnBuffer() : nullptr);
+    }
+    // Without the content read, the worker maps or reads the file itself. The output of such an input to a
+    // file, or of any input to stdout, is written while it is computed rather than gathered in memory
+    auto run = [&](const size_t i, std::shared_ptr<const MappedFile> content) {
+        slots[i].task = pool.submit([&, i, content]() {
+            Slot &slot = slots[i];
+            MappedFile mapped;
+            const bool opened = content || mapped.open(inputs[i]);
+            const bool direct = toStdout(i) || !content;
+            if (!opened) {
+                slot.ok = false;
+                slot.error = "Can't open the input " + inputs[i];
+            } else if (direct) {
+                std::ofstream file;
+                std::ostream turn(slot.turn.get());
+                if (!toStdout(i)) {
+                    file.open(inputs[i] + suffix, std::ios::out | std::ios::binary);
+                }
+                std::ostream &output = toStdout(i) ? turn : file;
+                slot.ok = output && transform(i, content ? *content : mapped, output, slot.error) && output.flush();
+                if (!output) {
+                    slot.error = "Can't write the output " + inputs[i] + suffix;
+                }
+            } else {
+                std::ostringstream output;
+                slot.ok = transform(i, content ? *content : mapped, output, slot.error);
+                slot.output = output.str();
+            }
+            if (!opened || direct) {
+                io->post((long long) i, slot.ok);
+            } else {
+                io->write((long long) i, inputs[i] + suffix, std::move(slot.output));
+            }
+        });
+    };
+    auto finish = [&](const size_t i) {
+        Slot &slot = slots[i];
+        if (slot.task) {
+            pool.wait(slot.task);
+            // The task holds the content of its input until it is released
+            slot.task.reset();
+        }
+        if (!slot.error.empty()) {
+            std::cerr << slot.error << std::endl;
+        }
+        status = slot.ok ? status : FAILURE;
+        slot.output = std::string();
+        inFlight--;
+        finished++;
+    };
+
+    // The workers write to stdout in turn, so the errors on stderr of this thread must not flush it
+    std::ostream *tied = std::cerr.tie(nullptr);
+    // Nothing is written to stdout before the first output there, which goes straight to it
+    for (size_t i = 0; i < inputs.size(); i++) {
+        if (toStdout(i)) {
+            slots[i].turn->release();
+            break;
+        }
+    }
+
+    while (finished < inputs.size()) {
+        // The inputs in flight between their read and their write stay within the depth
+        while (next < inputs.size() && inFlight < AsyncFileIO::DEFAULT_DEPTH) {
+            const size_t i = next++;
+            inFlight++;
+            struct stat status;
+            if (inputs[i] == STDIO_PATH) {
+                std::string content;
+                readInput(STDIO_PATH, content);
+                run(i, std::make_shared<const MappedFile>(std::move(content)));
+            } else if (stat(inputs[i].c_str(), &status) == 0 && S_ISREG(status.st_mode) &&
+                       (size_t) status.st_size < MappedFile::MIN_MAPPED_BYTES) {
+                io->read((long long) i, inputs[i]);
+            } else {
+                // A large file is mapped, and a pipe such as a process substitution is read, by its worker
+                run(i, nullptr);
+            }
+        }
+
+        AsyncFileIO::Completion completion = io->wait();
+        const size_t i = (size_t) completion.tag;
+        if (completion.kind == AsyncFileIO::READ && completion.ok) {
+            run(i, std::make_shared<const MappedFile>(std::move(completion.data)));
+        } else if (completion.kind == AsyncFileIO::READ) {
+            slots[i].ok = false;
+            slots[i].error = "Can't open the input " + inputs[i];
+            if (toStdout(i)) {
+                slots[i].ready = true;
+            } else {
+                finish(i);
+            }
+        } else if (completion.kind == AsyncFileIO::WRITE) {
+            if (!completion.ok) {
+                slots[i].ok = false;
+                slots[i].error = "Can't write the output " + inputs[i] + suffix;
+            }
+            finish(i);
+        } else if (toStdout(i)) {
+            slots[i].ready = true;
+        } else {
+            // A mapped input written by its worker, or one that can't be opened
+            finish(i);
+        }
+
+        // The outputs to stdout in the order of their inputs, the next one released once those before it are
+        while (nextOutput < inputs.size()) {
+            Slot &slot = slots[nextOutput];
+            if (toStdout(nextOutput)) {
+                slot.turn->release();
+                if (!slot.ready) {
+                    break;
+                }
+                if (slot.task) {
+                    pool.wait(slot.task);
+                }
+                if (!slot.turn->release() && slot.ok) {
+                    slot.ok = false;
+                    slot.error = "Can't write the output " + inputs[nextOutput] + suffix;
+                }
+                finish(nextOutput);
+            }
+            nextOutput++;
+        }
+    }
+    std::cout.flush();
+    std::cerr.tie(tied);
+    return status;
+}
+
+int Commands::encrypt(const Arguments &arguments) {
+    if (arguments.operands.empty()) {
+        return USAGE;
+    }
+    BigInteger n, e;
+    if (!readPublicKey(arguments.operands[0], n, e)) {
+        return FAILURE;
+    }
+    const MontgomeryContext context = MontgomeryContext(n);
+
+    return process(inputsOf(arguments, 1), arguments.suffix, [&](
+            size_t, const MappedFile &plaintext, std::ostream &output, std::string &) {
+        // Each block is written as soon as it is pulled, the pushes wait for the writes once the pipeline is full
+        StreamEncryptor encryptor(e, context, plaintext.size());
+        output << plaintext.size() << "\n" << encryptor.getBlockCount() << "\n";
+        BigInteger block;
+        for (size_t taken = 0; taken < plaintext.size();) {
+            taken += encryptor.push(plaintext.data() + taken, plaintext.size() - taken);
+            if (encryptor.full() && encryptor.pull(block)) {
+                output << block.toString(HEXADECIMAL_RADIX) << "\n";
+            }
+        }
+        while (encryptor.pull(block)) {
+            output << block.toString(HEXADECIMAL_RADIX) << "\n";
+        }
+        return true;
+    });
+}
+
+int Commands::decrypt(const Arguments &arguments) {
+    if (arguments.operands.empty()) {
+        return USAGE;
+    }
+    RSAPrivateKey key;
+    if (!readPrivateKey(arguments.operands[0], key)) {
+        return FAILURE;
+    }
+
+    const std::vector<std::string> inputs = inputsOf(arguments, 1);
+    return process(inputs, arguments.suffix, [&](
+            size_t index, const MappedFile &content, std::ostream &output, std::string &error) {
+        // Every ciphertext of the input in turn, parsed in place
+        SpanBuffer buffer(content.data(), content.size());
+        std::istream in(&buffer);
+        long long plaintextLength, ciphertextLength;
+        while (in >> plaintextLength >> ciphertextLength) {
+            if (plaintextLength < 0 || ciphertextLength < 0) {
+                error = "Malformed ciphertext in " + inputs[index];
+                return false;
+            }
+            StreamDecryptor decryptor(key, (size_t) plaintextLength);
+            std::string chunk;
+            for (long long i = 0; i < ciphertextLength; i++) {
+                BigInteger block(HEXADECIMAL_RADIX, readString(in));
+                if (!in) {
+                    error = "Truncated ciphertext in " + inputs[index];
+                    return false;
+                }
+                if (decryptor.full() && decryptor.pull(chunk)) {
+                    output.write(chunk.data(), (std::streamsize) chunk.length());
+                }
+                decryptor.push(block);
+            }
+            while (decryptor.pull(chunk)) {
+                output.write(chunk.data(), (std::streamsize) chunk.length());
+            }
+        }
+        return true;
+    });
+}
+
+int Commands::sign(const Arguments &arguments) {
+    if (arguments.operands.empty()) {
+        return USAGE;
+    }
+    RSAPrivateKey key;
+    if (!readPrivateKey(arguments.operands[0], key)) {
+        return FAILURE;
+    }
+
+    return process(inputsOf(arguments, 1), arguments.suffix, [&](
+            size_t, const MappedFile &plaintext, std::ostream &output, std::string &) {
+        output << BigInteger::signSignature(BKDRHash(plaintext.data(), plaintext.size()), key)
+                          .toString(HEXADECIMAL_RADIX) << "\n";
+        return true;
+    });
+}
+
+int Commands::verify(const Arguments &arguments) {
+    if (arguments.operands.size() < 2) {
+        return USAGE;
+    }
+    BigInteger n, e;
+    if (!readPublicKey(arguments.operands[0], n, e)) {
+        return FAILURE;
+    }
+    const MontgomeryContext context = MontgomeryContext(n);
+    std::ifstream signatureStream(arguments.operands[1]);
+    if (!signatureStream) {
+        std::cerr << "Can't open the signatures " << arguments.operands[1] << std::endl;
+        return FAILURE;
+    }
+
+    // The signatures are taken in the order of the inputs, before any of them is read
+    const std::vector<std::string> inputs = inputsOf(arguments, 2);
+    std::vector<std::string> signatures;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        signatures.push_back(readString(signatureStream));
+    }
+    return process(inputs, "", [&](size_t index, const MappedFile &plaintext, std::ostream &output, std::string &) {
+        // A signature is a hexadecimal number in (0, n)
+        const std::string &signature = signatures[index];
+        bool verified = !signature.empty() &&
+                        signature.find_first_not_of("0123456789abcdefABCDEF") == std::string::npos;
+        if (verified) {
+            BigInteger value(HEXADECIMAL_RADIX, signature);
+            verified = !value.isZero() && value.compareAbsolute(n) < 0 &&
+                       BigInteger::decryptSignature(value, e, context) == BKDRHash(plaintext.data(), plaintext.size());
+        }
+        output << inputs[index] << ": " << (verified ? "verified" : "failed") << "\n";
+        return verified;
+    });
+}
+
+int Commands::stream(const Arguments &arguments) {
+    if (!arguments.operands.empty() || arguments.threads < 0) {
+        return USAGE;
+    }
+    RequestStream requestStream(arguments.threads, arguments.lengthPrefixed ?
+                                                   RequestStream::LENGTH_PREFIXED :
+                                                   RequestStream::LINES);
+    return requestStream.serve(std::cin, std::cout) > 0 ? FAILURE : SUCCESS;
+}
+
+int Commands::daemon(const Arguments &arguments) {
+    if (arguments.operands.size() < 2 || arguments.threads < 0 || arguments.windowMicros < 0) {
+        return USAGE;
+    }
+    std::map<std::string, RSAPrivateKey> keys;
+    for (size_t i = 1; i < arguments.operands.size(); i++) {
+        if (!readPrivateKey(arguments.operands[i], keys[arguments.operands[i]])) {
+            return FAILURE;
+        }
+    }
+
+    // The signals are taken by a thread of their own, the others inherit the mask and never get them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    const std::string &socketPath = arguments.operands[0];
+    SigningDaemon signingDaemon(keys, arguments.windowMicros, arguments.threads);
+    if (!signingDaemon.listen(socketPath)) {
+        return FAILURE;
+    }
+    std::atomic<bool> signalled(false);
+    std::thread signalHandler([&signals, &signingDaemon, &signalled]() {
+        int signal;
+        sigwait(&signals, &signal);
+        signalled = true;
+        signingDaemon.stop();
+    });
+    std::cerr << "Serving " << keys.size() << " keys on " << socketPath << std::endl;
+    signingDaemon.serve();
+    // serve() may also end on a failure of the socket, then the handler still waits for a signal
+    if (!signalled) {
+        pthread_kill(signalHandler.native_handle(), SIGTERM);
+    }
+    signalHandler.join();
+
+    unlink(socketPath.c_str());
+    std::cerr << SigningDaemon::toString(signingDaemon.stats()) << std::endl;
+    return SUCCESS;
+}
+
+int Commands::client(const Arguments &arguments) {
+    const bool stats = arguments.operands.size() == 2 && arguments.operands[1] == "stats";
+    if (!stats && (arguments.operands.size() < 3 ||
+                   (arguments.operands[1] != "sign" && arguments.operands[1] != "decrypt"))) {
+        return USAGE;
+    }
+    SigningClient signingClient;
+    if (!signingClient.connect(arguments.operands[0])) {
+        std::cerr << "No daemon listens on " << arguments.operands[0] << std::endl;
+        return FAILURE;
+    }
+
+    bool ok;
+    std::string result;
+    if (stats) {
+        if (!signingClient.request("stats", "-", "", ok, result)) {
+            std::cerr << "Lost the connection to the daemon" << std::endl;
+            return FAILURE;
+        }
+        std::cout << result << std::endl;
+        return SUCCESS;
+    }
+
+    const std::string &operation = arguments.operands[1], &keyName = arguments.operands[2];
+    int status = SUCCESS;
+    for (const std::string &input : inputsOf(arguments, 3)) {
+        std::string content;
+        std::ofstream file;
+        std::ostream *out = nullptr;
+        if (!readInput(input, content) || !(out = openOutput(input, arguments.suffix, file))) {
+            status = FAILURE;
+            continue;
+        }
+        if (!signingClient.request(operation, keyName, content, ok, result)) {
+            std::cerr << "Lost the connection to the daemon" << std::endl;
+            return FAILURE;
+        }
+        if (!ok) {
+            std::cerr << input << ": " << result << std::endl;
+            status = FAILURE;
+            continue;
+        }
+        // A signature is a line, as sign writes it
+        *out << result << (operation == "sign" ? "\n" : "");
+        out->flush();
+    }
+    return status;
+}
+
+void Commands::usage(std::ostream &out) {
+    out << "Usage:" << std::endl;
+    out << "\tRSA keygen [-b bits] [-p primes] [-r] [public key file] [private key file]" << std::endl;
+    out << "\tRSA encrypt [-s suffix] <public key file> [file]..." << std::endl;
+    out << "\tRSA decrypt [-s suffix] <private key file> [file]..." << std::endl;
+    out << "\tRSA sign [-s suffix] <private key file> [file]..." << std::endl;
+    out << "\tRSA verify <public key file> <signature file> [file]..." << std::endl;
+    out << "\tRSA stream [-t threads] [-l]" << std::endl;
+    out << "\tRSA daemon [-w microseconds] [-t threads] <socket> <private key file>..." << std::endl;
+    out << "\tRSA client [-s suffix] <socket> sign|decrypt <private key file> [file]..." << std::endl;
+    out << "\tRSA client <socket> stats" << std::endl;
+    out << "The inputs are read from stdin for \"-\" or none, and the outputs are written to stdout,"
+        << " or to each input path plus the suffix of -s." << std::endl;
+    out << "-r draws a random public exponent instead of 65537. Run RSA without arguments for the menu."
+        << std::endl;
+    out << "stream serves a request per line of stdin, \"sign|decrypt <private key file> <payload>\" or"
+        << " \"verify|encrypt <public key file> <payload>\", and writes \"ok|error <result>\" lines in order."
+        << " -l frames each request as \"<operation> <key file> <bytes>\" and a line break followed by the"
+        << " payload, and each response the same." << std::endl;
+    out << "daemon serves the private keys on a UNIX socket until SIGINT or SIGTERM, batching the requests"
+        << " that arrive within -w microseconds, " << SigningDaemon::DEFAULT_WINDOW_MICROS << " by default."
+        << " client sends its inputs to the daemon, which knows the keys by the paths it was given."
+        << std::endl;
+}
+
+int Commands::run(const int argc, char *argv[]) {
+    Arguments arguments;
+    if (argc < 2 || !parse(argc, argv, arguments)) {
+        usage(std::cerr);
+        return USAGE;
+    }
+
+    const std::string command = argv[1];
+    int status = USAGE;
+    if (command == "keygen") {
+        status = keygen(arguments);
+    } else if (command == "encrypt") {
+        status = encrypt(arguments);
+    } else if (command == "decrypt") {
+        status = decrypt(arguments);
+    } else if (command == "sign") {
+        status = sign(arguments);
+    } else if (command == "verify") {
+        status = verify(arguments);
+    } else if (command == "stream") {
+        status = stream(arguments);
+    } else if (command == "daemon") {
+        status = daemon(arguments);
+    } else if (command == "client") {
+        status = client(arguments);
+    }
+    if (status == USAGE) {
+        usage(std::cerr);
+    }
+    return status;
+}
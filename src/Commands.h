@@ -0,0 +1,148 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#ifndef RSA_COMMANDS_H
+#define RSA_COMMANDS_H
+
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "BigInteger.h"
+#include "MappedFile.h"
+#include "RSAPrivateKey.h"
+
+/**
+ * The non-interactive subcommands of the CLI, for scripts:
+ *      keygen [-b bits] [-p primes] [-r] [public key file] [private key file]
+ *      encrypt [-s suffix] <public key file> [file]...
+ *      decrypt [-s suffix] <private key file> [file]...
+ *      sign [-s suffix] <private key file> [file]...
+ *      verify <public key file> <signature file> [file]...
+ *      stream [-t threads] [-l]
+ *      daemon [-w microseconds] [-t threads] <socket> <private key file>...
+ *      client [-s suffix] <socket> sign|decrypt <private key file> [file]...
+ *      client <socket> stats
+ *
+ * The key is read and its contexts are built once for all the inputs of a call. Each input is a file,
+ * the files of a directory, or stdin for "-" or no input at all. The inputs are read and their outputs
+ * written over AsyncFileIO while the others are computed, but for the large files, which are mapped
+ * instead. The outputs go to stdout one after another in the order of the inputs, or to the input path
+ * plus the suffix given by -s. The file formats are the ones of the menu:
+ * a ciphertext is the plaintext length, the number of blocks and the blocks, where decrypt reads every
+ * ciphertext of an input in turn; a signature is one hexadecimal line, where verify takes the lines of
+ * the signature file in the order of the inputs.
+ *
+ * stream serves the requests of stdin in one process until its end, see RequestStream, in lines or in
+ * length-prefixed frames with -l, over the given threads or one per core.
+ *
+ * daemon holds the private keys in memory and serves their signatures and decryptions on the socket until
+ * it is interrupted, see SigningDaemon, batching the requests that arrive within the window given by -w.
+ * client sends the inputs to a daemon, naming the key by the path it was given to the daemon, and writes
+ * the outputs as sign and decrypt do.
+ */
+class Commands {
+
+public:
+
+    // The exit codes of run()
+    const static int SUCCESS = 0;
+    // A signature does not match, or an input or output file can't be opened
+    const static int FAILURE = 1;
+    const static int USAGE = 2;
+
+private:
+
+    /** The options and operands of a subcommand */
+    struct Arguments {
+        std::vector<std::string> operands;
+        // The output path of an input is the input path plus suffix, or stdout when it is empty
+        std::string suffix;
+        int bits;
+        int primes;
+        bool randomExponent;
+        int threads;
+        bool lengthPrefixed;
+        int windowMicros;
+    };
+
+    /** @return False if argv has an unknown option or an option without its value */
+    static bool parse(int argc, char *argv[], Arguments &arguments);
+
+    /** @return The whole input, stdin for "-" */
+    static bool readInput(const std::string &path, std::string &content);
+
+    /**
+     * Open the output of an input, stdout for an empty suffix or the stdin input.
+     *
+     * @return The stream to write, or nullptr if the file can't be opened
+     */
+    static std::ostream *openOutput(const std::string &input, const std::string &suffix, std::ofstream &file);
+
+    /**
+     * @return The inputs after the first skipped operands, stdin if there is none, where a directory stands
+     *         for its files but the ones ending with the suffix
+     */
+    static std::vector<std::string> inputsOf(const Arguments &arguments, int skipped);
+
+    /**
+     * Write the output of the content of an input, on any thread.
+     *
+     * @return False if the input is malformed, then error holds why for stderr
+     */
+    typedef std::function<bool(size_t index, const MappedFile &content, std::ostream &output,
+                               std::string &error)> Transform;
+
+    /**
+     * Run transform over the inputs, with up to AsyncFileIO::DEFAULT_DEPTH of them in flight between their
+     * read and their write, and the transforms over a WorkerPool meanwhile. A regular file of at least
+     * MappedFile::MIN_MAPPED_BYTES is mapped on the worker of its transform rather than read, and an input
+     * that is not a regular file, like a pipe, is read there. The outputs go to the input paths plus the
+     * suffix, or to stdout in the order of the inputs, without any flush per line. The output of a file read
+     * here is written in one piece, that of an input mapped or read by its worker as the transform goes.
+     * The output to stdout is written as it goes once those before it are, and until then it is held in
+     * memory up to a bound and in a temporary file past it, so that no output is ever whole in memory.
+     *
+     * @return FAILURE if an input can't be read, an output can't be written or a transform fails
+     */
+    static int process(const std::vector<std::string> &inputs, const std::string &suffix, const Transform &transform);
+
+    static int keygen(const Arguments &arguments);
+
+    static int encrypt(const Arguments &arguments);
+
+    static int decrypt(const Arguments &arguments);
+
+    static int sign(const Arguments &arguments);
+
+    static int verify(const Arguments &arguments);
+
+    static int stream(const Arguments &arguments);
+
+    static int daemon(const Arguments &arguments);
+
+    static int client(const Arguments &arguments);
+
+public:
+
+    /** Read a public key file of n and e, @return False if it can't be read or n is not an odd modulus */
+    static bool readPublicKey(const std::string &path, BigInteger &n, BigInteger &e);
+
+    /** Read a private key file, @return False if it can't be read or n is not an odd modulus */
+    static bool readPrivateKey(const std::string &path, RSAPrivateKey &key);
+
+    /** Print the usage of the subcommands */
+    static void usage(std::ostream &out);
+
+    /**
+     * Run the subcommand of argv[1] with the rest of argv.
+     *
+     * @return The exit code of the process
+     */
+    static int run(int argc, char *argv[]);
+};
+
+
+#endif //RSA_COMMANDS_H
@@ -0,0 +1,25 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#include <algorithm>
+
+#include "FixedBigInteger.h"
+#include "Tuning.h"
+
+const int FixedPowMod::MAX_BITS;
+
+std::shared_ptr<const FixedPowMod> FixedPowMod::create(const BigInteger &modulus) {
+    // The halves of RSA576 ... RSA1024 take 5 to 8 limbs
+    const int bitLength = modulus.getBitLength();
+    if (bitLength > std::min(Tuning::profile().fixedMaxBits, MAX_BITS)) {
+        return nullptr;
+    } else if (bitLength <= 320) {
+        return std::make_shared<FixedMontgomeryContext<320>>(modulus);
+    } else if (bitLength <= 384) {
+        return std::make_shared<FixedMontgomeryContext<384>>(modulus);
+    } else if (bitLength <= 448) {
+        return std::make_shared<FixedMontgomeryContext<448>>(modulus);
+    }
+    return std::make_shared<FixedMontgomeryContext<512>>(modulus);
+}
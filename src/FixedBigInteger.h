@@ -0,0 +1,372 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#ifndef RSA_FIXEDBIGINTEGER_H
+#define RSA_FIXEDBIGINTEGER_H
+
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <memory>
+
+#include "utils.h"
+#include "BigInteger.h"
+#include "MontgomeryContext.h"
+
+/**
+ * Calls f(0), f(1), ..., f(N - 1) in place, so the loops over the limbs are unrolled at compile time.
+ */
+template<int N>
+struct Unroll {
+    template<typename F>
+    __attribute__((always_inline)) static inline void run(F &&f) {
+        Unroll<N - 1>::run(f);
+        f(N - 1);
+    }
+};
+
+template<>
+struct Unroll<0> {
+    template<typename F>
+    __attribute__((always_inline)) static inline void run(F &&) {
+
+    }
+};
+
+/**
+ * A non-negative integer of at most Bits bits in 64-bit limbs of a std::array, for the key sizes known at
+ * compile time. All the operations run over the whole width, without heap use or any loop bounded at runtime.
+ */
+template<int Bits>
+class FixedBigInteger {
+
+    template<int OtherBits>
+    friend class FixedBigInteger;
+
+public:
+
+    const static int LIMBS = (Bits + 63) / 64;
+
+    // The type of the products, twice the limbs
+    typedef FixedBigInteger<128 * LIMBS> Product;
+
+private:
+
+    std::array<unsigned long long, LIMBS> limbs;
+
+public:
+
+    /** Zero */
+    FixedBigInteger() : limbs() {
+
+    }
+
+    /** The bridge from BigInteger, where the absolute value of x has at most Bits bits */
+    explicit FixedBigInteger(const BigInteger &x) : limbs() {
+        assert(x.getBitLength() <= 64 * LIMBS);
+        std::memcpy(this->limbs.data(), x.number, x.length * UNSIGNED_INTEGER_BYTES);
+    }
+
+    /** The bridge to BigInteger */
+    BigInteger toBigInteger() const {
+        auto *words = new unsigned int[2 * LIMBS];
+        std::memcpy(words, this->limbs.data(), LIMBS * sizeof(unsigned long long));
+        int length = trimLeadingZeros(words, 2 * LIMBS);
+        return BigInteger{length ? 1 : 0, words, length};
+    }
+
+    unsigned long long &operator[](int i) {
+        return this->limbs[i];
+    }
+
+    const unsigned long long &operator[](int i) const {
+        return this->limbs[i];
+    }
+
+    bool testBit(int n) const {
+        return (this->limbs[n >> 6] >> (n & 63)) & 1;
+    }
+
+    /**
+     * result = x + y, where result may alias x or y.
+     *
+     * @return The carry, 0 or 1
+     */
+    static unsigned long long add(const FixedBigInteger &x, const FixedBigInteger &y, FixedBigInteger &result) {
+        unsigned long long carry = 0;
+        Unroll<LIMBS>::run([&](int i) {
+            unsigned __int128 sum = (unsigned __int128) x.limbs[i] + y.limbs[i] + carry;
+            result.limbs[i] = (unsigned long long) sum;
+            carry = (unsigned long long) (sum >> 64);
+        });
+        return carry;
+    }
+
+    /**
+     * result = x - y modulo 2^(64 * LIMBS), where result may alias x or y.
+     *
+     * @return The borrow, 0 or 1
+     */
+    static unsigned long long subtract(const FixedBigInteger &x, const FixedBigInteger &y, FixedBigInteger &result) {
+        unsigned long long borrow = 0;
+        Unroll<LIMBS>::run([&](int i) {
+            unsigned __int128 difference = (unsigned __int128) x.limbs[i] - y.limbs[i] - borrow;
+            result.limbs[i] = (unsigned long long) difference;
+            borrow = (unsigned long long) (difference >> 64) & 1;
+        });
+        return borrow;
+    }
+
+    /** result = x * y by the schoolbook rows */
+    static void multiply(const FixedBigInteger &x, const FixedBigInteger &y, Product &result) {
+        result = Product();
+        Unroll<LIMBS>::run([&](int i) {
+            unsigned long long carry = 0;
+            Unroll<LIMBS>::run([&](int j) {
+                unsigned __int128 product = (unsigned __int128) x.limbs[j] * y.limbs[i] + result.limbs[i + j] + carry;
+                result.limbs[i + j] = (unsigned long long) product;
+                carry = (unsigned long long) (product >> 64);
+            });
+            result.limbs[i + LIMBS] = carry;
+        });
+    }
+
+    /** result = x^2, the products x_i * x_j of i != j are computed once and doubled */
+    static void square(const FixedBigInteger &x, Product &result) {
+        result = Product();
+        Unroll<LIMBS>::run([&](int i) {
+            unsigned long long carry = 0;
+            // Starts past the diagonal, so that no index beyond the limbs is ever formed
+            for (int j = i + 1; j < LIMBS; j++) {
+                unsigned __int128 product = (unsigned __int128) x.limbs[j] * x.limbs[i] + result.limbs[i + j] + carry;
+                result.limbs[i + j] = (unsigned long long) product;
+                carry = (unsigned long long) (product >> 64);
+            }
+            result.limbs[i + LIMBS] = carry;
+        });
+
+        // Double the cross products, then add the squares x_i^2
+        unsigned long long shifted = 0;
+        Unroll<2 * LIMBS>::run([&](int i) {
+            unsigned long long limb = result.limbs[i];
+            result.limbs[i] = (limb << 1) | shifted;
+            shifted = limb >> 63;
+        });
+        unsigned long long carry = 0;
+        Unroll<LIMBS>::run([&](int i) {
+            unsigned __int128 square = (unsigned __int128) x.limbs[i] * x.limbs[i];
+            unsigned __int128 low = (unsigned __int128) result.limbs[2 * i] + (unsigned long long) square + carry;
+            result.limbs[2 * i] = (unsigned long long) low;
+            unsigned __int128 high = (unsigned __int128) result.limbs[2 * i + 1] + (unsigned long long) (square >> 64) +
+                                     (unsigned long long) (low >> 64);
+            result.limbs[2 * i + 1] = (unsigned long long) high;
+            carry = (unsigned long long) (high >> 64);
+        });
+    }
+
+    /** @return 1 if x > y, 0 if x == y, otherwise -1 */
+    static int compare(const FixedBigInteger &x, const FixedBigInteger &y) {
+        FixedBigInteger difference;
+        unsigned long long borrow = subtract(x, y, difference);
+        unsigned long long nonZero = 0;
+        Unroll<LIMBS>::run([&](int i) {
+            nonZero |= difference.limbs[i];
+        });
+        return borrow ? -1 : nonZero ? 1 : 0;
+    }
+
+    /** result = condition ? x : y, where condition is 0 or 1, without branches */
+    static void select(unsigned long long condition,
+                       const FixedBigInteger &x,
+                       const FixedBigInteger &y,
+                       FixedBigInteger &result) {
+
+        const unsigned long long mask = 0 - condition;
+        Unroll<LIMBS>::run([&](int i) {
+            result.limbs[i] = (x.limbs[i] & mask) | (y.limbs[i] & ~mask);
+        });
+    }
+
+    /** The low and the high LIMBS limbs of a product */
+    static void split(const Product &x, FixedBigInteger &low, FixedBigInteger &high) {
+        Unroll<LIMBS>::run([&](int i) {
+            low.limbs[i] = x.limbs[i];
+            high.limbs[i] = x.limbs[i + LIMBS];
+        });
+    }
+};
+
+/**
+ * The bridge of the fixed-width exponentiations for the callers working on BigInteger,
+ * where the width is selected by the size of the modulus at runtime.
+ */
+class FixedPowMod {
+
+public:
+
+    // The largest fixed width, and the default of Tuning::Profile::fixedMaxBits,
+    // beyond it the vector kernels of MontgomeryContext are faster
+    const static int MAX_BITS = 512;
+
+    virtual ~FixedPowMod() = default;
+
+    /** @return x^pow % the modulus, a pow wider than the fixed width takes the variable-width path */
+    virtual BigInteger powMod(const BigInteger &x, const BigInteger &pow) const = 0;
+
+    /**
+     * @return The exponentiation of the smallest fixed width for an odd modulus,
+     *         nullptr if it is larger than the fixed max bits of the tuning profile
+     */
+    static std::shared_ptr<const FixedPowMod> create(const BigInteger &modulus);
+};
+
+/**
+ * The Montgomery arithmetic modulo an odd number of at most Bits bits, in the residues of FixedBigInteger<Bits>
+ * with R = 2^(64 * LIMBS). Only the construction goes through BigInteger, the operations use no heap.
+ */
+template<int Bits>
+class FixedMontgomeryContext : public FixedPowMod {
+
+public:
+
+    typedef FixedBigInteger<Bits> Element;
+    typedef typename Element::Product Product;
+
+    const static int LIMBS = Element::LIMBS;
+
+    // The bits of each window in powMod(), the table of 2^w residues stays on the stack
+    const static int WINDOW_BITS = Bits > 1024 ? 5 : 4;
+
+private:
+
+    Element modulus;
+    // The modulus for the bridge from BigInteger
+    BigInteger bigModulus;
+    // -modulus^-1 % 2^64
+    unsigned long long modulusInverse;
+    // R^2 % modulus
+    Element rSquared;
+    // R % modulus
+    Element one;
+
+public:
+
+    /** @param modulus An odd number of at most Bits bits */
+    explicit FixedMontgomeryContext(const BigInteger &modulus) : modulus(modulus), bigModulus(modulus) {
+        // Newton's iteration doubles the correct low bits of the inverse each time, from 3 bits of m * m == 1 % 8
+        unsigned long long m = this->modulus[0], inverse = m;
+        for (int i = 0; i < 5; i++) {
+            inverse *= 2 - m * inverse;
+        }
+        this->modulusInverse = 0 - inverse;
+
+        BigInteger r = BigInteger(1) << (64 * LIMBS);
+        this->one = Element(r % modulus);
+        this->rSquared = Element(r * r % modulus);
+    }
+
+    const Element &getModulus() const {
+        return this->modulus;
+    }
+
+    /** result = t * R^-1 % modulus, where t < modulus * R */
+    void reduce(Product &t, Element &result) const {
+        unsigned long long top = 0;
+        Unroll<LIMBS>::run([&](int i) {
+            const unsigned long long q = t[i] * this->modulusInverse;
+            unsigned long long carry = 0;
+            Unroll<LIMBS>::run([&](int j) {
+                unsigned __int128 product = (unsigned __int128) q * this->modulus[j] + t[i + j] + carry;
+                t[i + j] = (unsigned long long) product;
+                carry = (unsigned long long) (product >> 64);
+            });
+            unsigned __int128 sum = (unsigned __int128) t[i + LIMBS] + carry + top;
+            t[i + LIMBS] = (unsigned long long) sum;
+            top = (unsigned long long) (sum >> 64);
+        });
+
+        // The sum is less than 2 * modulus, subtract it once without branches
+        Element low, high, difference;
+        Element::split(t, low, high);
+        unsigned long long borrow = Element::subtract(high, this->modulus, difference);
+        Element::select(top | (borrow ^ 1), difference, high, result);
+    }
+
+    /** result = x * y * R^-1 % modulus, where result may alias x or y */
+    void mulMod(const Element &x, const Element &y, Element &result) const {
+        Product product;
+        Element::multiply(x, y, product);
+        this->reduce(product, result);
+    }
+
+    /** result = x^2 * R^-1 % modulus, where result may alias x */
+    void sqrMod(const Element &x, Element &result) const {
+        Product product;
+        Element::square(x, product);
+        this->reduce(product, result);
+    }
+
+    /** @return The residue x * R % modulus of x < R */
+    Element toResidue(const Element &x) const {
+        Element result;
+        this->mulMod(x, this->rSquared, result);
+        return result;
+    }
+
+    /** @return The value of the residue x */
+    Element fromResidue(const Element &x) const {
+        Product product;
+        Unroll<LIMBS>::run([&](int i) {
+            product[i] = x[i];
+        });
+        Element result;
+        this->reduce(product, result);
+        return result;
+    }
+
+    /**
+     * @return x^pow % modulus, where x < R and pow has at most Bits bits.
+     *         The fixed window runs over all the Bits bits of pow and every lookup reads the whole table,
+     *         so neither the time nor the memory accesses depend on the values.
+     */
+    Element powMod(const Element &x, const Element &pow) const {
+        std::array<Element, 1 << WINDOW_BITS> table;
+        table[0] = this->one;
+        table[1] = this->toResidue(x);
+        for (int i = 2; i < (1 << WINDOW_BITS); i++) {
+            this->mulMod(table[i - 1], table[1], table[i]);
+        }
+
+        const static int windows = (64 * LIMBS + WINDOW_BITS - 1) / WINDOW_BITS;
+        Element power = this->one, entry;
+        for (int w = windows - 1; w >= 0; w--) {
+            for (int i = 0; i < WINDOW_BITS; i++) {
+                this->sqrMod(power, power);
+            }
+
+            unsigned long long index = 0;
+            for (int i = WINDOW_BITS - 1; i >= 0; i--) {
+                int bit = w * WINDOW_BITS + i;
+                index = (index << 1) | (bit < 64 * LIMBS ? pow.testBit(bit) : 0);
+            }
+            for (int i = 0; i < (1 << WINDOW_BITS); i++) {
+                unsigned long long difference = i ^ index;
+                Element::select(((difference | (0 - difference)) >> 63) ^ 1, table[i], entry, entry);
+            }
+            this->mulMod(power, entry, power);
+        }
+        return this->fromResidue(power);
+    }
+
+    BigInteger powMod(const BigInteger &x, const BigInteger &pow) const override {
+        // Only a malformed key has an exponent this wide, it doesn't fit the limbs
+        if (pow.getBitLength() > Bits) {
+            return MontgomeryContext(this->bigModulus).powModConstantTime(x, pow);
+        }
+        return this->powMod(Element(x % this->bigModulus), Element(pow)).toBigInteger();
+    }
+};
+
+
+#endif //RSA_FIXEDBIGINTEGER_H
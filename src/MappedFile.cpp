@@ -0,0 +1,89 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "MappedFile.h"
+
+const size_t MappedFile::MIN_MAPPED_BYTES;
+
+MappedFile::MappedFile(std::string content) :
+        mapping(nullptr),
+        mappedLength(0),
+        content(std::move(content)) {
+}
+
+MappedFile::~MappedFile() {
+    this->release();
+}
+
+void MappedFile::release() {
+    if (this->mapping) {
+        munmap(this->mapping, this->mappedLength);
+    }
+    this->mapping = nullptr;
+    this->mappedLength = 0;
+    this->content = std::string();
+}
+
+bool MappedFile::open(const std::string &path) {
+    this->release();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat status;
+    const bool regular = fstat(fd, &status) == 0 && S_ISREG(status.st_mode);
+    if (regular && (size_t) status.st_size >= MIN_MAPPED_BYTES) {
+        void *mapping = mmap(nullptr, (size_t) status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            // The blocks and the hash go through the bytes once from the start, so the kernel reads ahead
+            // and drops the pages behind
+            madvise(mapping, (size_t) status.st_size, MADV_SEQUENTIAL);
+            this->mapping = mapping;
+            this->mappedLength = (size_t) status.st_size;
+            close(fd);
+            return true;
+        }
+    }
+
+    // The size of a regular file is only a hint, it may change while it is read
+    if (regular) {
+        this->content.reserve((size_t) status.st_size);
+    }
+    char buffer[1 << 16];
+    while (true) {
+        ssize_t count = ::read(fd, buffer, sizeof(buffer));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            close(fd);
+            return count == 0;
+        }
+        this->content.append(buffer, (size_t) count);
+    }
+}
+
+const char *MappedFile::data() const {
+    return this->mapping ? (const char *) this->mapping : this->content.data();
+}
+
+size_t MappedFile::size() const {
+    return this->mapping ? this->mappedLength : this->content.size();
+}
+
+bool MappedFile::empty() const {
+    return this->size() == 0;
+}
+
+bool MappedFile::mapped() const {
+    return this->mapping != nullptr;
+}
@@ -0,0 +1,58 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#ifndef RSA_MAPPEDFILE_H
+#define RSA_MAPPEDFILE_H
+
+#include <string>
+
+/**
+ * The read-only bytes of a whole input, mapped from its file so that a large plaintext is never copied
+ * into a string before its blocks are packed or it is hashed.
+ *
+ * A regular file of at least MIN_MAPPED_BYTES is mapped and advised for a sequential read; a smaller one,
+ * or anything that can't be mapped like a pipe, is read into memory instead, as is the content given to
+ * the constructor. The bytes stay valid for the lifetime of the object.
+ */
+class MappedFile {
+
+private:
+
+    // The mapping, or nullptr when the bytes are held in content
+    void *mapping;
+    size_t mappedLength;
+    std::string content;
+
+    void release();
+
+public:
+
+    // The smallest file mapped, below it the read costs less than setting up and tearing down the mapping
+    const static size_t MIN_MAPPED_BYTES = 1 << 20;
+
+    /** Hold the given bytes, read elsewhere */
+    explicit MappedFile(std::string content = std::string());
+
+    MappedFile(const MappedFile &other) = delete;
+
+    MappedFile &operator=(const MappedFile &other) = delete;
+
+    ~MappedFile();
+
+    /** Map or read the whole file at path, replacing the bytes held, @return False if it can't be opened */
+    bool open(const std::string &path);
+
+    /** @return The first byte, not terminated */
+    const char *data() const;
+
+    size_t size() const;
+
+    bool empty() const;
+
+    /** @return True if the bytes are mapped from the file rather than read */
+    bool mapped() const;
+};
+
+
+#endif //RSA_MAPPEDFILE_H
@@ -0,0 +1,560 @@
+//
+// Created by Yongzao Dan on 2022/11/15.
+//
+
+#include "MontgomeryContext.h"
+#include "VectorKernels.h"
+#include "Tuning.h"
+
+/** @return 0xffffffff if x == y, otherwise 0, without branches */
+static inline unsigned int equalMask(unsigned int x, unsigned int y) {
+    unsigned int diff = x ^ y;
+    return ((diff | (0u - diff)) >> 31) - 1;
+}
+
+/** result = t - m if t + top * 2^(32 * n) >= m, otherwise t, where the sum is less than 2 * m */
+static inline void conditionalSubtract(
+        const unsigned int *t,
+        unsigned int top,
+        const unsigned int *m,
+        int n,
+        unsigned int *result) {
+
+    // Subtract m anyway and keep t only if the difference borrowed
+    long long borrow = 0;
+    for (int j = 0; j < n; j++) {
+        borrow += (long long) t[j] - m[j];
+        result[j] = (unsigned int) borrow;
+        borrow >>= UNSIGNED_INTEGER_BITS;
+    }
+    borrow += top;
+    auto keep = (unsigned int) (borrow >> UNSIGNED_INTEGER_BITS);
+    for (int j = 0; j < n; j++) {
+        result[j] = (t[j] & keep) | (result[j] & ~keep);
+    }
+}
+
+MontgomeryContext::MontgomeryContext(const BigInteger &modulus) : modulus(modulus) {
+    this->length = modulus.length;
+    this->modulusWords.assign(modulus.number, modulus.number + modulus.length);
+
+    // Newton's iteration doubles the correct low bits of m^-1 % 2^32 each time
+    unsigned int inverse = 1;
+    for (int i = 0; i < 5; i++) {
+        inverse *= 2 - modulus.number[0] * inverse;
+    }
+    this->modulusInverse = 0u - inverse;
+
+    // R^2 = 2^(64 * L), the only division, paid once per modulus
+    BigInteger rSquaredMod = (BigInteger(1) << (2 * this->length * (int) UNSIGNED_INTEGER_BITS)) % modulus;
+    this->rSquaredWords.assign(this->length, 0);
+    this->toWords(rSquaredMod, this->rSquaredWords.data());
+
+    // R % m = R^2 * R^-1 % m
+    this->oneResidue.assign(this->length, 0);
+    this->oneResidue[0] = 1;
+    this->multiply(this->oneResidue.data(), this->rSquaredWords.data(), this->oneResidue.data());
+
+    // Two spare bits keep R' > 4 * modulus
+    this->digits = 0;
+    this->digitInverse = 0;
+    if (VectorKernels::vectorized() && this->length >= Tuning::profile().vectorCrossoverWords) {
+        const int n = VectorKernels::digitCount(modulus.bitLength + 2);
+        const int rBits = n * VectorKernels::DIGIT_BITS;
+        this->digits = n;
+        this->digitInverse = VectorKernels::inverseDigit(modulus.number[0]);
+        this->modulusDigits.assign(n, 0);
+        VectorKernels::toDigits(modulus.number, modulus.length, this->modulusDigits.data(), n);
+
+        Residue words(this->length);
+        this->toWords((BigInteger(1) << rBits) % modulus, words.data());
+        this->oneDigits.assign(n, 0);
+        VectorKernels::toDigits(words.data(), this->length, this->oneDigits.data(), n);
+
+        // R'^2 * R^-1 takes a residue to its digits by a single multiplication, R takes them back
+        Residue unit(this->length, 0);
+        unit[0] = 1;
+        this->toWords((BigInteger(1) << (2 * rBits)) % modulus, words.data());
+        this->multiply(words.data(), unit.data(), words.data());
+        this->toDigitsFactor.assign(n, 0);
+        VectorKernels::toDigits(words.data(), this->length, this->toDigitsFactor.data(), n);
+        this->fromDigitsFactor.assign(n, 0);
+        VectorKernels::toDigits(this->oneResidue.data(), this->length, this->fromDigitsFactor.data(), n);
+    }
+}
+
+const BigInteger &MontgomeryContext::getModulus() const {
+    return this->modulus;
+}
+
+bool MontgomeryContext::isVectorized() const {
+    return this->digits > 0;
+}
+
+unsigned int *MontgomeryContext::scratch() const {
+    static thread_local std::vector<unsigned int> scratchSpace;
+    if ((int) scratchSpace.size() < 2 * this->length + 2) {
+        scratchSpace.resize(2 * this->length + 2);
+    }
+    return scratchSpace.data();
+}
+
+void MontgomeryContext::reduce(unsigned int *t, unsigned int *result) const {
+    const int n = this->length;
+    const unsigned int *m = this->modulusWords.data();
+
+    // t = (t + q * m * 2^(32 * i)) for i in [0, L), where q makes the i-th word zero,
+    // and extra keeps the carry out of the word i + L
+    unsigned int extra = 0;
+    for (int i = 0; i < n; i++) {
+        unsigned int q = t[i] * this->modulusInverse;
+        unsigned long long carry = 0;
+        for (int j = 0; j < n; j++) {
+            carry += (unsigned long long) q * m[j] + t[i + j];
+            t[i + j] = (unsigned int) carry;
+            carry >>= UNSIGNED_INTEGER_BITS;
+        }
+        carry += (unsigned long long) t[i + n] + extra;
+        t[i + n] = (unsigned int) carry;
+        extra = (unsigned int) (carry >> UNSIGNED_INTEGER_BITS);
+    }
+    conditionalSubtract(t + n, extra + t[2 * n], m, n, result);
+}
+
+void MontgomeryContext::multiply(const unsigned int *a, const unsigned int *b, unsigned int *result) const {
+    const int n = this->length;
+    const unsigned int *m = this->modulusWords.data();
+    unsigned int *t = this->scratch();
+    std::memset(t, 0, (n + 2) * UNSIGNED_INTEGER_BYTES);
+
+    for (int i = 0; i < n; i++) {
+        // t = t + a * b[i]
+        unsigned long long carry = 0;
+        for (int j = 0; j < n; j++) {
+            carry += (unsigned long long) a[j] * b[i] + t[j];
+            t[j] = (unsigned int) carry;
+            carry >>= UNSIGNED_INTEGER_BITS;
+        }
+        carry += t[n];
+        t[n] = (unsigned int) carry;
+        t[n + 1] = (unsigned int) (carry >> UNSIGNED_INTEGER_BITS);
+
+        // t = (t + q * m) / 2^32, where q makes the lowest word zero
+        unsigned int q = t[0] * this->modulusInverse;
+        carry = ((unsigned long long) q * m[0] + t[0]) >> UNSIGNED_INTEGER_BITS;
+        for (int j = 1; j < n; j++) {
+            carry += (unsigned long long) q * m[j] + t[j];
+            t[j - 1] = (unsigned int) carry;
+            carry >>= UNSIGNED_INTEGER_BITS;
+        }
+        carry += t[n];
+        t[n - 1] = (unsigned int) carry;
+        t[n] = t[n + 1] + (unsigned int) (carry >> UNSIGNED_INTEGER_BITS);
+    }
+    conditionalSubtract(t, t[n], m, n, result);
+}
+
+void MontgomeryContext::square(const unsigned int *a, unsigned int *result) const {
+    const int n = this->length;
+    unsigned int *t = this->scratch();
+    std::memset(t, 0, (2 * n + 1) * UNSIGNED_INTEGER_BYTES);
+
+    // The cross products a[i] * a[j] for i < j
+    for (int i = 0; i < n; i++) {
+        unsigned long long carry = 0;
+        for (int j = i + 1; j < n; j++) {
+            carry += (unsigned long long) a[i] * a[j] + t[i + j];
+            t[i + j] = (unsigned int) carry;
+            carry >>= UNSIGNED_INTEGER_BITS;
+        }
+        t[i + n] = (unsigned int) carry;
+    }
+
+    // Double them, then add the squares a[i]^2
+    unsigned int shifted = 0;
+    for (int i = 0; i < 2 * n; i++) {
+        unsigned int word = t[i];
+        t[i] = (word << 1) | shifted;
+        shifted = word >> (UNSIGNED_INTEGER_BITS - 1);
+    }
+    unsigned long long carry = 0;
+    for (int i = 0; i < n; i++) {
+        carry += (unsigned long long) a[i] * a[i] + t[2 * i];
+        t[2 * i] = (unsigned int) carry;
+        carry >>= UNSIGNED_INTEGER_BITS;
+        carry += t[2 * i + 1];
+        t[2 * i + 1] = (unsigned int) carry;
+        carry >>= UNSIGNED_INTEGER_BITS;
+    }
+    this->reduce(t, result);
+}
+
+void MontgomeryContext::add(const unsigned int *a, const unsigned int *b, unsigned int *result) const {
+    const int n = this->length;
+    unsigned int *sum = this->scratch();
+    unsigned long long carry = 0;
+    for (int j = 0; j < n; j++) {
+        carry += (unsigned long long) a[j] + b[j];
+        sum[j] = (unsigned int) carry;
+        carry >>= UNSIGNED_INTEGER_BITS;
+    }
+    conditionalSubtract(sum, (unsigned int) carry, this->modulusWords.data(), n, result);
+}
+
+void MontgomeryContext::subtract(const unsigned int *a, const unsigned int *b, unsigned int *result) const {
+    const int n = this->length;
+    const unsigned int *m = this->modulusWords.data();
+    long long borrow = 0;
+    for (int j = 0; j < n; j++) {
+        borrow += (long long) a[j] - b[j];
+        result[j] = (unsigned int) borrow;
+        borrow >>= UNSIGNED_INTEGER_BITS;
+    }
+
+    // Add m back if the difference borrowed
+    auto mask = (unsigned int) (borrow >> UNSIGNED_INTEGER_BITS);
+    unsigned long long carry = 0;
+    for (int j = 0; j < n; j++) {
+        carry += (unsigned long long) result[j] + (m[j] & mask);
+        result[j] = (unsigned int) carry;
+        carry >>= UNSIGNED_INTEGER_BITS;
+    }
+}
+
+void MontgomeryContext::toWords(const BigInteger &x, unsigned int *result) const {
+    std::memset(result, 0, this->length * UNSIGNED_INTEGER_BYTES);
+    std::memcpy(result, x.number, std::min(x.length, this->length) * UNSIGNED_INTEGER_BYTES);
+}
+
+BigInteger MontgomeryContext::fromWords(const unsigned int *words) const {
+    unsigned int *number = nullptr;
+    int numberLength = stripLeadingZeros(words, number, this->length);
+    if (numberLength == 0) {
+        delete[] number;
+        return BigInteger{};
+    }
+    return BigInteger{1, number, numberLength};
+}
+
+MontgomeryContext::Residue MontgomeryContext::toResidue(const BigInteger &x) const {
+    const int n = this->length;
+    Residue result(n), chunk(n);
+
+    // With x = x_c * R^c + ... + x_0 and result = v * R, let v = v * R + x_i for i from c down to 0
+    for (int i = (x.length - 1) / n; i >= 0; i--) {
+        int chunkLength = std::max(0, std::min(n, x.length - i * n));
+        std::memset(chunk.data(), 0, n * UNSIGNED_INTEGER_BYTES);
+        std::memcpy(chunk.data(), x.number + i * n, chunkLength * UNSIGNED_INTEGER_BYTES);
+
+        this->multiply(result.data(), this->rSquaredWords.data(), result.data());
+        this->multiply(chunk.data(), this->rSquaredWords.data(), chunk.data());
+        this->add(result.data(), chunk.data(), result.data());
+    }
+    return result;
+}
+
+BigInteger MontgomeryContext::fromResidue(const Residue &x) const {
+    Residue words(this->length), one(this->length);
+    one[0] = 1;
+    this->multiply(x.data(), one.data(), words.data());
+    return this->fromWords(words.data());
+}
+
+const MontgomeryContext::Residue &MontgomeryContext::one() const {
+    return this->oneResidue;
+}
+
+void MontgomeryContext::mulMod(const Residue &a, const Residue &b, Residue &result) const {
+    result.resize(this->length);
+    this->multiply(a.data(), b.data(), result.data());
+}
+
+void MontgomeryContext::sqrMod(const Residue &a, Residue &result) const {
+    result.resize(this->length);
+    this->square(a.data(), result.data());
+}
+
+void MontgomeryContext::addMod(const Residue &a, const Residue &b, Residue &result) const {
+    result.resize(this->length);
+    this->add(a.data(), b.data(), result.data());
+}
+
+void MontgomeryContext::subMod(const Residue &a, const Residue &b, Residue &result) const {
+    result.resize(this->length);
+    this->subtract(a.data(), b.data(), result.data());
+}
+
+void MontgomeryContext::halveMod(const Residue &a, Residue &result) const {
+    const int n = this->length;
+    const unsigned int *m = this->modulusWords.data();
+    unsigned int *sum = this->scratch();
+
+    // a / 2 == (a + m) / 2 (mod m) when a is odd, and m is odd
+    unsigned int mask = 0u - (a[0] & 1);
+    unsigned long long carry = 0;
+    for (int j = 0; j < n; j++) {
+        carry += (unsigned long long) a[j] + (m[j] & mask);
+        sum[j] = (unsigned int) carry;
+        carry >>= UNSIGNED_INTEGER_BITS;
+    }
+    sum[n] = (unsigned int) carry;
+
+    result.resize(n);
+    for (int j = 0; j < n; j++) {
+        result[j] = (sum[j] >> 1) | (sum[j + 1] << (UNSIGNED_INTEGER_BITS - 1));
+    }
+}
+
+BigInteger MontgomeryContext::mulMod(const BigInteger &x, const Residue &a) const {
+    Residue words(this->length);
+    this->toWords(x.length > this->length ? this->reduce(x) : x, words.data());
+    this->multiply(words.data(), a.data(), words.data());
+    return this->fromWords(words.data());
+}
+
+BigInteger MontgomeryContext::reduce(const BigInteger &x) const {
+    return this->fromResidue(this->toResidue(x));
+}
+
+int MontgomeryContext::windowBits(const int exponentBits) {
+    return Tuning::window(Tuning::profile().windowBits, exponentBits);
+}
+
+int MontgomeryContext::constantTimeWindowBits(const int exponentBits) {
+    return Tuning::window(Tuning::profile().constantTimeWindowBits, exponentBits);
+}
+
+/**
+ * result = x^pow by the sliding-window method over the odd powers of x,
+ * for both the residues and the digits of the vector kernels.
+ */
+template<typename Element, typename Multiply, typename Square>
+static void slidingWindowPowMod(
+        const Element &x,
+        const BigInteger &pow,
+        const Element &one,
+        Multiply multiply,
+        Square square,
+        Element &result) {
+
+    auto bitAt = [&pow](int i) {
+        return (unsigned int) pow.testBit(i);
+    };
+
+    // The odd powers x, x^3, ..., x^(2^w - 1)
+    const int window = MontgomeryContext::windowBits(pow.getBitLength());
+    std::vector<Element> oddPowers((size_t) 1 << (window - 1));
+    oddPowers[0] = x;
+    if (oddPowers.size() > 1) {
+        Element xSquared;
+        square(x, xSquared);
+        for (size_t i = 1; i < oddPowers.size(); i++) {
+            multiply(oddPowers[i - 1], xSquared, oddPowers[i]);
+        }
+    }
+
+    // Scan from the top, each window is the longest run of at most w bits that ends with a one
+    result = one;
+    bool started = false;
+    int i = pow.getBitLength() - 1;
+    while (i >= 0) {
+        if (!bitAt(i)) {
+            if (started) {
+                square(result, result);
+            }
+            i--;
+            continue;
+        }
+
+        int j = std::max(i - window + 1, 0);
+        while (!bitAt(j)) {
+            j++;
+        }
+        unsigned int digit = 0;
+        for (int k = i; k >= j; k--) {
+            digit = (digit << 1) | bitAt(k);
+        }
+
+        if (started) {
+            for (int k = i; k >= j; k--) {
+                square(result, result);
+            }
+            multiply(result, oddPowers[digit >> 1], result);
+        } else {
+            result = oddPowers[digit >> 1];
+            started = true;
+        }
+        i = j - 1;
+    }
+}
+
+/**
+ * result[0, n) = table[index * n, (index + 1) * n), by reading every entry and masking all but the wanted one,
+ * so the memory accesses are the same whatever the index is
+ */
+static void selectWords(const unsigned int *table, int count, int n, unsigned int index, unsigned int *result) {
+    std::memset(result, 0, n * UNSIGNED_INTEGER_BYTES);
+    for (int i = 0; i < count; i++) {
+        const unsigned int mask = equalMask(i, index);
+        const unsigned int *entry = table + i * n;
+        for (int j = 0; j < n; j++) {
+            result[j] |= entry[j] & mask;
+        }
+    }
+}
+
+/**
+ * result = x^exponent by the fixed window over all the bits of exponent,
+ * where select() reads the whole table of x^i for every lookup, for both the residues and the digits.
+ */
+template<typename Element, typename Multiply, typename Square, typename Select>
+static void fixedWindowPowMod(
+        const Element &x,
+        const std::vector<unsigned int> &exponent,
+        int window,
+        const Element &one,
+        Multiply multiply,
+        Square square,
+        Select select,
+        Element &result) {
+
+    typedef typename Element::value_type Word;
+    const int n = (int) x.size();
+    const int exponentLength = (int) exponent.size();
+    const int exponentBits = exponentLength * (int) UNSIGNED_INTEGER_BITS;
+    const int tableSize = 1 << window;
+    Element entry = one;
+
+    // table[i * n + j] is the j-th word of x^i
+    std::vector<Word> table(tableSize * n);
+    for (int i = 0; i < tableSize; i++) {
+        std::copy(entry.begin(), entry.end(), table.begin() + i * n);
+        multiply(entry, x, entry);
+    }
+
+    auto gather = [&](unsigned int index, Element &words) {
+        words.resize(n);
+        select(table.data(), tableSize, n, index, words.data());
+    };
+    // The bits [offset, offset + bits) of the exponent, where offset and bits are public
+    auto windowAt = [&](int offset, int bits) {
+        int index = offset >> 5;
+        int shift = offset & 31;
+        unsigned int value = exponent[index] >> shift;
+        if (shift + bits > (int) UNSIGNED_INTEGER_BITS && index + 1 < exponentLength) {
+            value |= exponent[index + 1] << (UNSIGNED_INTEGER_BITS - shift);
+        }
+        return value & ((1u << bits) - 1);
+    };
+
+    int topBits = exponentBits % window ? exponentBits % window : window;
+    int offset = exponentBits - topBits;
+    gather(windowAt(offset, topBits), result);
+    while (offset > 0) {
+        offset -= window;
+        for (int i = 0; i < window; i++) {
+            square(result, result);
+        }
+        gather(windowAt(offset, window), entry);
+        multiply(result, entry, result);
+    }
+}
+
+void MontgomeryContext::powMod(const Residue &x, const BigInteger &pow, Residue &result) const {
+    if (this->digits > 0) {
+        Digits base, power;
+        this->toDigitForm(x, base);
+        slidingWindowPowMod(
+                base,
+                pow,
+                this->oneDigits,
+                [this](const Digits &a, const Digits &b, Digits &product) { this->multiplyDigits(a, b, product); },
+                [this](const Digits &a, Digits &product) { this->multiplyDigits(a, a, product); },
+                power);
+        this->fromDigitForm(power, result);
+        return;
+    }
+    slidingWindowPowMod(
+            x,
+            pow,
+            this->oneResidue,
+            [this](const Residue &a, const Residue &b, Residue &product) { this->mulMod(a, b, product); },
+            [this](const Residue &a, Residue &product) { this->sqrMod(a, product); },
+            result);
+}
+
+unsigned long long *MontgomeryContext::digitScratch() const {
+    static thread_local std::vector<unsigned long long> scratchSpace;
+    if ((int) scratchSpace.size() < 2 * this->digits + 1) {
+        scratchSpace.resize(2 * this->digits + 1);
+    }
+    return scratchSpace.data();
+}
+
+void MontgomeryContext::multiplyDigits(const Digits &a, const Digits &b, Digits &result) const {
+    result.resize(this->digits);
+    VectorKernels::active().montgomeryMultiply(
+            a.data(),
+            b.data(),
+            this->modulusDigits.data(),
+            this->digitInverse,
+            this->digits,
+            this->digitScratch(),
+            result.data());
+}
+
+void MontgomeryContext::toDigitForm(const Residue &x, Digits &result) const {
+    result.resize(this->digits);
+    VectorKernels::toDigits(x.data(), this->length, result.data(), this->digits);
+    this->multiplyDigits(result, this->toDigitsFactor, result);
+}
+
+void MontgomeryContext::fromDigitForm(const Digits &x, Residue &result) const {
+    // x * R is less than 2 * modulus and takes one more word
+    const int n = this->length;
+    Digits product;
+    this->multiplyDigits(x, this->fromDigitsFactor, product);
+    unsigned int *t = this->scratch();
+    VectorKernels::fromDigits(product.data(), this->digits, t, n + 1);
+    result.resize(n);
+    conditionalSubtract(t, t[n], this->modulusWords.data(), n, result.data());
+}
+
+BigInteger MontgomeryContext::powMod(const BigInteger &x, const BigInteger &pow) const {
+    Residue residue = this->toResidue(x);
+    this->powMod(residue, pow, residue);
+    return this->fromResidue(residue);
+}
+
+BigInteger MontgomeryContext::powModConstantTime(const BigInteger &x, const BigInteger &pow) const {
+    // The exponent spans the modulus, or all of a wider pow, so its windows depend on the lengths only
+    Residue base = this->toResidue(x), exponent(std::max(this->length, pow.length)), power;
+    std::memcpy(exponent.data(), pow.number, pow.length * UNSIGNED_INTEGER_BYTES);
+    const int window = constantTimeWindowBits(this->length * (int) UNSIGNED_INTEGER_BITS);
+    if (this->digits > 0) {
+        // The select over 2^w entries costs more next to the multiplications of the vector kernels
+        Digits baseDigits, powerDigits;
+        this->toDigitForm(base, baseDigits);
+        fixedWindowPowMod(
+                baseDigits,
+                exponent,
+                std::max(window - 1, 1),
+                this->oneDigits,
+                [this](const Digits &a, const Digits &b, Digits &product) { this->multiplyDigits(a, b, product); },
+                [this](const Digits &a, Digits &product) { this->multiplyDigits(a, a, product); },
+                VectorKernels::active().select,
+                powerDigits);
+        this->fromDigitForm(powerDigits, power);
+    } else {
+        fixedWindowPowMod(
+                base,
+                exponent,
+                window,
+                this->oneResidue,
+                [this](const Residue &a, const Residue &b, Residue &product) { this->mulMod(a, b, product); },
+                [this](const Residue &a, Residue &product) { this->sqrMod(a, product); },
+                selectWords,
+                power);
+    }
+    return this->fromResidue(power);
+}
@@ -0,0 +1,173 @@
+//
+// Created by Yongzao Dan on 2022/11/15.
+//
+
+#ifndef RSA_MONTGOMERYCONTEXT_H
+#define RSA_MONTGOMERYCONTEXT_H
+
+#include <vector>
+
+#include "BigInteger.h"
+
+/**
+ * The modulus context of an odd m of L words, with fused modular arithmetic in Montgomery form:
+ * R = 2^(32 * L) and the residue of x is the L words of x * R % m.
+ *
+ * Residues stay reduced, every operation writes into a caller-owned residue and
+ * works in a per-thread scratch space, so a chain of operations allocates nothing.
+ * All the operations except powMod() run in time that depends only on L and the length of their inputs,
+ * there are neither branches on secret words nor secret-dependent memory accesses.
+ */
+class MontgomeryContext {
+
+public:
+
+    /** The L words of x * R % m, in little-endian order */
+    typedef std::vector<unsigned int> Residue;
+
+    /**
+     * The default least modulus words to run powMod() over the vector kernels, where they beat the word kernels.
+     * See PerformanceTests.testVectorCrossover, Tuning::Profile::vectorCrossoverWords takes the tuned one.
+     */
+    const static int VECTOR_CROSSOVER_WORDS = 16;
+
+private:
+
+    BigInteger modulus;
+    // The number of words in modulus
+    int length;
+    // -modulus^-1 % 2^32
+    unsigned int modulusInverse;
+    // The words of modulus, R % modulus and R^2 % modulus
+    Residue modulusWords;
+    Residue oneResidue;
+    Residue rSquaredWords;
+
+    /** The digits of a number in the radix of the vector kernels */
+    typedef std::vector<unsigned long long> Digits;
+
+    // The digits of the form that powMod() works in when the vector kernels pay off, otherwise 0.
+    // With R' = 2^(29 * digits) > 4 * modulus, x is held as x * R' % modulus, or that plus modulus.
+    int digits;
+    // -modulus^-1 % 2^29
+    unsigned long long digitInverse;
+    // The digits of modulus, R' % modulus, R'^2 * R^-1 % modulus and R % modulus
+    Digits modulusDigits;
+    Digits oneDigits;
+    Digits toDigitsFactor;
+    Digits fromDigitsFactor;
+
+    /** @return The per-thread scratch space of at least 2 * L + 2 words */
+    unsigned int *scratch() const;
+
+    /** result = t / R % modulus, where t = t[0, 2 * L) + extra * 2^(32 * L) < R * modulus */
+    void reduce(unsigned int *t, unsigned int *result) const;
+
+    /**
+     * The CIOS Montgomery multiplication, result = a * b * R^-1 % modulus.
+     *
+     * @param a Less than R
+     * @param b Less than modulus
+     * @param result May alias a or b
+     */
+    void multiply(const unsigned int *a, const unsigned int *b, unsigned int *result) const;
+
+    /** @return The per-thread scratch space of the vector kernels, at least 2 * digits + 1 */
+    unsigned long long *digitScratch() const;
+
+    /** result = a * b * R'^-1 % modulus, or that plus modulus, where a, b < 2 * modulus */
+    void multiplyDigits(const Digits &a, const Digits &b, Digits &result) const;
+
+    /** result = the digits of x * R', or that plus modulus */
+    void toDigitForm(const Residue &x, Digits &result) const;
+
+    /** result = the residue of the digits x */
+    void fromDigitForm(const Digits &x, Residue &result) const;
+
+    /** result = a^2 * R^-1 % modulus, where a < modulus, the cross products are computed once */
+    void square(const unsigned int *a, unsigned int *result) const;
+
+    /** result = (a + b) % modulus, where a, b < modulus */
+    void add(const unsigned int *a, const unsigned int *b, unsigned int *result) const;
+
+    /** result = (a - b) % modulus, where a, b < modulus */
+    void subtract(const unsigned int *a, const unsigned int *b, unsigned int *result) const;
+
+    /** Copy the words of x into L words, where x < R */
+    void toWords(const BigInteger &x, unsigned int *result) const;
+
+    /** @return The BigInteger of L words */
+    BigInteger fromWords(const unsigned int *words) const;
+
+public:
+
+    /** @param modulus An odd number greater than 1 */
+    explicit MontgomeryContext(const BigInteger &modulus);
+
+    const BigInteger &getModulus() const;
+
+    /** @return Whether powMod() runs over the vector kernels */
+    bool isVectorized() const;
+
+    /** @return The residue of x for any non-negative x, by Horner's rule over the L-word chunks of x */
+    Residue toResidue(const BigInteger &x) const;
+
+    /** @return The value of the residue x */
+    BigInteger fromResidue(const Residue &x) const;
+
+    /** @return The residue of 1 */
+    const Residue &one() const;
+
+    /** result = a * b, all of them are residues and result may alias a or b */
+    void mulMod(const Residue &a, const Residue &b, Residue &result) const;
+
+    /** result = a^2 */
+    void sqrMod(const Residue &a, Residue &result) const;
+
+    /** result = a + b */
+    void addMod(const Residue &a, const Residue &b, Residue &result) const;
+
+    /** result = a - b */
+    void subMod(const Residue &a, const Residue &b, Residue &result) const;
+
+    /** result = a / 2 */
+    void halveMod(const Residue &a, Residue &result) const;
+
+    /**
+     * Multiply a plain value by a residue with a single Montgomery multiplication,
+     * since x * (a * R) * R^-1 == x * a.
+     *
+     * @return x * a % modulus, where a is the value of the residue
+     */
+    BigInteger mulMod(const BigInteger &x, const Residue &a) const;
+
+    /** @return x % modulus */
+    BigInteger reduce(const BigInteger &x) const;
+
+    /** @return The bits of each window in powMod() for exponents of the given size, in the tuning profile */
+    static int windowBits(int exponentBits);
+
+    /** @return The bits of each window in powModConstantTime() for exponents of the given size, in the tuning profile */
+    static int constantTimeWindowBits(int exponentBits);
+
+    /**
+     * result = x^pow, by the sliding-window method over the odd powers of x.
+     * Moduli of at least the vector crossover words of the tuning profile run in the redundant radix of the vector kernels.
+     */
+    void powMod(const Residue &x, const BigInteger &pow, Residue &result) const;
+
+    /** @return x^pow % modulus */
+    BigInteger powMod(const BigInteger &x, const BigInteger &pow) const;
+
+    /**
+     * Fixed-window exponentiation over all the 32 * L bits of pow, where every lookup reads the whole table of x^i.
+     * Moduli of at least the vector crossover words of the tuning profile run over the vector kernels, which never branch on the digits.
+     *
+     * @param pow Usually less than R, a wider one runs over all of its words
+     * @return x^pow % modulus
+     */
+    BigInteger powModConstantTime(const BigInteger &x, const BigInteger &pow) const;
+};
+
+
+#endif //RSA_MONTGOMERYCONTEXT_H
@@ -0,0 +1,129 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#include "MultiBufferPowMod.h"
+#include "MontgomeryContext.h"
+#include "VectorKernels.h"
+
+void MultiBufferPowMod::scatter(const BigInteger &x, int k, int n, int lanes, LaneDigits &digits) {
+    std::vector<unsigned long long> laneDigits(n);
+    VectorKernels::toDigits(x.number, x.length, laneDigits.data(), n);
+    for (int j = 0; j < n; j++) {
+        digits[j * lanes + k] = laneDigits[j];
+    }
+}
+
+BigInteger MultiBufferPowMod::gather(const LaneDigits &digits, int k, int n, int lanes) {
+    std::vector<unsigned long long> laneDigits(n);
+    for (int j = 0; j < n; j++) {
+        laneDigits[j] = digits[j * lanes + k];
+    }
+
+    // n digits of 29 bits never take more than n words
+    auto *words = new unsigned int[n];
+    VectorKernels::fromDigits(laneDigits.data(), n, words, n);
+    int length = trimLeadingZeros(words, n);
+    return BigInteger{length ? 1 : 0, words, length};
+}
+
+void MultiBufferPowMod::powModLanes(
+        const BigInteger *x,
+        const BigInteger *pow,
+        const BigInteger *mod,
+        int count,
+        int lanes,
+        BigInteger *result) {
+
+    const VectorKernels::Kernels &kernels = VectorKernels::active();
+    int modulusBits = 0, exponentBits = 1;
+    for (int k = 0; k < count; k++) {
+        modulusBits = std::max(modulusBits, mod[k].getBitLength());
+        exponentBits = std::max(exponentBits, pow[k].getBitLength());
+    }
+
+    // Two spare bits keep R' = 2^(29 * n) > 4 * m for every lane,
+    // the spare lanes repeat the first input and their results are dropped
+    const int n = VectorKernels::digitCount(modulusBits + 2);
+    const int size = n * lanes;
+    LaneDigits m(size), mInverse(lanes), rSquared(size), base(size), one(size), power(size), entry(size);
+    LaneDigits t((2 * n + 1) * lanes);
+    const BigInteger rSquaredPower = BigInteger(1) << (2 * n * VectorKernels::DIGIT_BITS);
+    for (int k = 0; k < lanes; k++) {
+        int input = k < count ? k : 0;
+        scatter(mod[input], k, n, lanes, m);
+        mInverse[k] = VectorKernels::inverseDigit(mod[input].number[0]);
+        scatter(rSquaredPower % mod[input], k, n, lanes, rSquared);
+        scatter(x[input] % mod[input], k, n, lanes, base);
+        one[k] = 1;
+    }
+    auto multiply = [&](const LaneDigits &a, const LaneDigits &b, LaneDigits &product) {
+        kernels.laneMontgomeryMultiply(a.data(), b.data(), m.data(), mInverse.data(), n, lanes, t.data(), product.data());
+    };
+
+    // To the form x * R' % m, where 1 becomes R' % m
+    multiply(base, rSquared, base);
+    multiply(one, rSquared, entry);
+
+    // The table of x^i, i in [0, 2^w), where the window is one bit smaller than the one of
+    // MontgomeryContext::powModConstantTime() over the vector kernels for the same reason
+    const int window = std::max(MontgomeryContext::constantTimeWindowBits(exponentBits) - 1, 1);
+    const int tableSize = 1 << window;
+    std::vector<unsigned long long> table((size_t) tableSize * size);
+    for (int i = 0; i < tableSize; i++) {
+        std::copy(entry.begin(), entry.end(), table.begin() + (size_t) i * size);
+        multiply(entry, base, entry);
+    }
+
+    // The windows of each exponent, where the offsets are public
+    std::vector<unsigned int> indices(lanes);
+    auto windowAt = [&](int offset, int bits) {
+        for (int k = 0; k < lanes; k++) {
+            const BigInteger &exponent = pow[k < count ? k : 0];
+            unsigned int value = 0;
+            for (int i = offset + bits - 1; i >= offset; i--) {
+                value = (value << 1) | (unsigned int) exponent.testBit(i);
+            }
+            indices[k] = value;
+        }
+        return indices.data();
+    };
+
+    int topBits = exponentBits % window ? exponentBits % window : window;
+    int offset = exponentBits - topBits;
+    kernels.laneSelect(table.data(), tableSize, n, lanes, windowAt(offset, topBits), power.data());
+    while (offset > 0) {
+        offset -= window;
+        for (int i = 0; i < window; i++) {
+            multiply(power, power, power);
+        }
+        kernels.laneSelect(table.data(), tableSize, n, lanes, windowAt(offset, window), entry.data());
+        multiply(power, entry, power);
+    }
+
+    // Out of the form by multiplying 1, which leaves a value no more than m
+    std::fill(one.begin(), one.end(), 0);
+    std::fill(one.begin(), one.begin() + lanes, 1);
+    multiply(power, one, power);
+    for (int k = 0; k < count; k++) {
+        result[k] = gather(power, k, n, lanes);
+        if (result[k].compareAbsolute(mod[k]) >= 0) {
+            result[k] = result[k] - mod[k];
+        }
+    }
+}
+
+void MultiBufferPowMod::powMod(
+        const BigInteger *x,
+        const BigInteger *pow,
+        const BigInteger *mod,
+        int count,
+        BigInteger *result,
+        int lanes) {
+
+    lanes = lanes > LANES ? MAX_LANES : LANES;
+    for (int start = 0; start < count; start += lanes) {
+        int group = std::min(lanes, count - start);
+        powModLanes(x + start, pow + start, mod + start, group, lanes, result + start);
+    }
+}
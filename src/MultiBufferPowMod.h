@@ -0,0 +1,67 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#ifndef RSA_MULTIBUFFERPOWMOD_H
+#define RSA_MULTIBUFFERPOWMOD_H
+
+#include <vector>
+
+#include "BigInteger.h"
+
+/**
+ * Multi-buffer modular exponentiation: up to 8 independent x_k^pow_k % m_k in lock-step,
+ * one exponentiation per lane of the lane kernels in VectorKernels.
+ *
+ * All the lanes run the same fixed-window schedule over the longest exponent, with the digits of the
+ * longest modulus, so the lanes should have the moduli and exponents of about the same size.
+ * Like MontgomeryContext::powModConstantTime(), the schedule and the memory accesses depend on
+ * those sizes only, not on the values.
+ */
+class MultiBufferPowMod {
+
+public:
+
+    // The lanes of an exponentiation
+    const static int LANES = 4;
+    const static int MAX_LANES = 8;
+
+private:
+
+    /** The digits of all lanes, where the digit j of lane k is at [j * lanes + k] */
+    typedef std::vector<unsigned long long> LaneDigits;
+
+    /** Write the words of x into lane k of digits, which has n digits per lane */
+    static void scatter(const BigInteger &x, int k, int n, int lanes, LaneDigits &digits);
+
+    /** @return The value of lane k of the n normalized digits per lane */
+    static BigInteger gather(const LaneDigits &digits, int k, int n, int lanes);
+
+    /** The lock-step exponentiation of count <= lanes inputs */
+    static void powModLanes(
+            const BigInteger *x,
+            const BigInteger *pow,
+            const BigInteger *mod,
+            int count,
+            int lanes,
+            BigInteger *result);
+
+public:
+
+    /**
+     * result[i] = x[i]^pow[i] % mod[i] for i in [0, count), lanes of them at a time.
+     *
+     * @param mod Odd numbers greater than 1
+     * @param lanes 4 or 8, 8 interleaves two vectors of lanes to hide the latency of each
+     */
+    static void powMod(
+            const BigInteger *x,
+            const BigInteger *pow,
+            const BigInteger *mod,
+            int count,
+            BigInteger *result,
+            int lanes = LANES);
+};
+
+
+#endif //RSA_MULTIBUFFERPOWMOD_H
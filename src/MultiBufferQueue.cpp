@@ -0,0 +1,90 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#include <memory>
+
+#include "MultiBufferQueue.h"
+#include "VectorKernels.h"
+
+// The residues of a private request, recombined by the part that completes last
+struct PrivateRequest {
+    const RSAPrivateKey *key;
+    std::vector<BigInteger> residues;
+    int remaining;
+    MultiBufferQueue::Callback callback;
+};
+
+MultiBufferQueue::MultiBufferQueue(const int lanes) : lanes(lanes > MultiBufferPowMod::LANES ?
+                                                            MultiBufferPowMod::MAX_LANES :
+                                                            MultiBufferPowMod::LANES) {
+
+}
+
+void MultiBufferQueue::run(std::vector<Request> &requests) {
+    int count = (int) requests.size();
+    std::vector<BigInteger> x(count), pow(count), mod(count), result(count);
+    for (int i = 0; i < count; i++) {
+        x[i] = requests[i].x;
+        pow[i] = requests[i].pow;
+        mod[i] = requests[i].mod;
+    }
+    MultiBufferPowMod::powMod(x.data(), pow.data(), mod.data(), count, result.data(), this->lanes);
+
+    // The callbacks may push again, so take the requests out of the bucket first
+    std::vector<Request> completed;
+    completed.swap(requests);
+    for (int i = 0; i < count; i++) {
+        completed[i].callback(result[i]);
+    }
+}
+
+void MultiBufferQueue::push(const BigInteger &x, const BigInteger &pow, const BigInteger &mod, Callback callback) {
+    BucketKey key{VectorKernels::digitCount(mod.getBitLength() + 2), VectorKernels::digitCount(pow.getBitLength())};
+    std::vector<Request> &bucket = this->buckets[key];
+    bucket.push_back(Request{x, pow, mod, std::move(callback)});
+    if ((int) bucket.size() == this->lanes) {
+        this->run(bucket);
+    }
+}
+
+void MultiBufferQueue::pushPrivate(const RSAPrivateKey &key, const BigInteger &x, Callback callback) {
+    if (key.getPrimeCount() == 0) {
+        this->push(x, key.getD(), key.getN(), std::move(callback));
+        return;
+    }
+
+    int primeCount = key.getPrimeCount();
+    auto request = std::make_shared<PrivateRequest>();
+    request->key = &key;
+    request->residues.resize(primeCount);
+    request->remaining = primeCount;
+    request->callback = std::move(callback);
+    for (int i = 0; i < primeCount; i++) {
+        this->push(x, key.getExponents()[i], key.getPrimes()[i], [request, i](const BigInteger &residue) {
+            request->residues[i] = residue;
+            if (--request->remaining == 0) {
+                request->callback(request->key->recombine(request->residues));
+            }
+        });
+    }
+}
+
+void MultiBufferQueue::flush() {
+    // Until the callbacks stop pushing new requests
+    while (this->pending() > 0) {
+        for (auto &bucket : this->buckets) {
+            if (!bucket.second.empty()) {
+                this->run(bucket.second);
+            }
+        }
+    }
+}
+
+int MultiBufferQueue::pending() const {
+    int count = 0;
+    for (const auto &bucket : this->buckets) {
+        count += (int) bucket.second.size();
+    }
+    return count;
+}
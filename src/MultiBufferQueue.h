@@ -0,0 +1,70 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#ifndef RSA_MULTIBUFFERQUEUE_H
+#define RSA_MULTIBUFFERQUEUE_H
+
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "BigInteger.h"
+#include "MultiBufferPowMod.h"
+#include "RSAPrivateKey.h"
+
+/**
+ * Gathers independent exponentiations into full lanes of MultiBufferPowMod.
+ *
+ * The requests are bucketed by the digits of their moduli and exponents, a bucket runs as soon as
+ * it fills the lanes, and flush() runs the buckets left partial. The callbacks run on the thread
+ * that calls push() or flush(), in the order the buckets complete.
+ */
+class MultiBufferQueue {
+
+public:
+
+    typedef std::function<void(const BigInteger &)> Callback;
+
+private:
+
+    struct Request {
+        BigInteger x;
+        BigInteger pow;
+        BigInteger mod;
+        Callback callback;
+    };
+
+    // (digits of the modulus, digits of the exponent) to the requests waiting for lanes
+    typedef std::pair<int, int> BucketKey;
+
+    int lanes;
+    std::map<BucketKey, std::vector<Request>> buckets;
+
+    /** Run the requests of a bucket and hand the results to their callbacks */
+    void run(std::vector<Request> &requests);
+
+public:
+
+    /** @param lanes 4 or 8, as in MultiBufferPowMod::powMod() */
+    explicit MultiBufferQueue(int lanes = MultiBufferPowMod::LANES);
+
+    /** Queue x^pow % mod, where mod is odd */
+    void push(const BigInteger &x, const BigInteger &pow, const BigInteger &mod, Callback callback);
+
+    /**
+     * Queue x^d % n as the exponentiations modulo each prime of the key, the callback gets
+     * the recombined value once the last of them completes. The key must outlive the request.
+     */
+    void pushPrivate(const RSAPrivateKey &key, const BigInteger &x, Callback callback);
+
+    /** Run all the queued requests, with spare lanes for the partial buckets */
+    void flush();
+
+    /** @return The number of queued exponentiations */
+    int pending() const;
+};
+
+
+#endif //RSA_MULTIBUFFERQUEUE_H
@@ -0,0 +1,223 @@
+//
+// Created by Yongzao Dan on 2022/11/14.
+//
+
+#include <atomic>
+#include <unordered_map>
+
+#include "RSAPrivateKey.h"
+
+// The per-thread blinding state of a key, in residues of n
+struct BlindingPair {
+    // r^(e * 2^k) % n
+    MontgomeryContext::Residue blind;
+    // r^(-2^k) % n
+    MontgomeryContext::Residue unblind;
+    int uses;
+};
+
+static std::atomic<unsigned long long> nextBlindingId(0);
+
+// Pairs of keys that were destroyed stay in the cache, so drop all of them beyond this size
+static const size_t BLINDING_CACHE_CAPACITY = 64;
+
+const int RSAPrivateKey::BLINDING_REFRESH_LIMIT = 32;
+
+RSAPrivateKey::RSAPrivateKey() : blindingId(nextBlindingId++) {
+
+}
+
+RSAPrivateKey::RSAPrivateKey(const BigInteger &n, const BigInteger &d) : n(n), d(d), blindingId(nextBlindingId++) {
+    this->buildContexts();
+}
+
+RSAPrivateKey::RSAPrivateKey(
+        const BigInteger &e,
+        const BigInteger &d,
+        const std::vector<BigInteger> &primes) : e(e), d(d), primes(primes), blindingId(nextBlindingId++) {
+
+    this->n = BigInteger(1);
+    for (const BigInteger &prime : primes) {
+        // t_i = (r_1 * ... * r_(i-1))^-1 % r_i, and t_1 is unused
+        this->coefficients.push_back(this->exponents.empty() ?
+                                     BigInteger() :
+                                     (this->n % prime).multiplicativeInverse(prime));
+        this->exponents.push_back(d % (prime - 1));
+        this->n = this->n * prime;
+    }
+    this->buildContexts();
+}
+
+void RSAPrivateKey::buildContexts() {
+    this->contexts.clear();
+    this->fixedContexts.clear();
+    for (const BigInteger &prime : this->primes) {
+        this->contexts.emplace_back(prime);
+        this->fixedContexts.push_back(FixedPowMod::create(prime));
+    }
+    this->contexts.emplace_back(this->n);
+    this->fixedContexts.push_back(nullptr);
+}
+
+BigInteger RSAPrivateKey::powMod(const int i, const BigInteger &x, const BigInteger &pow) const {
+    if (this->fixedContexts[i]) {
+        return this->fixedContexts[i]->powMod(x, pow);
+    }
+    const MontgomeryContext &context = this->contexts[i];
+    return this->powMode == CONSTANT_TIME ? context.powModConstantTime(x, pow) : context.powMod(x, pow);
+}
+
+BigInteger RSAPrivateKey::privatePowMod(const BigInteger &x) const {
+    if (this->primes.empty()) {
+        return this->powMod((int) this->primes.size(), x, this->d);
+    }
+
+    std::vector<BigInteger> residues;
+    for (int i = 0; i < (int) this->primes.size(); i++) {
+        residues.push_back(this->powMod(i, x, this->exponents[i]));
+    }
+    return this->recombine(residues);
+}
+
+BigInteger RSAPrivateKey::recombine(const std::vector<BigInteger> &residues) const {
+    // Implementation of RSADP in RFC 8017 section 5.1.2, 2.b
+    BigInteger m = residues[0];
+    BigInteger product = this->primes[0];
+    for (int i = 1; i < (int) this->primes.size(); i++) {
+        const MontgomeryContext &context = this->contexts[i];
+
+        // h = (m_i - m) * t_i % r_i, then m = m + R * h
+        MontgomeryContext::Residue difference = context.toResidue(residues[i]);
+        context.subMod(difference, context.toResidue(m), difference);
+        BigInteger h = context.mulMod(this->coefficients[i], difference);
+        m = m + product * h;
+        product = product * this->primes[i];
+    }
+    return m;
+}
+
+void RSAPrivateKey::setPowMode(const PowMode mode) {
+    this->powMode = mode;
+}
+
+RSAPrivateKey::PowMode RSAPrivateKey::getPowMode() const {
+    return this->powMode;
+}
+
+BigInteger RSAPrivateKey::blindedPowMod(const BigInteger &x) const {
+    if (this->e.compareAbsolute(0u) == 0) {
+        return this->privatePowMod(x);
+    }
+
+    // One multiplication each to blind and unblind
+    MontgomeryContext::Residue unblinder;
+    return this->unblind(this->privatePowMod(this->blind(x, unblinder)), unblinder);
+}
+
+BigInteger RSAPrivateKey::blind(const BigInteger &x, MontgomeryContext::Residue &unblinder) const {
+    const MontgomeryContext &context = this->contexts.back();
+    if (this->e.compareAbsolute(0u) == 0) {
+        unblinder = context.toResidue(BigInteger(1u));
+        return x;
+    }
+
+    static thread_local std::unordered_map<unsigned long long, BlindingPair> blindingCache;
+    auto iter = blindingCache.find(this->blindingId);
+    if (iter == blindingCache.end() || iter->second.uses >= BLINDING_REFRESH_LIMIT) {
+        if (blindingCache.size() >= BLINDING_CACHE_CAPACITY) {
+            blindingCache.clear();
+        }
+
+        // r < n is a unit unless it reveals a prime factor of n, which is negligible
+        BigInteger r = BigInteger::randomBigInteger(this->n.getBitLength() - 1);
+        BlindingPair &pair = blindingCache[this->blindingId];
+        context.powMod(context.toResidue(r), this->e, pair.blind);
+        pair.unblind = context.toResidue(r.multiplicativeInverse(this->n));
+        pair.uses = 0;
+        iter = blindingCache.find(this->blindingId);
+    }
+
+    BlindingPair &pair = iter->second;
+    BigInteger blinded = context.mulMod(x, pair.blind);
+    unblinder = pair.unblind;
+
+    // (r^2)^e and (r^2)^-1 make the next pair
+    context.sqrMod(pair.blind, pair.blind);
+    context.sqrMod(pair.unblind, pair.unblind);
+    pair.uses++;
+    return blinded;
+}
+
+BigInteger RSAPrivateKey::unblind(const BigInteger &y, const MontgomeryContext::Residue &unblinder) const {
+    return this->contexts.back().mulMod(y, unblinder);
+}
+
+int RSAPrivateKey::getPrimeCount() const {
+    return (int) this->primes.size();
+}
+
+const BigInteger &RSAPrivateKey::getN() const {
+    return this->n;
+}
+
+const BigInteger &RSAPrivateKey::getE() const {
+    return this->e;
+}
+
+const BigInteger &RSAPrivateKey::getD() const {
+    return this->d;
+}
+
+const std::vector<BigInteger> &RSAPrivateKey::getPrimes() const {
+    return this->primes;
+}
+
+const std::vector<BigInteger> &RSAPrivateKey::getExponents() const {
+    return this->exponents;
+}
+
+void RSAPrivateKey::write(std::ostream &out) const {
+    this->n.write(out);
+    this->d.write(out);
+    if (this->primes.empty()) {
+        return;
+    }
+
+    this->e.write(out);
+    out << this->primes.size() << std::endl;
+    for (int i = 0; i < (int) this->primes.size(); i++) {
+        this->primes[i].write(out);
+        this->exponents[i].write(out);
+        this->coefficients[i].write(out);
+    }
+}
+
+RSAPrivateKey RSAPrivateKey::read(std::istream &in) {
+    BigInteger n = BigInteger(HEXADECIMAL_RADIX, readString(in));
+    BigInteger d = BigInteger(HEXADECIMAL_RADIX, readString(in));
+
+    // A legacy key file ends here
+    std::string eString = readString(in);
+    if (eString.empty()) {
+        return RSAPrivateKey{n, d};
+    }
+
+    RSAPrivateKey key;
+    key.n = n;
+    key.d = d;
+    key.e = BigInteger(HEXADECIMAL_RADIX, eString);
+    int primeCount = readInt(in);
+    for (int i = 0; i < primeCount; i++) {
+        key.primes.emplace_back(HEXADECIMAL_RADIX, readString(in));
+        key.exponents.emplace_back(HEXADECIMAL_RADIX, readString(in));
+        key.coefficients.emplace_back(HEXADECIMAL_RADIX, readString(in));
+        // The exponentiations modulo the prime assume both are reduced
+        if (key.exponents[i].compareAbsolute(key.primes[i]) >= 0 ||
+            key.coefficients[i].compareAbsolute(key.primes[i]) >= 0) {
+            in.setstate(std::ios::failbit);
+            return RSAPrivateKey{};
+        }
+    }
+    key.buildContexts();
+    return key;
+}
@@ -0,0 +1,145 @@
+//
+// Created by Yongzao Dan on 2022/11/14.
+//
+
+#ifndef RSA_RSAPRIVATEKEY_H
+#define RSA_RSAPRIVATEKEY_H
+
+#include <vector>
+
+#include "utils.h"
+#include "BigInteger.h"
+#include "MontgomeryContext.h"
+#include "FixedBigInteger.h"
+
+/**
+ * The RSA private key, with the optional multi-prime CRT parameters of RFC 8017:
+ *      n = r_1 * r_2 * ... * r_u,
+ *      d_i = d % (r_i - 1),
+ *      t_i = (r_1 * ... * r_(i-1))^-1 % r_i for i > 1.
+ */
+class RSAPrivateKey {
+
+public:
+
+    /** How the private exponentiations are computed */
+    enum PowMode {
+        // MontgomeryContext::powMod(), the exponent bits decide the branches
+        VARIABLE_TIME,
+        // MontgomeryContext::powModConstantTime()
+        CONSTANT_TIME
+    };
+
+private:
+
+    BigInteger n;
+    BigInteger e;
+    BigInteger d;
+
+    // The CRT parameters, all of them are empty when the prime factors are unknown
+    std::vector<BigInteger> primes;
+    std::vector<BigInteger> exponents;
+    std::vector<BigInteger> coefficients;
+
+    PowMode powMode = VARIABLE_TIME;
+    // The contexts of r_1, ..., r_u followed by the context of n, empty for an empty key
+    std::vector<MontgomeryContext> contexts;
+    // The fixed-width exponentiations modulo the primes that fit one, nullptr for the others
+    std::vector<std::shared_ptr<const FixedPowMod>> fixedContexts;
+
+    /** Build the contexts once n and the primes are known */
+    void buildContexts();
+
+    /**
+     * @return x^pow % the i-th modulus of contexts, in the selected PowMode.
+     *         The fixed-width exponentiation is constant-time and faster in both modes when the modulus fits it.
+     */
+    BigInteger powMod(int i, const BigInteger &x, const BigInteger &pow) const;
+
+    // Identifies the key in the per-thread blinding caches, copies of a key share the same id
+    unsigned long long blindingId;
+
+    // The cached blinding pair is regenerated from a fresh r after this many operations
+    static const int BLINDING_REFRESH_LIMIT;
+
+public:
+
+    /** Default constructor, an empty key */
+    RSAPrivateKey();
+
+    /** Construct a key without CRT parameters, the private operation is a plain x^d % n */
+    RSAPrivateKey(const BigInteger &n, const BigInteger &d);
+
+    /** Construct a key and derive the CRT parameters from the prime factors of n */
+    RSAPrivateKey(const BigInteger &e, const BigInteger &d, const std::vector<BigInteger> &primes);
+
+    /**
+     * @return x^d % n, by recombining x^d_i % r_i with Garner's algorithm if the primes are known,
+     *         in the selected PowMode
+     */
+    BigInteger privatePowMod(const BigInteger &x) const;
+
+    /**
+     * Garner's algorithm over the prime factors, which must be known.
+     *
+     * @param residues x^d_i % r_i for i in [1, u]
+     * @return x^d % n
+     */
+    BigInteger recombine(const std::vector<BigInteger> &residues) const;
+
+    /** Select the mode of privatePowMod(), VARIABLE_TIME by default */
+    void setPowMode(PowMode mode);
+
+    PowMode getPowMode() const;
+
+    /**
+     * Base blinding with a per-thread cached pair (A, B) = (r^e % n, r^-1 % n):
+     *      return (x * A)^d * B % n, then A = A^2 % n and B = B^2 % n for the next call.
+     * A fresh random r is only drawn when a thread first uses the key or the pair is worn out.
+     *
+     * @return x^d % n, unblinded if e is unknown
+     */
+    BigInteger blindedPowMod(const BigInteger &x) const;
+
+    /**
+     * The blinding of blindedPowMod() for a private operation run elsewhere, e.g. in MultiBufferQueue:
+     * y = unblind(privatePowMod(blind(x, unblinder)), unblinder) is x^d % n. Each call takes the next pair
+     * of the calling thread, and the unblinder may be used on any thread.
+     *
+     * @return x * A % n, or x if e is unknown
+     */
+    BigInteger blind(const BigInteger &x, MontgomeryContext::Residue &unblinder) const;
+
+    /** @return y * B % n for the unblinder of blind() */
+    BigInteger unblind(const BigInteger &y, const MontgomeryContext::Residue &unblinder) const;
+
+    /** @return The number of prime factors, 0 if they are unknown */
+    int getPrimeCount() const;
+
+    const BigInteger &getN() const;
+
+    const BigInteger &getE() const;
+
+    const BigInteger &getD() const;
+
+    /** @return The prime factors r_1, ..., r_u, empty if they are unknown */
+    const std::vector<BigInteger> &getPrimes() const;
+
+    /** @return The CRT exponents d_1, ..., d_u, empty if the primes are unknown */
+    const std::vector<BigInteger> &getExponents() const;
+
+    /**
+     * Write the key in hexadecimal, one number per line:
+     *      n, d, then e, u and the triples (r_i, d_i, t_i) if the primes are known, where t_1 is 0.
+     */
+    void write(std::ostream &out) const;
+
+    /**
+     * Read a key written by write(), or a legacy key file with n and d only.
+     * A CRT exponent or coefficient not below its prime sets the failbit of in and reads an empty key.
+     */
+    static RSAPrivateKey read(std::istream &in);
+};
+
+
+#endif //RSA_RSAPRIVATEKEY_H
@@ -0,0 +1,262 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "RequestStream.h"
+#include "Commands.h"
+#include "WorkerPool.h"
+
+/** @return Whether s is a non-empty hexadecimal number */
+static bool isHexadecimal(const std::string &s) {
+    return !s.empty() && s.find_first_not_of("0123456789abcdefABCDEF") == std::string::npos;
+}
+
+const size_t RequestStream::MAX_PAYLOAD_BYTES;
+
+RequestStream::RequestStream(const int threads, const Framing framing) :
+        threads(threads > 0 ? threads : (int) std::max(1u, std::thread::hardware_concurrency())),
+        framing(framing) {
+}
+
+bool RequestStream::read(std::istream &in, Request &request, std::string &error) {
+    std::string line;
+    if (!std::getline(in, line)) {
+        return false;
+    }
+    if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+    }
+
+    // The operation and the key file are the first two fields, the rest is the payload or its length
+    size_t first = line.find(' ');
+    size_t second = first == std::string::npos ? std::string::npos : line.find(' ', first + 1);
+    request.operation = line.substr(0, first);
+    std::string keyFile = first == std::string::npos ? "" : line.substr(first + 1, second - first - 1);
+    request.payload = second == std::string::npos ? "" : line.substr(second + 1);
+
+    if (this->framing == LENGTH_PREFIXED) {
+        char *end = nullptr;
+        errno = 0;
+        long long length = std::strtoll(request.payload.c_str(), &end, 10);
+        if (request.payload.empty() || *end != '\0' || errno == ERANGE ||
+            length < 0 || length > (long long) MAX_PAYLOAD_BYTES) {
+            // Without the length the rest of the stream can't be framed, so it is dropped
+            error = "malformed length";
+            in.setstate(std::ios::failbit);
+            return true;
+        }
+        request.payload.assign((size_t) length, '\0');
+        if (length > 0 && !in.read(&request.payload[0], length)) {
+            error = "truncated payload";
+            return true;
+        }
+    }
+
+    if (!this->resolve(keyFile, request, error)) {
+        return true;
+    }
+    error.clear();
+    return true;
+}
+
+bool RequestStream::resolve(const std::string &keyFile, Request &request, std::string &error) {
+    request.privateKey = nullptr;
+    request.publicContext = nullptr;
+    request.publicExponent = nullptr;
+
+    if (request.operation == "sign" || request.operation == "decrypt") {
+        auto cached = this->privateKeys.find(keyFile);
+        if (cached == this->privateKeys.end()) {
+            RSAPrivateKey key;
+            if (!Commands::readPrivateKey(keyFile, key)) {
+                error = "can't read the private key " + keyFile;
+                return false;
+            }
+            cached = this->privateKeys.emplace(keyFile, std::unique_ptr<RSAPrivateKey>(new RSAPrivateKey(key))).first;
+        }
+        request.privateKey = cached->second.get();
+        return true;
+    }
+
+    if (request.operation == "verify" || request.operation == "encrypt") {
+        auto cached = this->publicKeys.find(keyFile);
+        if (cached == this->publicKeys.end()) {
+            BigInteger n, e;
+            if (!Commands::readPublicKey(keyFile, n, e)) {
+                error = "can't read the public key " + keyFile;
+                return false;
+            }
+            cached = this->publicKeys.emplace(keyFile, std::unique_ptr<PublicKey>(
+                    new PublicKey{e, MontgomeryContext(n)})).first;
+        }
+        request.publicContext = &cached->second->context;
+        request.publicExponent = &cached->second->e;
+        return true;
+    }
+
+    error = "unknown operation " + request.operation;
+    return false;
+}
+
+bool RequestStream::execute(const Request &request, std::string &result) {
+    if (request.operation == "sign") {
+        result = BigInteger::signSignature(BKDRHash(request.payload), *request.privateKey).toString(HEXADECIMAL_RADIX);
+        return true;
+    }
+
+    if (request.operation == "verify") {
+        size_t space = request.payload.find(' ');
+        std::string signature = request.payload.substr(0, space);
+        if (space == std::string::npos || !isHexadecimal(signature)) {
+            result = "malformed signature";
+            return false;
+        }
+        std::string message = request.payload.substr(space + 1);
+        // Only a signature in (0, n) may verify, 0 would match the empty message
+        BigInteger value(HEXADECIMAL_RADIX, signature);
+        bool verified = !value.isZero() && value.compareAbsolute(request.publicContext->getModulus()) < 0 &&
+                        BigInteger::decryptSignature(value, *request.publicExponent, *request.publicContext) ==
+                        BKDRHash(message);
+        result = verified ? "verified" : "failed";
+        return true;
+    }
+
+    if (request.operation == "encrypt") {
+        BigInteger *ciphertext = nullptr;
+        int ciphertextLength = request.payload.empty() ? 0 : BigInteger::encryptPlaintext(
+                request.payload, ciphertext, *request.publicExponent, *request.publicContext);
+        result = std::to_string(request.payload.length()) + " " + std::to_string(ciphertextLength);
+        for (int i = 0; i < ciphertextLength; i++) {
+            result += " " + ciphertext[i].toString(HEXADECIMAL_RADIX);
+        }
+        delete[] ciphertext;
+        return true;
+    }
+
+    // decrypt
+    int plaintextLength;
+    std::vector<BigInteger> ciphertext;
+    if (!parseCiphertext(request.payload, plaintextLength, ciphertext)) {
+        result = "malformed ciphertext";
+        return false;
+    }
+    result = BigInteger::decryptCiphertext(plaintextLength, ciphertext.data(), (int) ciphertext.size(),
+                                           *request.privateKey);
+    return true;
+}
+
+bool RequestStream::parseCiphertext(
+        const std::string &payload,
+        int &plaintextLength,
+        std::vector<BigInteger> &ciphertext) {
+
+    std::istringstream in(payload);
+    int ciphertextLength = -1;
+    plaintextLength = -1;
+    in >> plaintextLength >> ciphertextLength;
+    ciphertext.clear();
+    for (int i = 0; in && i < ciphertextLength; i++) {
+        std::string block = readString(in);
+        if (!isHexadecimal(block)) {
+            break;
+        }
+        ciphertext.emplace_back(HEXADECIMAL_RADIX, block);
+    }
+    return plaintextLength >= 0 && ciphertextLength >= 0 && (int) ciphertext.size() == ciphertextLength;
+}
+
+void RequestStream::write(std::ostream &out, const bool ok, const std::string &result) const {
+    const char *status = ok ? "ok" : "error";
+    if (this->framing == LENGTH_PREFIXED) {
+        out << status << " " << result.length() << "\n" << result;
+    } else {
+        out << status << " " << result << "\n";
+    }
+}
+
+int RequestStream::serve(std::istream &in, std::ostream &out) {
+    // The responses in the order of the requests, a malformed request has no task
+    struct Slot {
+        std::shared_ptr<WorkerPool::Task> task;
+        bool ok;
+        std::string result;
+    };
+
+    WorkerPool pool(this->threads - 1);
+    const size_t window = (size_t) this->threads * WINDOW_PER_THREAD;
+    std::deque<std::shared_ptr<Slot>> slots;
+    std::mutex lock;
+    std::condition_variable changed;
+    bool finished = false;
+    int failures = 0;
+
+    // The writer waits for the oldest request, and runs the queued ones meanwhile as a thread of the pool
+    std::thread writer([&]() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            changed.wait(guard, [&]() { return finished || !slots.empty(); });
+            if (slots.empty()) {
+                break;
+            }
+            std::shared_ptr<Slot> slot = slots.front();
+            guard.unlock();
+
+            if (slot->task) {
+                pool.wait(slot->task);
+                slot->task.reset();
+            }
+            this->write(out, slot->ok, slot->result);
+            failures += slot->ok ? 0 : 1;
+
+            guard.lock();
+            slots.pop_front();
+            changed.notify_all();
+            if (slots.empty()) {
+                // Caught up with the reader, the client may be waiting for these responses
+                guard.unlock();
+                out.flush();
+                guard.lock();
+            }
+        }
+    });
+
+    while (true) {
+        std::shared_ptr<Slot> slot = std::make_shared<Slot>();
+        Request request;
+        std::string error;
+        if (!this->read(in, request, error)) {
+            break;
+        }
+
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [&]() { return slots.size() < window; });
+        if (error.empty()) {
+            // The slot stays in slots until the writer is done with it, and must not own its own task
+            Slot *pending = slot.get();
+            slot->task = pool.submit([pending, request]() {
+                pending->ok = execute(request, pending->result);
+            });
+        } else {
+            slot->ok = false;
+            slot->result = error;
+        }
+        slots.push_back(slot);
+        changed.notify_all();
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        finished = true;
+    }
+    changed.notify_all();
+    writer.join();
+    out.flush();
+    return failures;
+}
@@ -0,0 +1,120 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#ifndef RSA_REQUESTSTREAM_H
+#define RSA_REQUESTSTREAM_H
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BigInteger.h"
+#include "MontgomeryContext.h"
+#include "RSAPrivateKey.h"
+
+/**
+ * Serves a stream of requests in one process, for the pipelines that would otherwise spawn a process per message.
+ *
+ * Each request names an operation, a key file and a payload:
+ *      sign <private key file> <message>               -> the hexadecimal signature of the message
+ *      verify <public key file> <signature> <message>  -> "verified" or "failed"
+ *      encrypt <public key file> <plaintext>           -> the ciphertext: length, blocks and the hexadecimal blocks
+ *      decrypt <private key file> <ciphertext>         -> the plaintext
+ * The ciphertexts are separated by whitespaces, the same as in the ciphertext files. A key file is read once
+ * on its first request and cached, the requests are run over a WorkerPool, and the responses are written in the
+ * order of the requests, "ok <result>" or "error <message>".
+ *
+ * LINES framing takes a request per line, where the payload is the rest of the line, and writes a response per
+ * line, so the messages and plaintexts must not hold line breaks. LENGTH_PREFIXED framing takes a line of
+ * "<operation> <key file> <payload bytes>" followed by the payload, and writes a line of "ok|error <result bytes>"
+ * followed by the result, for any bytes.
+ */
+class RequestStream {
+
+public:
+
+    enum Framing {
+        LINES,
+        LENGTH_PREFIXED
+    };
+
+    // The requests in flight for each thread, so the workers never wait for the reader
+    const static int WINDOW_PER_THREAD = 4;
+
+    // The largest length-prefixed payload taken, a longer one ends the stream
+    const static size_t MAX_PAYLOAD_BYTES = 1 << 24;
+
+    /** A request parsed on the reading thread, with its key resolved, to be run on a worker */
+    struct Request {
+        std::string operation;
+        std::string payload;
+        const RSAPrivateKey *privateKey;
+        const MontgomeryContext *publicContext;
+        const BigInteger *publicExponent;
+    };
+
+private:
+
+    struct PublicKey {
+        BigInteger e;
+        MontgomeryContext context;
+    };
+
+    const int threads;
+    const Framing framing;
+
+    // The keys by their file, read on first use and never released
+    std::map<std::string, std::unique_ptr<PublicKey>> publicKeys;
+    std::map<std::string, std::unique_ptr<RSAPrivateKey>> privateKeys;
+
+    /**
+     * Read the next request of in.
+     *
+     * @return False at the end of in, otherwise request is filled or error holds why it is malformed
+     */
+    bool read(std::istream &in, Request &request, std::string &error);
+
+    /** Write a response in the framing */
+    void write(std::ostream &out, bool ok, const std::string &result) const;
+
+public:
+
+    /**
+     * @param threads The threads running the requests, one per core for 0
+     */
+    RequestStream(int threads, Framing framing);
+
+    /**
+     * Resolve the key of request from the cache, reading the key file on its first use.
+     *
+     * @return False if the operation is unknown or the key file can't be read
+     */
+    bool resolve(const std::string &keyFile, Request &request, std::string &error);
+
+    /**
+     * Parse a ciphertext payload, the plaintext length, the number of blocks and the hexadecimal blocks.
+     *
+     * @return False if it is malformed or truncated
+     */
+    static bool parseCiphertext(const std::string &payload, int &plaintextLength, std::vector<BigInteger> &ciphertext);
+
+    /**
+     * Run a resolved request, safe to call from any thread.
+     *
+     * @return False if the payload is malformed, then result holds why
+     */
+    static bool execute(const Request &request, std::string &result);
+
+    /**
+     * Serve the requests of in until its end, and flush out whenever every response so far is written.
+     *
+     * @return The number of the failed requests
+     */
+    int serve(std::istream &in, std::ostream &out);
+};
+
+
+#endif //RSA_REQUESTSTREAM_H
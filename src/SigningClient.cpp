@@ -0,0 +1,39 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#include <cstdlib>
+
+#include "SigningClient.h"
+
+bool SigningClient::connect(const std::string &path) {
+    return this->socket.connect(path);
+}
+
+bool SigningClient::request(
+        const std::string &operation,
+        const std::string &keyName,
+        const std::string &payload,
+        bool &ok,
+        std::string &result) {
+
+    // One write for the header and the payload, the daemon reads both before it answers
+    std::string frame = operation + " " + keyName + " " + std::to_string(payload.length()) + "\n" + payload;
+    std::string header;
+    if (!this->socket.write(frame) || !this->socket.readLine(header)) {
+        return false;
+    }
+
+    // "ok|error <bytes>"
+    size_t space = header.find(' ');
+    if (space == std::string::npos) {
+        return false;
+    }
+    char *end = nullptr;
+    long long length = std::strtoll(header.c_str() + space + 1, &end, 10);
+    if (*end != '\0' || length < 0) {
+        return false;
+    }
+    ok = header.compare(0, space, "ok") == 0;
+    return this->socket.read((size_t) length, result);
+}
@@ -0,0 +1,40 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#ifndef RSA_SIGNINGCLIENT_H
+#define RSA_SIGNINGCLIENT_H
+
+#include <string>
+
+#include "UnixSocket.h"
+
+/**
+ * A connection to a SigningDaemon, which runs one request at a time.
+ *
+ * The requests of several clients in flight at once are the ones the daemon batches, so a process
+ * with concurrent requests opens a client per thread.
+ */
+class SigningClient {
+
+private:
+
+    UnixSocket socket;
+
+public:
+
+    /** @return False if no daemon listens on path */
+    bool connect(const std::string &path);
+
+    /**
+     * Send a request and wait for its response, see SigningDaemon for the operations.
+     *
+     * @param ok Whether the daemon served the request, otherwise result holds why not
+     * @return False if the connection is lost
+     */
+    bool request(const std::string &operation, const std::string &keyName, const std::string &payload,
+                 bool &ok, std::string &result);
+};
+
+
+#endif //RSA_SIGNINGCLIENT_H
@@ -0,0 +1,303 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+#include <sys/socket.h>
+
+#include "SigningDaemon.h"
+#include "RequestStream.h"
+
+const int SigningDaemon::DEFAULT_WINDOW_MICROS;
+const size_t SigningDaemon::MAX_PAYLOAD_BYTES;
+const int SigningDaemon::LATENCY_SAMPLES;
+
+SigningDaemon::SigningDaemon(
+        const std::map<std::string, RSAPrivateKey> &keys,
+        const int windowMicros,
+        const int threads,
+        const int batchSize) :
+        keys(keys),
+        window(std::chrono::microseconds(std::max(windowMicros, 0))),
+        threads(threads > 0 ? threads : (int) std::max(1u, std::thread::hardware_concurrency())),
+        batchSize(std::max(batchSize, 1)),
+        nextConnection(0),
+        stopping(false),
+        counters(),
+        totalLatencyMicros(0),
+        nextLatency(0) {
+}
+
+bool SigningDaemon::listen(const std::string &socketPath) {
+    return this->listener.listen(socketPath);
+}
+
+void SigningDaemon::serve() {
+    std::vector<std::thread> workers;
+    for (int i = 0; i < this->threads; i++) {
+        workers.emplace_back([this]() {
+            this->work();
+        });
+    }
+
+    while (true) {
+        std::unique_ptr<UnixSocket> connection(new UnixSocket());
+        if (!this->listener.accept(*connection)) {
+            break;
+        }
+
+        std::lock_guard<std::mutex> guard(this->lock);
+        if (this->stopping) {
+            break;
+        }
+        const long long id = this->nextConnection++;
+        this->connections[id] = connection->descriptor();
+        this->counters.connections++;
+
+        // The connection is closed by its thread once it is no longer listed, so stop() never shuts down
+        // a descriptor that was reused
+        std::thread([this, id](std::unique_ptr<UnixSocket> connection) {
+            this->serve(*connection);
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->connections.erase(id);
+            this->counters.connections--;
+            this->disconnected.notify_all();
+        }, std::move(connection)).detach();
+    }
+
+    // Wake up the connections blocked in their reads, then wait for them and the queued jobs
+    std::unique_lock<std::mutex> guard(this->lock);
+    this->stopping = true;
+    for (const auto &connection : this->connections) {
+        ::shutdown(connection.second, SHUT_RDWR);
+    }
+    this->queued.notify_all();
+    this->disconnected.wait(guard, [this]() { return this->connections.empty(); });
+    guard.unlock();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+void SigningDaemon::stop() {
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->stopping = true;
+    }
+    this->listener.shutdown();
+    this->queued.notify_all();
+}
+
+void SigningDaemon::serve(UnixSocket &connection) {
+    std::string header, payload;
+    while (connection.readLine(header)) {
+        // "<operation> <key name> <payload bytes>", the bare "stats" has neither
+        std::istringstream fields(header);
+        std::string operation, keyName, lengthString;
+        fields >> operation >> keyName >> lengthString;
+        char *end = nullptr;
+        long long length = lengthString.empty() ? 0 : std::strtoll(lengthString.c_str(), &end, 10);
+        if ((lengthString.empty() && !keyName.empty()) || (end && *end != '\0') ||
+            length < 0 || length > (long long) MAX_PAYLOAD_BYTES) {
+            // Without the length the rest of the stream can't be framed, so the connection is dropped
+            std::string error = "malformed length";
+            connection.write("error " + std::to_string(error.length()) + "\n" + error);
+            return;
+        }
+        if (!connection.read((size_t) length, payload)) {
+            return;
+        }
+
+        bool ok = true;
+        std::string result;
+        auto job = std::make_shared<Job>();
+        if (operation == "stats") {
+            result = toString(this->stats());
+        } else if (!this->parse(operation, keyName, payload, *job, result)) {
+            ok = false;
+        } else {
+            std::future<std::string> future = job->result.get_future();
+            if (this->submit(job)) {
+                result = future.get();
+            } else {
+                ok = false;
+                result = "stopping";
+            }
+        }
+
+        if (!ok) {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->counters.failures++;
+        }
+        if (!connection.write((ok ? "ok " : "error ") + std::to_string(result.length()) + "\n" + result)) {
+            return;
+        }
+    }
+}
+
+bool SigningDaemon::parse(
+        const std::string &operation,
+        const std::string &keyName,
+        const std::string &payload,
+        Job &job,
+        std::string &error) const {
+
+    if (operation != "sign" && operation != "decrypt") {
+        error = "unknown operation " + operation;
+        return false;
+    }
+    auto key = this->keys.find(keyName);
+    if (key == this->keys.end()) {
+        error = "unknown key " + keyName;
+        return false;
+    }
+
+    job.key = &key->second;
+    job.sign = operation == "sign";
+    if (job.sign) {
+        job.plaintextLength = 0;
+        job.blocks.emplace_back(BKDRHash(payload));
+    } else if (!RequestStream::parseCiphertext(payload, job.plaintextLength, job.blocks)) {
+        error = "malformed ciphertext";
+        return false;
+    }
+    return true;
+}
+
+bool SigningDaemon::submit(const std::shared_ptr<Job> &job) {
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        if (this->stopping) {
+            return false;
+        }
+        job->arrival = Clock::now();
+        this->jobs.push_back(job);
+        this->counters.queueDepth = (int) this->jobs.size();
+        this->counters.maxQueueDepth = std::max(this->counters.maxQueueDepth, this->counters.queueDepth);
+    }
+    this->queued.notify_all();
+    return true;
+}
+
+void SigningDaemon::work() {
+    MultiBufferQueue queue(MultiBufferPowMod::MAX_LANES);
+    std::unique_lock<std::mutex> guard(this->lock);
+    while (true) {
+        this->queued.wait(guard, [this]() { return this->stopping || !this->jobs.empty(); });
+        if (this->jobs.empty()) {
+            return;
+        }
+
+        // Another worker may take the jobs meanwhile, then this one starts over with the next oldest
+        const Clock::time_point deadline = this->jobs.front()->arrival + this->window;
+        this->queued.wait_until(guard, deadline, [this]() {
+            return this->stopping || this->jobs.empty() || (int) this->jobs.size() >= this->batchSize;
+        });
+        if (this->jobs.empty()) {
+            continue;
+        }
+
+        std::vector<std::shared_ptr<Job>> batch;
+        while (!this->jobs.empty() && (int) batch.size() < this->batchSize) {
+            batch.push_back(this->jobs.front());
+            this->jobs.pop_front();
+        }
+        this->counters.queueDepth = (int) this->jobs.size();
+        this->counters.batches++;
+        guard.unlock();
+
+        this->run(batch, queue);
+
+        // The counters include a request by the time its client has the response
+        guard.lock();
+        const Clock::time_point now = Clock::now();
+        for (const std::shared_ptr<Job> &job : batch) {
+            double latency = std::chrono::duration<double, std::micro>(now - job->arrival).count();
+            this->counters.requests++;
+            this->counters.maxLatencyMicros = std::max(this->counters.maxLatencyMicros, latency);
+            this->totalLatencyMicros += latency;
+            if ((int) this->latencies.size() < LATENCY_SAMPLES) {
+                this->latencies.push_back(latency);
+            } else {
+                this->latencies[this->nextLatency] = latency;
+            }
+            this->nextLatency = (this->nextLatency + 1) % LATENCY_SAMPLES;
+        }
+        guard.unlock();
+        for (const std::shared_ptr<Job> &job : batch) {
+            job->result.set_value(std::move(job->output));
+        }
+        guard.lock();
+    }
+}
+
+void SigningDaemon::run(std::vector<std::shared_ptr<Job>> &batch, MultiBufferQueue &queue) {
+    auto finish = [](Job &job) {
+        job.output = job.sign ?
+                     job.plain[0].toString(HEXADECIMAL_RADIX) :
+                     BigInteger::joinPlaintext(job.plaintextLength, job.plain.data(), (int) job.plain.size(),
+                                               job.key->getN());
+    };
+
+    // Too few exponentiations to fill the lanes once run faster one by one
+    int exponentiations = 0;
+    for (const std::shared_ptr<Job> &job : batch) {
+        exponentiations += (int) job->blocks.size() * std::max(job->key->getPrimeCount(), 1);
+    }
+    const bool lanes = exponentiations >= MultiBufferPowMod::LANES;
+
+    for (const std::shared_ptr<Job> &job : batch) {
+        const int count = (int) job->blocks.size();
+        job->unblinders.resize(count);
+        job->plain.resize(count);
+        job->remaining = count;
+        if (count == 0 || !lanes) {
+            for (int i = 0; i < count; i++) {
+                job->plain[i] = job->key->blindedPowMod(job->blocks[i]);
+            }
+            finish(*job);
+            continue;
+        }
+        for (int i = 0; i < count; i++) {
+            const BigInteger blinded = job->key->blind(job->blocks[i], job->unblinders[i]);
+            Job *pending = job.get();
+            queue.pushPrivate(*job->key, blinded, [pending, i, &finish](const BigInteger &y) {
+                pending->plain[i] = pending->key->unblind(y, pending->unblinders[i]);
+                if (--pending->remaining == 0) {
+                    finish(*pending);
+                }
+            });
+        }
+    }
+    queue.flush();
+}
+
+SigningDaemon::Stats SigningDaemon::stats() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    Stats stats = this->counters;
+    stats.meanLatencyMicros = stats.requests > 0 ? this->totalLatencyMicros / (double) stats.requests : 0;
+    std::vector<double> sorted = this->latencies;
+    std::sort(sorted.begin(), sorted.end());
+    stats.p50LatencyMicros = sorted.empty() ? 0 : sorted[sorted.size() / 2];
+    stats.p99LatencyMicros = sorted.empty() ? 0 : sorted[sorted.size() * 99 / 100];
+    return stats;
+}
+
+std::string SigningDaemon::toString(const Stats &stats) {
+    std::ostringstream out;
+    out << "requests=" << stats.requests
+        << " failures=" << stats.failures
+        << " batches=" << stats.batches
+        << " mean_batch=" << (stats.batches > 0 ? (double) stats.requests / (double) stats.batches : 0)
+        << " queue_depth=" << stats.queueDepth
+        << " max_queue_depth=" << stats.maxQueueDepth
+        << " connections=" << stats.connections
+        << " mean_latency_us=" << stats.meanLatencyMicros
+        << " p50_latency_us=" << stats.p50LatencyMicros
+        << " p99_latency_us=" << stats.p99LatencyMicros
+        << " max_latency_us=" << stats.maxLatencyMicros;
+    return out.str();
+}
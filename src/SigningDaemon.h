@@ -0,0 +1,170 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#ifndef RSA_SIGNINGDAEMON_H
+#define RSA_SIGNINGDAEMON_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BigInteger.h"
+#include "MontgomeryContext.h"
+#include "MultiBufferPowMod.h"
+#include "MultiBufferQueue.h"
+#include "RSAPrivateKey.h"
+#include "UnixSocket.h"
+
+/**
+ * A resident process per host that holds the private keys in memory and serves their private operations
+ * on a UNIX socket, so that the clients never read the key files.
+ *
+ * Each request is a line of "<operation> <key name> <payload bytes>" followed by the payload, and each
+ * response a line of "ok|error <result bytes>" followed by the result, as the LENGTH_PREFIXED framing of
+ * RequestStream:
+ *      sign <key name> <message>       -> the hexadecimal signature of the message
+ *      decrypt <key name> <ciphertext> -> the plaintext, of a ciphertext in the format of the ciphertext files
+ *      stats                           -> the counters of toString(Stats)
+ * where the key names are the paths of the key files given to the daemon.
+ *
+ * A connection runs one request at a time, and the requests of the connections are micro-batched: a batch
+ * closes when it holds batchSize requests or when its oldest request has waited the window, then its
+ * exponentiations run in the lanes of a MultiBufferQueue, or one by one when they are too few to fill
+ * the lanes. The inputs are blinded like blindedPowMod() before they join a batch, and the batches run
+ * over the given threads.
+ */
+class SigningDaemon {
+
+public:
+
+    // The default batching window, about a tenth of a 2048-bit signature
+    const static int DEFAULT_WINDOW_MICROS = 200;
+
+    // The largest payload taken, a connection sending more is dropped
+    const static size_t MAX_PAYLOAD_BYTES = 1 << 24;
+
+    // The latest latencies kept for the percentiles
+    const static int LATENCY_SAMPLES = 4096;
+
+    struct Stats {
+        long long requests;
+        long long failures;
+        long long batches;
+        // The requests waiting for a batch, now and at most
+        int queueDepth;
+        int maxQueueDepth;
+        int connections;
+        // From the arrival of a request to its result, over all the requests for the mean and the max,
+        // over the latest LATENCY_SAMPLES ones for the percentiles
+        double meanLatencyMicros;
+        double p50LatencyMicros;
+        double p99LatencyMicros;
+        double maxLatencyMicros;
+    };
+
+private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    /** A parsed request waiting for a batch, then for its exponentiations */
+    struct Job {
+        const RSAPrivateKey *key;
+        bool sign;
+        int plaintextLength;
+        // The hash to sign, or the blocks to decrypt
+        std::vector<BigInteger> blocks;
+        // Written by the batch
+        std::vector<MontgomeryContext::Residue> unblinders;
+        std::vector<BigInteger> plain;
+        int remaining;
+        std::string output;
+        Clock::time_point arrival;
+        std::promise<std::string> result;
+    };
+
+    // The keys by their name, never changed once constructed so read without the lock
+    std::map<std::string, RSAPrivateKey> keys;
+    const Clock::duration window;
+    const int threads;
+    const int batchSize;
+
+    UnixSocket listener;
+
+    // Guards everything below
+    mutable std::mutex lock;
+    // Notified on every queued job and on stop()
+    std::condition_variable queued;
+    // Notified when a connection ends
+    std::condition_variable disconnected;
+    std::deque<std::shared_ptr<Job>> jobs;
+    // The descriptors of the open connections by their id
+    std::map<long long, int> connections;
+    long long nextConnection;
+    bool stopping;
+
+    Stats counters;
+    double totalLatencyMicros;
+    std::vector<double> latencies;
+    int nextLatency;
+
+    /** Take batches off the jobs until stop() and the queue is drained */
+    void work();
+
+    /** Run the exponentiations of a batch over queue, or one by one if they can't fill its lanes */
+    void run(std::vector<std::shared_ptr<Job>> &batch, MultiBufferQueue &queue);
+
+    /** Serve the requests of a connection until it closes */
+    void serve(UnixSocket &connection);
+
+    /**
+     * Parse the payload of a request into a job.
+     *
+     * @return False if the key is unknown or the payload malformed, then error holds why
+     */
+    bool parse(const std::string &operation, const std::string &keyName, const std::string &payload,
+               Job &job, std::string &error) const;
+
+    /** Queue a job for the next batch, @return False if the daemon is stopping */
+    bool submit(const std::shared_ptr<Job> &job);
+
+public:
+
+    /**
+     * @param keys The private keys by their name, with the primes for the CRT
+     * @param windowMicros How long the oldest request of a batch waits for more, 0 to run it at once
+     * @param threads The threads running the batches, one per core for 0
+     * @param batchSize The requests closing a batch before its window
+     */
+    SigningDaemon(const std::map<std::string, RSAPrivateKey> &keys, int windowMicros, int threads,
+                  int batchSize = MultiBufferPowMod::MAX_LANES);
+
+    SigningDaemon(const SigningDaemon &other) = delete;
+
+    SigningDaemon &operator=(const SigningDaemon &other) = delete;
+
+    /** @return False if the socket can't be bound, with the reason on stderr */
+    bool listen(const std::string &socketPath);
+
+    /** Serve the connections of the socket until stop(), then drain the queued requests */
+    void serve();
+
+    /** Make serve() return, safe to call from any thread */
+    void stop();
+
+    /** @return The counters so far */
+    Stats stats() const;
+
+    /** @return The counters in entries of "key=value" separated by spaces */
+    static std::string toString(const Stats &stats);
+};
+
+
+#endif //RSA_SIGNINGDAEMON_H
@@ -2,21 +2,28 @@
 // Created by Yongzao Dan on 2022/11/7.
 //
 
+#include <algorithm>
+
 #include "SmallPrimeSieve.h"
 
-// The length of SMALL_SIEVE is reference from java.math.SmallPrimeSieve
-const int SmallPrimeSieve::SMALL_SIEVE_LENGTH = 150 * 64;
-const int SmallPrimeSieve::SMALL_PRIMES_COUNT = getSmallPrimesCount();
-const int *SmallPrimeSieve::SMALL_PRIMES = sieveSmallPrimes();
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RSA_X86_RESIDUE_KERNELS
+#include <immintrin.h>
+#endif
+
+// All the primes below 2^15, the largest that the signed 16-bit residue kernels hold,
+// of which sievedPrimesCount() takes a prefix by the size of the candidates
+const int SmallPrimeSieve::SMALL_SIEVE_LENGTH = 1 << 15;
 
-int SmallPrimeSieve::getSmallPrimesCount() {
+// The small primes are sieved at compile time, so there is no static initializer for them.
+
+static constexpr int countSmallPrimes(int sieveLength) {
     int smallPrimesCount = 0;
-    bool *isComposite = new bool[SMALL_SIEVE_LENGTH];
-    memset(isComposite, false, SMALL_SIEVE_LENGTH);
-    for (int i = 2; i < SMALL_SIEVE_LENGTH; i++) {
+    bool isComposite[SmallPrimeSieve::SMALL_SIEVE_LENGTH] = {};
+    for (int i = 2; i < sieveLength; i++) {
         if (!isComposite[i]) {
             ++smallPrimesCount;
-            for (int j = i * 2; j < SMALL_SIEVE_LENGTH; j += i) {
+            for (int j = i * 2; j < sieveLength; j += i) {
                 isComposite[j] = true;
             }
         }
@@ -24,54 +31,210 @@ int SmallPrimeSieve::getSmallPrimesCount() {
     return smallPrimesCount;
 }
 
-int *SmallPrimeSieve::sieveSmallPrimes() {
-    int smallPrimesCount = 0;
-    bool *isComposite = new bool[SMALL_SIEVE_LENGTH];
-    memset(isComposite, false, SMALL_SIEVE_LENGTH);
-    for (int i = 2; i < SMALL_SIEVE_LENGTH; i++) {
-        if (!isComposite[i]) {
-            ++smallPrimesCount;
-            for (int j = i * 2; j < SMALL_SIEVE_LENGTH; j += i) {
-                isComposite[j] = true;
+const int SmallPrimeSieve::SMALL_PRIMES_COUNT = countSmallPrimes(SMALL_SIEVE_LENGTH);
+// One AVX2 register holds 16 residues
+const int SmallPrimeSieve::RESIDUE_LANES = 16;
+const int SmallPrimeSieve::PADDED_PRIMES_COUNT =
+        (SMALL_PRIMES_COUNT + RESIDUE_LANES - 1) / RESIDUE_LANES * RESIDUE_LANES;
+
+struct SmallPrimeTable {
+    uint16_t primes[SmallPrimeSieve::PADDED_PRIMES_COUNT];
+
+    constexpr SmallPrimeTable() : primes() {
+        int index = 0;
+        bool isComposite[SmallPrimeSieve::SMALL_SIEVE_LENGTH] = {};
+        for (int i = 2; i < SmallPrimeSieve::SMALL_SIEVE_LENGTH; i++) {
+            if (!isComposite[i]) {
+                primes[index++] = (uint16_t) i;
+                for (int j = i * 2; j < SmallPrimeSieve::SMALL_SIEVE_LENGTH; j += i) {
+                    isComposite[j] = true;
+                }
             }
         }
+        while (index < SmallPrimeSieve::PADDED_PRIMES_COUNT) {
+            primes[index++] = 2;
+        }
     }
+};
 
-    int index = 0;
-    auto *z = new int[smallPrimesCount];
-    for (int i = 2; i < SMALL_SIEVE_LENGTH; i++) {
-        if (!isComposite[i]) {
-            z[index++] = i;
-        }
+static constexpr SmallPrimeTable SMALL_PRIME_TABLE{};
+
+const uint16_t *SmallPrimeSieve::SMALL_PRIMES = SMALL_PRIME_TABLE.primes;
+
+int SmallPrimeSieve::sievedPrimesCount(const int bitLength) {
+    // Each prime p in the sieve saves the primality tests of 1 / p of the candidates left, and costs
+    // a remainder of base when the sieve is reset and a residue update per step. The primality tests
+    // grow about cubically with the bit length while the sieve grows linearly, so the candidates
+    // above 512 bits take every prime below 2^15, which saves about 12% of the tests of 1024 and
+    // 2048-bit primes over the 1184 primes below 9600 of java.math.BigInteger's sieve.
+    return bitLength <= 512 ? 1184 : PADDED_PRIMES_COUNT;
+}
+
+int SmallPrimeSieve::sieveBound(const int bitLength) {
+    int count = sievedPrimesCount(bitLength);
+    return count < SMALL_PRIMES_COUNT ? SMALL_PRIMES[count] : SMALL_SIEVE_LENGTH;
+}
+
+// ========================================
+// Begin of residue kernels
+// ========================================
+
+// All the primes and residues are less than 2^15,
+// so the residues never overflow and the signed 16-bit compares are safe.
+
+static bool selfAddByTwoScalar(uint16_t *residues, const uint16_t *primes, int count) {
+    // Accumulate the zero flags branch-free, the same as the vectorized kernels
+    unsigned int hit = 0;
+    for (int i = 0; i < count; i++) {
+        unsigned int r = residues[i] + 2u;
+        r -= r >= primes[i] ? primes[i] : 0;
+        residues[i] = (uint16_t) r;
+        hit |= (r == 0);
     }
-    return z;
+    return hit != 0;
 }
 
-SmallPrimeSieve::SmallPrimeSieve(const BigInteger &base) {
+#ifdef RSA_X86_RESIDUE_KERNELS
+
+__attribute__((target("sse2")))
+static bool selfAddByTwoSse2(uint16_t *residues, const uint16_t *primes, int count) {
+    const __m128i two = _mm_set1_epi16(2);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i hit = zero;
+    for (int i = 0; i < count; i += 8) {
+        __m128i r = _mm_loadu_si128((const __m128i *) (residues + i));
+        __m128i p = _mm_loadu_si128((const __m128i *) (primes + i));
+        r = _mm_add_epi16(r, two);
+        // Subtract p from the lanes where r >= p
+        __m128i less = _mm_cmplt_epi16(r, p);
+        r = _mm_sub_epi16(r, _mm_andnot_si128(less, p));
+        _mm_storeu_si128((__m128i *) (residues + i), r);
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi16(r, zero));
+    }
+    return _mm_movemask_epi8(hit) != 0;
+}
+
+__attribute__((target("avx2")))
+static bool selfAddByTwoAvx2(uint16_t *residues, const uint16_t *primes, int count) {
+    const __m256i two = _mm256_set1_epi16(2);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i hit = zero;
+    for (int i = 0; i < count; i += 16) {
+        __m256i r = _mm256_loadu_si256((const __m256i *) (residues + i));
+        __m256i p = _mm256_loadu_si256((const __m256i *) (primes + i));
+        r = _mm256_add_epi16(r, two);
+        // Subtract p from the lanes where r >= p
+        __m256i less = _mm256_cmpgt_epi16(p, r);
+        r = _mm256_sub_epi16(r, _mm256_andnot_si256(less, p));
+        _mm256_storeu_si256((__m256i *) (residues + i), r);
+        hit = _mm256_or_si256(hit, _mm256_cmpeq_epi16(r, zero));
+    }
+    return _mm256_movemask_epi8(hit) != 0;
+}
+
+#endif
+
+const char *SmallPrimeSieve::RESIDUE_KERNEL_NAME = "scalar";
+
+SmallPrimeSieve::ResidueKernel SmallPrimeSieve::residueKernel() {
+    // Selected on first use instead of during static initialization
+    static const ResidueKernel kernel = selectResidueKernel();
+    return kernel;
+}
+
+SmallPrimeSieve::ResidueKernel SmallPrimeSieve::selectResidueKernel() {
+#ifdef RSA_X86_RESIDUE_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        RESIDUE_KERNEL_NAME = "avx2";
+        return selfAddByTwoAvx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        RESIDUE_KERNEL_NAME = "sse2";
+        return selfAddByTwoSse2;
+    }
+#endif
+    return selfAddByTwoScalar;
+}
+
+const char *SmallPrimeSieve::residueKernelName() {
+    residueKernel();
+    return RESIDUE_KERNEL_NAME;
+}
+
+// ========================================
+// End of residue kernels
+// ========================================
+
+
+SmallPrimeSieve::SmallPrimeSieve(const BigInteger &base, bool sieveSafePrime) {
+    // The safe prime p = 2 * base + 1 is one bit longer than base
+    this->count = sievedPrimesCount(base.getBitLength() + (sieveSafePrime ? 1 : 0));
+    this->remainders = new uint16_t[this->count];
+    this->safeRemainders = sieveSafePrime ? new uint16_t[this->count] : nullptr;
+    this->reset(base);
+}
+
+SmallPrimeSieve::~SmallPrimeSieve() {
+    delete[] this->remainders;
+    delete[] this->safeRemainders;
+}
+
+void SmallPrimeSieve::reset(const BigInteger &base) {
     this->candidate = true;
-    this->remainders = new int[SMALL_PRIMES_COUNT];
-    for (int i = 0; i < SMALL_PRIMES_COUNT; i++) {
-        this->remainders[i] = (int) (base % SmallPrimeSieve::SMALL_PRIMES[i]);
+    const int primesCount = std::min(this->count, SMALL_PRIMES_COUNT);
+    for (int i = 0; i < primesCount; i++) {
+        this->remainders[i] = (uint16_t) (base % SmallPrimeSieve::SMALL_PRIMES[i]);
         if (!this->remainders[i]) {
             this->candidate = false;
         }
     }
+    for (int i = primesCount; i < this->count; i++) {
+        this->remainders[i] = 1;
+    }
+
+    if (this->safeRemainders) {
+        for (int i = 0; i < this->count; i++) {
+            this->safeRemainders[i] = (uint16_t) ((2u * this->remainders[i] + 1) % SMALL_PRIMES[i]);
+            if (!this->safeRemainders[i]) {
+                this->candidate = false;
+            }
+        }
+    }
 }
 
 void SmallPrimeSieve::selfAddByTwo() {
-    this->candidate = true;
-    for (int i = 0; i < SMALL_PRIMES_COUNT; i++) {
-        this->remainders[i] = (this->remainders[i] + 2);
-        this->remainders[i] = this->remainders[i] >= SmallPrimeSieve::SMALL_PRIMES[i] ?
-                              this->remainders[i] - SmallPrimeSieve::SMALL_PRIMES[i] :
-                              this->remainders[i];
-        if (!this->remainders[i]) {
-            this->candidate = false;
-        }
+    ResidueKernel kernel = residueKernel();
+    bool hit = kernel(this->remainders, SmallPrimeSieve::SMALL_PRIMES, this->count);
+    if (this->safeRemainders) {
+        // 2 * base + 1 grows by 4, in two steps so that each step is reduced by one subtraction,
+        // and the zeros of the intermediate 2 * base + 3 don't matter
+        kernel(this->safeRemainders, SmallPrimeSieve::SMALL_PRIMES, this->count);
+        hit |= kernel(this->safeRemainders, SmallPrimeSieve::SMALL_PRIMES, this->count);
     }
+    this->candidate = !hit;
 }
 
 bool SmallPrimeSieve::isCandidate() const {
     return this->candidate;
 }
 
+int SmallPrimeSieve::trialDivision(const BigInteger &x) {
+    if (x.compareAbsolute(2) < 0) {
+        return -1;
+    }
+
+    const int primesCount = std::min(sievedPrimesCount(x.getBitLength()), SMALL_PRIMES_COUNT);
+    for (int i = 0; i < primesCount; i++) {
+        if (x.compareAbsolute(SMALL_PRIMES[i]) == 0) {
+            return 1;
+        }
+        if (x % SMALL_PRIMES[i] == 0) {
+            return -1;
+        }
+    }
+
+    // Every composite below sieveBound()^2 has a prime factor below sieveBound()
+    const unsigned int bound = (unsigned int) sieveBound(x.getBitLength());
+    return x.compareAbsolute(bound * bound) < 0 ? 1 : 0;
+}
@@ -5,6 +5,7 @@
 #ifndef RSA_SMALLPRIMESIEVE_H
 #define RSA_SMALLPRIMESIEVE_H
 
+#include <cstdint>
 #include <iostream>
 
 #include "utils.h"
@@ -13,29 +14,80 @@
 /** Pre-calculate a batch of small primes, in order to speed up big prime detection. */
 class SmallPrimeSieve {
 
-private:
+public:
 
     static const int SMALL_SIEVE_LENGTH;
 
     static const int SMALL_PRIMES_COUNT;
-    static int getSmallPrimesCount();
 
-    static const int *SMALL_PRIMES;
-    static int *sieveSmallPrimes();
+    // The residues are processed RESIDUE_LANES at a time by the vectorized kernels,
+    // so both arrays are padded with the prime 2, whose residue stays 1 for odd candidates.
+    static const int RESIDUE_LANES;
+    static const int PADDED_PRIMES_COUNT;
+
+private:
+
+    static const uint16_t *SMALL_PRIMES;
+
+    /**
+     * Let residues[i] = (residues[i] + 2) % primes[i] for i in [0, count).
+     *
+     * @return True iff there exists some residues[i] == 0 after the update
+     */
+    typedef bool (*ResidueKernel)(uint16_t *residues, const uint16_t *primes, int count);
+
+    static const char *RESIDUE_KERNEL_NAME;
+    static ResidueKernel residueKernel();
+    static ResidueKernel selectResidueKernel();
 
-    int *remainders;
+    // The prefix of SMALL_PRIMES sieved, a multiple of RESIDUE_LANES
+    int count;
+    uint16_t *remainders;
+    // safeRemainders[i] = (2 * base + 1) % SMALL_PRIMES[i], only when sieving safe primes
+    uint16_t *safeRemainders;
     bool candidate;
 
 public:
 
+    /** @return The number of the small primes sieved for the candidates of bitLength bits, a multiple of RESIDUE_LANES */
+    static int sievedPrimesCount(int bitLength);
+
+    /** @return The least prime left out of the sieve for the candidates of bitLength bits */
+    static int sieveBound(int bitLength);
+
+    /**
+     * Let remainders[i] = base % SMALL_PRIMES[i], over the small primes sieved for the bit length of base
+     *
+     * @param sieveSafePrime Also reject the candidates where 2 * base + 1 has a small prime factor
+     */
+    explicit SmallPrimeSieve(const BigInteger &base, bool sieveSafePrime = false);
+
+    SmallPrimeSieve(const SmallPrimeSieve &other) = delete;
+
+    SmallPrimeSieve &operator=(const SmallPrimeSieve &other) = delete;
+
+    ~SmallPrimeSieve();
+
     /** Let remainders[i] = base % SMALL_PRIMES[i] */
-    explicit SmallPrimeSieve(const BigInteger &base);
+    void reset(const BigInteger &base);
 
-    /** Let remainders[i] = (remainders[i] + 2) % SMALL_PRIMES[i] */
+    /** Let remainders[i] = (remainders[i] + 2) % SMALL_PRIMES[i], and safeRemainders by 4 */
     void selfAddByTwo();
 
     /** @return True iff for all i, remainders[i] > 0 */
     bool isCandidate() const;
+
+    /**
+     * Trial division by the small primes sieved for the bit length of x.
+     *
+     * @return -1 if x is composite (or less than 2),
+     *         1 if x is a prime, which is certain when x < sieveBound()^2,
+     *         0 if x has no small prime factors and the primality is unknown.
+     */
+    static int trialDivision(const BigInteger &x);
+
+    /** @return The name of the residue kernel selected for this CPU: "avx2", "sse2" or "scalar" */
+    static const char *residueKernelName();
 };
 
 
@@ -0,0 +1,128 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#include <algorithm>
+
+#include "StreamCipher.h"
+
+const int BlockPipeline::DEFAULT_DEPTH;
+
+BlockPipeline::BlockPipeline(
+        WorkerPool &pool,
+        const int depth,
+        std::function<BigInteger(const BigInteger &)> exponentiate) :
+        pool(pool),
+        depth(std::max(depth, 1)),
+        exponentiate(std::move(exponentiate)) {
+}
+
+BlockPipeline::~BlockPipeline() {
+    for (const std::unique_ptr<Block> &block : this->blocks) {
+        this->pool.wait(block->task);
+    }
+}
+
+void BlockPipeline::submit(BigInteger input) {
+    this->blocks.emplace_back(new Block());
+    Block *block = this->blocks.back().get();
+    block->input = std::move(input);
+    block->task = this->pool.submit([this, block]() {
+        block->output = this->exponentiate(block->input);
+    });
+}
+
+bool BlockPipeline::next(BigInteger &output) {
+    if (this->blocks.empty()) {
+        return false;
+    }
+    this->pool.wait(this->blocks.front()->task);
+    output = std::move(this->blocks.front()->output);
+    this->blocks.pop_front();
+    return true;
+}
+
+bool BlockPipeline::full() const {
+    return (int) this->blocks.size() >= this->depth;
+}
+
+int BlockPipeline::pending() const {
+    return (int) this->blocks.size();
+}
+
+StreamEncryptor::StreamEncryptor(
+        const BigInteger &e,
+        const MontgomeryContext &context,
+        const size_t plaintextLength,
+        const int depth,
+        WorkerPool &pool) :
+        BlockPipeline(pool, depth, [e, context](const BigInteger &plain) {
+            return context.powMod(plain, e);
+        }),
+        plaintextLength(plaintextLength),
+        blockBytes((size_t) ((context.getModulus().getBitLength() - 1) / ASCII_BITS)),
+        pushed(0) {
+}
+
+long long StreamEncryptor::getBlockCount() const {
+    return (long long) ((this->plaintextLength + this->blockBytes - 1) / this->blockBytes);
+}
+
+size_t StreamEncryptor::push(const char *bytes, size_t length) {
+    length = std::min(length, this->plaintextLength - this->pushed);
+    size_t taken = 0;
+    while (taken < length && !this->full()) {
+        // A whole block is packed in place, the rest gathers in partial
+        const size_t count = std::min(this->blockBytes - this->partial.length(), length - taken);
+        if (this->partial.empty() && count == this->blockBytes) {
+            this->submit(BigInteger::fromBytes(bytes + taken, count));
+        } else {
+            this->partial.append(bytes + taken, count);
+        }
+        taken += count;
+        this->pushed += count;
+
+        if (!this->partial.empty() &&
+            (this->partial.length() == this->blockBytes || this->pushed == this->plaintextLength)) {
+            this->submit(BigInteger::fromBytes(this->partial.data(), this->partial.length()));
+            this->partial.clear();
+        }
+    }
+    return taken;
+}
+
+bool StreamEncryptor::pull(BigInteger &block) {
+    return this->next(block);
+}
+
+StreamDecryptor::StreamDecryptor(
+        const RSAPrivateKey &key,
+        const size_t plaintextLength,
+        const int depth,
+        WorkerPool &pool) :
+        BlockPipeline(pool, depth, [key](const BigInteger &cipher) {
+            return key.blindedPowMod(cipher);
+        }),
+        n(key.getN()),
+        blockBytes((size_t) ((key.getN().getBitLength() - 1) / ASCII_BITS)),
+        remaining(plaintextLength) {
+}
+
+bool StreamDecryptor::push(const BigInteger &block) {
+    if (this->full()) {
+        return false;
+    }
+    this->submit(block);
+    return true;
+}
+
+bool StreamDecryptor::pull(std::string &chunk) {
+    BigInteger plain;
+    if (!this->next(plain)) {
+        return false;
+    }
+    const size_t length = std::min(this->remaining, this->blockBytes);
+    chunk = BigInteger::joinPlaintext((int) length, &plain, 1, this->n);
+    this->remaining -= length;
+    return true;
+}
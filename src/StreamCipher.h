@@ -0,0 +1,145 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#ifndef RSA_STREAMCIPHER_H
+#define RSA_STREAMCIPHER_H
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "BigInteger.h"
+#include "MontgomeryContext.h"
+#include "RSAPrivateKey.h"
+#include "WorkerPool.h"
+
+/**
+ * The blocks between the stage that pushes them and the one that pulls them, exponentiated over a WorkerPool
+ * meanwhile and pulled in the order they were pushed.
+ *
+ * At most depth blocks are held at once, from their push to their pull, so a whole file goes through in
+ * constant memory. A full pipeline takes no more blocks until the oldest is pulled, and the thread
+ * waiting in pull() runs the queued exponentiations itself, so one thread may drive both ends.
+ */
+class BlockPipeline {
+
+private:
+
+    struct Block {
+        std::shared_ptr<WorkerPool::Task> task;
+        BigInteger input;
+        BigInteger output;
+    };
+
+    WorkerPool &pool;
+    const int depth;
+    // Holds its own copy of the key, so the blocks still running never see a derived class destroyed
+    const std::function<BigInteger(const BigInteger &)> exponentiate;
+    // The blocks pushed but not pulled yet, oldest first, at stable addresses for their tasks
+    std::deque<std::unique_ptr<Block>> blocks;
+
+protected:
+
+    BlockPipeline(WorkerPool &pool, int depth, std::function<BigInteger(const BigInteger &)> exponentiate);
+
+    /** Queue the exponentiation of input, the pipeline must not be full */
+    void submit(BigInteger input);
+
+    /** Wait for the oldest block, @return False if none is held */
+    bool next(BigInteger &output);
+
+public:
+
+    // The blocks held by default, some per core while a 2048-bit block is about 256 bytes
+    const static int DEFAULT_DEPTH = 256;
+
+    BlockPipeline(const BlockPipeline &other) = delete;
+
+    BlockPipeline &operator=(const BlockPipeline &other) = delete;
+
+    /** Wait for the blocks still held, their results are dropped */
+    virtual ~BlockPipeline();
+
+    /** @return True if no block is taken until the oldest is pulled */
+    bool full() const;
+
+    /** @return The blocks pushed but not pulled yet */
+    int pending() const;
+};
+
+/**
+ * Encrypts a plaintext of a known length pushed in chunks of any size, into the blocks of
+ * BigInteger::encryptPlaintext() pulled one by one.
+ *
+ * The length is known beforehand so the header of a ciphertext file, the plaintext length and the number
+ * of blocks, can be written before the first block.
+ */
+class StreamEncryptor : public BlockPipeline {
+
+private:
+
+    const size_t plaintextLength;
+    const size_t blockBytes;
+    size_t pushed;
+    // The bytes of the block not complete yet
+    std::string partial;
+
+public:
+
+    /**
+     * @param context The context of n, copied
+     * @param plaintextLength The bytes to be pushed in all
+     * @param pool Where the exponentiations run, besides the thread waiting in pull()
+     */
+    StreamEncryptor(const BigInteger &e, const MontgomeryContext &context, size_t plaintextLength,
+                    int depth = DEFAULT_DEPTH, WorkerPool &pool = WorkerPool::shared());
+
+    /** @return The number of blocks of the whole plaintext */
+    long long getBlockCount() const;
+
+    /**
+     * Take the next bytes of the plaintext, as many as the free blocks of the pipeline hold. The last
+     * block is queued once the whole plaintext is taken.
+     *
+     * @return The bytes taken, from 0 when the pipeline is full up to length
+     */
+    size_t push(const char *bytes, size_t length);
+
+    /** Wait for the next block of the ciphertext, @return False once all the blocks taken are pulled */
+    bool pull(BigInteger &block);
+};
+
+/**
+ * Decrypts the blocks of a ciphertext pushed one by one, into the chunks of its plaintext pulled in order,
+ * each one the bytes of a block.
+ */
+class StreamDecryptor : public BlockPipeline {
+
+private:
+
+    const BigInteger n;
+    const size_t blockBytes;
+    // The plaintext bytes not pulled yet
+    size_t remaining;
+
+public:
+
+    /**
+     * @param key The private key, copied
+     * @param plaintextLength The bytes of the whole plaintext, from the header of the ciphertext
+     * @param pool Where the exponentiations run, besides the thread waiting in pull()
+     */
+    StreamDecryptor(const RSAPrivateKey &key, size_t plaintextLength, int depth = DEFAULT_DEPTH,
+                    WorkerPool &pool = WorkerPool::shared());
+
+    /** Take the next block of the ciphertext, @return False if the pipeline is full */
+    bool push(const BigInteger &block);
+
+    /** Wait for the plaintext of the next block, @return False once all the blocks taken are pulled */
+    bool pull(std::string &chunk);
+};
+
+
+#endif //RSA_STREAMCIPHER_H
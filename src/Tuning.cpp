@@ -0,0 +1,203 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "Tuning.h"
+#include "MontgomeryContext.h"
+#include "FixedBigInteger.h"
+#include "BigInteger.h"
+
+const char *const Tuning::TUNING_FILE_ENV = "RSA_TUNING_FILE";
+const char *const Tuning::TUNING_FILE = "rsa_tuning.txt";
+const char *const Tuning::FORCE_ENV = "RSA_FORCE_ALGORITHM";
+const char *const Tuning::NATIVE = "native";
+const char *const Tuning::PORTABLE = "portable";
+
+/** @return s without the leading and trailing whitespaces */
+static std::string trim(const std::string &s) {
+    const char *whitespaces = " \t\r\n";
+    size_t begin = s.find_first_not_of(whitespaces);
+    if (begin == std::string::npos) {
+        return "";
+    }
+    return s.substr(begin, s.find_last_not_of(whitespaces) - begin + 1);
+}
+
+/** @return Whether s is a whole non-negative integer, which is stored in value */
+static bool parseInt(const std::string &s, int &value) {
+    if (s.empty() || s.length() > 10 || s.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    long long parsed = std::atoll(s.c_str());
+    if (parsed > INT_MAX) {
+        return false;
+    }
+    value = (int) parsed;
+    return true;
+}
+
+/** @return Whether s is a list of ascending "bits:window" ending with "*:window", which is stored in bands */
+static bool parseBands(const std::string &s, Tuning::WindowBands &bands) {
+    Tuning::WindowBands parsed;
+    std::stringstream stream(s);
+    std::string band;
+    while (std::getline(stream, band, ' ')) {
+        band = trim(band);
+        if (band.empty()) {
+            continue;
+        }
+        size_t colon = band.find(':');
+        if (colon == std::string::npos || (!parsed.empty() && parsed.back().first == INT_MAX)) {
+            return false;
+        }
+
+        int bits, window;
+        std::string bitsString = trim(band.substr(0, colon));
+        if (bitsString == "*") {
+            bits = INT_MAX;
+        } else if (!parseInt(bitsString, bits) || (!parsed.empty() && bits <= parsed.back().first)) {
+            return false;
+        }
+        if (!parseInt(trim(band.substr(colon + 1)), window) || window < 1 || window > 8) {
+            return false;
+        }
+        parsed.emplace_back(bits, window);
+    }
+    if (parsed.empty() || parsed.back().first != INT_MAX) {
+        return false;
+    }
+    bands = parsed;
+    return true;
+}
+
+Tuning::Profile Tuning::defaults() {
+    Profile profile;
+    profile.wordKernels = NATIVE;
+    profile.vectorKernels = NATIVE;
+    profile.vectorCrossoverWords = MontgomeryContext::VECTOR_CROSSOVER_WORDS;
+    profile.fixedMaxBits = FixedPowMod::MAX_BITS;
+    // Balance the 2^(w - 1) odd powers in the table against the exponentBits / (w + 1) multiplications
+    profile.windowBits = {{23, 1}, {79, 3}, {239, 4}, {671, 5}, {1791, 6}, {INT_MAX, 7}};
+    // Balance the 2^w - 1 multiplications to build the table against the exponentBits / w in the loop
+    profile.constantTimeWindowBits = {{22, 1}, {89, 3}, {306, 4}, {937, 5}, {INT_MAX, 6}};
+    profile.karatsubaThresholdWords = BigInteger::KARATSUBA_THRESHOLD_WORDS;
+    profile.parallelMultiplyWords = BigInteger::PARALLEL_MULTIPLY_WORDS;
+    profile.multiplyThreads = 0;
+    return profile;
+}
+
+Tuning::Profile Tuning::load() {
+    Profile profile = defaults();
+
+    const char *path = std::getenv(TUNING_FILE_ENV);
+    std::ifstream in(path ? path : TUNING_FILE);
+    if (in.is_open() && !read(in, profile)) {
+        std::cerr << "Malformed entries in the tuning file " << (path ? path : TUNING_FILE)
+                  << " are ignored." << std::endl;
+    }
+
+    const char *force = std::getenv(FORCE_ENV);
+    if (force) {
+        std::stringstream stream(force);
+        std::string entry;
+        while (std::getline(stream, entry, ',')) {
+            if (!trim(entry).empty() && !apply(entry, profile)) {
+                std::cerr << "Malformed entry " << FORCE_ENV << "=" << entry << " is ignored." << std::endl;
+            }
+        }
+    }
+    return profile;
+}
+
+Tuning::Profile &Tuning::current() {
+    // Loaded on first use instead of during static initialization
+    static Profile profile = load();
+    return profile;
+}
+
+const Tuning::Profile &Tuning::profile() {
+    return current();
+}
+
+void Tuning::setProfile(const Profile &profile) {
+    current() = profile;
+}
+
+bool Tuning::apply(const std::string &entry, Profile &profile) {
+    size_t equal = entry.find('=');
+    if (equal == std::string::npos) {
+        return false;
+    }
+    std::string key = trim(entry.substr(0, equal)), value = trim(entry.substr(equal + 1));
+
+    if (key == "word_kernels" || key == "vector_kernels") {
+        if (value != NATIVE && value != PORTABLE) {
+            return false;
+        }
+        (key == "word_kernels" ? profile.wordKernels : profile.vectorKernels) = value;
+        return true;
+    } else if (key == "vector_crossover_words") {
+        return parseInt(value, profile.vectorCrossoverWords);
+    } else if (key == "fixed_max_bits") {
+        return parseInt(value, profile.fixedMaxBits);
+    } else if (key == "window_bits") {
+        return parseBands(value, profile.windowBits);
+    } else if (key == "constant_time_window_bits") {
+        return parseBands(value, profile.constantTimeWindowBits);
+    } else if (key == "karatsuba_threshold_words") {
+        return parseInt(value, profile.karatsubaThresholdWords);
+    } else if (key == "parallel_multiply_words") {
+        return parseInt(value, profile.parallelMultiplyWords);
+    } else if (key == "multiply_threads") {
+        return parseInt(value, profile.multiplyThreads);
+    }
+    return false;
+}
+
+bool Tuning::read(std::istream &in, Profile &profile) {
+    bool valid = true;
+    std::string line;
+    while (std::getline(in, line)) {
+        line = trim(line);
+        if (!line.empty() && line[0] != '#') {
+            valid &= apply(line, profile);
+        }
+    }
+    return valid;
+}
+
+/** @return The bands in the format of parseBands() */
+static std::string bandsToString(const Tuning::WindowBands &bands) {
+    std::string s;
+    for (const std::pair<int, int> &band : bands) {
+        s += (s.empty() ? "" : " ") + (band.first == INT_MAX ? "*" : std::to_string(band.first)) +
+             ":" + std::to_string(band.second);
+    }
+    return s;
+}
+
+void Tuning::write(std::ostream &out, const Profile &profile) {
+    out << "word_kernels = " << profile.wordKernels << std::endl;
+    out << "vector_kernels = " << profile.vectorKernels << std::endl;
+    out << "vector_crossover_words = " << profile.vectorCrossoverWords << std::endl;
+    out << "fixed_max_bits = " << profile.fixedMaxBits << std::endl;
+    out << "window_bits = " << bandsToString(profile.windowBits) << std::endl;
+    out << "constant_time_window_bits = " << bandsToString(profile.constantTimeWindowBits) << std::endl;
+    out << "karatsuba_threshold_words = " << profile.karatsubaThresholdWords << std::endl;
+    out << "parallel_multiply_words = " << profile.parallelMultiplyWords << std::endl;
+    out << "multiply_threads = " << profile.multiplyThreads << std::endl;
+}
+
+int Tuning::window(const WindowBands &bands, const int exponentBits) {
+    for (const std::pair<int, int> &band : bands) {
+        if (exponentBits <= band.first) {
+            return band.second;
+        }
+    }
+    return bands.back().second;
+}
@@ -0,0 +1,107 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#ifndef RSA_TUNING_H
+#define RSA_TUNING_H
+
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * The algorithm selections and thresholds of the dispatch in BigInteger, MontgomeryContext and FixedPowMod.
+ *
+ * The profile is loaded once on first use: the compiled-in defaults, then the tuning file written by the
+ * RSATune tool if it exists, then the entries forced by the environment. Both the file and the environment
+ * hold entries of "key = value", one per line in the file and separated by ',' in the environment:
+ *      word_kernels = native | portable
+ *      vector_kernels = native | portable
+ *      vector_crossover_words = <words>
+ *      fixed_max_bits = <bits>
+ *      window_bits = <max exponent bits>:<window> ... *:<window>
+ *      constant_time_window_bits = <max exponent bits>:<window> ... *:<window>
+ *      karatsuba_threshold_words = <words>
+ *      parallel_multiply_words = <words>
+ *      multiply_threads = <threads>
+ * The kernels and the threads are selected once on first use, the others are read by every dispatch.
+ */
+class Tuning {
+
+public:
+
+    // The exponents up to first bits take the window of second bits, the last band takes the rest
+    typedef std::vector<std::pair<int, int>> WindowBands;
+
+    struct Profile {
+        // The kernels of WordKernels::active() and VectorKernels::active()
+        std::string wordKernels;
+        std::string vectorKernels;
+        // The moduli of at least these words run over the vector kernels in MontgomeryContext
+        int vectorCrossoverWords;
+        // The moduli of at most these bits run over FixedPowMod
+        int fixedMaxBits;
+        // MontgomeryContext::windowBits() and MontgomeryContext::constantTimeWindowBits()
+        WindowBands windowBits;
+        WindowBands constantTimeWindowBits;
+        // The products whose shorter operand has at least these words run over Karatsuba in BigInteger
+        int karatsubaThresholdWords;
+        // The Karatsuba levels of at least these words fork their sub-products onto WorkerPool::shared()
+        int parallelMultiplyWords;
+        // The threads of WorkerPool::shared() including the calling one, 0 for one per core
+        int multiplyThreads;
+    };
+
+    // The path of the tuning file, TUNING_FILE in the working directory by default
+    static const char *const TUNING_FILE_ENV;
+    static const char *const TUNING_FILE;
+
+    // The entries forced for A/B runs, over the tuning file, e.g. "word_kernels = portable, fixed_max_bits = 0"
+    static const char *const FORCE_ENV;
+
+    // The names of the kernel selections
+    static const char *const NATIVE;
+    static const char *const PORTABLE;
+
+private:
+
+    static Profile load();
+
+    static Profile &current();
+
+public:
+
+    /** @return The compiled-in defaults */
+    static Profile defaults();
+
+    /** @return The profile loaded on first use */
+    static const Profile &profile();
+
+    /** Replace the profile, for the tuning tool and the tests. The kernels that are already selected stay. */
+    static void setProfile(const Profile &profile);
+
+    /**
+     * Apply an entry of "key = value" to the profile.
+     *
+     * @return False if the entry is malformed or the key is unknown, then the profile is unchanged
+     */
+    static bool apply(const std::string &entry, Profile &profile);
+
+    /**
+     * Apply the entries of in to the profile, one per line, where the blank lines and the lines
+     * starting with '#' are skipped.
+     *
+     * @return False if any entry is malformed, the others are still applied
+     */
+    static bool read(std::istream &in, Profile &profile);
+
+    /** Write the profile in the format of read() */
+    static void write(std::ostream &out, const Profile &profile);
+
+    /** @return The window of the exponents of the given bits in the bands */
+    static int window(const WindowBands &bands, int exponentBits);
+};
+
+
+#endif //RSA_TUNING_H
@@ -0,0 +1,180 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "UnixSocket.h"
+
+const size_t UnixSocket::MAX_LINE;
+
+// The bytes asked of each recv()
+const static size_t RECEIVE_BYTES = 4096;
+
+// The longest wait of accept() before it retries for the descriptors or memory it ran out of
+const static int MAX_ACCEPT_BACKOFF_MILLIS = 100;
+
+/** @return Whether path fits the address, which is stored in address */
+static bool addressOf(const std::string &path, sockaddr_un &address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.length() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.length());
+    return true;
+}
+
+UnixSocket::UnixSocket(const int fd) : fd(fd) {
+
+}
+
+UnixSocket::~UnixSocket() {
+    if (this->fd >= 0) {
+        close(this->fd);
+    }
+}
+
+bool UnixSocket::listen(const std::string &path) {
+    sockaddr_un address;
+    if (!addressOf(path, address)) {
+        std::cerr << "The socket path " << path << " is too long." << std::endl;
+        return false;
+    }
+    this->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (this->fd < 0) {
+        std::cerr << "Can't create a socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // A socket file left by a daemon that was killed would fail the bind
+    struct stat status;
+    if (lstat(path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode)) {
+        unlink(path.c_str());
+    }
+
+    // The socket is created without any permission for the group and the others
+    mode_t mask = umask(0177);
+    int bound = bind(this->fd, (const sockaddr *) &address, sizeof(address));
+    umask(mask);
+    if (bound < 0 || ::listen(this->fd, SOMAXCONN) < 0) {
+        std::cerr << "Can't listen on " << path << ": " << std::strerror(errno) << std::endl;
+        close(this->fd);
+        this->fd = -1;
+        return false;
+    }
+    return true;
+}
+
+bool UnixSocket::connect(const std::string &path) {
+    sockaddr_un address;
+    if (!addressOf(path, address)) {
+        return false;
+    }
+    this->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (this->fd < 0 || ::connect(this->fd, (const sockaddr *) &address, sizeof(address)) < 0) {
+        if (this->fd >= 0) {
+            close(this->fd);
+            this->fd = -1;
+        }
+        return false;
+    }
+    return true;
+}
+
+bool UnixSocket::accept(UnixSocket &connection) {
+    int backoffMillis = 1;
+    while (true) {
+        int accepted = ::accept(this->fd, nullptr, nullptr);
+        if (accepted >= 0) {
+            connection.fd = accepted;
+            connection.buffer.clear();
+            return true;
+        }
+        // Retry the interrupted calls and the connections aborted before they were accepted
+        if (errno == EINTR || errno == ECONNABORTED) {
+            continue;
+        }
+        // Out of descriptors or memory for now, the pending connection stays queued meanwhile
+        if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(backoffMillis));
+            backoffMillis = std::min(backoffMillis * 2, MAX_ACCEPT_BACKOFF_MILLIS);
+            continue;
+        }
+        return false;
+    }
+}
+
+bool UnixSocket::receive() {
+    char bytes[RECEIVE_BYTES];
+    while (true) {
+        ssize_t received = recv(this->fd, bytes, sizeof(bytes), 0);
+        if (received > 0) {
+            this->buffer.append(bytes, (size_t) received);
+            return true;
+        }
+        if (received == 0 || errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+bool UnixSocket::readLine(std::string &line) {
+    size_t scanned = 0;
+    while (true) {
+        size_t end = this->buffer.find('\n', scanned);
+        if (end != std::string::npos) {
+            line.assign(this->buffer, 0, end);
+            this->buffer.erase(0, end + 1);
+            return true;
+        }
+        scanned = this->buffer.length();
+        if (scanned > MAX_LINE || !this->receive()) {
+            return false;
+        }
+    }
+}
+
+bool UnixSocket::read(const size_t length, std::string &data) {
+    while (this->buffer.length() < length) {
+        if (!this->receive()) {
+            return false;
+        }
+    }
+    data.assign(this->buffer, 0, length);
+    this->buffer.erase(0, length);
+    return true;
+}
+
+bool UnixSocket::write(const std::string &data) {
+    size_t written = 0;
+    while (written < data.length()) {
+        ssize_t sent = send(this->fd, data.data() + written, data.length() - written, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        written += (size_t) sent;
+    }
+    return true;
+}
+
+void UnixSocket::shutdown() {
+    ::shutdown(this->fd, SHUT_RDWR);
+}
+
+int UnixSocket::descriptor() const {
+    return this->fd;
+}
@@ -0,0 +1,75 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#ifndef RSA_UNIXSOCKET_H
+#define RSA_UNIXSOCKET_H
+
+#include <string>
+
+/**
+ * A stream socket in the UNIX domain, with the buffered reads of the line-framed protocols.
+ *
+ * The socket owns its descriptor and closes it on destruction. The writes never raise SIGPIPE,
+ * a peer that went away fails them instead.
+ */
+class UnixSocket {
+
+private:
+
+    int fd;
+    // The bytes received beyond the last line or block read
+    std::string buffer;
+
+    /** Receive more bytes into buffer, @return False at the end of the stream or on an error */
+    bool receive();
+
+public:
+
+    // A line longer than this fails readLine(), so a peer can't make the buffer grow without bound
+    const static size_t MAX_LINE = 4096;
+
+    explicit UnixSocket(int fd = -1);
+
+    UnixSocket(const UnixSocket &other) = delete;
+
+    UnixSocket &operator=(const UnixSocket &other) = delete;
+
+    ~UnixSocket();
+
+    /**
+     * Bind a listening socket to path, replacing a stale socket file there. Only the owner may connect.
+     *
+     * @return False if the socket can't be bound, with the reason on stderr
+     */
+    bool listen(const std::string &path);
+
+    /** @return False if there is no listening socket at path */
+    bool connect(const std::string &path);
+
+    /**
+     * Wait for the next connection of a listening socket. Running out of descriptors or memory is waited
+     * out with a backoff, as the connections that hold them close.
+     *
+     * @return False once the socket is shut down
+     */
+    bool accept(UnixSocket &connection);
+
+    /** @return The next line without its line break, false at the end of the stream */
+    bool readLine(std::string &line);
+
+    /** @return The next length bytes, false if the stream ends before */
+    bool read(size_t length, std::string &data);
+
+    /** @return False if the peer went away */
+    bool write(const std::string &data);
+
+    /** Wake up the threads blocked in accept() or the reads, which then fail */
+    void shutdown();
+
+    /** @return The descriptor, -1 if the socket is not open */
+    int descriptor() const;
+};
+
+
+#endif //RSA_UNIXSOCKET_H
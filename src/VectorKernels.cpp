@@ -0,0 +1,481 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#include <algorithm>
+#include <cstring>
+
+#include "VectorKernels.h"
+#include "Tuning.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RSA_X86_VECTOR_KERNELS
+#include <immintrin.h>
+#endif
+
+const unsigned long long VectorKernels::DIGIT_MASK;
+
+// A lane below 2^29 takes 32 more products of 58 bits, or 16 rows of two products, before it may overflow
+const static int MULTIPLY_NORMALIZE_ROWS = 32;
+const static int MONTGOMERY_NORMALIZE_ROWS = 16;
+
+int VectorKernels::digitCount(const int bits) {
+    int digits = (bits + DIGIT_BITS - 1) / DIGIT_BITS;
+    return (digits + VECTOR_DIGITS - 1) / VECTOR_DIGITS * VECTOR_DIGITS;
+}
+
+void VectorKernels::toDigits(const unsigned int *words, int length, unsigned long long *digits, int count) {
+    unsigned long long buffer = 0;
+    int bits = 0;
+    int index = 0;
+    for (int i = 0; i < count; i++) {
+        if (bits < DIGIT_BITS && index < length) {
+            buffer |= (unsigned long long) words[index++] << bits;
+            bits += 32;
+        }
+        digits[i] = buffer & DIGIT_MASK;
+        buffer >>= DIGIT_BITS;
+        bits = std::max(bits - DIGIT_BITS, 0);
+    }
+}
+
+void VectorKernels::fromDigits(const unsigned long long *digits, int count, unsigned int *words, int length) {
+    unsigned long long buffer = 0;
+    int bits = 0;
+    int index = 0;
+    for (int i = 0; i < length; i++) {
+        while (bits < 32 && index < count) {
+            buffer |= digits[index++] << bits;
+            bits += DIGIT_BITS;
+        }
+        words[i] = (unsigned int) buffer;
+        buffer >>= 32;
+        bits = std::max(bits - 32, 0);
+    }
+}
+
+unsigned long long VectorKernels::normalize(unsigned long long *digits, int count) {
+    unsigned long long carry = 0;
+    for (int i = 0; i < count; i++) {
+        carry += digits[i];
+        digits[i] = carry & DIGIT_MASK;
+        carry >>= DIGIT_BITS;
+    }
+    return carry;
+}
+
+void VectorKernels::normalizeLanes(unsigned long long *digits, int count, int lanes) {
+    for (int k = 0; k < lanes; k++) {
+        unsigned long long carry = 0;
+        for (int i = 0; i < count; i++) {
+            carry += digits[i * lanes + k];
+            digits[i * lanes + k] = carry & DIGIT_MASK;
+            carry >>= DIGIT_BITS;
+        }
+        digits[count * lanes + k] += carry;
+    }
+}
+
+unsigned long long VectorKernels::inverseDigit(unsigned long long m) {
+    // Newton's iteration doubles the correct low bits of m^-1 each time
+    unsigned long long inverse = 1;
+    for (int i = 0; i < 5; i++) {
+        inverse *= 2 - m * inverse;
+    }
+    return (0 - inverse) & DIGIT_MASK;
+}
+
+// ========================================
+// Begin of portable kernels
+// ========================================
+
+static void multiplyPortable(
+        const unsigned long long *x,
+        int xCount,
+        const unsigned long long *y,
+        int yCount,
+        unsigned long long *z) {
+
+    std::memset(z, 0, (xCount + yCount) * sizeof(unsigned long long));
+    for (int i = 0; i < yCount; i++) {
+        for (int j = 0; j < xCount; j++) {
+            z[i + j] += x[j] * y[i];
+        }
+        if ((i + 1) % MULTIPLY_NORMALIZE_ROWS == 0) {
+            z[i + xCount] += VectorKernels::normalize(z, i + xCount);
+        }
+    }
+    VectorKernels::normalize(z, xCount + yCount);
+}
+
+static void montgomeryMultiplyPortable(
+        const unsigned long long *a,
+        const unsigned long long *b,
+        const unsigned long long *m,
+        unsigned long long mInverse,
+        int n,
+        unsigned long long *t,
+        unsigned long long *result) {
+
+    std::memset(t, 0, (2 * n + 1) * sizeof(unsigned long long));
+    for (int i = 0; i < n; i++) {
+        // q makes the digit i of t + a * b[i] + q * m divisible by 2^29
+        unsigned long long q = ((t[i] + a[0] * b[i]) * mInverse) & VectorKernels::DIGIT_MASK;
+        for (int j = 0; j < n; j++) {
+            t[i + j] += a[j] * b[i] + m[j] * q;
+        }
+        t[i + 1] += t[i] >> VectorKernels::DIGIT_BITS;
+        if ((i + 1) % MONTGOMERY_NORMALIZE_ROWS == 0) {
+            t[i + n + 1] += VectorKernels::normalize(t + i + 1, n);
+        }
+    }
+    t[2 * n] += VectorKernels::normalize(t + n, n);
+    std::memcpy(result, t + n, n * sizeof(unsigned long long));
+}
+
+static void selectPortable(
+        const unsigned long long *table,
+        int count,
+        int n,
+        unsigned int index,
+        unsigned long long *result) {
+
+    std::memset(result, 0, n * sizeof(unsigned long long));
+    for (int i = 0; i < count; i++) {
+        // All ones if i == index, otherwise 0
+        unsigned long long difference = (unsigned long long) (i ^ index);
+        unsigned long long mask = ((difference | (0 - difference)) >> 63) - 1;
+        const unsigned long long *entry = table + (size_t) i * n;
+        for (int j = 0; j < n; j++) {
+            result[j] |= entry[j] & mask;
+        }
+    }
+}
+
+static void laneMontgomeryMultiplyPortable(
+        const unsigned long long *a,
+        const unsigned long long *b,
+        const unsigned long long *m,
+        const unsigned long long *mInverse,
+        int n,
+        int lanes,
+        unsigned long long *t,
+        unsigned long long *result) {
+
+    std::memset(t, 0, (2 * n + 1) * lanes * sizeof(unsigned long long));
+    for (int i = 0; i < n; i++) {
+        for (int k = 0; k < lanes; k++) {
+            unsigned long long bi = b[i * lanes + k];
+            unsigned long long q = ((t[i * lanes + k] + a[k] * bi) * mInverse[k]) & VectorKernels::DIGIT_MASK;
+            for (int j = 0; j < n; j++) {
+                t[(i + j) * lanes + k] += a[j * lanes + k] * bi + m[j * lanes + k] * q;
+            }
+            t[(i + 1) * lanes + k] += t[i * lanes + k] >> VectorKernels::DIGIT_BITS;
+        }
+        if ((i + 1) % MONTGOMERY_NORMALIZE_ROWS == 0) {
+            VectorKernels::normalizeLanes(t + (i + 1) * lanes, n, lanes);
+        }
+    }
+    VectorKernels::normalizeLanes(t + n * lanes, n, lanes);
+    std::memcpy(result, t + n * lanes, n * lanes * sizeof(unsigned long long));
+}
+
+static void laneSelectPortable(
+        const unsigned long long *table,
+        int count,
+        int n,
+        int lanes,
+        const unsigned int *indices,
+        unsigned long long *result) {
+
+    std::memset(result, 0, n * lanes * sizeof(unsigned long long));
+    for (int i = 0; i < count; i++) {
+        const unsigned long long *entry = table + (size_t) i * n * lanes;
+        for (int k = 0; k < lanes; k++) {
+            unsigned long long difference = (unsigned long long) (i ^ indices[k]);
+            unsigned long long mask = ((difference | (0 - difference)) >> 63) - 1;
+            for (int j = 0; j < n; j++) {
+                result[j * lanes + k] |= entry[j * lanes + k] & mask;
+            }
+        }
+    }
+}
+
+// ========================================
+// End of portable kernels
+// ========================================
+
+
+#ifdef RSA_X86_VECTOR_KERNELS
+
+// ========================================
+// Begin of AVX2 kernels
+// ========================================
+
+// _mm256_mul_epu32 multiplies the low 32 bits of each lane into 64 bits, which holds a product of two digits
+
+__attribute__((target("avx2")))
+static void multiplyAvx2(
+        const unsigned long long *x,
+        int xCount,
+        const unsigned long long *y,
+        int yCount,
+        unsigned long long *z) {
+
+    std::memset(z, 0, (xCount + yCount) * sizeof(unsigned long long));
+    for (int i = 0; i < yCount; i++) {
+        const __m256i multiplier = _mm256_set1_epi64x((long long) y[i]);
+        for (int j = 0; j < xCount; j += VectorKernels::VECTOR_DIGITS) {
+            auto *lanes = (__m256i *) (z + i + j);
+            __m256i sum = _mm256_loadu_si256(lanes);
+            sum = _mm256_add_epi64(sum, _mm256_mul_epu32(_mm256_loadu_si256((const __m256i *) (x + j)), multiplier));
+            _mm256_storeu_si256(lanes, sum);
+        }
+        if ((i + 1) % MULTIPLY_NORMALIZE_ROWS == 0) {
+            z[i + xCount] += VectorKernels::normalize(z, i + xCount);
+        }
+    }
+    VectorKernels::normalize(z, xCount + yCount);
+}
+
+__attribute__((target("avx2")))
+static void montgomeryMultiplyAvx2(
+        const unsigned long long *a,
+        const unsigned long long *b,
+        const unsigned long long *m,
+        unsigned long long mInverse,
+        int n,
+        unsigned long long *t,
+        unsigned long long *result) {
+
+    std::memset(t, 0, (2 * n + 1) * sizeof(unsigned long long));
+    for (int i = 0; i < n; i++) {
+        unsigned long long q = ((t[i] + a[0] * b[i]) * mInverse) & VectorKernels::DIGIT_MASK;
+        const __m256i multiplier = _mm256_set1_epi64x((long long) b[i]);
+        const __m256i quotient = _mm256_set1_epi64x((long long) q);
+        for (int j = 0; j < n; j += VectorKernels::VECTOR_DIGITS) {
+            auto *lanes = (__m256i *) (t + i + j);
+            __m256i sum = _mm256_loadu_si256(lanes);
+            sum = _mm256_add_epi64(sum, _mm256_mul_epu32(_mm256_loadu_si256((const __m256i *) (a + j)), multiplier));
+            sum = _mm256_add_epi64(sum, _mm256_mul_epu32(_mm256_loadu_si256((const __m256i *) (m + j)), quotient));
+            _mm256_storeu_si256(lanes, sum);
+        }
+        t[i + 1] += t[i] >> VectorKernels::DIGIT_BITS;
+        if ((i + 1) % MONTGOMERY_NORMALIZE_ROWS == 0) {
+            t[i + n + 1] += VectorKernels::normalize(t + i + 1, n);
+        }
+    }
+    t[2 * n] += VectorKernels::normalize(t + n, n);
+    std::memcpy(result, t + n, n * sizeof(unsigned long long));
+}
+
+__attribute__((target("avx2")))
+static void selectAvx2(
+        const unsigned long long *table,
+        int count,
+        int n,
+        unsigned int index,
+        unsigned long long *result) {
+
+    // Each vector of the result is accumulated in a register over all the entries
+    const __m256i wanted = _mm256_set1_epi64x(index);
+    const __m256i one = _mm256_set1_epi64x(1);
+    for (int j = 0; j < n; j += VectorKernels::VECTOR_DIGITS) {
+        __m256i word = _mm256_setzero_si256();
+        __m256i current = _mm256_setzero_si256();
+        for (int i = 0; i < count; i++) {
+            __m256i mask = _mm256_cmpeq_epi64(current, wanted);
+            __m256i entry = _mm256_loadu_si256((const __m256i *) (table + (size_t) i * n + j));
+            word = _mm256_or_si256(word, _mm256_and_si256(entry, mask));
+            current = _mm256_add_epi64(current, one);
+        }
+        _mm256_storeu_si256((__m256i *) (result + j), word);
+    }
+}
+
+/** normalizeLanes() over 4 * GROUPS lanes */
+template<int GROUPS>
+__attribute__((target("avx2")))
+static inline void normalizeLanesAvx2(unsigned long long *digits, int count) {
+    const int lanes = VectorKernels::VECTOR_DIGITS * GROUPS;
+    const __m256i mask = _mm256_set1_epi64x(VectorKernels::DIGIT_MASK);
+    __m256i carry[GROUPS];
+    for (int g = 0; g < GROUPS; g++) {
+        carry[g] = _mm256_setzero_si256();
+    }
+    for (int i = 0; i <= count; i++) {
+        for (int g = 0; g < GROUPS; g++) {
+            auto *lane = (__m256i *) (digits + i * lanes + VectorKernels::VECTOR_DIGITS * g);
+            __m256i sum = _mm256_add_epi64(_mm256_loadu_si256(lane), carry[g]);
+            if (i == count) {
+                _mm256_storeu_si256(lane, sum);
+                continue;
+            }
+            _mm256_storeu_si256(lane, _mm256_and_si256(sum, mask));
+            carry[g] = _mm256_srli_epi64(sum, VectorKernels::DIGIT_BITS);
+        }
+    }
+}
+
+/**
+ * The lanes are kept in GROUPS vectors, all of them go through each digit together,
+ * so the independent chains of the groups overlap in the pipeline.
+ */
+template<int GROUPS>
+__attribute__((target("avx2")))
+static void laneMontgomeryMultiplyAvx2(
+        const unsigned long long *a,
+        const unsigned long long *b,
+        const unsigned long long *m,
+        const unsigned long long *mInverse,
+        int n,
+        unsigned long long *t,
+        unsigned long long *result) {
+
+    const int lanes = VectorKernels::VECTOR_DIGITS * GROUPS;
+    const __m256i mask = _mm256_set1_epi64x(VectorKernels::DIGIT_MASK);
+    std::memset(t, 0, (2 * n + 1) * lanes * sizeof(unsigned long long));
+
+    __m256i inverse[GROUPS];
+    for (int g = 0; g < GROUPS; g++) {
+        inverse[g] = _mm256_loadu_si256((const __m256i *) (mInverse + VectorKernels::VECTOR_DIGITS * g));
+    }
+    for (int i = 0; i < n; i++) {
+        __m256i multiplier[GROUPS], quotient[GROUPS];
+        for (int g = 0; g < GROUPS; g++) {
+            const int offset = VectorKernels::VECTOR_DIGITS * g;
+            multiplier[g] = _mm256_loadu_si256((const __m256i *) (b + i * lanes + offset));
+            __m256i low = _mm256_add_epi64(
+                    _mm256_loadu_si256((const __m256i *) (t + i * lanes + offset)),
+                    _mm256_mul_epu32(_mm256_loadu_si256((const __m256i *) (a + offset)), multiplier[g]));
+            // Only the low 29 bits of the product matter, so do the low 32 bits of low
+            quotient[g] = _mm256_and_si256(_mm256_mul_epu32(low, inverse[g]), mask);
+        }
+        for (int j = 0; j < n; j++) {
+            for (int g = 0; g < GROUPS; g++) {
+                const int offset = j * lanes + VectorKernels::VECTOR_DIGITS * g;
+                auto *lane = (__m256i *) (t + i * lanes + offset);
+                __m256i sum = _mm256_loadu_si256(lane);
+                sum = _mm256_add_epi64(
+                        sum,
+                        _mm256_mul_epu32(_mm256_loadu_si256((const __m256i *) (a + offset)), multiplier[g]));
+                sum = _mm256_add_epi64(
+                        sum,
+                        _mm256_mul_epu32(_mm256_loadu_si256((const __m256i *) (m + offset)), quotient[g]));
+                _mm256_storeu_si256(lane, sum);
+            }
+        }
+        for (int g = 0; g < GROUPS; g++) {
+            const int offset = VectorKernels::VECTOR_DIGITS * g;
+            auto *next = (__m256i *) (t + (i + 1) * lanes + offset);
+            __m256i carry = _mm256_srli_epi64(
+                    _mm256_loadu_si256((const __m256i *) (t + i * lanes + offset)),
+                    VectorKernels::DIGIT_BITS);
+            _mm256_storeu_si256(next, _mm256_add_epi64(_mm256_loadu_si256(next), carry));
+        }
+        if ((i + 1) % MONTGOMERY_NORMALIZE_ROWS == 0) {
+            normalizeLanesAvx2<GROUPS>(t + (i + 1) * lanes, n);
+        }
+    }
+    normalizeLanesAvx2<GROUPS>(t + n * lanes, n);
+    std::memcpy(result, t + n * lanes, n * lanes * sizeof(unsigned long long));
+}
+
+__attribute__((target("avx2")))
+static void laneMontgomeryMultiplyAvx2(
+        const unsigned long long *a,
+        const unsigned long long *b,
+        const unsigned long long *m,
+        const unsigned long long *mInverse,
+        int n,
+        int lanes,
+        unsigned long long *t,
+        unsigned long long *result) {
+
+    if (lanes == 2 * VectorKernels::VECTOR_DIGITS) {
+        laneMontgomeryMultiplyAvx2<2>(a, b, m, mInverse, n, t, result);
+    } else {
+        laneMontgomeryMultiplyAvx2<1>(a, b, m, mInverse, n, t, result);
+    }
+}
+
+__attribute__((target("avx2")))
+static void laneSelectAvx2(
+        const unsigned long long *table,
+        int count,
+        int n,
+        int lanes,
+        const unsigned int *indices,
+        unsigned long long *result) {
+
+    const __m256i one = _mm256_set1_epi64x(1);
+    for (int g = 0; g < lanes; g += VectorKernels::VECTOR_DIGITS) {
+        const __m256i wanted = _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *) (indices + g)));
+        for (int j = 0; j < n; j++) {
+            __m256i word = _mm256_setzero_si256();
+            __m256i current = _mm256_setzero_si256();
+            const unsigned long long *column = table + j * lanes + g;
+            for (int i = 0; i < count; i++) {
+                __m256i entry = _mm256_loadu_si256((const __m256i *) (column + (size_t) i * n * lanes));
+                word = _mm256_or_si256(word, _mm256_and_si256(entry, _mm256_cmpeq_epi64(current, wanted)));
+                current = _mm256_add_epi64(current, one);
+            }
+            _mm256_storeu_si256((__m256i *) (result + j * lanes + g), word);
+        }
+    }
+}
+
+// ========================================
+// End of AVX2 kernels
+// ========================================
+
+#endif
+
+static const VectorKernels::Kernels PORTABLE_KERNELS = {
+        "portable",
+        multiplyPortable,
+        montgomeryMultiplyPortable,
+        selectPortable,
+        laneMontgomeryMultiplyPortable,
+        laneSelectPortable
+};
+
+VectorKernels::Kernels VectorKernels::selectKernels() {
+#ifdef RSA_X86_VECTOR_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return Kernels{
+                "avx2",
+                multiplyAvx2,
+                montgomeryMultiplyAvx2,
+                selectAvx2,
+                laneMontgomeryMultiplyAvx2,
+                laneSelectAvx2
+        };
+    }
+#endif
+    return PORTABLE_KERNELS;
+}
+
+const VectorKernels::Kernels &VectorKernels::active() {
+    // Selected on first use instead of during static initialization
+    static const Kernels kernels = Tuning::profile().vectorKernels == Tuning::PORTABLE ? PORTABLE_KERNELS : selectKernels();
+    return kernels;
+}
+
+const VectorKernels::Kernels &VectorKernels::native() {
+    static const Kernels kernels = selectKernels();
+    return kernels;
+}
+
+const VectorKernels::Kernels &VectorKernels::portable() {
+    return PORTABLE_KERNELS;
+}
+
+bool VectorKernels::vectorized() {
+    return active().multiply != PORTABLE_KERNELS.multiply;
+}
+
+const char *VectorKernels::kernelName() {
+    return active().name;
+}
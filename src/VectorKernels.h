@@ -0,0 +1,153 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#ifndef RSA_VECTORKERNELS_H
+#define RSA_VECTORKERNELS_H
+
+/**
+ * The multiply-accumulate kernels over numbers in a redundant radix of 2^29.
+ *
+ * A number is an array of digits in 64-bit lanes, the value is the sum of digits[i] * 2^(29 * i).
+ * The product of two 29-bit digits takes 58 bits, so a lane absorbs dozens of products before its carry
+ * has to be pushed into the next lane, and four lanes are multiplied and accumulated per AVX2 instruction.
+ * The carries are normalized lazily, every few rows instead of after every product.
+ *
+ * The kernels take arrays padded to whole vectors, that is a multiple of 4 digits with zeros above the value.
+ */
+class VectorKernels {
+
+public:
+
+    const static int DIGIT_BITS = 29;
+    const static unsigned long long DIGIT_MASK = (1ULL << DIGIT_BITS) - 1;
+    // The number of digits in a vector
+    const static int VECTOR_DIGITS = 4;
+
+    /**
+     * z[0, xCount + yCount) = x[0, xCount) * y[0, yCount), normalized.
+     *
+     * @param xCount A multiple of 4
+     */
+    typedef void (*MultiplyKernel)(
+            const unsigned long long *x,
+            int xCount,
+            const unsigned long long *y,
+            int yCount,
+            unsigned long long *z);
+
+    /**
+     * The almost Montgomery multiplication in R' = 2^(29 * n), result = a * b * R'^-1 % m or that plus m.
+     * When a, b < 2 * m and 4 * m < R', result < 2 * m as well, so the results chain without a final subtraction.
+     *
+     * @param n The digits of a, b, m and result, a multiple of 4
+     * @param mInverse -m^-1 % 2^29
+     * @param t Scratch space of 2 * n + 1 digits
+     * @param result Normalized, may alias a or b
+     */
+    typedef void (*MontgomeryKernel)(
+            const unsigned long long *a,
+            const unsigned long long *b,
+            const unsigned long long *m,
+            unsigned long long mInverse,
+            int n,
+            unsigned long long *t,
+            unsigned long long *result);
+
+    /**
+     * result[0, n) = table[index * n, (index + 1) * n), by reading all the count entries and masking
+     * all but the wanted one, so that neither the branches nor the memory accesses depend on index.
+     *
+     * @param n A multiple of 4
+     */
+    typedef void (*SelectKernel)(
+            const unsigned long long *table,
+            int count,
+            int n,
+            unsigned int index,
+            unsigned long long *result);
+
+    /**
+     * The MontgomeryKernel over independent numbers in lock-step, one per lane, where the digit j of lane k
+     * is at [j * lanes + k] of every array. Each lane has its own modulus m and -m^-1 % 2^29 in mInverse[k].
+     *
+     * @param lanes 4 or 8
+     * @param t Scratch space of (2 * n + 1) * lanes digits
+     */
+    typedef void (*LaneMontgomeryKernel)(
+            const unsigned long long *a,
+            const unsigned long long *b,
+            const unsigned long long *m,
+            const unsigned long long *mInverse,
+            int n,
+            int lanes,
+            unsigned long long *t,
+            unsigned long long *result);
+
+    /**
+     * The SelectKernel over entries of n digits in lanes, where lane k of result is taken from
+     * the entry indices[k] of the table, and every lane reads all the entries.
+     */
+    typedef void (*LaneSelectKernel)(
+            const unsigned long long *table,
+            int count,
+            int n,
+            int lanes,
+            const unsigned int *indices,
+            unsigned long long *result);
+
+    struct Kernels {
+        const char *name;
+        MultiplyKernel multiply;
+        MontgomeryKernel montgomeryMultiply;
+        SelectKernel select;
+        LaneMontgomeryKernel laneMontgomeryMultiply;
+        LaneSelectKernel laneSelect;
+    };
+
+private:
+
+    static Kernels selectKernels();
+
+public:
+
+    /** @return The digits to hold the given bits, rounded up to whole vectors */
+    static int digitCount(int bits);
+
+    /** digits[0, count) = the words, where the words beyond count digits are ignored */
+    static void toDigits(const unsigned int *words, int length, unsigned long long *digits, int count);
+
+    /** words[0, length) = the normalized digits, where the digits beyond length words are ignored */
+    static void fromDigits(const unsigned long long *digits, int count, unsigned int *words, int length);
+
+    /**
+     * Push the carries up so that every digit is less than 2^29.
+     *
+     * @return The carry out of digits[count - 1]
+     */
+    static unsigned long long normalize(unsigned long long *digits, int count);
+
+    /** normalize() on every lane, where the carries are added to the digit count of each lane */
+    static void normalizeLanes(unsigned long long *digits, int count, int lanes);
+
+    /** @return -m^-1 % 2^29 of an odd m */
+    static unsigned long long inverseDigit(unsigned long long m);
+
+    /** @return The kernels selected on first use, the native ones unless the tuning profile selects the portable ones */
+    static const Kernels &active();
+
+    /** @return The fastest kernels of this CPU regardless of the tuning profile */
+    static const Kernels &native();
+
+    /** @return The portable kernels, the reference of the others */
+    static const Kernels &portable();
+
+    /** @return Whether the active kernels are vectorized, otherwise the word kernels are faster */
+    static bool vectorized();
+
+    /** @return The name of the active kernels: "avx2" or "portable" */
+    static const char *kernelName();
+};
+
+
+#endif //RSA_VECTORKERNELS_H
@@ -0,0 +1,265 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#include <cstring>
+
+#include "WordKernels.h"
+#include "Tuning.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define RSA_X86_64_CARRY_KERNELS
+#endif
+
+/** @return The limb at the given word offset */
+static inline unsigned long long loadLimb(const unsigned int *words) {
+    unsigned long long limb;
+    std::memcpy(&limb, words, sizeof(limb));
+    return limb;
+}
+
+static inline void storeLimb(unsigned int *words, unsigned long long limb) {
+    std::memcpy(words, &limb, sizeof(limb));
+}
+
+// ========================================
+// Begin of portable kernels
+// ========================================
+
+static unsigned long long multiplyAddPortable(unsigned int *z, const unsigned int *x, int n, unsigned long long y) {
+    unsigned long long carry = 0;
+    for (int i = 0; i < n; i++) {
+        unsigned __int128 product = (unsigned __int128) loadLimb(x + 2 * i) * y + loadLimb(z + 2 * i) + carry;
+        storeLimb(z + 2 * i, (unsigned long long) product);
+        carry = (unsigned long long) (product >> 64);
+    }
+    return carry;
+}
+
+static unsigned long long multiplySubtractPortable(
+        unsigned int *z,
+        const unsigned int *x,
+        int n,
+        unsigned long long y) {
+
+    unsigned long long carry = 0;
+    unsigned long long borrow = 0;
+    for (int i = 0; i < n; i++) {
+        unsigned __int128 product = (unsigned __int128) loadLimb(x + 2 * i) * y + carry;
+        auto low = (unsigned long long) product;
+        carry = (unsigned long long) (product >> 64);
+
+        unsigned long long limb = loadLimb(z + 2 * i);
+        unsigned long long difference = limb - low - borrow;
+        borrow = (limb < low) || (limb - low < borrow);
+        storeLimb(z + 2 * i, difference);
+    }
+    return carry + borrow;
+}
+
+static unsigned int addPortable(unsigned int *z, const unsigned int *x, const unsigned int *y, int n) {
+    unsigned long long carry = 0;
+    for (int i = 0; i < n; i++) {
+        unsigned __int128 sum = (unsigned __int128) loadLimb(x + 2 * i) + loadLimb(y + 2 * i) + carry;
+        storeLimb(z + 2 * i, (unsigned long long) sum);
+        carry = (unsigned long long) (sum >> 64);
+    }
+    return (unsigned int) carry;
+}
+
+static unsigned int subtractPortable(unsigned int *z, const unsigned int *x, const unsigned int *y, int n) {
+    unsigned long long borrow = 0;
+    for (int i = 0; i < n; i++) {
+        unsigned long long a = loadLimb(x + 2 * i);
+        unsigned long long b = loadLimb(y + 2 * i);
+        storeLimb(z + 2 * i, a - b - borrow);
+        borrow = (a < b) || (a - b < borrow);
+    }
+    return (unsigned int) borrow;
+}
+
+// ========================================
+// End of portable kernels
+// ========================================
+
+
+#ifdef RSA_X86_64_CARRY_KERNELS
+
+// ========================================
+// Begin of BMI2 and ADX kernels
+// ========================================
+
+// The loops advance with lea and jrcxz, which leave CF and OF untouched,
+// so that the carry chains live in the flags across the iterations.
+
+static unsigned long long multiplyAddAdx(unsigned int *z, const unsigned int *x, int n, unsigned long long y) {
+    if (n <= 0) {
+        return 0;
+    }
+
+    // Two carry chains: CF for z[i] + low, OF for the high limb of the previous product
+    unsigned long long carry, low, high;
+    unsigned long long count = n;
+    __asm__ volatile (
+            "xorl %k[carry], %k[carry]\n\t"
+            "1:\n\t"
+            "mulxq (%[x]), %[low], %[high]\n\t"
+            "adcxq (%[z]), %[low]\n\t"
+            "adoxq %[carry], %[low]\n\t"
+            "movq %[low], (%[z])\n\t"
+            "movq %[high], %[carry]\n\t"
+            "leaq 8(%[x]), %[x]\n\t"
+            "leaq 8(%[z]), %[z]\n\t"
+            "leaq -1(%[count]), %[count]\n\t"
+            "jrcxz 2f\n\t"
+            "jmp 1b\n\t"
+            "2:\n\t"
+            "movl $0, %k[low]\n\t"
+            "adcxq %[low], %[carry]\n\t"
+            "adoxq %[low], %[carry]\n\t"
+            : [carry] "=&r"(carry), [low] "=&r"(low), [high] "=&r"(high),
+              [x] "+r"(x), [z] "+r"(z), [count] "+c"(count)
+            : "d"(y)
+            : "cc", "memory");
+    return carry;
+}
+
+static unsigned long long multiplySubtractAdx(
+        unsigned int *z,
+        const unsigned int *x,
+        int n,
+        unsigned long long y) {
+
+    if (n <= 0) {
+        return 0;
+    }
+
+    // OF chains the product limbs, CF chains z + ~product + 1, which is z - product
+    unsigned long long carry, low, high;
+    unsigned long long count = n;
+    __asm__ volatile (
+            "xorl %k[carry], %k[carry]\n\t"
+            "stc\n\t"
+            "1:\n\t"
+            "mulxq (%[x]), %[low], %[high]\n\t"
+            "adoxq %[carry], %[low]\n\t"
+            "notq %[low]\n\t"
+            "adcxq (%[z]), %[low]\n\t"
+            "movq %[low], (%[z])\n\t"
+            "movq %[high], %[carry]\n\t"
+            "leaq 8(%[x]), %[x]\n\t"
+            "leaq 8(%[z]), %[z]\n\t"
+            "leaq -1(%[count]), %[count]\n\t"
+            "jrcxz 2f\n\t"
+            "jmp 1b\n\t"
+            "2:\n\t"
+            // The highest product limb, plus the borrow which is the complement of CF
+            "movl $0, %k[low]\n\t"
+            "adoxq %[low], %[carry]\n\t"
+            "cmc\n\t"
+            "adcxq %[low], %[carry]\n\t"
+            : [carry] "=&r"(carry), [low] "=&r"(low), [high] "=&r"(high),
+              [x] "+r"(x), [z] "+r"(z), [count] "+c"(count)
+            : "d"(y)
+            : "cc", "memory");
+    return carry;
+}
+
+static unsigned int addAdx(unsigned int *z, const unsigned int *x, const unsigned int *y, int n) {
+    if (n <= 0) {
+        return 0;
+    }
+
+    unsigned long long limb;
+    unsigned long long count = n;
+    __asm__ volatile (
+            "clc\n\t"
+            "1:\n\t"
+            "movq (%[x]), %[limb]\n\t"
+            "adcxq (%[y]), %[limb]\n\t"
+            "movq %[limb], (%[z])\n\t"
+            "leaq 8(%[x]), %[x]\n\t"
+            "leaq 8(%[y]), %[y]\n\t"
+            "leaq 8(%[z]), %[z]\n\t"
+            "leaq -1(%[count]), %[count]\n\t"
+            "jrcxz 2f\n\t"
+            "jmp 1b\n\t"
+            "2:\n\t"
+            "movl $0, %k[limb]\n\t"
+            "adcxq %[limb], %[limb]\n\t"
+            : [limb] "=&r"(limb), [x] "+r"(x), [y] "+r"(y), [z] "+r"(z), [count] "+c"(count)
+            :
+            : "cc", "memory");
+    return (unsigned int) limb;
+}
+
+static unsigned int subtractAdx(unsigned int *z, const unsigned int *x, const unsigned int *y, int n) {
+    if (n <= 0) {
+        return 0;
+    }
+
+    unsigned long long limb;
+    unsigned long long count = n;
+    __asm__ volatile (
+            "clc\n\t"
+            "1:\n\t"
+            "movq (%[x]), %[limb]\n\t"
+            "sbbq (%[y]), %[limb]\n\t"
+            "movq %[limb], (%[z])\n\t"
+            "leaq 8(%[x]), %[x]\n\t"
+            "leaq 8(%[y]), %[y]\n\t"
+            "leaq 8(%[z]), %[z]\n\t"
+            "leaq -1(%[count]), %[count]\n\t"
+            "jrcxz 2f\n\t"
+            "jmp 1b\n\t"
+            "2:\n\t"
+            "movl $0, %k[limb]\n\t"
+            "adcq %[limb], %[limb]\n\t"
+            : [limb] "=&r"(limb), [x] "+r"(x), [y] "+r"(y), [z] "+r"(z), [count] "+c"(count)
+            :
+            : "cc", "memory");
+    return (unsigned int) limb;
+}
+
+// ========================================
+// End of BMI2 and ADX kernels
+// ========================================
+
+#endif
+
+static const WordKernels::Kernels PORTABLE_KERNELS = {
+        "portable",
+        multiplyAddPortable,
+        multiplySubtractPortable,
+        addPortable,
+        subtractPortable
+};
+
+WordKernels::Kernels WordKernels::selectKernels() {
+#ifdef RSA_X86_64_CARRY_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("bmi2") && __builtin_cpu_supports("adx")) {
+        return Kernels{"bmi2-adx", multiplyAddAdx, multiplySubtractAdx, addAdx, subtractAdx};
+    }
+#endif
+    return PORTABLE_KERNELS;
+}
+
+const WordKernels::Kernels &WordKernels::active() {
+    // Selected on first use instead of during static initialization
+    static const Kernels kernels = Tuning::profile().wordKernels == Tuning::PORTABLE ? PORTABLE_KERNELS : selectKernels();
+    return kernels;
+}
+
+const WordKernels::Kernels &WordKernels::native() {
+    static const Kernels kernels = selectKernels();
+    return kernels;
+}
+
+const WordKernels::Kernels &WordKernels::portable() {
+    return PORTABLE_KERNELS;
+}
+
+const char *WordKernels::kernelName() {
+    return active().name;
+}
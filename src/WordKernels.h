@@ -0,0 +1,79 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#ifndef RSA_WORDKERNELS_H
+#define RSA_WORDKERNELS_H
+
+/**
+ * The carry-chain kernels under the addition, subtraction, multiplication and long division of BigInteger.
+ *
+ * They work on 64-bit limbs, each limb is two consecutive words of a number array in little-endian order,
+ * so the arrays may be accessed at any word offset. On x86-64 with BMI2 and ADX the kernels
+ * keep the carries in the flags with mulx/adcx/adox, otherwise the portable ones are used.
+ */
+class WordKernels {
+
+public:
+
+    /**
+     * Let z[0, n) += x[0, n) * y.
+     *
+     * @return The carry limb
+     */
+    typedef unsigned long long (*MultiplyAddKernel)(unsigned int *z, const unsigned int *x, int n, unsigned long long y);
+
+    /**
+     * Let z[0, n) -= x[0, n) * y modulo 2^(64n).
+     *
+     * @return t such that the old z - x * y == the new z - t * 2^(64n)
+     */
+    typedef unsigned long long (*MultiplySubtractKernel)(
+            unsigned int *z,
+            const unsigned int *x,
+            int n,
+            unsigned long long y);
+
+    /**
+     * Let z[0, n) = x[0, n) + y[0, n), where z may alias x or y.
+     *
+     * @return The carry, 0 or 1
+     */
+    typedef unsigned int (*AddKernel)(unsigned int *z, const unsigned int *x, const unsigned int *y, int n);
+
+    /**
+     * Let z[0, n) = x[0, n) - y[0, n), where z may alias x or y.
+     *
+     * @return The borrow, 0 or 1
+     */
+    typedef unsigned int (*SubtractKernel)(unsigned int *z, const unsigned int *x, const unsigned int *y, int n);
+
+    struct Kernels {
+        const char *name;
+        MultiplyAddKernel multiplyAdd;
+        MultiplySubtractKernel multiplySubtract;
+        AddKernel add;
+        SubtractKernel subtract;
+    };
+
+private:
+
+    static Kernels selectKernels();
+
+public:
+
+    /** @return The kernels selected on first use, the native ones unless the tuning profile selects the portable ones */
+    static const Kernels &active();
+
+    /** @return The fastest kernels of this CPU regardless of the tuning profile */
+    static const Kernels &native();
+
+    /** @return The portable kernels, the reference of the others */
+    static const Kernels &portable();
+
+    /** @return The name of the active kernels: "bmi2-adx" or "portable" */
+    static const char *kernelName();
+};
+
+
+#endif //RSA_WORDKERNELS_H
@@ -0,0 +1,99 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#include <algorithm>
+
+#include "WorkerPool.h"
+#include "Tuning.h"
+
+class WorkerPool::Task {
+
+public:
+
+    std::function<void()> f;
+    // Written under the lock of the pool
+    bool done;
+
+    explicit Task(std::function<void()> f) : f(std::move(f)), done(false) {}
+};
+
+WorkerPool::WorkerPool(const int workers) : stopping(false) {
+    for (int i = 0; i < workers; i++) {
+        this->workers.emplace_back([this]() {
+            std::unique_lock<std::mutex> guard(this->lock);
+            while (true) {
+                this->changed.wait(guard, [this]() { return this->stopping || !this->queue.empty(); });
+                if (this->queue.empty()) {
+                    return;
+                }
+                std::shared_ptr<Task> task = this->queue.front();
+                this->queue.pop_front();
+                guard.unlock();
+                this->run(task);
+                guard.lock();
+            }
+        });
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->stopping = true;
+    }
+    this->changed.notify_all();
+    for (std::thread &worker : this->workers) {
+        worker.join();
+    }
+}
+
+WorkerPool &WorkerPool::shared() {
+    // Sized on first use instead of during static initialization
+    static WorkerPool pool(std::max(Tuning::profile().multiplyThreads > 0 ?
+                                    Tuning::profile().multiplyThreads - 1 :
+                                    (int) std::thread::hardware_concurrency() - 1, 0));
+    return pool;
+}
+
+int WorkerPool::size() const {
+    return (int) this->workers.size();
+}
+
+void WorkerPool::run(const std::shared_ptr<Task> &task) {
+    task->f();
+    // What f captured goes now, not when the last owner of the task lets it go
+    task->f = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        task->done = true;
+    }
+    this->changed.notify_all();
+}
+
+std::shared_ptr<WorkerPool::Task> WorkerPool::submit(std::function<void()> f) {
+    std::shared_ptr<Task> task = std::make_shared<Task>(std::move(f));
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->queue.push_back(task);
+    }
+    this->changed.notify_all();
+    return task;
+}
+
+void WorkerPool::wait(const std::shared_ptr<Task> &task) {
+    std::unique_lock<std::mutex> guard(this->lock);
+    while (!task->done) {
+        if (this->queue.empty()) {
+            this->changed.wait(guard);
+            continue;
+        }
+
+        // The newest task is the smallest of the recursion, and most likely the awaited one
+        std::shared_ptr<Task> next = this->queue.back();
+        this->queue.pop_back();
+        guard.unlock();
+        this->run(next);
+        guard.lock();
+    }
+}
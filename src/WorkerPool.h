@@ -0,0 +1,71 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#ifndef RSA_WORKERPOOL_H
+#define RSA_WORKERPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed set of worker threads over one queue of tasks, for the fork-join recursions of BigInteger.
+ *
+ * A thread waiting for a task runs the queued tasks meanwhile, so the tasks may submit and wait for
+ * their own sub-tasks at any depth without starving the pool, and a pool without workers runs
+ * every task on the waiting thread.
+ */
+class WorkerPool {
+
+public:
+
+    class Task;
+
+private:
+
+    std::vector<std::thread> workers;
+    std::deque<std::shared_ptr<Task>> queue;
+    // Guards queue, stopping and the completion of the tasks
+    std::mutex lock;
+    // Notified on every submitted and every finished task
+    std::condition_variable changed;
+    bool stopping;
+
+    /** Run the task on this thread and wake up its waiters */
+    void run(const std::shared_ptr<Task> &task);
+
+public:
+
+    /** @param workers The threads besides the ones that wait for the tasks */
+    explicit WorkerPool(int workers);
+
+    WorkerPool(const WorkerPool &other) = delete;
+
+    WorkerPool &operator=(const WorkerPool &other) = delete;
+
+    /** Join the workers after the queued tasks */
+    ~WorkerPool();
+
+    /**
+     * The pool shared by the multiplications, with Tuning::Profile::multiplyThreads - 1 workers
+     * (or one per core but the calling one by default), created on first use.
+     */
+    static WorkerPool &shared();
+
+    /** @return The number of workers */
+    int size() const;
+
+    /** Queue f to run on some thread, the caller must wait() for the returned task */
+    std::shared_ptr<Task> submit(std::function<void()> f);
+
+    /** Block until the task is done, running the queued tasks meanwhile */
+    void wait(const std::shared_ptr<Task> &task);
+};
+
+
+#endif //RSA_WORKERPOOL_H
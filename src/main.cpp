@@ -1,9 +1,11 @@
 #include <iostream>
-#include <sstream>
 
 #include "utils.h"
 #include "rsa.h"
 #include "BigInteger.h"
+#include "Commands.h"
+#include "MappedFile.h"
+#include "MontgomeryContext.h"
 
 void generateRSAKeys() {
     // Input RSA-number
@@ -17,7 +19,10 @@ void generateRSAKeys() {
         std::cout << "\t5. RSA-1024(1024-bits)" << std::endl;
         std::cout << "\t6. RSA-1536(1536-bits)" << std::endl;
         std::cout << "\t7. RSA-2048(2048-bits)" << std::endl;
-        std::cout << "Enter RSA number[1, 7]: ";
+        std::cout << "\t8. RSA-3072(3072-bits)" << std::endl;
+        std::cout << "\t9. RSA-4096(4096-bits)" << std::endl;
+        std::cout << "\t10. RSA-8192(8192-bits)" << std::endl;
+        std::cout << "Enter RSA number[1, 10]: ";
 
         int index = readInt(std::cin);
         switch (index) {
@@ -42,6 +47,15 @@ void generateRSAKeys() {
             case 7:
                 nLength = RSA2048;
                 break;
+            case 8:
+                nLength = RSA3072;
+                break;
+            case 9:
+                nLength = RSA4096;
+                break;
+            case 10:
+                nLength = RSA8192;
+                break;
             default:
                 std::cout << "Unrecognized RSA number, please try again." << std::endl;
                 continue;
@@ -70,11 +84,24 @@ void generateRSAKeys() {
         }
     }
 
+    // Select the number of primes
+    int primeCount = 2;
+    int maxPrimes = maxPrimeCount(nLength);
+    while (maxPrimes > 2) {
+        std::cout << "Enter the number of primes in n[2, " << maxPrimes << "]: ";
+        primeCount = readInt(std::cin);
+        if (primeCount >= 2 && primeCount <= maxPrimes) {
+            break;
+        }
+        std::cout << "Unrecognized number of primes, please try again." << std::endl;
+    }
+
     auto startTime = clock();
 
     // Generate RSA keys
-    BigInteger n, e, d;
-    generateRSANumbers(n, nLength, e, isEDefault, d);
+    RSAPrivateKey key = generateMultiPrimeRSAKey(nLength, primeCount, isEDefault);
+    const BigInteger &n = key.getN();
+    const BigInteger &e = key.getE();
 
     // Write public key
     const static std::string publicKeyFile = "./public_key.txt";
@@ -87,8 +114,7 @@ void generateRSAKeys() {
     // Write private key
     const static std::string privateKeyFile = "./private_key.txt";
     std::ofstream privateKey(privateKeyFile);
-    n.write(privateKey);
-    d.write(privateKey);
+    key.write(privateKey);
     privateKey.close();
     std::cout << "Successfully generate RSA private key on: " << privateKeyFile << std::endl;
 
@@ -110,44 +136,46 @@ void inputPublicKey(BigInteger &n, BigInteger &e) {
     std::cout << "Successfully read RSA public key." << std::endl;
 }
 
-void inputPrivateKey(BigInteger &n, BigInteger &d) {
+void inputPrivateKey(RSAPrivateKey &key) {
     std::ifstream privateKey = openReadFile("Please input your private_key file: ");
 
-    std::string nString = readString(privateKey);
-    n = BigInteger(HEXADECIMAL_RADIX, nString);
-    std::string dString = readString(privateKey);
-    d = BigInteger(HEXADECIMAL_RADIX, dString);
+    key = RSAPrivateKey::read(privateKey);
 
     privateKey.close();
     std::cout << "Successfully read RSA private key." << std::endl;
 }
 
-std::string inputPlaintext() {
-    std::ifstream plain = openReadFile("Please input your plaintext file: ");
-
-    std::ostringstream tmp;
-    tmp << plain.rdbuf();
-    std::string plaintext = tmp.str();
+void inputPlaintext(MappedFile &plaintext) {
+    // Mapped rather than copied into a string, the plaintext may be large
+    while (true) {
+        std::cout << "Please input your plaintext file: ";
+        std::string fileName = readString(std::cin);
+        if (plaintext.open(fileName)) {
+            std::cout << "Successfully open file: " << fileName << std::endl;
+            break;
+        }
+        std::cout << "The specified file: " << fileName << " doesn't exist, please retry." << std::endl;
+    }
 
-    plain.close();
     std::cout << "Successfully read plaintext." << std::endl;
-    return plaintext;
 }
 
 void encryptPlaintext() {
     // Input public key and plaintext
     BigInteger n, e;
     inputPublicKey(n, e);
-    std::string plaintext = inputPlaintext();
+    MappedFile plaintext;
+    inputPlaintext(plaintext);
 
     // Encrypt and write
     BigInteger *ciphertext = nullptr;
-    int ciphertextLength = BigInteger::encryptPlaintext(plaintext, ciphertext, e, n);
+    int ciphertextLength = BigInteger::encryptPlaintext(plaintext.data(), plaintext.size(), ciphertext, e,
+                                                        MontgomeryContext(n));
 
     const static std::string ciphertextFile = "./ciphertext.txt";
     std::ofstream ciphertextStream(ciphertextFile);
 
-    ciphertextStream << plaintext.length() << std::endl;
+    ciphertextStream << plaintext.size() << std::endl;
     ciphertextStream << ciphertextLength << std::endl;
     for (int i = 0; i < ciphertextLength; i++) {
         ciphertext[i].write(ciphertextStream);
@@ -159,8 +187,8 @@ void encryptPlaintext() {
 
 void decryptCiphertext() {
     // Input private key
-    BigInteger n, d;
-    inputPrivateKey(n, d);
+    RSAPrivateKey key;
+    inputPrivateKey(key);
 
     // Input ciphertext
     std::ifstream ciphertextStream = openReadFile("Please input your ciphertext file: ");
@@ -178,7 +206,7 @@ void decryptCiphertext() {
     const static std::string plaintextFile = "./plaintext.txt";
     std::ofstream plaintextStream(plaintextFile);
 
-    std::string plaintext = BigInteger::decryptCiphertext(plaintextLength, ciphertext, ciphertextLength, d, n);
+    std::string plaintext = BigInteger::decryptCiphertext(plaintextLength, ciphertext, ciphertextLength, key);
     plaintextStream << plaintext;
 
     plaintextStream.close();
@@ -187,18 +215,19 @@ void decryptCiphertext() {
 
 void signSignature() {
     // Input private key
-    BigInteger n, d;
-    inputPrivateKey(n, d);
+    RSAPrivateKey key;
+    inputPrivateKey(key);
 
     // Input plaintext and hash
-    std::string plaintext = inputPlaintext();
-    unsigned int hashcode = BKDRHash(plaintext);
+    MappedFile plaintext;
+    inputPlaintext(plaintext);
+    unsigned int hashcode = BKDRHash(plaintext.data(), plaintext.size());
 
     // Sign and write
     const static std::string signatureFile = "./signature.txt";
     std::ofstream signatureStream(signatureFile);
 
-    BigInteger signature = BigInteger::signSignature(hashcode, d, n);
+    BigInteger signature = BigInteger::signSignature(hashcode, key);
     signature.write(signatureStream);
 
     signatureStream.close();
@@ -211,8 +240,9 @@ void verifySignature() {
     inputPublicKey(n, e);
 
     // Input plaintext
-    std::string plaintext = inputPlaintext();
-    unsigned int hashcode = BKDRHash(plaintext);
+    MappedFile plaintext;
+    inputPlaintext(plaintext);
+    unsigned int hashcode = BKDRHash(plaintext.data(), plaintext.size());
 
     // Input signature
     std::ifstream signatureStream = openReadFile("Please input your signature file: ");
@@ -228,7 +258,12 @@ void verifySignature() {
     }
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+
+    // The subcommands for scripts, the menu otherwise
+    if (argc > 1) {
+        return Commands::run(argc, argv);
+    }
 
     std::cout << "Welcome to use EasyRSA!" << std::endl;
 
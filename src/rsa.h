@@ -5,7 +5,10 @@
 #ifndef RSA_RSA_H
 #define RSA_RSA_H
 
+#include <vector>
+
 #include "BigInteger.h"
+#include "RSAPrivateKey.h"
 
 const static int RSA576 = 576;
 const static int RSA640 = 640;
@@ -14,6 +17,9 @@ const static int RSA896 = 896;
 const static int RSA1024 = 1024;
 const static int RSA1536 = 1536;
 const static int RSA2048 = 2048;
+const static int RSA3072 = 3072;
+const static int RSA4096 = 4096;
+const static int RSA8192 = 8192;
 
 /**
  * Generate RSA numbers, which satisfied:
@@ -22,18 +28,20 @@ const static int RSA2048 = 2048;
  *
  * @param nLength The expected bit length of n
  * @param isEDefault The e will be set to 65537 if True, a random big prime otherwise
+ * @param test The probable prime test for p and q
  */
 static void generateRSANumbers(
         BigInteger &n,
         int nLength,
         BigInteger &e,
         bool isEDefault,
-        BigInteger &d) {
+        BigInteger &d,
+        BigInteger::PrimalityTest test = BigInteger::MILLER_RABIN) {
 
     int pLength = nLength >> 1;
     int qLength = nLength - pLength;
-    BigInteger p = BigInteger::generateBigPrime(pLength);
-    BigInteger q = BigInteger::generateBigPrime(qLength);
+    BigInteger p = BigInteger::generateBigPrime(pLength, test);
+    BigInteger q = BigInteger::generateBigPrime(qLength, test);
 
     n = p * q;
     BigInteger phiN = (p - 1) * (q - 1);
@@ -52,4 +60,69 @@ static void generateRSANumbers(
     }
 }
 
+/** @return The maximum number of primes for a modulus of nLength bits, the same limits as OpenSSL */
+static int maxPrimeCount(int nLength) {
+    return nLength < 1536 ? 2 : (nLength < 4096 ? 3 : (nLength < 8192 ? 4 : 5));
+}
+
+/**
+ * Generate a multi-prime RSA key in the style of RFC 8017, which satisfied:
+ *      1. n = r_1 * r_2 * ... * r_u, where r_i are distinct big primes
+ *      2. e * d == 1 (mod (r_1 - 1) * ... * (r_u - 1))
+ *
+ * @param nLength The expected bit length of n
+ * @param primeCount The number of primes u, in [2, maxPrimeCount(nLength)]
+ * @param isEDefault The e will be set to 65537 if True, a random big prime otherwise
+ * @param test The probable prime test for r_i
+ */
+static RSAPrivateKey generateMultiPrimeRSAKey(
+        int nLength,
+        int primeCount,
+        bool isEDefault,
+        BigInteger::PrimalityTest test = BigInteger::MILLER_RABIN) {
+
+    std::vector<BigInteger> primes;
+    BigInteger phiN;
+    // Only the top bit of each prime is set, so their product may fall a bit short of nLength
+    BigInteger n;
+    while (n.getBitLength() != nLength) {
+        primes.clear();
+        phiN = BigInteger(1);
+        n = BigInteger(1);
+        int remainLength = nLength;
+        for (int i = 0; i < primeCount; i++) {
+            int primeLength = remainLength / (primeCount - i);
+            BigInteger prime = BigInteger::generateBigPrime(primeLength, test);
+            bool distinct = true;
+            for (const BigInteger &other : primes) {
+                distinct = distinct && other.compareAbsolute(prime) != 0;
+            }
+            if (!distinct) {
+                --i;
+                continue;
+            }
+
+            primes.push_back(prime);
+            phiN = phiN * (prime - 1);
+            n = n * prime;
+            remainLength -= primeLength;
+        }
+    }
+
+    int eLength = nLength / primeCount;
+    int delta = phiN.getBitLength() - eLength;
+    BigInteger e = isEDefault ?
+                   BigInteger(BigInteger::E_DEFAULT) :
+                   BigInteger::generateBigPrime(eLength + (int) (rd() % delta));
+    BigInteger d = e.multiplicativeInverse(phiN);
+
+    // Ensure gcd(e, phiN) == 1
+    while ((e * d % phiN).compareAbsolute(1) != 0) {
+        e = BigInteger::generateBigPrime(eLength + (int) (rd() % delta));
+        d = e.multiplicativeInverse(phiN);
+    }
+
+    return RSAPrivateKey{e, d, primes};
+}
+
 #endif //RSA_RSA_H
@@ -6,6 +6,9 @@
 #define RSA_UTILS_H
 
 #include <random>
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
 #include <iostream>
 #include <fstream>
 
@@ -24,65 +27,77 @@ const static unsigned int UNSIGNED_INTEGER_MASK = 0xffffffff;
 const static long long LONG_LONG_MASK = 0xffffffffL;
 const static unsigned long long UNSIGNED_LONG_LONG_MASK = 0xffffffffL;
 
-/** @return The bitLength of the given array */
+/** @return The bitLength of the given array, whose highest word is not zero */
 static int calcBitLength(const unsigned int *arr, int length) {
-    unsigned int mask = 1 << 31;
-    unsigned int head = arr[length - 1];
-    int result = UNSIGNED_INTEGER_BITS;
-    while (head < mask) {
-        mask >>= 1;
-        result -= 1;
+    return (int) UNSIGNED_INTEGER_BITS - __builtin_clz(arr[length - 1]) + (length - 1) * (int) UNSIGNED_INTEGER_BITS;
+}
+
+/** @return The length of arr without its leading zero words */
+static int trimLeadingZeros(const unsigned int *arr, int length) {
+    while (length > 0 && arr[length - 1] == 0) {
+        --length;
     }
-    return result + (length - 1) * (int) UNSIGNED_INTEGER_BITS;
+    return length;
 }
 
 /** Strip the leading zeros of the given array */
 static int stripLeadingZeros(const unsigned int *src, unsigned int *&dst, int length) {
-    int firstNonZero = length - 1;
-    while (firstNonZero >= 0 && src[firstNonZero] == 0) {
-        --firstNonZero;
-    }
-    if (firstNonZero == length - 1) {
-        dst = new unsigned int[length];
-        std::memcpy(dst, src, length * UNSIGNED_INTEGER_BYTES);
-        return length;
-    } else {
-        dst = new unsigned int[firstNonZero + 1];
-        std::memcpy(dst, src, (firstNonZero + 1) * UNSIGNED_INTEGER_BYTES);
-        return firstNonZero + 1;
-    }
+    length = trimLeadingZeros(src, length);
+    dst = new unsigned int[length];
+    std::memcpy(dst, src, length * UNSIGNED_INTEGER_BYTES);
+    return length;
 }
 
 /** @return The number of leading zeros in arr[length - 1] */
 static int countLeadingZeros(const unsigned int *arr, int length) {
-    int result = 0;
     unsigned int head = arr[length - 1];
-    unsigned int currBit = 1 << 31;
-    while (head < currBit) {
-        result += 1;
-        currBit >>= 1;
-    }
-    return result;
+    return head ? __builtin_clz(head) : (int) UNSIGNED_INTEGER_BITS;
 }
 
 /** @return The tailing zeros of arr */
 static int countTailingZeros(const unsigned int *arr, int length) {
-    int result = 0;
     for (int i = 0; i < length; i++) {
-        unsigned int tail = arr[i];
-        if (!tail) {
-            result += UNSIGNED_INTEGER_BITS;
-            continue;
+        if (arr[i]) {
+            return i * (int) UNSIGNED_INTEGER_BITS + __builtin_ctz(arr[i]);
         }
+    }
+    return length * (int) UNSIGNED_INTEGER_BITS;
+}
 
-        while (!(tail & 1)) {
-            ++result;
-            tail >>= 1;
+/**
+ * dst[0, length + block] = src << (32 * block + shift), where shift < 32.
+ * dst may be src, the words are moved from the top.
+ */
+static void shiftLeftWords(const unsigned int *src, unsigned int *dst, int length, int block, int shift) {
+    if (shift == 0) {
+        dst[length + block] = 0;
+        std::memmove(dst + block, src, length * UNSIGNED_INTEGER_BYTES);
+    } else {
+        unsigned int carried = 0;
+        for (int i = length - 1; i >= 0; i--) {
+            unsigned int word = src[i];
+            dst[i + block + 1] = carried | (word >> (UNSIGNED_INTEGER_BITS - shift));
+            carried = word << shift;
         }
+        // The loop above writes dst[length + block] first, and dst[block] is the lowest word left
+        dst[block] = carried;
+    }
+    std::memset(dst, 0, block * UNSIGNED_INTEGER_BYTES);
+}
 
-        return result;
+/**
+ * dst[0, length - block) = src >> (32 * block + shift), where shift < 32 and block < length.
+ * dst may be src, the words are moved from the bottom.
+ */
+static void shiftRightWords(const unsigned int *src, unsigned int *dst, int length, int block, int shift) {
+    if (shift == 0) {
+        std::memmove(dst, src + block, (length - block) * UNSIGNED_INTEGER_BYTES);
+        return;
     }
-    return result;
+    for (int i = 0; i < length - block - 1; i++) {
+        dst[i] = (src[i + block] >> shift) | (src[i + block + 1] << (UNSIGNED_INTEGER_BITS - shift));
+    }
+    dst[length - block - 1] = src[length - 1] >> shift;
 }
 
 /**
@@ -90,54 +105,33 @@ static int countTailingZeros(const unsigned int *arr, int length) {
  * The 'dst' will have a leading zero ceil for better computing.
  */
 static int leftShiftAndAddLeadingZero(const unsigned int *src, unsigned int *&dst, int length, int shift) {
-    int result;
-    unsigned int shiftOffset = UNSIGNED_INTEGER_BITS - shift;
-    unsigned int shiftMask = ((1 << shift) - 1) << shiftOffset;
-    if (shift <= countLeadingZeros(src, length)) {
-        result = length;
-        dst = new unsigned int[length + 1];
-        dst[length] = 0;
-    } else {
-        result = length + 1;
-        dst = new unsigned int[length + 2];
-        dst[length] = (src[length - 1] & shiftMask) >> shiftOffset;
-        dst[length + 1] = 0;
-    }
-
-    for (int i = length - 1; i > 0; i--) {
-        dst[i] = (src[i] << shift) | ((src[i - 1] & shiftMask) >> shiftOffset);
-    }
-    dst[0] = src[0] << shift;
-    return result;
+    // dst has length + 2 words, the highest one is always zero
+    dst = new unsigned int[length + 2];
+    shiftLeftWords(src, dst, length, 0, shift);
+    dst[length + 1] = 0;
+    return shift <= countLeadingZeros(src, length) ? length : length + 1;
 }
 
 /** Right shift the 'src' by 'shift' bits. */
 static int rightShift(const unsigned int *src, unsigned int *&dst, int length, int shift) {
     int block = shift >> 5;
-    shift %= UNSIGNED_INTEGER_BITS;
-    unsigned int shiftMask = (1 << shift) - 1;
-    unsigned int shiftOffset = UNSIGNED_INTEGER_BITS - shift;
-
-    auto *result = new unsigned int[length];
-    for (int i = 0; i < length - 1 - block; i++) {
-        result[i] = shift ?
-                    (((src[i + block + 1] & shiftMask) << shiftOffset) | (src[i + block] >> shift)) :
-                    src[i + block];
-    }
-    result[length - block - 1] = src[length - 1] >> shift;
-    for (int i = length - block; i < length - 1; i++) {
-        result[i] = 0;
+    if (block >= length) {
+        dst = new unsigned int[0];
+        return 0;
     }
 
-    return stripLeadingZeros(result, dst, length);
+    dst = new unsigned int[length - block];
+    shiftRightWords(src, dst, length, block, shift & (UNSIGNED_INTEGER_BITS - 1));
+    return trimLeadingZeros(dst, length - block);
 }
 
-static std::random_device randomDevice;
-static std::default_random_engine randomEngine(randomDevice());
-static std::uniform_int_distribution<unsigned int> uniformDistribution(0, UNSIGNED_INTEGER_MASK);
-
 /** @return A uniform distribution random variable within [0, 2^32) */
 static unsigned int rd() {
+    // Seeded on first use rather than by a static initializer in every translation unit,
+    // and per thread so that concurrent callers never share the engine state
+    static thread_local std::random_device randomDevice;
+    static thread_local std::default_random_engine randomEngine(randomDevice());
+    static thread_local std::uniform_int_distribution<unsigned int> uniformDistribution(0, UNSIGNED_INTEGER_MASK);
     return uniformDistribution(randomEngine);
 }
 
@@ -170,15 +164,18 @@ static std::ifstream openReadFile(const std::string &msg) {
 }
 
 const static unsigned int bkdrSeed = 131;
-static unsigned int BKDRHash(const std::string &s) {
+static unsigned int BKDRHash(const char *bytes, size_t length) {
     unsigned int hashcode = 0;
-    unsigned int length = s.length();
-    for (int i = 0; i < length; i++) {
-        hashcode = hashcode * bkdrSeed + s[i];
+    for (size_t i = 0; i < length; i++) {
+        hashcode = hashcode * bkdrSeed + bytes[i];
     }
     return hashcode;
 }
 
+static unsigned int BKDRHash(const std::string &s) {
+    return BKDRHash(s.data(), s.length());
+}
+
 static void printLnSecond(clock_t delta) {
     std::cout << std::setprecision(3) << (double) delta / CLOCKS_PER_SEC << "s." << std::endl;
 }
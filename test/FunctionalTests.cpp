@@ -2,11 +2,35 @@
 // Created by Yongzao Dan on 2022/11/11.
 //
 
+#include <climits>
 #include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "gtest/gtest.h"
 
 #include "BigInteger.h"
+#include "SmallPrimeSieve.h"
+#include "BatchRSAKey.h"
+#include "MontgomeryContext.h"
+#include "WordKernels.h"
+#include "VectorKernels.h"
+#include "MultiBufferPowMod.h"
+#include "MultiBufferQueue.h"
+#include "FixedBigInteger.h"
+#include "Tuning.h"
+#include "BatchGCD.h"
+#include "WorkerPool.h"
+#include "Commands.h"
+#include "RequestStream.h"
+#include "SigningDaemon.h"
+#include "SigningClient.h"
+#include "AsyncFileIO.h"
+#include "MappedFile.h"
+#include "StreamCipher.h"
 #include "rsa.h"
 
 class FunctionalTests: public::testing::Test {
@@ -153,6 +177,150 @@ TEST_F(FunctionalTests, isPrimeTest) {
     in.close();
 }
 
+TEST_F(FunctionalTests, primalityPipelineTest) {
+    // Small numbers are decided exactly
+    for (unsigned int i = 0; i < 1000; i++) {
+        bool expected = i >= 2;
+        for (unsigned int j = 2; j * j <= i && expected; j++) {
+            expected = i % j != 0;
+        }
+        EXPECT_EQ(expected, BigInteger(i).isPrime());
+    }
+
+    // Strong pseudoprimes to base 2 without small factors must be caught by the random Miller-Rabin rounds
+    const static std::string pseudoprimes[] = {"20f68681", "1b9285c1", "1684df5f"};
+    for (const std::string &pseudoprime : pseudoprimes) {
+        EXPECT_FALSE(BigInteger(HEXADECIMAL_RADIX, pseudoprime).isPrime());
+    }
+
+    // Products of two big primes pass the trial division and are rejected by the base-2 stage
+    BigInteger::resetPrimalityStats();
+    std::ifstream in("../test/data/isPrimeTest.txt");
+    BigInteger last;
+    for (int i = 0; i < TEST_CASES; i++) {
+        std::string a;
+        in >> a;
+        BigInteger A = BigInteger(HEXADECIMAL_RADIX, a);
+        if (i > 0) {
+            EXPECT_FALSE((A * last).isPrime());
+        }
+        last = A;
+    }
+    in.close();
+
+    BigInteger::PrimalityStats stats = BigInteger::getPrimalityStats();
+    EXPECT_EQ(0ULL, stats.trialDivisionRejected);
+    EXPECT_EQ((unsigned long long) TEST_CASES - 1, stats.baseTwoRejected);
+    EXPECT_EQ(0ULL, stats.accepted);
+}
+
+TEST_F(FunctionalTests, jacobiSymbolTest) {
+    // Euler's criterion: (a/p) == a^((p - 1) / 2) (mod p) for an odd prime p
+    std::ifstream in("../test/data/isPrimeTest.txt");
+    for (int i = 0; i < TEST_CASES; i++) {
+        std::string p;
+        in >> p;
+        BigInteger P = BigInteger(HEXADECIMAL_RADIX, p);
+        BigInteger half = (P - 1) / BigInteger(2);
+        for (int a = -10; a <= 10; a++) {
+            BigInteger A = a >= 0 ? BigInteger(a) : P - BigInteger(-a);
+            BigInteger euler = A.bigPowMod(half, P);
+            int expected = euler.isZero() ? 0 : (euler.compareAbsolute(1) == 0 ? 1 : -1);
+            EXPECT_EQ(expected, P.jacobiSymbol(a));
+        }
+    }
+    in.close();
+}
+
+TEST_F(FunctionalTests, bailliePSWTest) {
+    for (unsigned int i = 0; i < 1000; i++) {
+        EXPECT_EQ(BigInteger(i).isPrime(), BigInteger(i).isPrime(BigInteger::BAILLIE_PSW));
+    }
+
+    // Strong pseudoprimes to base 2 are always rejected by the Lucas test
+    BigInteger::resetPrimalityStats();
+    const static std::string pseudoprimes[] = {"20f68681", "1b9285c1", "1684df5f"};
+    for (const std::string &pseudoprime : pseudoprimes) {
+        EXPECT_FALSE(BigInteger(HEXADECIMAL_RADIX, pseudoprime).isPrime(BigInteger::BAILLIE_PSW));
+    }
+    EXPECT_EQ(3ULL, BigInteger::getPrimalityStats().lucasRejected);
+
+    std::ifstream in("../test/data/isPrimeTest.txt");
+    BigInteger last;
+    for (int i = 0; i < TEST_CASES; i++) {
+        std::string a;
+        in >> a;
+        BigInteger A = BigInteger(HEXADECIMAL_RADIX, a);
+        EXPECT_TRUE(A.isPrime(BigInteger::BAILLIE_PSW));
+        if (i > 0) {
+            EXPECT_FALSE((A * last).isPrime(BigInteger::BAILLIE_PSW));
+            // Perfect squares have no D with (D/n) == -1
+            EXPECT_FALSE((A * A).isPrime(BigInteger::BAILLIE_PSW));
+        }
+        last = A;
+    }
+    in.close();
+
+    for (int i = 0; i < 10; i++) {
+        BigInteger p = BigInteger::generateBigPrime(512, BigInteger::BAILLIE_PSW);
+        EXPECT_TRUE(p.isPrime(BigInteger::MILLER_RABIN));
+    }
+}
+
+TEST_F(FunctionalTests, safePrimeTest) {
+    for (int i = 0; i < 5; i++) {
+        BigInteger p = BigInteger::generateSafePrime(256);
+        EXPECT_EQ(256, p.getBitLength());
+        EXPECT_TRUE(p.isPrime());
+        EXPECT_TRUE(((p - 1) / BigInteger(2)).isPrime());
+    }
+}
+
+TEST_F(FunctionalTests, strongPrimeTest) {
+    for (int i = 0; i < 5; i++) {
+        BigInteger p = BigInteger::generateStrongPrime(512);
+        EXPECT_EQ(512, p.getBitLength());
+        EXPECT_TRUE(p.isPrime());
+    }
+}
+
+static void testSmallPrimeSieve(int bitLength, bool sieveSafePrime, int testCases, int steps) {
+    for (int i = 0; i < testCases; i++) {
+        BigInteger base = BigInteger::randomBigInteger(bitLength) + BigInteger(1);
+        if (base % 2 == 0) {
+            base = base + BigInteger(1);
+        }
+
+        SmallPrimeSieve sieve{base, sieveSafePrime};
+        const int sieveBound = SmallPrimeSieve::sieveBound(base.getBitLength() + (sieveSafePrime ? 1 : 0));
+        for (int j = 0; j < steps; j++) {
+            BigInteger safe = base + base + BigInteger(1);
+            bool expected = true;
+            for (int k = 2; k < sieveBound && expected; k++) {
+                expected = base % k != 0 && (!sieveSafePrime || safe % k != 0);
+            }
+            EXPECT_EQ(expected, sieve.isCandidate());
+
+            base = base + BigInteger(2);
+            sieve.selfAddByTwo();
+        }
+    }
+}
+
+TEST_F(FunctionalTests, smallPrimeSieveTest) {
+    // The sieve covers every prime below sieveBound(), so a candidate is rejected
+    // iff it has a divisor in [2, sieveBound())
+    std::cout << "Residue kernel: " << SmallPrimeSieve::residueKernelName() << std::endl;
+    EXPECT_EQ(9601, SmallPrimeSieve::sieveBound(512));
+    EXPECT_EQ(SmallPrimeSieve::SMALL_SIEVE_LENGTH, SmallPrimeSieve::sieveBound(RSA2048 >> 1));
+    testSmallPrimeSieve(496, false, TEST_CASES, 50);
+    testSmallPrimeSieve(1024, false, TEST_CASES / 10, 10);
+
+    // The safe prime sieve also rejects the candidates where 2 * base + 1 has a small divisor
+    testSmallPrimeSieve(496, true, TEST_CASES, 50);
+    testSmallPrimeSieve(1024, true, TEST_CASES / 10, 10);
+}
+
 const static int TEST_PLAIN_TEXT_LENGTH = 300;
 
 static int randomRSANumber() {
@@ -215,4 +383,1159 @@ TEST_F(FunctionalTests, signatureTest) {
         unsigned int decode = BigInteger::decryptSignature(signature, e, n);
         EXPECT_EQ(hashcode, decode);
     }
-}
\ No newline at end of file
+}
+
+TEST_F(FunctionalTests, multiPrimeTest) {
+    const std::string keyFile = "multi_prime_test_" + std::to_string(rd()) + "_key.txt";
+    for (int i = 0; i < TEST_CASES / 20; i++) {
+        int primeCount = 2 + i % (maxPrimeCount(RSA2048) - 1);
+        RSAPrivateKey key = generateMultiPrimeRSAKey(RSA2048, primeCount, randomIsEDefault());
+        EXPECT_EQ(primeCount, key.getPrimeCount());
+        EXPECT_EQ(RSA2048, key.getN().getBitLength());
+
+        // The CRT recombination matches the plain exponentiation
+        BigInteger x = BigInteger::randomBigInteger(key.getN().getBitLength() - 1);
+        BigInteger y = key.privatePowMod(x);
+        EXPECT_EQ(0, y.compareAbsolute(x.bigPowMod(key.getD(), key.getN())));
+        EXPECT_EQ(0, y.bigPowMod(key.getE(), key.getN()).compareAbsolute(x));
+
+        // The key file keeps the CRT parameters
+        std::ofstream out(keyFile);
+        key.write(out);
+        out.close();
+        std::ifstream in(keyFile);
+        RSAPrivateKey read = RSAPrivateKey::read(in);
+        in.close();
+        EXPECT_EQ(primeCount, read.getPrimeCount());
+        EXPECT_EQ(0, read.privatePowMod(x).compareAbsolute(y));
+
+        std::string plaintext = randomPlaintext();
+        BigInteger *ciphertext = nullptr;
+        int ciphertextLength = BigInteger::encryptPlaintext(plaintext, ciphertext, key.getE(), key.getN());
+        std::string decryptText = BigInteger::decryptCiphertext(
+                TEST_PLAIN_TEXT_LENGTH,
+                ciphertext,
+                ciphertextLength,
+                read);
+        EXPECT_EQ(plaintext, decryptText);
+        delete[] ciphertext;
+
+        unsigned int hashcode = BKDRHash(plaintext);
+        BigInteger signature = BigInteger::signSignature(hashcode, read);
+        EXPECT_EQ(hashcode, BigInteger::decryptSignature(signature, key.getE(), key.getN()));
+    }
+
+    // A legacy key file has n and d only
+    std::ofstream out(keyFile);
+    RSAPrivateKey key = generateMultiPrimeRSAKey(RSA576, 2, true);
+    key.getN().write(out);
+    key.getD().write(out);
+    out.close();
+    std::ifstream in(keyFile);
+    RSAPrivateKey legacy = RSAPrivateKey::read(in);
+    in.close();
+    EXPECT_EQ(0, legacy.getPrimeCount());
+    BigInteger x = BigInteger::randomBigInteger(RSA576 - 1);
+    EXPECT_EQ(0, legacy.privatePowMod(x).compareAbsolute(key.privatePowMod(x)));
+    std::remove(keyFile.c_str());
+}
+
+TEST_F(FunctionalTests, batchRSATest) {
+    const static int batchSize = 8;
+    RSAPrivateKey key = generateMultiPrimeRSAKey(RSA1024, 2, true);
+    BatchRSAKey batchKey = BatchRSAKey(key, batchSize);
+    ASSERT_EQ(batchSize, batchKey.getBatchSize());
+    for (int i = 0; i < batchSize; i++) {
+        EXPECT_TRUE(batchKey.getExponent(i).isPrime());
+        for (int j = 0; j < i; j++) {
+            EXPECT_NE(0, batchKey.getExponent(i).compareAbsolute(batchKey.getExponent(j)));
+        }
+    }
+
+    BigInteger plaintext[batchSize], ciphertext[batchSize], decryptText[batchSize];
+    for (int count = 1; count <= batchSize; count++) {
+        for (int i = 0; i < count; i++) {
+            plaintext[i] = BigInteger::randomBigInteger(key.getN().getBitLength() - 1);
+            ciphertext[i] = batchKey.encrypt(plaintext[i], i);
+        }
+        EXPECT_TRUE(batchKey.decrypt(ciphertext, count, decryptText));
+        for (int i = 0; i < count; i++) {
+            EXPECT_EQ(0, decryptText[i].compareAbsolute(plaintext[i]));
+        }
+    }
+    EXPECT_FALSE(batchKey.decrypt(ciphertext, 0, decryptText));
+    EXPECT_FALSE(batchKey.decrypt(ciphertext, batchSize + 1, decryptText));
+}
+
+TEST_F(FunctionalTests, blindingTest) {
+    const static int threadCount = 4;
+    RSAPrivateKey key = generateMultiPrimeRSAKey(RSA1024, 2, true);
+
+    // Every thread has its own blinding pair, refreshed many times over
+    bool passed[threadCount];
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; t++) {
+        threads.emplace_back([&key, &passed, t]() {
+            passed[t] = true;
+            for (int i = 0; i < TEST_CASES; i++) {
+                BigInteger x = BigInteger::randomBigInteger(key.getN().getBitLength() - 1);
+                passed[t] &= key.blindedPowMod(x).compareAbsolute(key.privatePowMod(x)) == 0;
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    for (int t = 0; t < threadCount; t++) {
+        EXPECT_TRUE(passed[t]);
+    }
+
+    // A copy shares the cached pair, and a key without e is not blinded
+    RSAPrivateKey copy = key;
+    RSAPrivateKey legacy = RSAPrivateKey{key.getN(), key.getD()};
+    BigInteger x = BigInteger::randomBigInteger(key.getN().getBitLength() - 1);
+    EXPECT_EQ(0, copy.blindedPowMod(x).compareAbsolute(key.privatePowMod(x)));
+    EXPECT_EQ(0, legacy.blindedPowMod(x).compareAbsolute(key.privatePowMod(x)));
+}
+
+TEST_F(FunctionalTests, montgomeryContextTest) {
+    for (int i = 0; i < TEST_CASES; i++) {
+        int bitLength = 32 + (int) (rd() % 1024);
+        BigInteger mod = BigInteger::randomBigInteger(bitLength);
+        if (mod % 2u == 0) {
+            mod = mod - 1;
+        }
+        MontgomeryContext context = MontgomeryContext(mod);
+        BigInteger a = BigInteger::randomBigInteger(1 + (int) (rd() % (2 * bitLength))) % mod;
+        BigInteger b = BigInteger::randomBigInteger(bitLength + 64) % mod;
+        BigInteger x = BigInteger::randomBigInteger(1 + (int) (rd() % (3 * bitLength)));
+        BigInteger pow = BigInteger::randomBigInteger(1 + (int) (rd() % bitLength));
+
+        EXPECT_EQ(0, context.reduce(x).compareAbsolute(x % mod));
+
+        // The fused operations on residues
+        MontgomeryContext::Residue ra = context.toResidue(a), rb = context.toResidue(b), result;
+        context.mulMod(ra, rb, result);
+        EXPECT_EQ(0, context.fromResidue(result).compareAbsolute(a * b % mod));
+        EXPECT_EQ(0, context.mulMod(a, rb).compareAbsolute(a * b % mod));
+        context.sqrMod(ra, result);
+        EXPECT_EQ(0, context.fromResidue(result).compareAbsolute(a * a % mod));
+        context.addMod(ra, rb, result);
+        EXPECT_EQ(0, context.fromResidue(result).compareAbsolute((a + b) % mod));
+        context.subMod(ra, rb, result);
+        EXPECT_EQ(0, (context.fromResidue(result) + b).compareAbsolute(a.compareAbsolute(b) >= 0 ? a : a + mod));
+        context.halveMod(ra, result);
+        context.addMod(result, result, result);
+        EXPECT_TRUE(result == ra);
+
+        // The exponentiations against the plain square-and-multiply
+        BigInteger expected = BigInteger{1};
+        BigInteger base = x % mod;
+        std::string powString = pow.toString(HEXADECIMAL_RADIX);
+        for (int j = (int) powString.length() - 1; j >= 0; j--) {
+            unsigned int digit = powString[j] <= '9' ? powString[j] - '0' : powString[j] - 'a' + 10;
+            for (int k = 0; k < (int) HEXADECIMAL_BITS; k++) {
+                if ((digit >> k) & 1) {
+                    expected = expected * base % mod;
+                }
+                base = base * base % mod;
+            }
+        }
+        EXPECT_EQ(0, context.powMod(x, pow).compareAbsolute(expected));
+        EXPECT_EQ(0, context.powModConstantTime(x, pow).compareAbsolute(expected));
+
+        // An exponent wider than the modulus keeps its high words
+        BigInteger wide = (BigInteger(1) << (mod.getBitLength() + 100)) + pow;
+        EXPECT_EQ(0, context.powModConstantTime(x, wide).compareAbsolute(context.powMod(x, wide)));
+    }
+}
+
+TEST_F(FunctionalTests, constantTimeKeyTest) {
+    for (int primeCount = 1; primeCount <= 3; primeCount++) {
+        RSAPrivateKey key = generateMultiPrimeRSAKey(RSA1536, std::max(2, primeCount), true);
+        if (primeCount == 1) {
+            key = RSAPrivateKey{key.getN(), key.getD()};
+        }
+        RSAPrivateKey constantTimeKey = key;
+        constantTimeKey.setPowMode(RSAPrivateKey::CONSTANT_TIME);
+        EXPECT_EQ(RSAPrivateKey::CONSTANT_TIME, constantTimeKey.getPowMode());
+
+        for (int i = 0; i < TEST_CASES / 20; i++) {
+            BigInteger x = BigInteger::randomBigInteger(key.getN().getBitLength() - 1);
+            EXPECT_EQ(0, constantTimeKey.privatePowMod(x).compareAbsolute(key.privatePowMod(x)));
+            EXPECT_EQ(0, constantTimeKey.blindedPowMod(x).compareAbsolute(key.privatePowMod(x)));
+        }
+    }
+}
+
+TEST_F(FunctionalTests, bitwiseTest) {
+    for (int i = 0; i < TEST_CASES; i++) {
+        BigInteger x = BigInteger::randomBigInteger(1 + (int) (rd() % 1024));
+        BigInteger y = BigInteger::randomBigInteger(1 + (int) (rd() % 1024));
+        int n = (int) (rd() % 200);
+
+        // 2^n by repeated doubling
+        BigInteger power = BigInteger{1};
+        for (int j = 0; j < n; j++) {
+            power = power + power;
+        }
+        EXPECT_EQ(0, (x << n).compareAbsolute(x * power));
+        EXPECT_EQ(0, (x >> n).compareAbsolute(x / power));
+        EXPECT_EQ(0, (x << -n).compareAbsolute(x >> n));
+        EXPECT_EQ(x.getBitLength() + n, (x << n).getBitLength());
+
+        // The in-place variants
+        BigInteger z = x;
+        z <<= n;
+        EXPECT_EQ(0, z.compareAbsolute(x * power));
+        z >>= n;
+        EXPECT_EQ(0, z.compareAbsolute(x));
+        z >>= x.getBitLength();
+        EXPECT_TRUE(z.isZero());
+
+        // &, |, testBit and bitCount against the hexadecimal digits
+        std::string xString = x.toString(HEXADECIMAL_RADIX), yString = y.toString(HEXADECIMAL_RADIX);
+        std::string andString, orString;
+        int bitCount = 0;
+        for (int j = 0; j < (int) std::max(xString.length(), yString.length()); j++) {
+            auto digitAt = [j](const std::string &str) {
+                int index = (int) str.length() - 1 - j;
+                return index < 0 ? 0u : (unsigned int) (str[index] <= '9' ? str[index] - '0' : str[index] - 'a' + 10);
+            };
+            unsigned int xDigit = digitAt(xString), yDigit = digitAt(yString);
+            andString.insert(andString.begin(), "0123456789abcdef"[xDigit & yDigit]);
+            orString.insert(orString.begin(), "0123456789abcdef"[xDigit | yDigit]);
+            bitCount += __builtin_popcount(xDigit);
+            for (int k = 0; k < (int) HEXADECIMAL_BITS; k++) {
+                EXPECT_EQ((bool) ((xDigit >> k) & 1), x.testBit(j * (int) HEXADECIMAL_BITS + k));
+            }
+        }
+        andString.erase(0, std::min(andString.find_first_not_of('0'), andString.length()));
+        EXPECT_EQ(0, (x & y).compareAbsolute(BigInteger(HEXADECIMAL_RADIX, andString)));
+        EXPECT_EQ(0, (x | y).compareAbsolute(BigInteger(HEXADECIMAL_RADIX, orString)));
+        EXPECT_EQ(bitCount, x.bitCount());
+        EXPECT_EQ(n, (x << n).getLowestSetBit() - x.getLowestSetBit());
+        EXPECT_FALSE(x.testBit(x.getBitLength()));
+    }
+    EXPECT_EQ(-1, BigInteger{}.getLowestSetBit());
+}
+
+TEST_F(FunctionalTests, wordKernelsTest) {
+    // The active kernels must agree with the portable ones, including the all-ones carry paths
+    const static int maxLimbs = 20;
+    const WordKernels::Kernels &active = WordKernels::active();
+    const WordKernels::Kernels &portable = WordKernels::portable();
+    std::cout << "Word kernels: " << WordKernels::kernelName() << std::endl;
+    for (int i = 0; i < TEST_CASES; i++) {
+        int n = i % maxLimbs + 1;
+        bool saturated = i % 4 == 0;
+        unsigned int x[2 * maxLimbs], y[2 * maxLimbs], z[2 * maxLimbs], w[2 * maxLimbs];
+        for (int j = 0; j < 2 * n; j++) {
+            x[j] = saturated ? UNSIGNED_INTEGER_MASK : rd();
+            y[j] = saturated ? UNSIGNED_INTEGER_MASK : rd();
+            z[j] = w[j] = rd();
+        }
+        unsigned long long multiplier = saturated ? ~0ULL : ((unsigned long long) rd() << 32 | rd());
+
+        EXPECT_EQ(portable.multiplyAdd(z, x, n, multiplier), active.multiplyAdd(w, x, n, multiplier));
+        EXPECT_EQ(0, std::memcmp(z, w, 2 * n * sizeof(unsigned int)));
+
+        EXPECT_EQ(portable.multiplySubtract(z, y, n, multiplier), active.multiplySubtract(w, y, n, multiplier));
+        EXPECT_EQ(0, std::memcmp(z, w, 2 * n * sizeof(unsigned int)));
+
+        EXPECT_EQ(portable.add(z, z, x, n), active.add(w, w, x, n));
+        EXPECT_EQ(0, std::memcmp(z, w, 2 * n * sizeof(unsigned int)));
+
+        EXPECT_EQ(portable.subtract(z, y, z, n), active.subtract(w, y, w, n));
+        EXPECT_EQ(0, std::memcmp(z, w, 2 * n * sizeof(unsigned int)));
+    }
+
+    // Odd and even word lengths go through the padded multiplication and division
+    for (int i = 0; i < TEST_CASES; i++) {
+        BigInteger a = BigInteger::randomBigInteger(32 * (i % 13) + 64 + i);
+        BigInteger b = BigInteger::randomBigInteger(32 * (i % 7) + 33 + i % 32);
+        BigInteger q = a / b;
+        BigInteger r = a % b;
+        EXPECT_GT(0, r.compareAbsolute(b));
+        EXPECT_EQ(0, (q * b + r).compareAbsolute(a));
+        EXPECT_TRUE((a * b - b * a).isZero());
+        EXPECT_EQ(0, ((a + b) - b).compareAbsolute(a));
+    }
+}
+
+/** @return The hexadecimal string of the words, without leading zeros */
+static std::string hexOfWords(const unsigned int *words, int length) {
+    std::string hex;
+    for (int i = length - 1; i >= 0; i--) {
+        for (int shift = 28; shift >= 0; shift -= 4) {
+            char digit = "0123456789abcdef"[(words[i] >> shift) & 15];
+            if (!hex.empty() || digit != '0') {
+                hex.push_back(digit);
+            }
+        }
+    }
+    return hex.empty() ? "0" : hex;
+}
+
+TEST_F(FunctionalTests, vectorKernelsTest) {
+    const VectorKernels::Kernels &active = VectorKernels::active();
+    const VectorKernels::Kernels &portable = VectorKernels::portable();
+    std::cout << "Vector kernels: " << VectorKernels::kernelName() << std::endl;
+    for (int i = 0; i < TEST_CASES; i++) {
+        // Random words with the all-ones words in between, where the digits of 29 bits straddle the words
+        int length = 1 + (int) (rd() % 96);
+        std::vector<unsigned int> a(length), b(length), words(2 * length);
+        for (int j = 0; j < length; j++) {
+            a[j] = j % 5 == 0 ? UNSIGNED_INTEGER_MASK : rd();
+            b[j] = j % 7 == 0 ? UNSIGNED_INTEGER_MASK : rd();
+        }
+        // b is odd and a < b, so that b is also a modulus of the Montgomery multiplication
+        b[0] |= 1;
+        b[length - 1] |= 1;
+        a[length - 1] = b[length - 1] >> 1;
+
+        const int n = VectorKernels::digitCount(32 * length + 2);
+        std::vector<unsigned long long> x(n), y(n), z(2 * n), w(2 * n), t(2 * n + 1);
+        VectorKernels::toDigits(a.data(), length, x.data(), n);
+        VectorKernels::toDigits(b.data(), length, y.data(), n);
+        VectorKernels::fromDigits(x.data(), n, words.data(), length);
+        EXPECT_TRUE(std::equal(a.begin(), a.end(), words.begin()));
+
+        // The products against BigInteger
+        active.multiply(x.data(), n, y.data(), n, z.data());
+        portable.multiply(x.data(), n, y.data(), n, w.data());
+        EXPECT_TRUE(z == w);
+        VectorKernels::fromDigits(z.data(), 2 * n, words.data(), 2 * length);
+        BigInteger A = BigInteger(HEXADECIMAL_RADIX, hexOfWords(a.data(), length));
+        BigInteger B = BigInteger(HEXADECIMAL_RADIX, hexOfWords(b.data(), length));
+        BigInteger C = BigInteger(HEXADECIMAL_RADIX, hexOfWords(words.data(), 2 * length));
+        EXPECT_EQ(0, (A * B).compareAbsolute(C));
+
+        // The almost Montgomery multiplication of x * x by m = y
+        unsigned long long mInverse = VectorKernels::inverseDigit(y[0]);
+        active.montgomeryMultiply(x.data(), x.data(), y.data(), mInverse, n, t.data(), z.data());
+        portable.montgomeryMultiply(x.data(), x.data(), y.data(), mInverse, n, t.data(), w.data());
+        EXPECT_TRUE(std::equal(z.begin(), z.begin() + n, w.begin()));
+        VectorKernels::fromDigits(z.data(), n, words.data(), length + 1);
+        BigInteger product = BigInteger(HEXADECIMAL_RADIX, hexOfWords(words.data(), length + 1));
+        EXPECT_GT(0, product.compareAbsolute(B + B));
+        BigInteger R = BigInteger(1) << (n * VectorKernels::DIGIT_BITS);
+        EXPECT_EQ(0, (product * R % B).compareAbsolute(A * A % B));
+    }
+
+    // The masked select returns exactly the wanted entry
+    const static int count = 32, n = 8;
+    std::vector<unsigned long long> table(count * n), entry(n);
+    for (unsigned long long &digit : table) {
+        digit = (unsigned long long) rd() << 32 | rd();
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        active.select(table.data(), count, n, i, entry.data());
+        EXPECT_TRUE(std::equal(entry.begin(), entry.end(), table.begin() + i * n));
+        portable.select(table.data(), count, n, i, entry.data());
+        EXPECT_TRUE(std::equal(entry.begin(), entry.end(), table.begin() + i * n));
+    }
+}
+
+TEST_F(FunctionalTests, multiBufferTest) {
+    const VectorKernels::Kernels &active = VectorKernels::active();
+    const VectorKernels::Kernels &portable = VectorKernels::portable();
+    for (int lanes : {MultiBufferPowMod::LANES, MultiBufferPowMod::MAX_LANES}) {
+        // The lane kernels against the portable ones, with a different modulus in each lane
+        const int n = VectorKernels::digitCount(32 * (1 + (int) (rd() % 64)));
+        std::vector<unsigned long long> a(n * lanes), m(n * lanes), mInverse(lanes), t((2 * n + 1) * lanes);
+        std::vector<unsigned long long> z(n * lanes), w(n * lanes);
+        for (int j = 0; j < n * lanes; j++) {
+            a[j] = rd() & VectorKernels::DIGIT_MASK;
+            m[j] = j >= (n - 1) * lanes ? rd() & (VectorKernels::DIGIT_MASK >> 3) : rd() & VectorKernels::DIGIT_MASK;
+        }
+        for (int k = 0; k < lanes; k++) {
+            m[k] |= 1;
+            mInverse[k] = VectorKernels::inverseDigit(m[k]);
+        }
+        active.laneMontgomeryMultiply(a.data(), a.data(), m.data(), mInverse.data(), n, lanes, t.data(), z.data());
+        portable.laneMontgomeryMultiply(a.data(), a.data(), m.data(), mInverse.data(), n, lanes, t.data(), w.data());
+        EXPECT_TRUE(z == w);
+
+        const static int count = 16;
+        std::vector<unsigned long long> table(count * n * lanes);
+        std::vector<unsigned int> indices(lanes);
+        for (unsigned long long &digit : table) {
+            digit = (unsigned long long) rd() << 32 | rd();
+        }
+        for (int k = 0; k < lanes; k++) {
+            indices[k] = rd() % count;
+        }
+        active.laneSelect(table.data(), count, n, lanes, indices.data(), z.data());
+        portable.laneSelect(table.data(), count, n, lanes, indices.data(), w.data());
+        EXPECT_TRUE(z == w);
+        for (int k = 0; k < lanes; k++) {
+            for (int j = 0; j < n; j++) {
+                EXPECT_EQ(table[(indices[k] * n + j) * lanes + k], z[j * lanes + k]);
+            }
+        }
+
+        // Groups of mixed moduli and exponents against MontgomeryContext, with a partial group at the end
+        for (int i = 0; i < TEST_CASES / 10; i++) {
+            int total = 1 + (int) (rd() % (2 * lanes + 3));
+            int bitLength = 96 + (int) (rd() % 1024);
+            std::vector<BigInteger> x(total), pow(total), mod(total), result(total);
+            for (int j = 0; j < total; j++) {
+                mod[j] = BigInteger::randomBigInteger(bitLength - (int) (rd() % 64));
+                if (mod[j] % 2u == 0) {
+                    mod[j] = mod[j] - 1;
+                }
+                x[j] = j % 7 == 3 ? BigInteger() : BigInteger::randomBigInteger(1 + (int) (rd() % (2 * bitLength)));
+                pow[j] = j % 5 == 4 ? BigInteger() : BigInteger::randomBigInteger(1 + (int) (rd() % bitLength));
+            }
+            MultiBufferPowMod::powMod(x.data(), pow.data(), mod.data(), total, result.data(), lanes);
+            for (int j = 0; j < total; j++) {
+                EXPECT_EQ(0, result[j].compareAbsolute(MontgomeryContext(mod[j]).powMod(x[j], pow[j])));
+            }
+        }
+    }
+
+    // The private requests of keys with 1 to 3 primes, recombined once all of their parts complete
+    std::vector<RSAPrivateKey> keys;
+    keys.push_back(generateMultiPrimeRSAKey(RSA1024, 2, true));
+    keys.push_back(generateMultiPrimeRSAKey(RSA1536, 3, true));
+    keys.push_back(RSAPrivateKey{keys[0].getN(), keys[0].getD()});
+    MultiBufferQueue queue;
+    std::vector<BigInteger> expected, signatures(TEST_CASES / 4);
+    for (int i = 0; i < TEST_CASES / 4; i++) {
+        const RSAPrivateKey &key = keys[i % keys.size()];
+        BigInteger x = BigInteger::randomBigInteger(key.getN().getBitLength() - 1);
+        expected.push_back(key.privatePowMod(x));
+        queue.pushPrivate(key, x, [&signatures, i](const BigInteger &y) {
+            signatures[i] = y;
+        });
+    }
+    queue.flush();
+    EXPECT_EQ(0, queue.pending());
+    for (int i = 0; i < TEST_CASES / 4; i++) {
+        EXPECT_EQ(0, signatures[i].compareAbsolute(expected[i]));
+    }
+}
+
+template<int Bits>
+static void testFixedBigInteger(int testCases) {
+    typedef FixedBigInteger<Bits> Fixed;
+    for (int i = 0; i < testCases; i++) {
+        BigInteger a = BigInteger::randomBigInteger(1 + (int) (rd() % Bits));
+        BigInteger b = i % 5 == 0 ? a : BigInteger::randomBigInteger(1 + (int) (rd() % Bits));
+        Fixed x = Fixed(a), y = Fixed(b), sum, difference;
+        typename Fixed::Product product;
+        EXPECT_EQ(0, x.toBigInteger().compareAbsolute(a));
+
+        BigInteger carry = BigInteger((unsigned int) Fixed::add(x, y, sum)) << (64 * Fixed::LIMBS);
+        EXPECT_EQ(0, (sum.toBigInteger() + carry).compareAbsolute(a + b));
+        EXPECT_EQ(a.compareAbsolute(b), Fixed::compare(x, y));
+        if (a.compareAbsolute(b) >= 0) {
+            EXPECT_EQ(0u, Fixed::subtract(x, y, difference));
+            EXPECT_EQ(0, difference.toBigInteger().compareAbsolute(a - b));
+        } else {
+            EXPECT_EQ(1u, Fixed::subtract(x, y, difference));
+        }
+        Fixed::multiply(x, y, product);
+        EXPECT_EQ(0, product.toBigInteger().compareAbsolute(a * b));
+        Fixed::square(x, product);
+        EXPECT_EQ(0, product.toBigInteger().compareAbsolute(a * a));
+
+        // The Montgomery arithmetic against MontgomeryContext
+        BigInteger mod = BigInteger::randomBigInteger(Bits - (int) (rd() % 32));
+        if (mod % 2u == 0) {
+            mod = mod - 1;
+        }
+        FixedMontgomeryContext<Bits> context = FixedMontgomeryContext<Bits>(mod);
+        Fixed rx = context.toResidue(Fixed(a % mod)), ry = context.toResidue(Fixed(b % mod)), result;
+        context.mulMod(rx, ry, result);
+        EXPECT_EQ(0, context.fromResidue(result).toBigInteger().compareAbsolute(a * b % mod));
+        context.sqrMod(rx, result);
+        EXPECT_EQ(0, context.fromResidue(result).toBigInteger().compareAbsolute(a * a % mod));
+        EXPECT_EQ(0, context.powMod(x, y).toBigInteger().compareAbsolute(MontgomeryContext(mod).powMod(a, b)));
+    }
+}
+
+TEST_F(FunctionalTests, fixedBigIntegerTest) {
+    testFixedBigInteger<288>(TEST_CASES);
+    testFixedBigInteger<512>(TEST_CASES);
+    testFixedBigInteger<RSA2048>(TEST_CASES / 10);
+
+    // The bridge selects a width by the size of the modulus, up to the fixed max bits of the tuning profile
+    for (int i = 0; i < TEST_CASES; i++) {
+        BigInteger mod = BigInteger::randomBigInteger(3 + (int) (rd() % (FixedPowMod::MAX_BITS + 64)));
+        if (mod % 2u == 0) {
+            mod = mod - 1;
+        }
+        std::shared_ptr<const FixedPowMod> fixed = FixedPowMod::create(mod);
+        EXPECT_EQ(mod.getBitLength() <= std::min(Tuning::profile().fixedMaxBits, FixedPowMod::MAX_BITS), fixed != nullptr);
+        if (fixed) {
+            BigInteger x = BigInteger::randomBigInteger(1 + (int) (rd() % (2 * mod.getBitLength())));
+            BigInteger pow = BigInteger::randomBigInteger(1 + (int) (rd() % mod.getBitLength()));
+            EXPECT_EQ(0, fixed->powMod(x, pow).compareAbsolute(MontgomeryContext(mod).powMod(x, pow)));
+
+            // An exponent wider than the fixed width takes the variable-width path rather than overflowing
+            BigInteger wide = BigInteger::randomBigInteger(RSA2048);
+            EXPECT_EQ(0, fixed->powMod(x, wide).compareAbsolute(MontgomeryContext(mod).powMod(x, wide)));
+        }
+    }
+
+    // A key file whose CRT exponent is not below its prime is refused
+    RSAPrivateKey key = generateMultiPrimeRSAKey(512, 2, true);
+    std::stringstream written;
+    key.write(written);
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(written, line);) {
+        lines.push_back(line);
+    }
+    // n, d, e, u, then r_1, d_1 and t_1
+    lines[5] = BigInteger::randomBigInteger(RSA2048).toString(HEXADECIMAL_RADIX);
+    std::stringstream forged;
+    for (const std::string &line : lines) {
+        forged << line << "\n";
+    }
+    EXPECT_TRUE(RSAPrivateKey::read(forged).getN().isZero());
+    EXPECT_TRUE(forged.fail());
+}
+
+TEST_F(FunctionalTests, tuningTest) {
+    // The defaults keep the windows that were compiled in before the tuning profile,
+    // and the window of 7 bits for the exponents of the 4096 and 8192-bit moduli
+    Tuning::Profile defaults = Tuning::defaults();
+    for (int bits = 1; bits <= 5000; bits++) {
+        EXPECT_EQ(bits > 1791 ? 7 : bits > 671 ? 6 : bits > 239 ? 5 : bits > 79 ? 4 : bits > 23 ? 3 : 1,
+                  Tuning::window(defaults.windowBits, bits));
+        EXPECT_EQ(bits > 937 ? 6 : bits > 306 ? 5 : bits > 89 ? 4 : bits > 22 ? 3 : 1,
+                  Tuning::window(defaults.constantTimeWindowBits, bits));
+    }
+
+    // A tuning file, where the malformed entries leave the profile unchanged
+    Tuning::Profile profile = defaults;
+    std::stringstream file;
+    file << "# Written by RSATune" << std::endl << std::endl;
+    file << "word_kernels = portable" << std::endl;
+    file << "  vector_crossover_words=24  " << std::endl;
+    file << "window_bits = 100:2 2000:5 *:7" << std::endl;
+    file << "fixed_max_bits = -1" << std::endl;
+    file << "constant_time_window_bits = 100:2 50:3 *:4" << std::endl;
+    file << "unknown = 1" << std::endl;
+    EXPECT_FALSE(Tuning::read(file, profile));
+    EXPECT_EQ(Tuning::PORTABLE, profile.wordKernels);
+    EXPECT_EQ(Tuning::NATIVE, profile.vectorKernels);
+    EXPECT_EQ(24, profile.vectorCrossoverWords);
+    EXPECT_EQ(defaults.fixedMaxBits, profile.fixedMaxBits);
+    EXPECT_TRUE(profile.constantTimeWindowBits == defaults.constantTimeWindowBits);
+    EXPECT_EQ(2, Tuning::window(profile.windowBits, 100));
+    EXPECT_EQ(5, Tuning::window(profile.windowBits, 101));
+    EXPECT_EQ(7, Tuning::window(profile.windowBits, 2001));
+    EXPECT_FALSE(Tuning::apply("window_bits = 100:2", profile));
+    EXPECT_FALSE(Tuning::apply("vector_kernels = avx512", profile));
+    EXPECT_TRUE(Tuning::apply("fixed_max_bits = 0", profile));
+    EXPECT_EQ(0, profile.fixedMaxBits);
+    EXPECT_TRUE(Tuning::apply("karatsuba_threshold_words = 32", profile));
+    EXPECT_TRUE(Tuning::apply("parallel_multiply_words=4096", profile));
+    EXPECT_TRUE(Tuning::apply("multiply_threads = 8", profile));
+    EXPECT_FALSE(Tuning::apply("multiply_threads = many", profile));
+    EXPECT_EQ(8, profile.multiplyThreads);
+
+    // The written profile reads back the same
+    std::stringstream written;
+    Tuning::write(written, profile);
+    Tuning::Profile readBack = defaults;
+    EXPECT_TRUE(Tuning::read(written, readBack));
+    EXPECT_EQ(profile.wordKernels, readBack.wordKernels);
+    EXPECT_EQ(profile.vectorCrossoverWords, readBack.vectorCrossoverWords);
+    EXPECT_EQ(profile.fixedMaxBits, readBack.fixedMaxBits);
+    EXPECT_EQ(32, readBack.karatsubaThresholdWords);
+    EXPECT_EQ(4096, readBack.parallelMultiplyWords);
+    EXPECT_EQ(8, readBack.multiplyThreads);
+    EXPECT_TRUE(profile.windowBits == readBack.windowBits);
+    EXPECT_TRUE(profile.constantTimeWindowBits == readBack.constantTimeWindowBits);
+
+    // Every profile computes the same, only slower or faster
+    const Tuning::Profile original = Tuning::profile();
+    BigInteger mod = BigInteger::randomBigInteger(1024);
+    if (mod % 2u == 0) {
+        mod = mod - 1;
+    }
+    BigInteger x = BigInteger::randomBigInteger(1023), pow = BigInteger::randomBigInteger(1024);
+    BigInteger expected = MontgomeryContext(mod).powMod(x, pow);
+    for (int crossover : {0, INT_MAX}) {
+        profile.vectorCrossoverWords = crossover;
+        Tuning::setProfile(profile);
+        MontgomeryContext context = MontgomeryContext(mod);
+        EXPECT_EQ(0, context.powMod(x, pow).compareAbsolute(expected));
+        EXPECT_EQ(0, context.powModConstantTime(x, pow).compareAbsolute(expected));
+    }
+    Tuning::setProfile(original);
+}
+
+TEST_F(FunctionalTests, karatsubaMultiplyTest) {
+    // The products over Karatsuba, forked at every level of at least 64 words, equal the schoolbook ones
+    const Tuning::Profile original = Tuning::profile();
+    Tuning::Profile schoolbook = original, karatsuba = original;
+    schoolbook.karatsubaThresholdWords = INT_MAX;
+    karatsuba.karatsubaThresholdWords = 8;
+    karatsuba.parallelMultiplyWords = 64;
+    for (int i = 0; i < TEST_CASES; i++) {
+        // Balanced and unbalanced operands, up to 8192 bits
+        BigInteger x = BigInteger::randomBigInteger(1 + (int) (rd() % 8192));
+        BigInteger y = i % 2 ? BigInteger::randomBigInteger(1 + (int) (rd() % 8192)) : x;
+        if (i % 4 == 1) {
+            y = y - 1;
+        }
+
+        Tuning::setProfile(schoolbook);
+        BigInteger expected = x * y;
+        Tuning::setProfile(karatsuba);
+        EXPECT_EQ(0, (x * y).compareAbsolute(expected));
+        EXPECT_EQ(expected.getBitLength(), (y * x).getBitLength());
+    }
+    Tuning::setProfile(original);
+
+    // The tasks submit and wait for their own sub-tasks on a pool with fewer workers than tasks
+    WorkerPool pool(3);
+    std::function<long long(int, int)> sum = [&](int begin, int end) -> long long {
+        if (end - begin <= 16) {
+            long long s = 0;
+            for (int j = begin; j < end; j++) {
+                s += j;
+            }
+            return s;
+        }
+        long long left = 0;
+        std::shared_ptr<WorkerPool::Task> task = pool.submit([&]() { left = sum(begin, (begin + end) / 2); });
+        long long right = sum((begin + end) / 2, end);
+        pool.wait(task);
+        return left + right;
+    };
+    EXPECT_EQ(3, pool.size());
+    EXPECT_EQ(99999LL * 100000 / 2, sum(0, 100000));
+}
+
+TEST_F(FunctionalTests, batchGCDTest) {
+    // Moduli of fresh primes, where a few of them are rebuilt on the primes of the others
+    const static int count = 37, primeBits = 128;
+    std::vector<BigInteger> primes, moduli;
+    for (int i = 0; i < 2 * count; i++) {
+        primes.push_back(BigInteger::generateBigPrime(primeBits));
+    }
+    for (int i = 0; i < count; i++) {
+        moduli.push_back(primes[2 * i] * primes[2 * i + 1]);
+    }
+    moduli[3] = primes[0] * primes[7];
+    moduli[20] = primes[40] * primes[70];
+    moduli[36] = moduli[35];
+
+    for (int threads : {1, 4}) {
+        std::vector<BigInteger> gcds = BatchGCD::gcds(moduli, threads);
+        ASSERT_EQ(count, (int) gcds.size());
+        for (int i = 0; i < count; i++) {
+            // The definition against the plain product of the others
+            BigInteger others = BigInteger(1);
+            for (int j = 0; j < count; j++) {
+                if (j != i) {
+                    others = others * moduli[j];
+                }
+            }
+            EXPECT_EQ(0, gcds[i].compareAbsolute(moduli[i].gcd(others)));
+        }
+    }
+    EXPECT_EQ(0, BatchGCD::gcds(moduli)[0].compareAbsolute(primes[0]));
+    EXPECT_EQ(0, BatchGCD::gcds(moduli)[36].compareAbsolute(moduli[36]));
+    EXPECT_EQ(0, BatchGCD::gcds(moduli)[1].compareAbsolute(1));
+}
+
+/** @return The exit code of Commands::run() on the arguments after the program name */
+static int runCommand(std::vector<std::string> arguments) {
+    arguments.insert(arguments.begin(), "RSA");
+    std::vector<char *> argv;
+    for (std::string &argument : arguments) {
+        argv.push_back(&argument[0]);
+    }
+    return Commands::run((int) argv.size(), argv.data());
+}
+
+static std::string readFile(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    std::ostringstream content;
+    content << in.rdbuf();
+    return content.str();
+}
+
+TEST_F(FunctionalTests, commandsTest) {
+    // Several inputs in one call, each written to the input path plus the suffix
+    const std::string prefix = "commands_test_" + std::to_string(rd()) + "_";
+    const std::string publicKey = prefix + "public.txt", privateKey = prefix + "private.txt";
+    const std::string signatures = prefix + "signatures.txt";
+    std::vector<std::string> inputs, files;
+    for (int i = 0; i < 3; i++) {
+        inputs.push_back(prefix + std::to_string(i) + ".txt");
+        std::ofstream(inputs[i]) << std::string(i * 97, (char) ('a' + i)) << "end of input " << i;
+    }
+
+    EXPECT_EQ(Commands::SUCCESS, runCommand({"keygen", "-b", "640", "-p", "2", publicKey, privateKey}));
+    std::vector<std::string> encrypt = {"encrypt", "-s", ".enc", publicKey};
+    std::vector<std::string> decrypt = {"decrypt", "-s", ".dec", privateKey};
+    std::vector<std::string> sign = {"sign", "-s", ".sig", privateKey};
+    for (const std::string &input : inputs) {
+        encrypt.push_back(input);
+        decrypt.push_back(input + ".enc");
+        sign.push_back(input);
+    }
+    EXPECT_EQ(Commands::SUCCESS, runCommand(encrypt));
+    EXPECT_EQ(Commands::SUCCESS, runCommand(decrypt));
+    EXPECT_EQ(Commands::SUCCESS, runCommand(sign));
+
+    std::ofstream signatureStream(signatures);
+    for (const std::string &input : inputs) {
+        EXPECT_EQ(readFile(input), readFile(input + ".enc.dec"));
+        signatureStream << readFile(input + ".sig");
+        files.insert(files.end(), {input, input + ".enc", input + ".enc.dec", input + ".sig"});
+    }
+    signatureStream.close();
+
+    // The outputs to stdout in the order of the inputs, those of the large one held past the bound in memory
+    const std::string large = prefix + "large.txt";
+    std::ofstream(large) << std::string(MappedFile::MIN_MAPPED_BYTES, 'x');
+    EXPECT_EQ(Commands::SUCCESS, runCommand({"encrypt", "-s", ".enc", publicKey, large}));
+    testing::internal::CaptureStdout();
+    EXPECT_EQ(Commands::SUCCESS, runCommand({"encrypt", publicKey, large, inputs[0], large, inputs[1]}));
+    EXPECT_TRUE(readFile(large + ".enc") + readFile(inputs[0] + ".enc") + readFile(large + ".enc") +
+                readFile(inputs[1] + ".enc") == testing::internal::GetCapturedStdout());
+    files.insert(files.end(), {large, large + ".enc"});
+
+    std::vector<std::string> verify = {"verify", publicKey, signatures};
+    verify.insert(verify.end(), inputs.begin(), inputs.end());
+    EXPECT_EQ(Commands::SUCCESS, runCommand(verify));
+    std::swap(verify[3], verify[4]);
+    EXPECT_EQ(Commands::FAILURE, runCommand(verify));
+
+    // 0 would verify the empty message, whose hash is 0, and n the same
+    const std::string empty = prefix + "empty.txt", forged = prefix + "forged.txt";
+    std::ofstream(empty).close();
+    BigInteger n, e;
+    ASSERT_TRUE(Commands::readPublicKey(publicKey, n, e));
+    for (const std::string &signature : {std::string("0"), std::string("00"), n.toString(HEXADECIMAL_RADIX)}) {
+        std::ofstream(forged) << signature << "\n";
+        EXPECT_EQ(Commands::FAILURE, runCommand({"verify", publicKey, forged, empty}));
+    }
+    files.insert(files.end(), {empty, forged});
+
+    // A pipe, like a process substitution, is read rather than refused
+    const std::string pipe = prefix + "pipe";
+    ASSERT_EQ(0, mkfifo(pipe.c_str(), 0600));
+    std::thread writer([&]() {
+        std::ofstream(pipe) << readFile(inputs[1]);
+    });
+    EXPECT_EQ(Commands::SUCCESS, runCommand({"sign", "-s", ".sig", privateKey, pipe}));
+    writer.join();
+    EXPECT_EQ(readFile(inputs[1] + ".sig"), readFile(pipe + ".sig"));
+    files.insert(files.end(), {pipe, pipe + ".sig"});
+
+    // A directory stands for its files, but the outputs of the earlier calls
+    const std::string directory = prefix + "directory";
+    ASSERT_EQ(0, mkdir(directory.c_str(), 0700));
+    for (int i = 0; i < 3; i++) {
+        std::ofstream(directory + "/" + std::to_string(i)) << "file " << i;
+    }
+    EXPECT_EQ(Commands::SUCCESS, runCommand({"encrypt", "-s", ".enc", publicKey, directory}));
+    EXPECT_EQ(Commands::SUCCESS, runCommand({"encrypt", "-s", ".enc", publicKey, directory + "/"}));
+    EXPECT_EQ(Commands::SUCCESS, runCommand({"decrypt", "-s", ".dec", privateKey, directory + "/0.enc",
+                                             directory + "/1.enc", directory + "/2.enc"}));
+    for (int i = 0; i < 3; i++) {
+        const std::string file = directory + "/" + std::to_string(i);
+        EXPECT_EQ("file " + std::to_string(i), readFile(file + ".enc.dec"));
+        EXPECT_FALSE(std::ifstream(file + ".enc.enc").good());
+        files.insert(files.end(), {file, file + ".enc", file + ".enc.dec"});
+    }
+
+    EXPECT_EQ(Commands::USAGE, runCommand({"encrypt"}));
+    EXPECT_EQ(Commands::USAGE, runCommand({"keygen", "-b", "1024", "-p", "3"}));
+    EXPECT_EQ(Commands::USAGE, runCommand({"unknown"}));
+    EXPECT_EQ(Commands::FAILURE, runCommand({"sign", prefix + "missing.txt"}));
+
+    files.insert(files.end(), {publicKey, privateKey, signatures});
+    for (const std::string &file : files) {
+        std::remove(file.c_str());
+    }
+    rmdir(directory.c_str());
+}
+
+TEST_F(FunctionalTests, asyncFileIOTest) {
+    const std::string prefix = "async_file_io_test_" + std::to_string(rd()) + "_";
+    std::vector<std::string> contents;
+    for (int size : {0, 1, 4095, 4096, 100000, 3 << 20}) {
+        std::string content(size, '\0');
+        for (char &c : content) {
+            c = (char) rd();
+        }
+        contents.push_back(content);
+    }
+
+    for (AsyncFileIO::Backend backend : {AsyncFileIO::IO_URING, AsyncFileIO::THREADS}) {
+        std::unique_ptr<AsyncFileIO> io = AsyncFileIO::create(4, backend);
+        const int count = (int) contents.size();
+
+        // All the writes and then all the reads in flight at once, completed in any order
+        for (int i = 0; i < count; i++) {
+            io->write(i, prefix + std::to_string(i), contents[i]);
+        }
+        std::vector<bool> completed(count, false);
+        for (int i = 0; i < count; i++) {
+            AsyncFileIO::Completion completion = io->wait();
+            EXPECT_EQ(AsyncFileIO::WRITE, completion.kind);
+            EXPECT_TRUE(completion.ok);
+            completed[completion.tag] = true;
+        }
+        EXPECT_EQ(std::vector<bool>(count, true), completed);
+
+        for (int i = 0; i < count; i++) {
+            io->read(i, prefix + std::to_string(i));
+        }
+        io->read(count, prefix + "missing");
+        io->post(count + 1, false);
+        for (int i = 0; i < count + 2; i++) {
+            AsyncFileIO::Completion completion = io->wait();
+            if (completion.tag < count) {
+                EXPECT_EQ(AsyncFileIO::READ, completion.kind);
+                EXPECT_TRUE(completion.ok);
+                EXPECT_TRUE(contents[completion.tag] == completion.data);
+            } else {
+                EXPECT_EQ(completion.tag == count ? AsyncFileIO::READ : AsyncFileIO::POSTED, completion.kind);
+                EXPECT_FALSE(completion.ok);
+            }
+        }
+
+        // A directory is not a file to read or write
+        io->read(0, ".");
+        io->write(1, ".", "x");
+        EXPECT_FALSE(io->wait().ok);
+        EXPECT_FALSE(io->wait().ok);
+    }
+
+    for (int i = 0; i < (int) contents.size(); i++) {
+        std::remove((prefix + std::to_string(i)).c_str());
+    }
+}
+
+TEST_F(FunctionalTests, mappedFileTest) {
+    const std::string prefix = "mapped_file_test_" + std::to_string(rd()) + "_";
+    const size_t sizes[] = {0, 1, 4096, MappedFile::MIN_MAPPED_BYTES - 1, MappedFile::MIN_MAPPED_BYTES,
+                            MappedFile::MIN_MAPPED_BYTES + 12345};
+    std::vector<std::string> files;
+    for (size_t size : sizes) {
+        std::string content(size, '\0');
+        for (char &c : content) {
+            c = (char) rd();
+        }
+        files.push_back(prefix + std::to_string(size));
+        std::ofstream(files.back(), std::ios::binary) << content;
+
+        // Only the large files are mapped, the bytes are the same either way
+        MappedFile file;
+        ASSERT_TRUE(file.open(files.back()));
+        EXPECT_EQ(size >= MappedFile::MIN_MAPPED_BYTES, file.mapped());
+        ASSERT_EQ(size, file.size());
+        EXPECT_TRUE(std::equal(content.begin(), content.end(), file.data()));
+        EXPECT_EQ(BKDRHash(content), BKDRHash(file.data(), file.size()));
+    }
+    MappedFile missing(std::string("held"));
+    EXPECT_EQ("held", std::string(missing.data(), missing.size()));
+    EXPECT_FALSE(missing.open(prefix + "missing"));
+
+    // The blocks packed in place are the ones of the string, and bytes past ASCII round-trip
+    RSAPrivateKey key = generateMultiPrimeRSAKey(RSA768, 2, true);
+    const MontgomeryContext context(key.getN());
+    for (int i = 0; i < TEST_CASES; i++) {
+        std::string plaintext(1 + rd() % 300, ' ');
+        for (char &c : plaintext) {
+            c = (char) ('a' + rd() % 26);
+        }
+        EXPECT_EQ(0, BigInteger(ASCII_RADIX, plaintext).compareAbsolute(
+                BigInteger::fromBytes(plaintext.data(), plaintext.size())));
+
+        BigInteger *expected = nullptr, *actual = nullptr;
+        int expectedLength = BigInteger::encryptPlaintext(plaintext, expected, key.getE(), key.getN());
+        int actualLength = BigInteger::encryptPlaintext(plaintext.data(), plaintext.size(), actual, key.getE(),
+                                                        context);
+        ASSERT_EQ(expectedLength, actualLength);
+        for (int j = 0; j < actualLength; j++) {
+            EXPECT_EQ(0, expected[j].compareAbsolute(actual[j]));
+        }
+        delete[] expected;
+        delete[] actual;
+
+        for (char &c : plaintext) {
+            c = (char) rd();
+        }
+        int ciphertextLength = BigInteger::encryptPlaintext(plaintext.data(), plaintext.size(), actual,
+                                                            key.getE(), context);
+        EXPECT_EQ(plaintext, BigInteger::decryptCiphertext((int) plaintext.size(), actual, ciphertextLength, key));
+        delete[] actual;
+    }
+
+    // Leading zero bytes leave no zero words on top
+    const std::string zeros(9, '\0'), padded = zeros + "a";
+    EXPECT_TRUE(BigInteger::fromBytes(zeros.data(), zeros.size()).isZero());
+    EXPECT_EQ(7, BigInteger::fromBytes(padded.data(), padded.size()).getBitLength());
+
+    // sign and verify over a mapped input
+    const std::string publicKey = prefix + "public.txt", privateKey = prefix + "private.txt";
+    const std::string large = files.back();
+    EXPECT_EQ(Commands::SUCCESS, runCommand({"keygen", "-b", "640", "-p", "2", publicKey, privateKey}));
+    EXPECT_EQ(Commands::SUCCESS, runCommand({"sign", "-s", ".sig", privateKey, large}));
+    EXPECT_EQ(Commands::SUCCESS, runCommand({"verify", publicKey, large + ".sig", large}));
+
+    files.insert(files.end(), {publicKey, privateKey, large + ".sig"});
+    for (const std::string &file : files) {
+        std::remove(file.c_str());
+    }
+}
+
+TEST_F(FunctionalTests, streamCipherTest) {
+    RSAPrivateKey key = generateMultiPrimeRSAKey(RSA576, 2, true);
+    const MontgomeryContext context(key.getN());
+    const size_t blockBytes = (RSA576 - 1) / ASCII_BITS;
+    WorkerPool pool(2);
+    for (size_t size : {(size_t) 0, (size_t) 1, blockBytes - 1, blockBytes, blockBytes + 1, 20 * blockBytes + 7}) {
+        // Runs of zero bytes make blocks shorter than they hold
+        std::string plaintext(size, '\0');
+        for (size_t i = 0; i < size; i++) {
+            plaintext[i] = i / blockBytes % 3 == 1 ? '\0' : (char) rd();
+        }
+        BigInteger *expected = nullptr;
+        int expectedLength = size == 0 ? 0 : BigInteger::encryptPlaintext(plaintext, expected, key.getE(), context);
+
+        // Chunks of any size, pulled one block at a time once the pipeline is full
+        const int depth = 3;
+        StreamEncryptor encryptor(key.getE(), context, size, depth, pool);
+        EXPECT_EQ(expectedLength, encryptor.getBlockCount());
+        std::vector<BigInteger> ciphertext;
+        BigInteger block;
+        for (size_t taken = 0; taken < size;) {
+            taken += encryptor.push(plaintext.data() + taken, std::min((size_t) (1 + rd() % 100), size - taken));
+            EXPECT_LE(encryptor.pending(), depth);
+            if (encryptor.full() && encryptor.pull(block)) {
+                ciphertext.push_back(block);
+            }
+        }
+        EXPECT_EQ(0u, encryptor.push("beyond", 6));
+        while (encryptor.pull(block)) {
+            ciphertext.push_back(block);
+        }
+        ASSERT_EQ(expectedLength, (int) ciphertext.size());
+        for (int i = 0; i < expectedLength; i++) {
+            EXPECT_EQ(0, expected[i].compareAbsolute(ciphertext[i]));
+        }
+        delete[] expected;
+
+        StreamDecryptor decryptor(key, size, depth, pool);
+        std::string decrypted, chunk;
+        for (const BigInteger &cipher : ciphertext) {
+            if (!decryptor.push(cipher)) {
+                ASSERT_TRUE(decryptor.pull(chunk));
+                decrypted += chunk;
+                EXPECT_TRUE(decryptor.push(cipher));
+            }
+        }
+        while (decryptor.pull(chunk)) {
+            decrypted += chunk;
+        }
+        EXPECT_TRUE(plaintext == decrypted);
+    }
+
+    // Dropped with blocks still running
+    {
+        std::string plaintext(10 * blockBytes, 'x');
+        StreamEncryptor encryptor(key.getE(), context, plaintext.size(), 4, pool);
+        EXPECT_EQ(4 * blockBytes, encryptor.push(plaintext.data(), plaintext.size()));
+    }
+
+    // A mapped input streams through the commands to its output file and back
+    const std::string prefix = "stream_cipher_test_" + std::to_string(rd()) + "_";
+    const std::string publicKey = prefix + "public.txt", privateKey = prefix + "private.txt";
+    const std::string input = prefix + "input";
+    std::string content(MappedFile::MIN_MAPPED_BYTES + 12345, '\0');
+    for (char &c : content) {
+        c = (char) rd();
+    }
+    std::ofstream(input, std::ios::binary) << content;
+    EXPECT_EQ(Commands::SUCCESS, runCommand({"keygen", "-b", "512", "-p", "2", publicKey, privateKey}));
+    EXPECT_EQ(Commands::SUCCESS, runCommand({"encrypt", "-s", ".enc", publicKey, input}));
+    EXPECT_EQ(Commands::SUCCESS, runCommand({"decrypt", "-s", ".dec", privateKey, input + ".enc"}));
+    EXPECT_TRUE(content == readFile(input + ".enc.dec"));
+
+    for (const std::string &file : {publicKey, privateKey, input, input + ".enc", input + ".enc.dec"}) {
+        std::remove(file.c_str());
+    }
+}
+
+TEST_F(FunctionalTests, requestStreamTest) {
+    const std::string prefix = "request_stream_test_" + std::to_string(rd()) + "_";
+    const std::string publicKey = prefix + "public.txt", privateKey = prefix + "private.txt";
+    RSAPrivateKey key = generateMultiPrimeRSAKey(RSA768, 2, true);
+    std::ofstream publicKeyStream(publicKey), privateKeyStream(privateKey);
+    key.getN().write(publicKeyStream);
+    key.getE().write(publicKeyStream);
+    key.write(privateKeyStream);
+    publicKeyStream.close();
+    privateKeyStream.close();
+
+    // Many requests in flight, answered in order
+    std::vector<std::string> messages;
+    std::stringstream requests, responses;
+    for (int i = 0; i < 200; i++) {
+        messages.push_back("message " + std::to_string(i) + std::string(i % 150, '.'));
+        requests << (i % 2 ? "sign " + privateKey : "encrypt " + publicKey) << " " << messages[i] << std::endl;
+    }
+    requests << "unknown " << publicKey << " x" << std::endl << "sign " << prefix << "missing.txt x" << std::endl;
+    EXPECT_EQ(2, RequestStream(4, RequestStream::LINES).serve(requests, responses));
+
+    std::stringstream followUps, followUpResponses;
+    for (int i = 0; i < 200; i++) {
+        std::string status, result;
+        responses >> status;
+        std::getline(responses, result);
+        ASSERT_EQ("ok", status);
+        followUps << (i % 2 ? "verify " + publicKey : "decrypt " + privateKey) << result << " "
+                  << (i % 2 ? messages[i] : "") << std::endl;
+    }
+    std::string line;
+    std::getline(responses, line);
+    EXPECT_EQ("error unknown operation unknown", line);
+    std::getline(responses, line);
+    EXPECT_EQ(0u, line.find("error can't read the private key"));
+
+    EXPECT_EQ(0, RequestStream(3, RequestStream::LINES).serve(followUps, followUpResponses));
+    for (int i = 0; i < 200; i++) {
+        std::getline(followUpResponses, line);
+        EXPECT_EQ(i % 2 ? "ok verified" : "ok " + messages[i], line);
+    }
+
+    // The length-prefixed frames carry any bytes
+    const std::string binary = std::string("line\nbreak\0and a zero", 20);
+    std::stringstream frames, frameResponses;
+    frames << "encrypt " << publicKey << " " << binary.length() << std::endl << binary;
+    std::string status;
+    size_t length;
+    RequestStream(2, RequestStream::LENGTH_PREFIXED).serve(frames, frameResponses);
+    frameResponses >> status >> length;
+    frameResponses.get();
+    std::string ciphertext(length, '\0');
+    frameResponses.read(&ciphertext[0], (std::streamsize) length);
+    EXPECT_EQ("ok", status);
+
+    std::stringstream decryptFrame, decryptResponse;
+    decryptFrame << "decrypt " << privateKey << " " << ciphertext.length() << std::endl << ciphertext;
+    RequestStream(2, RequestStream::LENGTH_PREFIXED).serve(decryptFrame, decryptResponse);
+    EXPECT_EQ("ok " + std::to_string(binary.length()) + "\n" + binary, decryptResponse.str());
+
+    // A length past the cap, or past long long, ends the stream instead of the allocation
+    for (const std::string &length : {std::string("99999999999999"), std::string("99999999999999999999")}) {
+        std::stringstream hugeFrame, hugeResponse;
+        hugeFrame << "encrypt " << publicKey << " " << length << std::endl << "x";
+        EXPECT_EQ(1, RequestStream(2, RequestStream::LENGTH_PREFIXED).serve(hugeFrame, hugeResponse));
+        EXPECT_EQ("error 16\nmalformed length", hugeResponse.str());
+    }
+
+    // The signatures 0 and n would verify the empty message
+    std::stringstream forged, forgedResponses;
+    forged << "verify " << publicKey << " 0 " << std::endl
+           << "verify " << publicKey << " " << key.getN().toString(HEXADECIMAL_RADIX) << " " << std::endl;
+    RequestStream(2, RequestStream::LINES).serve(forged, forgedResponses);
+    EXPECT_EQ("ok failed\nok failed\n", forgedResponses.str());
+
+    std::remove(publicKey.c_str());
+    std::remove(privateKey.c_str());
+}
+
+TEST_F(FunctionalTests, signingDaemonTest) {
+    const std::string socketPath = "/tmp/signing_daemon_test_" + std::to_string(rd()) + ".sock";
+    RSAPrivateKey key = generateMultiPrimeRSAKey(RSA768, 2, true);
+    // A legacy key has neither the primes nor e, so it is neither split nor blinded
+    RSAPrivateKey legacy = RSAPrivateKey(key.getN(), key.getD());
+    SigningDaemon daemon({{"key", key}, {"legacy", legacy}}, 300, 2);
+    ASSERT_TRUE(daemon.listen(socketPath));
+    std::thread server([&daemon]() {
+        daemon.serve();
+    });
+
+    // Concurrent connections make the batches
+    const static int clients = 8, requests = 10;
+    std::vector<bool> passed(clients, true);
+    std::vector<std::thread> threads;
+    for (int c = 0; c < clients; c++) {
+        threads.emplace_back([&, c]() {
+            SigningClient client;
+            if (!client.connect(socketPath)) {
+                passed[c] = false;
+                return;
+            }
+            for (int i = 0; i < requests; i++) {
+                const std::string keyName = (c + i) % 3 ? "key" : "legacy";
+                std::string message = "message " + std::to_string(c) + " " + std::to_string(i) + std::string(i * 9, '.');
+                bool ok = false;
+                std::string result;
+                if (i % 2) {
+                    BigInteger *ciphertext = nullptr;
+                    int ciphertextLength = BigInteger::encryptPlaintext(message, ciphertext, key.getE(), key.getN());
+                    std::string payload = std::to_string(message.length()) + " " + std::to_string(ciphertextLength);
+                    for (int j = 0; j < ciphertextLength; j++) {
+                        payload += " " + ciphertext[j].toString(HEXADECIMAL_RADIX);
+                    }
+                    delete[] ciphertext;
+                    passed[c] = passed[c] && client.request("decrypt", keyName, payload, ok, result) && ok &&
+                                result == message;
+                } else {
+                    passed[c] = passed[c] && client.request("sign", keyName, message, ok, result) && ok &&
+                                result == BigInteger::signSignature(BKDRHash(message), key).toString(HEXADECIMAL_RADIX);
+                }
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    for (int c = 0; c < clients; c++) {
+        EXPECT_TRUE(passed[c]);
+    }
+
+    SigningClient client;
+    ASSERT_TRUE(client.connect(socketPath));
+    bool ok;
+    std::string result;
+    EXPECT_TRUE(client.request("decrypt", "key", "0 0", ok, result));
+    EXPECT_TRUE(ok);
+    EXPECT_EQ("", result);
+    EXPECT_TRUE(client.request("sign", "missing", "x", ok, result));
+    EXPECT_FALSE(ok);
+    EXPECT_EQ("unknown key missing", result);
+    EXPECT_TRUE(client.request("verify", "key", "x", ok, result));
+    EXPECT_FALSE(ok);
+    EXPECT_TRUE(client.request("decrypt", "key", "3 2 abc", ok, result));
+    EXPECT_FALSE(ok);
+    EXPECT_EQ("malformed ciphertext", result);
+
+    SigningDaemon::Stats stats = daemon.stats();
+    EXPECT_EQ(clients * requests + 1, stats.requests);
+    EXPECT_EQ(3, stats.failures);
+    EXPECT_TRUE(stats.batches >= 1 && stats.batches <= stats.requests);
+    EXPECT_EQ(0, stats.queueDepth);
+    EXPECT_TRUE(stats.maxQueueDepth >= 1 && stats.maxQueueDepth <= clients);
+    EXPECT_TRUE(stats.p50LatencyMicros <= stats.p99LatencyMicros && stats.p99LatencyMicros <= stats.maxLatencyMicros);
+    EXPECT_TRUE(client.request("stats", "-", "", ok, result));
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(0u, result.find("requests=" + std::to_string(clients * requests + 1) + " failures=3 "));
+
+    // A malformed header drops the connection, and stop() ends the open ones
+    UnixSocket raw;
+    ASSERT_TRUE(raw.connect(socketPath));
+    EXPECT_TRUE(raw.write("sign key many\n"));
+    EXPECT_TRUE(raw.readLine(result));
+    EXPECT_EQ("error 16", result);
+    daemon.stop();
+    server.join();
+    EXPECT_FALSE(client.request("stats", "-", "", ok, result));
+    std::remove(socketPath.c_str());
+}
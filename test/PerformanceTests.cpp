@@ -2,12 +2,31 @@
 // Created by Yongzao Dan on 2022/11/12.
 //
 
+#include <chrono>
+#include <climits>
+#include <cstdlib>
 #include <fstream>
+#include <sstream>
+#include <thread>
 
 #include "gtest/gtest.h"
 
 #include "BigInteger.h"
 #include "rsa.h"
+#include "BatchRSAKey.h"
+#include "MontgomeryContext.h"
+#include "VectorKernels.h"
+#include "MultiBufferQueue.h"
+#include "FixedBigInteger.h"
+#include "BatchGCD.h"
+#include "WorkerPool.h"
+#include "Tuning.h"
+#include "RequestStream.h"
+#include "SigningDaemon.h"
+#include "SigningClient.h"
+#include "AsyncFileIO.h"
+#include "MappedFile.h"
+#include "StreamCipher.h"
 
 class PerformanceTests: public::testing::Test {
 
@@ -218,4 +237,756 @@ TEST_F(PerformanceTests, test2048) {
     std::cout << "Maximum: " << std::setprecision(3) << maximum << " ms." << std::endl;
     std::cout << "Average: " << std::setprecision(3) << avg << " ms." << std::endl;
     std::cout << "Sigma: " << std::setprecision(3) << sigma << std::endl;
-}
\ No newline at end of file
+}
+TEST_F(PerformanceTests, testPrimalityTests1024) {
+    const static int primeLength = RSA2048 >> 1;
+    const static int batchSize = 10;
+    const BigInteger::PrimalityTest tests[] = {BigInteger::MILLER_RABIN, BigInteger::BAILLIE_PSW};
+    const std::string names[] = {"Miller-Rabin", "Baillie-PSW"};
+
+    for (int t = 0; t < 2; t++) {
+        BigInteger::resetPrimalityStats();
+        double totalCost = 0;
+        for (int i = 0; i < batchSize; i++) {
+            auto curStart = clock();
+            BigInteger::generateBigPrime(primeLength, tests[t]);
+            auto curEnd = clock();
+            totalCost += (double) (curEnd - curStart) / CLOCKS_PER_MS;
+        }
+
+        BigInteger::PrimalityStats stats = BigInteger::getPrimalityStats();
+        std::cout << std::endl << "Generating " << primeLength << "-bit primes with " << names[t] << " costs: " << std::endl;
+        std::cout << "Average: " << std::setprecision(3) << totalCost / batchSize << " ms." << std::endl;
+        std::cout << "Rejected by trial division: " << stats.trialDivisionRejected
+                  << ", base-2: " << stats.baseTwoRejected
+                  << ", Miller-Rabin: " << stats.millerRabinRejected
+                  << ", Lucas: " << stats.lucasRejected << std::endl;
+    }
+}
+
+static void testSafePrime(int bitLength, int batchSize) {
+    double totalCost = 0;
+    double minimum = (1 << 30), maximum = 0;
+    for (int i = 0; i < batchSize; i++) {
+        auto curStart = clock();
+        BigInteger::generateSafePrime(bitLength);
+        auto curEnd = clock();
+
+        double cost = (double) (curEnd - curStart) / 1000;
+        minimum = std::min(minimum, cost);
+        maximum = std::max(maximum, cost);
+        totalCost += cost;
+    }
+
+    std::cout << std::endl << "Generating " << bitLength << "-bit safe primes costs: " << std::endl;
+    std::cout << "Minimum: " << std::setprecision(3) << minimum << " ms." << std::endl;
+    std::cout << "Maximum: " << std::setprecision(3) << maximum << " ms." << std::endl;
+    std::cout << "Average: " << std::setprecision(3) << totalCost / batchSize << " ms." << std::endl;
+    std::cout << "Throughput: " << std::setprecision(3) << batchSize * 1000 / totalCost << " primes/s." << std::endl;
+}
+
+TEST_F(PerformanceTests, testSafePrime1024) {
+    testSafePrime(RSA1024, 5);
+}
+
+TEST_F(PerformanceTests, testSafePrime2048) {
+    testSafePrime(RSA2048, 1);
+}
+
+TEST_F(PerformanceTests, testMultiPrime2048) {
+    const static int keyCount = 5;
+    for (int primeCount = 1; primeCount <= maxPrimeCount(RSA2048); primeCount++) {
+        double totalCost = 0;
+        for (int i = 0; i < keyCount; i++) {
+            RSAPrivateKey key = generateMultiPrimeRSAKey(RSA2048, std::max(2, primeCount), true);
+            // One prime stands for the plain x^d % n without CRT
+            if (primeCount == 1) {
+                key = RSAPrivateKey{key.getN(), key.getD()};
+            }
+
+            BigInteger x = BigInteger::randomBigInteger(RSA2048 - 2);
+            auto curStart = clock();
+            for (int j = 0; j < BATCH_SIZE / keyCount; j++) {
+                key.privatePowMod(x);
+            }
+            auto curEnd = clock();
+            totalCost += (double) (curEnd - curStart) / CLOCKS_PER_MS;
+        }
+
+        std::cout << std::endl << "RSA-2048 private operation with " << primeCount << " prime(s) costs: " << std::endl;
+        std::cout << "Average: " << std::setprecision(3) << totalCost / (BATCH_SIZE / keyCount * keyCount) << " ms." << std::endl;
+    }
+}
+
+/** Time the key generation and the private operations of the two-prime keys of nLength bits */
+static void testLargeKey(int nLength, int keyCount, int operationCount) {
+    double keyCost = 0, variableCost = 0, constantCost = 0;
+    for (int i = 0; i < keyCount; i++) {
+        auto curStart = clock();
+        RSAPrivateKey key = generateMultiPrimeRSAKey(nLength, 2, true);
+        auto curEnd = clock();
+        keyCost += (double) (curEnd - curStart) / 1000;
+
+        RSAPrivateKey constantTimeKey = key;
+        constantTimeKey.setPowMode(RSAPrivateKey::CONSTANT_TIME);
+        BigInteger x = BigInteger::randomBigInteger(nLength - 2);
+
+        curStart = clock();
+        for (int j = 0; j < operationCount; j++) {
+            key.privatePowMod(x);
+        }
+        curEnd = clock();
+        variableCost += (double) (curEnd - curStart) / 1000;
+
+        curStart = clock();
+        for (int j = 0; j < operationCount; j++) {
+            constantTimeKey.privatePowMod(x);
+        }
+        curEnd = clock();
+        constantCost += (double) (curEnd - curStart) / 1000;
+    }
+
+    std::cout << std::endl << "RSA-" << nLength << " costs: " << std::endl;
+    std::cout << "Key generation: " << std::setprecision(3) << keyCost / keyCount << " ms." << std::endl;
+    std::cout << "Private operation: " << std::setprecision(3) << variableCost / (keyCount * operationCount)
+              << " ms." << std::endl;
+    std::cout << "Constant-time private operation: " << std::setprecision(3)
+              << constantCost / (keyCount * operationCount) << " ms." << std::endl;
+}
+
+TEST_F(PerformanceTests, test3072) {
+    testLargeKey(RSA3072, 5, BATCH_SIZE / 5);
+}
+
+TEST_F(PerformanceTests, test4096) {
+    testLargeKey(RSA4096, 3, BATCH_SIZE / 5);
+}
+
+TEST_F(PerformanceTests, test8192) {
+    testLargeKey(RSA8192, 1, BATCH_SIZE / 10);
+}
+
+TEST_F(PerformanceTests, testBatchRSA2048) {
+    const static int maxBatchSize = 8;
+    RSAPrivateKey key = generateMultiPrimeRSAKey(RSA2048, 2, true);
+    BatchRSAKey batchKey = BatchRSAKey(key, maxBatchSize);
+    BigInteger ciphertext[maxBatchSize], plaintext[maxBatchSize];
+    for (int i = 0; i < maxBatchSize; i++) {
+        ciphertext[i] = BigInteger::randomBigInteger(RSA2048 - 2);
+    }
+
+    // The single CRT decryption is the baseline
+    auto curStart = clock();
+    for (int j = 0; j < BATCH_SIZE / 5; j++) {
+        key.privatePowMod(ciphertext[0]);
+    }
+    auto curEnd = clock();
+    double baseCost = (double) (curEnd - curStart) / CLOCKS_PER_MS / (BATCH_SIZE / 5);
+    std::cout << std::endl << "RSA-2048 CRT decryption costs: " << std::setprecision(3) << baseCost << " ms." << std::endl;
+
+    for (int batchSize = 1; batchSize <= maxBatchSize; batchSize <<= 1) {
+        curStart = clock();
+        for (int j = 0; j < BATCH_SIZE / 5; j++) {
+            batchKey.decrypt(ciphertext, batchSize, plaintext);
+        }
+        curEnd = clock();
+        double cost = (double) (curEnd - curStart) / CLOCKS_PER_MS / (BATCH_SIZE / 5) / batchSize;
+        std::cout << "Batch of " << batchSize << " amortized: " << std::setprecision(3) << cost
+                  << " ms per block, " << baseCost / cost << "x." << std::endl;
+    }
+}
+
+TEST_F(PerformanceTests, testBlinding2048) {
+    RSAPrivateKey key = generateMultiPrimeRSAKey(RSA2048, 2, true);
+    BigInteger x = BigInteger::randomBigInteger(RSA2048 - 2);
+    key.blindedPowMod(x);
+
+    auto curStart = clock();
+    for (int j = 0; j < BATCH_SIZE; j++) {
+        key.privatePowMod(x);
+    }
+    auto curEnd = clock();
+    double plainCost = (double) (curEnd - curStart) / CLOCKS_PER_MS / BATCH_SIZE;
+
+    curStart = clock();
+    for (int j = 0; j < BATCH_SIZE; j++) {
+        key.blindedPowMod(x);
+    }
+    curEnd = clock();
+    double blindedCost = (double) (curEnd - curStart) / CLOCKS_PER_MS / BATCH_SIZE;
+
+    std::cout << std::endl << "RSA-2048 private operation costs: " << std::endl;
+    std::cout << "Unblinded: " << std::setprecision(3) << plainCost << " ms." << std::endl;
+    std::cout << "Blinded: " << std::setprecision(3) << blindedCost << " ms, overhead "
+              << (blindedCost / plainCost - 1) * 100 << "%." << std::endl;
+}
+
+TEST_F(PerformanceTests, testConstantTime2048) {
+    // The constant-time mode must stay within this ratio of the variable-time one
+    const static double budget = 1.15;
+    const static int keyCount = 5;
+    double variableCost = 0, constantCost = 0;
+    for (int i = 0; i < keyCount; i++) {
+        RSAPrivateKey key = generateMultiPrimeRSAKey(RSA2048, 2, true);
+        RSAPrivateKey constantTimeKey = key;
+        constantTimeKey.setPowMode(RSAPrivateKey::CONSTANT_TIME);
+        BigInteger x = BigInteger::randomBigInteger(RSA2048 - 2);
+
+        auto curStart = clock();
+        for (int j = 0; j < BATCH_SIZE / keyCount; j++) {
+            key.privatePowMod(x);
+        }
+        auto curEnd = clock();
+        variableCost += (double) (curEnd - curStart) / CLOCKS_PER_MS;
+
+        curStart = clock();
+        for (int j = 0; j < BATCH_SIZE / keyCount; j++) {
+            constantTimeKey.privatePowMod(x);
+        }
+        curEnd = clock();
+        constantCost += (double) (curEnd - curStart) / CLOCKS_PER_MS;
+    }
+
+    variableCost /= BATCH_SIZE / keyCount * keyCount;
+    constantCost /= BATCH_SIZE / keyCount * keyCount;
+    std::cout << std::endl << "RSA-2048 private operation costs: " << std::endl;
+    std::cout << "Variable-time: " << std::setprecision(3) << variableCost << " ms." << std::endl;
+    std::cout << "Constant-time: " << std::setprecision(3) << constantCost << " ms, "
+              << constantCost / variableCost << "x." << std::endl;
+    EXPECT_LT(constantCost, variableCost * budget);
+}
+
+TEST_F(PerformanceTests, testFusedMulMod2048) {
+    const static int rounds = 100 * BATCH_SIZE;
+    BigInteger mod = BigInteger::randomBigInteger(RSA2048);
+    if (mod % 2u == 0) {
+        mod = mod - 1;
+    }
+    BigInteger a = BigInteger::randomBigInteger(RSA2048 - 1);
+    BigInteger b = BigInteger::randomBigInteger(RSA2048 - 1);
+
+    auto curStart = clock();
+    BigInteger x = a;
+    for (int j = 0; j < rounds; j++) {
+        x = x * b % mod;
+    }
+    auto curEnd = clock();
+    double plainCost = (double) (curEnd - curStart) / CLOCKS_PER_MS / rounds * 1000;
+
+    MontgomeryContext context = MontgomeryContext(mod);
+    MontgomeryContext::Residue y = context.toResidue(a), rb = context.toResidue(b);
+    curStart = clock();
+    for (int j = 0; j < rounds; j++) {
+        context.mulMod(y, rb, y);
+    }
+    curEnd = clock();
+    double mulCost = (double) (curEnd - curStart) / CLOCKS_PER_MS / rounds * 1000;
+
+    curStart = clock();
+    for (int j = 0; j < rounds; j++) {
+        context.sqrMod(y, y);
+    }
+    curEnd = clock();
+    double sqrCost = (double) (curEnd - curStart) / CLOCKS_PER_MS / rounds * 1000;
+
+    std::cout << std::endl << "2048-bit modular multiplication costs: " << std::endl;
+    std::cout << "a * b % m: " << std::setprecision(3) << plainCost << " us." << std::endl;
+    std::cout << "mulMod: " << std::setprecision(3) << mulCost << " us." << std::endl;
+    std::cout << "sqrMod: " << std::setprecision(3) << sqrCost << " us." << std::endl;
+}
+
+TEST_F(PerformanceTests, testMultiBuffer2048) {
+    const static int keyCount = 2;
+    std::vector<RSAPrivateKey> keys;
+    std::vector<BigInteger> messages;
+    for (int i = 0; i < keyCount; i++) {
+        keys.push_back(generateMultiPrimeRSAKey(RSA2048, 2, true));
+    }
+    for (int i = 0; i < BATCH_SIZE; i++) {
+        messages.push_back(BigInteger::randomBigInteger(RSA2048 - 2));
+    }
+
+    auto curStart = clock();
+    for (int i = 0; i < BATCH_SIZE; i++) {
+        keys[i % keyCount].privatePowMod(messages[i]);
+    }
+    auto curEnd = clock();
+    double sequentialCost = (double) (curEnd - curStart) / CLOCKS_PER_MS / BATCH_SIZE;
+    std::cout << std::endl << "RSA-2048 signatures of " << keyCount << " keys cost: " << std::endl;
+    std::cout << "Sequential: " << std::setprecision(3) << sequentialCost << " ms." << std::endl;
+
+    for (int lanes : {MultiBufferPowMod::LANES, MultiBufferPowMod::MAX_LANES}) {
+        MultiBufferQueue queue = MultiBufferQueue(lanes);
+        int completed = 0;
+        curStart = clock();
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            queue.pushPrivate(keys[i % keyCount], messages[i], [&completed](const BigInteger &) {
+                completed++;
+            });
+        }
+        queue.flush();
+        curEnd = clock();
+        EXPECT_TRUE(completed == BATCH_SIZE);
+        double cost = (double) (curEnd - curStart) / CLOCKS_PER_MS / BATCH_SIZE;
+        std::cout << "Multi-buffer of " << lanes << " lanes: " << std::setprecision(3) << cost << " ms, "
+                  << sequentialCost / cost << "x the throughput." << std::endl;
+    }
+}
+
+TEST_F(PerformanceTests, testFixedWidth) {
+    for (int nLength : {RSA576, RSA768, RSA1024}) {
+        RSAPrivateKey key = generateMultiPrimeRSAKey(nLength, 2, true);
+        const BigInteger &prime = key.getPrimes()[0], &exponent = key.getExponents()[0];
+        MontgomeryContext context = MontgomeryContext(prime);
+        std::shared_ptr<const FixedPowMod> fixed = FixedPowMod::create(prime);
+        BigInteger x = BigInteger::randomBigInteger(nLength - 2);
+
+        auto curStart = clock();
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            context.powModConstantTime(x, exponent);
+        }
+        auto curEnd = clock();
+        double contextCost = (double) (curEnd - curStart) / CLOCKS_PER_MS / BATCH_SIZE;
+
+        curStart = clock();
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            fixed->powMod(x, exponent);
+        }
+        curEnd = clock();
+        double fixedCost = (double) (curEnd - curStart) / CLOCKS_PER_MS / BATCH_SIZE;
+
+        std::cout << std::endl << "RSA-" << nLength << " constant-time exponentiation modulo a prime costs: " << std::endl;
+        std::cout << "MontgomeryContext: " << std::setprecision(3) << contextCost << " ms." << std::endl;
+        std::cout << "FixedBigInteger: " << std::setprecision(3) << fixedCost << " ms, "
+                  << contextCost / fixedCost << "x faster." << std::endl;
+    }
+}
+
+TEST_F(PerformanceTests, testBatchGCD1024) {
+    const static int count = 1024, pairs = 1000;
+    std::vector<BigInteger> moduli;
+    for (int i = 0; i < count; i++) {
+        moduli.push_back(BigInteger::generateBigPrime(RSA1024 / 2) * BigInteger::generateBigPrime(RSA1024 / 2));
+    }
+
+    auto curStart = std::chrono::steady_clock::now();
+    std::vector<BigInteger> gcds = BatchGCD::gcds(moduli);
+    auto curEnd = std::chrono::steady_clock::now();
+    double batchCost = std::chrono::duration<double, std::milli>(curEnd - curStart).count();
+
+    // The pairwise GCDs are extrapolated from a sample
+    curStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < pairs; i++) {
+        moduli[i % count].gcd(moduli[(i + 1) % count]);
+    }
+    curEnd = std::chrono::steady_clock::now();
+    double pairwiseCost = std::chrono::duration<double, std::milli>(curEnd - curStart).count() / pairs *
+                          count * (count - 1) / 2;
+
+    std::cout << std::endl << "Batch GCD of " << count << " RSA-1024 moduli costs: " << std::endl;
+    std::cout << "Batch: " << std::setprecision(3) << batchCost << " ms." << std::endl;
+    std::cout << "Pairwise: " << std::setprecision(3) << pairwiseCost << " ms, estimated." << std::endl;
+    for (const BigInteger &g : gcds) {
+        EXPECT_EQ(0, g.compareAbsolute(1));
+    }
+    EXPECT_LT(batchCost, pairwiseCost);
+}
+
+TEST_F(PerformanceTests, testParallelMultiply) {
+    // Products of 10^6-bit operands by the schoolbook rows, serial Karatsuba and Karatsuba over the worker pool
+    const static int bits = 1000000, rounds = 3;
+    BigInteger x = BigInteger::randomBigInteger(bits), y = BigInteger::randomBigInteger(bits);
+    const Tuning::Profile original = Tuning::profile();
+    Tuning::Profile schoolbook = original, serial = original;
+    schoolbook.karatsubaThresholdWords = INT_MAX;
+    serial.parallelMultiplyWords = INT_MAX;
+
+    const Tuning::Profile profiles[] = {schoolbook, serial, original};
+    const std::string names[] = {"Schoolbook", "Serial Karatsuba", "Parallel Karatsuba"};
+    BigInteger products[3];
+    double costs[3];
+    for (int i = 0; i < 3; i++) {
+        Tuning::setProfile(profiles[i]);
+        auto curStart = std::chrono::steady_clock::now();
+        for (int j = 0; j < (i ? rounds : 1); j++) {
+            products[i] = x * y;
+        }
+        auto curEnd = std::chrono::steady_clock::now();
+        costs[i] = std::chrono::duration<double, std::milli>(curEnd - curStart).count() / (i ? rounds : 1);
+    }
+    Tuning::setProfile(original);
+
+    std::cout << std::endl << bits << "-bit multiplication costs, " << WorkerPool::shared().size() + 1
+              << " thread(s): " << std::endl;
+    for (int i = 0; i < 3; i++) {
+        std::cout << names[i] << ": " << std::setprecision(3) << costs[i] << " ms, "
+                  << costs[0] / costs[i] << "x." << std::endl;
+        EXPECT_EQ(0, products[i].compareAbsolute(products[0]));
+    }
+}
+
+/** @return The 32-bit words of x in little-endian order */
+static std::vector<unsigned int> wordsOf(const BigInteger &x) {
+    std::vector<unsigned int> words((x.getBitLength() + 31) / 32);
+    for (int i = 0; i < x.getBitLength(); i++) {
+        words[i >> 5] |= (unsigned int) x.testBit(i) << (i & 31);
+    }
+    return words;
+}
+
+TEST_F(PerformanceTests, testVectorCrossover) {
+    // The word kernels against the vector kernels, where the vector multiplication pays for the conversions
+    const static int rounds = 20 * BATCH_SIZE;
+    const static int sizes[] = {256, 512, 1024, 1536, 2048, 3072, 4096, 8192};
+    const VectorKernels::Kernels &kernels = VectorKernels::active();
+    std::cout << std::endl << "Vector kernels: " << VectorKernels::kernelName() << std::endl;
+    std::cout << "Bits\tmultiply\tvector\tmulMod\tvector (us)" << std::endl;
+    for (int bits : sizes) {
+        BigInteger mod = BigInteger::randomBigInteger(bits);
+        if (mod % 2u == 0) {
+            mod = mod - 1;
+        }
+        BigInteger a = BigInteger::randomBigInteger(bits - 1);
+        BigInteger b = BigInteger::randomBigInteger(bits - 1);
+        std::vector<unsigned int> aWords = wordsOf(a), bWords = wordsOf(b);
+
+        auto curStart = clock();
+        for (int j = 0; j < rounds; j++) {
+            BigInteger product = a * b;
+        }
+        auto curEnd = clock();
+        double multiplyCost = (double) (curEnd - curStart) / CLOCKS_PER_MS / rounds * 1000;
+
+        const int n = VectorKernels::digitCount(bits + 2);
+        std::vector<unsigned long long> x(n), y(n), z(2 * n + 1);
+        std::vector<unsigned int> words(aWords.size() + bWords.size());
+        curStart = clock();
+        for (int j = 0; j < rounds; j++) {
+            VectorKernels::toDigits(aWords.data(), (int) aWords.size(), x.data(), n);
+            VectorKernels::toDigits(bWords.data(), (int) bWords.size(), y.data(), n);
+            kernels.multiply(x.data(), n, y.data(), n, z.data());
+            VectorKernels::fromDigits(z.data(), 2 * n, words.data(), (int) words.size());
+        }
+        curEnd = clock();
+        double vectorMultiplyCost = (double) (curEnd - curStart) / CLOCKS_PER_MS / rounds * 1000;
+
+        MontgomeryContext context = MontgomeryContext(mod);
+        MontgomeryContext::Residue ra = context.toResidue(a), rb = context.toResidue(b);
+        curStart = clock();
+        for (int j = 0; j < rounds; j++) {
+            context.mulMod(ra, rb, ra);
+        }
+        curEnd = clock();
+        double mulModCost = (double) (curEnd - curStart) / CLOCKS_PER_MS / rounds * 1000;
+
+        std::vector<unsigned int> modWords = wordsOf(mod);
+        std::vector<unsigned long long> m(n);
+        VectorKernels::toDigits(modWords.data(), (int) modWords.size(), m.data(), n);
+        unsigned long long mInverse = VectorKernels::inverseDigit(m[0]);
+        curStart = clock();
+        for (int j = 0; j < rounds; j++) {
+            kernels.montgomeryMultiply(x.data(), y.data(), m.data(), mInverse, n, z.data(), x.data());
+        }
+        curEnd = clock();
+        double vectorMulModCost = (double) (curEnd - curStart) / CLOCKS_PER_MS / rounds * 1000;
+
+        std::cout << bits << "\t" << std::setprecision(3) << multiplyCost
+                  << "\t" << std::setprecision(3) << vectorMultiplyCost
+                  << "\t" << std::setprecision(3) << mulModCost
+                  << "\t" << std::setprecision(3) << vectorMulModCost << std::endl;
+    }
+}
+
+TEST_F(PerformanceTests, testRequestStream2048) {
+    // Sign and then verify small messages through one stream, one per core
+    const static int requestCount = 20 * BATCH_SIZE;
+    const std::string prefix = "request_stream_" + std::to_string(rd()) + "_";
+    const std::string publicKey = prefix + "public.txt", privateKey = prefix + "private.txt";
+    RSAPrivateKey key = generateMultiPrimeRSAKey(RSA2048, 2, true);
+    std::ofstream publicKeyStream(publicKey), privateKeyStream(privateKey);
+    key.getN().write(publicKeyStream);
+    key.getE().write(publicKeyStream);
+    key.write(privateKeyStream);
+    publicKeyStream.close();
+    privateKeyStream.close();
+
+    std::stringstream signRequests, signatures;
+    for (int i = 0; i < requestCount; i++) {
+        signRequests << "sign " << privateKey << " message " << i << std::endl;
+    }
+    auto curStart = std::chrono::steady_clock::now();
+    EXPECT_EQ(0, RequestStream(0, RequestStream::LINES).serve(signRequests, signatures));
+    auto curEnd = std::chrono::steady_clock::now();
+    double signCost = std::chrono::duration<double>(curEnd - curStart).count();
+
+    std::stringstream verifyRequests, verifications;
+    for (int i = 0; i < requestCount; i++) {
+        std::string status, signature;
+        signatures >> status >> signature;
+        verifyRequests << "verify " << publicKey << " " << signature << " message " << i << std::endl;
+    }
+    curStart = std::chrono::steady_clock::now();
+    EXPECT_EQ(0, RequestStream(0, RequestStream::LINES).serve(verifyRequests, verifications));
+    curEnd = std::chrono::steady_clock::now();
+    double verifyCost = std::chrono::duration<double>(curEnd - curStart).count();
+
+    std::cout << std::endl << "RSA-2048 request stream over " << std::thread::hardware_concurrency()
+              << " thread(s): " << std::endl;
+    std::cout << "Sign: " << std::setprecision(4) << requestCount / signCost << " requests/s." << std::endl;
+    std::cout << "Verify: " << std::setprecision(4) << requestCount / verifyCost << " requests/s." << std::endl;
+    std::remove(publicKey.c_str());
+    std::remove(privateKey.c_str());
+}
+
+TEST_F(PerformanceTests, testSigningDaemon2048) {
+    // Concurrent connections signing back to back, one request at a time and then in batches within windows
+    const static int connections = 16, requests = 20;
+    const std::string socketPath = "/tmp/signing_daemon_" + std::to_string(rd()) + ".sock";
+    RSAPrivateKey key = generateMultiPrimeRSAKey(RSA2048, 2, true);
+
+    std::cout << std::endl << "RSA-2048 signing daemon with " << connections << " connections over "
+              << std::thread::hardware_concurrency() << " thread(s): " << std::endl;
+    for (std::pair<int, int> configuration : {std::make_pair(0, 1), std::make_pair(0, 8), std::make_pair(200, 8),
+                                              std::make_pair(500, 8)}) {
+        const int windowMicros = configuration.first, batchSize = configuration.second;
+        SigningDaemon daemon({{"key", key}}, windowMicros, 0, batchSize);
+        ASSERT_TRUE(daemon.listen(socketPath));
+        std::thread server([&daemon]() {
+            daemon.serve();
+        });
+
+        auto curStart = std::chrono::steady_clock::now();
+        std::vector<std::thread> clients;
+        for (int c = 0; c < connections; c++) {
+            clients.emplace_back([&socketPath, c]() {
+                SigningClient client;
+                EXPECT_TRUE(client.connect(socketPath));
+                bool ok;
+                std::string signature;
+                for (int i = 0; i < requests; i++) {
+                    EXPECT_TRUE(client.request("sign", "key", "message " + std::to_string(c * requests + i),
+                                               ok, signature) && ok);
+                }
+            });
+        }
+        for (std::thread &client : clients) {
+            client.join();
+        }
+        auto curEnd = std::chrono::steady_clock::now();
+        double cost = std::chrono::duration<double>(curEnd - curStart).count();
+
+        SigningDaemon::Stats stats = daemon.stats();
+        daemon.stop();
+        server.join();
+        std::cout << "Batches of up to " << batchSize << " within " << windowMicros << " us: " << std::setprecision(4)
+                  << connections * requests / cost << " requests/s, "
+                  << (double) stats.requests / stats.batches << " requests per batch, latency p50 "
+                  << stats.p50LatencyMicros << " us, p99 " << stats.p99LatencyMicros << " us." << std::endl;
+    }
+    std::remove(socketPath.c_str());
+}
+
+TEST_F(PerformanceTests, testAsyncFileIO) {
+    // Copy many files, one by one over the streams and then with the reads and writes in flight
+    const static int fileCount = 4 * BATCH_SIZE, fileBytes = 64 << 10;
+    const std::string prefix = "async_file_io_" + std::to_string(rd()) + "_";
+    std::vector<std::string> paths;
+    for (int i = 0; i < fileCount; i++) {
+        paths.push_back(prefix + std::to_string(i));
+        std::ofstream(paths.back(), std::ios::binary) << std::string(fileBytes, (char) ('a' + i % 26));
+    }
+
+    auto curStart = std::chrono::steady_clock::now();
+    for (const std::string &path : paths) {
+        std::ifstream in(path, std::ios::binary);
+        std::ostringstream content;
+        content << in.rdbuf();
+        std::ofstream(path + ".copy", std::ios::binary) << content.str();
+    }
+    auto curEnd = std::chrono::steady_clock::now();
+    double streamCost = std::chrono::duration<double, std::milli>(curEnd - curStart).count();
+    std::cout << std::endl << "Copy " << fileCount << " files of " << fileBytes / 1024 << " KB: " << std::endl;
+    std::cout << "std::ifstream and std::ofstream: " << std::setprecision(3) << streamCost << " ms." << std::endl;
+
+    for (AsyncFileIO::Backend backend : {AsyncFileIO::IO_URING, AsyncFileIO::THREADS}) {
+        std::unique_ptr<AsyncFileIO> io = AsyncFileIO::create(AsyncFileIO::DEFAULT_DEPTH, backend);
+        curStart = std::chrono::steady_clock::now();
+        int next = 0, inFlight = 0, written = 0;
+        while (written < fileCount) {
+            while (next < fileCount && inFlight < AsyncFileIO::DEFAULT_DEPTH) {
+                io->read(next, paths[next]);
+                next++;
+                inFlight++;
+            }
+            AsyncFileIO::Completion completion = io->wait();
+            if (completion.kind == AsyncFileIO::READ) {
+                io->write(completion.tag, paths[completion.tag] + ".copy", std::move(completion.data));
+            } else {
+                EXPECT_TRUE(completion.ok);
+                inFlight--;
+                written++;
+            }
+        }
+        curEnd = std::chrono::steady_clock::now();
+        double cost = std::chrono::duration<double, std::milli>(curEnd - curStart).count();
+        std::cout << "AsyncFileIO over " << io->name() << ", " << AsyncFileIO::DEFAULT_DEPTH << " in flight: "
+                  << std::setprecision(3) << cost << " ms, " << streamCost / cost << "x faster." << std::endl;
+    }
+
+    for (const std::string &path : paths) {
+        std::remove(path.c_str());
+        std::remove((path + ".copy").c_str());
+    }
+}
+
+TEST_F(PerformanceTests, testMappedFile) {
+    // Read a large plaintext, pack the blocks of a 2048-bit modulus and hash it, without the exponentiations
+    const static size_t fileBytes = 64 << 20, blockBytes = (RSA2048 - 1) / ASCII_BITS;
+    const std::string path = "mapped_file_" + std::to_string(rd());
+    {
+        std::string content(fileBytes, '\0');
+        for (size_t i = 0; i < fileBytes; i++) {
+            content[i] = (char) ('a' + i % 26);
+        }
+        std::ofstream(path, std::ios::binary) << content;
+    }
+
+    auto curStart = std::chrono::steady_clock::now();
+    unsigned int expected, actual;
+    long long expectedBits = 0, actualBits = 0;
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::ostringstream tmp;
+        tmp << in.rdbuf();
+        std::string plaintext = tmp.str();
+        for (size_t head = 0; head < plaintext.length(); head += blockBytes) {
+            expectedBits += BigInteger(ASCII_RADIX, plaintext.substr(head, blockBytes)).getBitLength();
+        }
+        expected = BKDRHash(plaintext);
+    }
+    auto curEnd = std::chrono::steady_clock::now();
+    double copyCost = std::chrono::duration<double, std::milli>(curEnd - curStart).count();
+
+    curStart = std::chrono::steady_clock::now();
+    {
+        MappedFile plaintext;
+        ASSERT_TRUE(plaintext.open(path));
+        for (size_t head = 0; head < plaintext.size(); head += blockBytes) {
+            actualBits += BigInteger::fromBytes(plaintext.data() + head,
+                                                 std::min(blockBytes, plaintext.size() - head)).getBitLength();
+        }
+        actual = BKDRHash(plaintext.data(), plaintext.size());
+    }
+    curEnd = std::chrono::steady_clock::now();
+    double mappedCost = std::chrono::duration<double, std::milli>(curEnd - curStart).count();
+    EXPECT_EQ(expected, actual);
+    EXPECT_EQ(expectedBits, actualBits);
+
+    std::cout << std::endl << "Pack and hash a plaintext of " << (fileBytes >> 20) << " MB: " << std::endl;
+    std::cout << "std::ostringstream and substr: " << std::setprecision(3) << copyCost << " ms." << std::endl;
+    std::cout << "MappedFile and fromBytes: " << std::setprecision(3) << mappedCost << " ms, "
+              << copyCost / mappedCost << "x faster." << std::endl;
+    std::remove(path.c_str());
+}
+
+TEST_F(PerformanceTests, testStreamCipher) {
+    // Encrypt a plaintext whole, then through the pipeline with its bounded blocks
+    const static size_t plaintextBytes = 4 << 20;
+    RSAPrivateKey key = generateMultiPrimeRSAKey(RSA2048, 2, true);
+    const MontgomeryContext context(key.getN());
+    std::string plaintext(plaintextBytes, '\0');
+    for (char &c : plaintext) {
+        c = (char) rd();
+    }
+
+    auto curStart = std::chrono::steady_clock::now();
+    BigInteger *ciphertext = nullptr;
+    int ciphertextLength = BigInteger::encryptPlaintext(plaintext, ciphertext, key.getE(), context);
+    auto curEnd = std::chrono::steady_clock::now();
+    double wholeCost = std::chrono::duration<double, std::milli>(curEnd - curStart).count();
+
+    curStart = std::chrono::steady_clock::now();
+    StreamEncryptor encryptor(key.getE(), context, plaintext.size());
+    int blocks = 0, maxPending = 0;
+    BigInteger block;
+    for (size_t taken = 0; taken < plaintext.size();) {
+        taken += encryptor.push(plaintext.data() + taken, std::min((size_t) (64 << 10), plaintext.size() - taken));
+        maxPending = std::max(maxPending, encryptor.pending());
+        while (encryptor.full() && encryptor.pull(block)) {
+            EXPECT_EQ(0, ciphertext[blocks++].compareAbsolute(block));
+        }
+    }
+    while (encryptor.pull(block)) {
+        EXPECT_EQ(0, ciphertext[blocks++].compareAbsolute(block));
+    }
+    curEnd = std::chrono::steady_clock::now();
+    double streamCost = std::chrono::duration<double, std::milli>(curEnd - curStart).count();
+    EXPECT_EQ(ciphertextLength, blocks);
+    delete[] ciphertext;
+
+    std::cout << std::endl << "Encrypt " << (plaintextBytes >> 20) << " MB under RSA-2048, " << ciphertextLength
+              << " blocks: " << std::endl;
+    std::cout << "encryptPlaintext, all the blocks held: " << std::setprecision(3) << wholeCost << " ms."
+              << std::endl;
+    std::cout << "StreamEncryptor, at most " << maxPending << " blocks held: " << std::setprecision(3)
+              << streamCost << " ms, " << wholeCost / streamCost << "x faster." << std::endl;
+}
+
+#ifdef RSA_CLI_PATH
+static double averageCommandCost(const std::string &command, int batchSize) {
+    double totalCost = 0;
+    for (int i = 0; i < batchSize; i++) {
+        auto curStart = std::chrono::steady_clock::now();
+        EXPECT_EQ(0, std::system(command.c_str()));
+        auto curEnd = std::chrono::steady_clock::now();
+        totalCost += std::chrono::duration<double, std::milli>(curEnd - curStart).count();
+    }
+    return totalCost / batchSize;
+}
+
+TEST_F(PerformanceTests, testStartupLatency) {
+    // Start the CLI and quit immediately, the shell-only cost is measured as the baseline
+    const static std::string shellCommand = "echo 6 > /dev/null";
+    const static std::string cliCommand = std::string("echo 6 | ") + RSA_CLI_PATH + " > /dev/null";
+
+    double shellCost = averageCommandCost(shellCommand, BATCH_SIZE);
+    double cliCost = averageCommandCost(cliCommand, BATCH_SIZE);
+
+    std::cout << std::endl << "Starting and quitting the CLI costs: " << std::endl;
+    std::cout << "Average: " << std::setprecision(3) << cliCost << " ms." << std::endl;
+    std::cout << "Shell baseline: " << std::setprecision(3) << shellCost << " ms." << std::endl;
+}
+
+TEST_F(PerformanceTests, testBatchCommand) {
+    // Signing small files one process each against all of them in one call of the sign subcommand
+    const static int fileCount = 50;
+    const std::string prefix = "batch_command_" + std::to_string(rd()) + "_";
+    const std::string cli = RSA_CLI_PATH;
+    EXPECT_EQ(0, std::system((cli + " keygen -b 2048 " + prefix + "public.txt " + prefix + "private.txt").c_str()));
+
+    std::string inputs;
+    for (int i = 0; i < fileCount; i++) {
+        std::string input = prefix + std::to_string(i) + ".txt";
+        std::ofstream(input) << "message " << i;
+        inputs += " " + input;
+    }
+
+    auto curStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < fileCount; i++) {
+        std::string command = cli + " sign " + prefix + "private.txt " + prefix + std::to_string(i) + ".txt > /dev/null";
+        EXPECT_EQ(0, std::system(command.c_str()));
+    }
+    auto curEnd = std::chrono::steady_clock::now();
+    double perProcessCost = std::chrono::duration<double, std::milli>(curEnd - curStart).count() / fileCount;
+
+    curStart = std::chrono::steady_clock::now();
+    EXPECT_EQ(0, std::system((cli + " sign " + prefix + "private.txt" + inputs + " > /dev/null").c_str()));
+    curEnd = std::chrono::steady_clock::now();
+    double batchCost = std::chrono::duration<double, std::milli>(curEnd - curStart).count() / fileCount;
+
+    std::cout << std::endl << "Signing " << fileCount << " files with RSA-2048 costs: " << std::endl;
+    std::cout << "One process per file: " << std::setprecision(3) << perProcessCost << " ms per file." << std::endl;
+    std::cout << "One process in all: " << std::setprecision(3) << batchCost << " ms per file." << std::endl;
+    EXPECT_EQ(0, std::system(("rm -f " + prefix + "*").c_str()));
+}
+#endif
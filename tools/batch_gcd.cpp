@@ -0,0 +1,90 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+#include "BigInteger.h"
+#include "BatchGCD.h"
+
+/**
+ * Audits public keys for shared prime factors by the batch GCD.
+ *
+ * Usage: RSABatchGCD <public key file>... , or RSABatchGCD - to read the paths from stdin, one per line.
+ * The public key files are the ones main.cpp writes, n and then e in hexadecimal.
+ * Prints the moduli sharing a factor with some other modulus, and exits with 1 if there is any.
+ */
+
+/** @return Whether s is a non-empty hexadecimal number */
+static bool isHexadecimal(const std::string &s) {
+    return !s.empty() && s.find_first_not_of("0123456789abcdefABCDEF") == std::string::npos;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cout << "Usage: " << argv[0] << " <public key file>... | -" << std::endl;
+        return 2;
+    }
+
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "-") {
+            std::string path;
+            while (std::getline(std::cin, path)) {
+                if (!path.empty()) {
+                    paths.push_back(path);
+                }
+            }
+        } else {
+            paths.emplace_back(argv[i]);
+        }
+    }
+
+    // The unreadable files and the moduli that can't be RSA ones are reported and left out of the audit,
+    // a 0 would otherwise share every factor of the others
+    std::vector<std::string> files;
+    std::vector<BigInteger> moduli;
+    for (const std::string &path : paths) {
+        std::ifstream in(path);
+        std::string n = readString(in);
+        if (!isHexadecimal(n)) {
+            std::cout << "Skipped " << path << ": not a public key file." << std::endl;
+            continue;
+        }
+        BigInteger modulus(HEXADECIMAL_RADIX, n);
+        if (modulus.compareAbsolute(1) <= 0 || !modulus.testBit(0)) {
+            std::cout << "Skipped " << path << ": the modulus is even or not above 1." << std::endl;
+            continue;
+        }
+        files.push_back(path);
+        moduli.push_back(modulus);
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+    std::vector<BigInteger> gcds = BatchGCD::gcds(moduli);
+    auto endTime = std::chrono::steady_clock::now();
+
+    int weakCount = 0;
+    for (int i = 0; i < (int) moduli.size(); i++) {
+        if (gcds[i].compareAbsolute(1) == 0) {
+            continue;
+        }
+        weakCount++;
+        std::cout << files[i] << ": ";
+        if (gcds[i].compareAbsolute(moduli[i]) == 0) {
+            std::cout << "every factor is shared, or the modulus is duplicated." << std::endl;
+        } else {
+            std::cout << "shares the factor " << gcds[i].toString(HEXADECIMAL_RADIX) << std::endl;
+        }
+    }
+
+    std::cout << "Audited " << moduli.size() << " moduli in "
+              << std::chrono::duration<double>(endTime - startTime).count() << "s, "
+              << weakCount << " of them share factors." << std::endl;
+    return weakCount > 0 ? 1 : 0;
+}
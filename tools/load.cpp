@@ -0,0 +1,106 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SigningClient.h"
+
+/**
+ * Drives a signing daemon with sign requests from concurrent connections, each one sending its next request
+ * as soon as the previous one is answered.
+ *
+ * Usage: RSALoad <socket> <key name> [connections] [requests per connection] [message bytes]
+ * Prints the throughput and the latencies seen by the clients, then the counters of the daemon.
+ */
+
+const static int DEFAULT_CONNECTIONS = 16;
+const static int DEFAULT_REQUESTS = 100;
+const static int DEFAULT_MESSAGE_BYTES = 64;
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        std::cout << "Usage: " << argv[0] << " <socket> <key name> [connections] [requests per connection]"
+                  << " [message bytes]" << std::endl;
+        return 2;
+    }
+    const std::string socketPath = argv[1], keyName = argv[2];
+    const int connections = argc > 3 ? std::atoi(argv[3]) : DEFAULT_CONNECTIONS;
+    const int requests = argc > 4 ? std::atoi(argv[4]) : DEFAULT_REQUESTS;
+    const int messageBytes = argc > 5 ? std::atoi(argv[5]) : DEFAULT_MESSAGE_BYTES;
+    if (connections <= 0 || requests <= 0 || messageBytes < 0) {
+        std::cout << "The connections and the requests must be positive." << std::endl;
+        return 2;
+    }
+
+    typedef std::chrono::steady_clock Clock;
+    std::mutex lock;
+    std::vector<double> latencies;
+    int failures = 0;
+
+    auto startTime = Clock::now();
+    std::vector<std::thread> clients;
+    for (int c = 0; c < connections; c++) {
+        clients.emplace_back([&, c]() {
+            std::vector<double> local;
+            int localFailures = 0;
+            SigningClient client;
+            if (!client.connect(socketPath)) {
+                std::lock_guard<std::mutex> guard(lock);
+                failures += requests;
+                return;
+            }
+
+            // Distinct messages, so that nothing on the way can answer from a cache
+            std::mt19937 random((unsigned int) c);
+            std::string message(messageBytes, ' ');
+            for (int i = 0; i < requests; i++) {
+                for (char &ch : message) {
+                    ch = (char) ('a' + random() % 26);
+                }
+                bool ok;
+                std::string result;
+                auto requestStart = Clock::now();
+                if (!client.request("sign", keyName, message, ok, result)) {
+                    localFailures += requests - i;
+                    break;
+                }
+                local.push_back(std::chrono::duration<double, std::micro>(Clock::now() - requestStart).count());
+                localFailures += ok ? 0 : 1;
+            }
+
+            std::lock_guard<std::mutex> guard(lock);
+            latencies.insert(latencies.end(), local.begin(), local.end());
+            failures += localFailures;
+        });
+    }
+    for (std::thread &client : clients) {
+        client.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << connections << " connections, " << latencies.size() << " requests answered in " << seconds
+              << "s: " << latencies.size() / seconds << " requests/s, " << failures << " failed." << std::endl;
+    if (!latencies.empty()) {
+        std::cout << "Latency: p50 " << latencies[latencies.size() / 2] << " us, p99 "
+                  << latencies[latencies.size() * 99 / 100] << " us, max " << latencies.back() << " us."
+                  << std::endl;
+    }
+
+    SigningClient client;
+    bool ok;
+    std::string stats;
+    if (client.connect(socketPath) && client.request("stats", "-", "", ok, stats) && ok) {
+        std::cout << "Daemon: " << stats << std::endl;
+    }
+    return failures > 0 ? 1 : 0;
+}
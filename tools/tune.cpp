@@ -0,0 +1,271 @@
+//
+// Created by Yongzao Dan on 2022/11/16.
+//
+
+#include <chrono>
+#include <climits>
+#include <fstream>
+#include <functional>
+#include <vector>
+
+#include "BigInteger.h"
+#include "MontgomeryContext.h"
+#include "FixedBigInteger.h"
+#include "WordKernels.h"
+#include "VectorKernels.h"
+#include "Tuning.h"
+
+/**
+ * Times the candidate algorithms of each size band on this machine and writes the tuning file loaded by Tuning,
+ * to the path of the first argument or Tuning::TUNING_FILE by default. The threads of the multiplications
+ * are left to the defaults, this tool runs on one of them.
+ */
+
+// Each sample runs for at least this long, and the fastest of the samples is taken against the noise
+const static double SAMPLE_MS = 20;
+const static int SAMPLES = 5;
+
+// The fraction of the cost of the default window that another window must save to replace it
+const static double WINDOW_MARGIN = 0.05;
+
+// The windows tried in powMod() and powModConstantTime()
+const static int MAX_WINDOW_BITS = 7;
+
+/**
+ * Time the candidates in turns, so that the load of the machine drifting in between weighs on all of them.
+ *
+ * @param prepare Called before each sample of a candidate, to select it
+ * @return The microseconds of a call of each candidate
+ */
+static std::vector<double> measure(
+        int count,
+        const std::function<void(int)> &run,
+        const std::function<void(int)> &prepare = [](int) {}) {
+
+    typedef std::chrono::steady_clock Clock;
+    std::vector<int> calls(count, 1);
+    std::vector<double> best(count, 1e300);
+    for (int i = 0; i < SAMPLES; i++) {
+        for (int candidate = 0; candidate < count; candidate++) {
+            prepare(candidate);
+            while (true) {
+                auto start = Clock::now();
+                for (int j = 0; j < calls[candidate]; j++) {
+                    run(candidate);
+                }
+                double elapsed = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+                if (elapsed >= SAMPLE_MS * 1000) {
+                    best[candidate] = std::min(best[candidate], elapsed / calls[candidate]);
+                    break;
+                }
+                calls[candidate] *= 2;
+            }
+        }
+    }
+    return best;
+}
+
+static BigInteger randomOdd(int bitLength) {
+    BigInteger x = BigInteger::randomBigInteger(bitLength);
+    return x % 2u ? x : x - 1;
+}
+
+/** The kernels that win the schoolbook rows of the word kernels */
+static std::string tuneWordKernels() {
+    if (std::string(WordKernels::native().name) == WordKernels::portable().name) {
+        return Tuning::NATIVE;
+    }
+
+    double nativeCost = 0, portableCost = 0;
+    const WordKernels::Kernels *kernels[] = {&WordKernels::native(), &WordKernels::portable()};
+    for (int limbs : {8, 16, 32, 64}) {
+        std::vector<unsigned int> x(2 * limbs, UNSIGNED_INTEGER_MASK), z(4 * limbs);
+        std::vector<double> costs = measure(2, [&](int candidate) {
+            for (int i = 0; i < limbs; i++) {
+                kernels[candidate]->multiplyAdd(z.data() + 2 * i, x.data(), limbs, 0x9e3779b97f4a7c15ULL);
+            }
+        });
+        nativeCost += costs[0];
+        portableCost += costs[1];
+    }
+    std::cout << "Word kernels: " << WordKernels::native().name << " " << nativeCost << " us, portable "
+              << portableCost << " us." << std::endl;
+    return nativeCost <= portableCost ? Tuning::NATIVE : Tuning::PORTABLE;
+}
+
+/** The kernels that win the Montgomery multiplications of the vector kernels */
+static std::string tuneVectorKernels() {
+    if (std::string(VectorKernels::native().name) == VectorKernels::portable().name) {
+        return Tuning::NATIVE;
+    }
+
+    double nativeCost = 0, portableCost = 0;
+    const VectorKernels::Kernels *kernels[] = {&VectorKernels::native(), &VectorKernels::portable()};
+    for (int bits : {512, 1024, 2048, 4096}) {
+        const int n = VectorKernels::digitCount(bits + 2);
+        std::vector<unsigned long long> x(n, VectorKernels::DIGIT_MASK), t(2 * n + 1), z(n);
+        const unsigned long long mInverse = VectorKernels::inverseDigit(x[0]);
+        std::vector<double> costs = measure(2, [&](int candidate) {
+            kernels[candidate]->montgomeryMultiply(x.data(), x.data(), x.data(), mInverse, n, t.data(), z.data());
+        });
+        nativeCost += costs[0];
+        portableCost += costs[1];
+    }
+    std::cout << "Vector kernels: " << VectorKernels::native().name << " " << nativeCost << " us, portable "
+              << portableCost << " us." << std::endl;
+    return nativeCost <= portableCost ? Tuning::NATIVE : Tuning::PORTABLE;
+}
+
+/** The least words from which the vector kernels win powMod() at every sampled size */
+static int tuneVectorCrossover(Tuning::Profile profile) {
+    if (!VectorKernels::vectorized()) {
+        return profile.vectorCrossoverWords;
+    }
+
+    int crossover = INT_MAX;
+    for (int words = 64; words >= 4; words -= 2) {
+        BigInteger mod = randomOdd(words * (int) UNSIGNED_INTEGER_BITS);
+        BigInteger x = BigInteger::randomBigInteger(words * (int) UNSIGNED_INTEGER_BITS - 1);
+        BigInteger pow = BigInteger::randomBigInteger(words * (int) UNSIGNED_INTEGER_BITS);
+
+        // The contexts pick the word or the vector kernels when they are built
+        std::vector<MontgomeryContext> contexts;
+        for (int vectorCrossoverWords : {INT_MAX, 0}) {
+            profile.vectorCrossoverWords = vectorCrossoverWords;
+            Tuning::setProfile(profile);
+            contexts.emplace_back(mod);
+        }
+        std::vector<double> costs = measure(2, [&](int candidate) {
+            contexts[candidate].powMod(x, pow);
+        });
+        std::cout << "powMod of " << words << " words: word kernels " << costs[0] << " us, vector kernels "
+                  << costs[1] << " us." << std::endl;
+        if (costs[1] >= costs[0]) {
+            break;
+        }
+        crossover = words;
+    }
+    return crossover;
+}
+
+/** The largest fixed width that wins the variable-time powMod() at all the widths up to it */
+static int tuneFixedMaxBits(Tuning::Profile profile) {
+    profile.fixedMaxBits = FixedPowMod::MAX_BITS;
+    Tuning::setProfile(profile);
+
+    int maxBits = 0;
+    for (int bits = 320; bits <= FixedPowMod::MAX_BITS; bits += 64) {
+        BigInteger mod = randomOdd(bits);
+        BigInteger x = BigInteger::randomBigInteger(bits - 1), pow = BigInteger::randomBigInteger(bits);
+        MontgomeryContext context = MontgomeryContext(mod);
+        std::shared_ptr<const FixedPowMod> fixed = FixedPowMod::create(mod);
+        std::vector<double> costs = measure(2, [&](int candidate) {
+            candidate ? fixed->powMod(x, pow) : context.powMod(x, pow);
+        });
+        std::cout << "powMod of " << bits << " bits: MontgomeryContext " << costs[0] << " us, FixedPowMod "
+                  << costs[1] << " us." << std::endl;
+        if (costs[1] >= costs[0]) {
+            break;
+        }
+        maxBits = bits;
+    }
+    return maxBits;
+}
+
+/** The least words from which a level of Karatsuba wins the schoolbook rows at every sampled size */
+static int tuneKaratsubaThreshold(Tuning::Profile profile) {
+    // On one thread, or the forks of the pool would be counted as a win of Karatsuba
+    profile.parallelMultiplyWords = INT_MAX;
+    int threshold = INT_MAX;
+    for (int words = 512; words >= 32; words -= 32) {
+        BigInteger x = BigInteger::randomBigInteger(words * (int) UNSIGNED_INTEGER_BITS);
+        BigInteger y = BigInteger::randomBigInteger(words * (int) UNSIGNED_INTEGER_BITS);
+        std::vector<double> costs = measure(
+                2,
+                [&](int) {
+                    x * y;
+                },
+                [&](int candidate) {
+                    // The halves of a single level of Karatsuba fall back to the schoolbook rows
+                    profile.karatsubaThresholdWords = candidate ? words : INT_MAX;
+                    Tuning::setProfile(profile);
+                });
+        std::cout << "multiply of " << words << " words: schoolbook " << costs[0] << " us, Karatsuba "
+                  << costs[1] << " us." << std::endl;
+        if (costs[1] >= costs[0]) {
+            break;
+        }
+        threshold = words;
+    }
+    return threshold;
+}
+
+/** The fastest window at each sampled size, where the neighbouring sizes of the same window are merged */
+static Tuning::WindowBands tuneWindows(Tuning::Profile profile, bool constantTime) {
+    Tuning::setProfile(profile);
+    Tuning::WindowBands bands;
+    for (int bits : {64, 128, 256, 512, 768, 1024, 1536, 2048, 3072, 4096}) {
+        BigInteger mod = randomOdd(bits);
+        BigInteger x = BigInteger::randomBigInteger(bits - 1), pow = BigInteger::randomBigInteger(bits);
+        MontgomeryContext context = MontgomeryContext(mod);
+        std::vector<double> costs = measure(
+                MAX_WINDOW_BITS,
+                [&](int) {
+                    constantTime ? context.powModConstantTime(x, pow) : context.powMod(x, pow);
+                },
+                [&](int candidate) {
+                    (constantTime ? profile.constantTimeWindowBits : profile.windowBits) = {{INT_MAX, candidate + 1}};
+                    Tuning::setProfile(profile);
+                });
+
+        // Another window must beat the default one by a margin, the near ties are noise
+        const int defaultWindow = constantTime ?
+                                  Tuning::window(Tuning::defaults().constantTimeWindowBits, bits) :
+                                  Tuning::window(Tuning::defaults().windowBits, bits);
+        int bestWindow = defaultWindow;
+        double bestCost = costs[defaultWindow - 1] * (1 - WINDOW_MARGIN);
+        for (int window = 1; window <= MAX_WINDOW_BITS; window++) {
+            if (costs[window - 1] < bestCost) {
+                bestCost = costs[window - 1];
+                bestWindow = window;
+            }
+        }
+        std::cout << (constantTime ? "powModConstantTime" : "powMod") << " of " << bits << " bits: window "
+                  << bestWindow << ", " << costs[bestWindow - 1] << " us." << std::endl;
+
+        if (!bands.empty() && bands.back().second == bestWindow) {
+            bands.back().first = bits;
+        } else {
+            bands.emplace_back(bits, bestWindow);
+        }
+    }
+    bands.back().first = INT_MAX;
+    return bands;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = argc > 1 ? argv[1] : Tuning::TUNING_FILE;
+
+    // Start from the compiled-in defaults whatever the current tuning file and environment hold
+    Tuning::Profile profile = Tuning::defaults();
+    Tuning::setProfile(profile);
+
+    profile.wordKernels = tuneWordKernels();
+    profile.vectorKernels = tuneVectorKernels();
+    profile.vectorCrossoverWords = tuneVectorCrossover(profile);
+    profile.fixedMaxBits = tuneFixedMaxBits(profile);
+    profile.karatsubaThresholdWords = tuneKaratsubaThreshold(profile);
+    profile.windowBits = tuneWindows(profile, false);
+    profile.constantTimeWindowBits = tuneWindows(profile, true);
+
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        std::cout << "Failed to write the tuning file " << path << std::endl;
+        return 1;
+    }
+    out << "# Written by RSATune, the algorithms and thresholds timed on this machine" << std::endl;
+    Tuning::write(out, profile);
+    std::cout << std::endl << "Tuning file " << path << ":" << std::endl;
+    Tuning::write(std::cout, profile);
+    return 0;
+}